@@ -10,36 +10,44 @@
 #include <sys/wait.h>
 
 #include "./readline.h"
+#include "./libquysh.h"
+
+/* Counts the bytes written by a command, and shows them */
+void capture(const char *data, size_t len, void *userData) {
+  *(size_t*)userData += len;
+  fwrite(data, 1, len, stdout);
+}
 
 int main(int argc, char** argv, char**envp) {
+  pQuyshCtx_t ctx = quysh_ctx_new();
+
   for (;;) {
     printf("> ");
     fflush(stdout);
     char* line = readline();
+    if (line == NULL)
+      break;
     printf("%s\n", line);
     char** words = split_in_words(line);
-    if(strcmp(words[0],"cd")==0){
-        int err = chdir(words[1]);
-        if(err==-1){
-          printf("Erreur: impossible de se déplacer dans %s\n",words[1]);
-        }else{
-          printf("cd DONE.\n");
-        }
-    }
-    else{
-      if(strcmp(words[0],"pwd")==0){
-        char s[100];
-        printf("%s\n",getcwd(s,100));
-      }
-    }
     for (int i=0;words[i]!=NULL;i++){
       printf("[%s], ", words[i]);
-      
+
     }
 
     printf("\n");
+
+    // cd, pwd and every other command are run by libquysh, without /bin/sh
+    size_t captured = 0;
+    int status = 0;
+    quysh_set_output(ctx, capture, NULL, &captured);
+    int res = quysh_run(ctx, line, &status);
+    printf("status %d, %zu byte(s) written\n", status, captured);
+
     free(words);
     free(line);
+    if (res == QUYSH_EXIT)
+      break;
   }
+  quysh_ctx_free(ctx);
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,228 @@
+/*
+    Bump allocator used by QuYsh for everything that only lives as long as a command line
+    (the line itself, its words, resolved paths, argv copies...).
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16              // Alignment of every allocation
+#define ARENA_KEEP_MAX (1024 * 1024) // Above this capacity, a reset gives the memory back to the system
+
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+
+pArenaBlock_t newArenaBlock(size_t size, pArenaBlock_t next);
+
+/*
+ * Function: newArena
+ * ------------------
+ * Creates an empty arena
+ *
+ *  blockSize: The default size of the blocks of the arena
+ *
+ *  Returns: A pointer to the newly allocated arena
+ */
+pArena_t newArena(size_t blockSize)
+{
+    pArena_t arena = (pArena_t)malloc(sizeof(arena_t));
+
+    arena->blockSize = blockSize;
+    arena->current = newArenaBlock(blockSize, NULL);
+    arena->capacity = blockSize;
+    arena->used = 0;
+    arena->allocations = 0;
+    arena->highWater = 0;
+
+    return arena;
+}
+
+/*
+ * Function: arenaAlloc
+ * --------------------
+ * Allocates memory from an arena. The memory stays valid until the next reset of the arena
+ *
+ *  arena: The arena
+ *  size:  The number of bytes to allocate
+ *
+ *  Returns: A pointer to the allocated memory
+ */
+void *arenaAlloc(pArena_t arena, size_t size)
+{
+    pArenaBlock_t block = arena->current;
+    void *ptr;
+
+    size = ARENA_ROUND(size);
+
+    if (block->used + size > block->size)
+    {
+        size_t blockSize = (size > arena->blockSize) ? size : arena->blockSize;
+
+        block = newArenaBlock(blockSize, block);
+        arena->current = block;
+        arena->capacity += blockSize;
+    }
+
+    ptr = block->data + block->used;
+    block->used += size;
+
+    arena->used += size;
+    arena->allocations++;
+    if (arena->used > arena->highWater)
+        arena->highWater = arena->used;
+
+    return ptr;
+}
+
+/*
+ * Function: arenaRealloc
+ * ----------------------
+ * Resizes an allocation of an arena. The last allocation of the arena grows in place when its block has room,
+ * which makes growing buffers (strings, arrays) cheap as long as nothing else is allocated in between
+ *
+ *  arena:   The arena
+ *  ptr:     The allocation to resize (NULL to allocate)
+ *  oldSize: The size of the allocation
+ *  newSize: The new size of the allocation
+ *
+ *  Returns: A pointer to the resized allocation (ptr if it grew in place)
+ */
+void *arenaRealloc(pArena_t arena, void *ptr, size_t oldSize, size_t newSize)
+{
+    pArenaBlock_t block = arena->current;
+    size_t oldRounded = ARENA_ROUND(oldSize);
+    size_t newRounded = ARENA_ROUND(newSize);
+    void *newPtr;
+
+    if (ptr == NULL)
+        return arenaAlloc(arena, newSize);
+
+    if ((char *)ptr + oldRounded == block->data + block->used && newRounded >= oldRounded &&
+        block->used - oldRounded + newRounded <= block->size)
+    {
+        block->used += newRounded - oldRounded;
+        arena->used += newRounded - oldRounded;
+        if (arena->used > arena->highWater)
+            arena->highWater = arena->used;
+        return ptr;
+    }
+
+    newPtr = arenaAlloc(arena, newSize);
+    memcpy(newPtr, ptr, (oldSize < newSize) ? oldSize : newSize);
+
+    return newPtr;
+}
+
+/*
+ * Function: arenaStrdup
+ * ---------------------
+ * Copies a string into an arena
+ *
+ *  arena: The arena
+ *  str:   The string to copy
+ *
+ *  Returns: A pointer to the copy
+ */
+char *arenaStrdup(pArena_t arena, const char *str)
+{
+    return arenaStrndup(arena, str, strlen(str));
+}
+
+/*
+ * Function: arenaStrndup
+ * ----------------------
+ * Copies the first characters of a string into an arena, and null-terminates the copy
+ *
+ *  arena: The arena
+ *  str:   The string to copy
+ *  len:   The number of characters to copy
+ *
+ *  Returns: A pointer to the copy
+ */
+char *arenaStrndup(pArena_t arena, const char *str, size_t len)
+{
+    char *copy = (char *)arenaAlloc(arena, len + 1);
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+
+    return copy;
+}
+
+/*
+ * Function: resetArena
+ * --------------------
+ * Frees all the allocations of an arena at once
+ * If the last cycle needed several blocks, they are merged into a single one so that the next cycles
+ * do not chain blocks again, unless that block would be oversized (then the default size is restored)
+ *
+ *  arena: The arena
+ */
+void resetArena(pArena_t arena)
+{
+    pArenaBlock_t block = arena->current;
+
+    if (block->next != NULL || arena->capacity > ARENA_KEEP_MAX)
+    {
+        size_t size = (arena->capacity > ARENA_KEEP_MAX) ? arena->blockSize : arena->capacity;
+
+        while (block != NULL)
+        {
+            pArenaBlock_t next = block->next;
+            free(block);
+            block = next;
+        }
+
+        arena->current = newArenaBlock(size, NULL);
+        arena->capacity = size;
+    }
+    else
+    {
+        block->used = 0;
+    }
+
+    arena->used = 0;
+    arena->allocations = 0;
+}
+
+/*
+ * Function: freeArena
+ * -------------------
+ * Deallocates an arena and all of its blocks
+ *
+ *  arena: The arena
+ */
+void freeArena(pArena_t arena)
+{
+    pArenaBlock_t block = arena->current;
+
+    while (block != NULL)
+    {
+        pArenaBlock_t next = block->next;
+        free(block);
+        block = next;
+    }
+
+    free(arena);
+}
+
+/*
+ * Function: newArenaBlock
+ * -----------------------
+ * Allocates a block of an arena
+ *
+ *  size: The number of bytes available in the block
+ *  next: The block previously used by the arena
+ *
+ *  Returns: A pointer to the newly allocated block
+ */
+pArenaBlock_t newArenaBlock(size_t size, pArenaBlock_t next)
+{
+    pArenaBlock_t block = (pArenaBlock_t)malloc(sizeof(arenaBlock_t) + size);
+
+    block->next = next;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
@@ -0,0 +1,54 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Structure: arenaBlock
+ * ---------------------
+ * A chunk of memory from which the allocations of an arena are carved
+ *
+ *  next: The previously filled block (NULL for the oldest one)
+ *  size: The number of bytes available in the block
+ *  used: The number of bytes already allocated in the block
+ *  data: The memory of the block
+ */
+typedef struct arenaBlock
+{
+    struct arenaBlock *next;
+    size_t size;
+    size_t used;
+    _Alignas(16) char data[]; // Aligned like every allocation of the arena
+} arenaBlock_t, *pArenaBlock_t;
+
+/*
+ * Structure: arena
+ * ----------------
+ * A bump allocator: allocations are never freed one by one, the whole arena is reset at once
+ *
+ *  current:     The block allocations are currently carved from
+ *  blockSize:   The default size of a block
+ *  used:        The number of bytes allocated since the last reset
+ *  allocations: The number of allocations since the last reset
+ *  highWater:   The largest number of bytes ever allocated between two resets
+ *  capacity:    The number of bytes held by all the blocks of the arena
+ */
+typedef struct arena
+{
+    pArenaBlock_t current;
+    size_t blockSize;
+    size_t used;
+    size_t allocations;
+    size_t highWater;
+    size_t capacity;
+} arena_t, *pArena_t;
+
+pArena_t newArena(size_t blockSize);
+void *arenaAlloc(pArena_t arena, size_t size);
+void *arenaRealloc(pArena_t arena, void *ptr, size_t oldSize, size_t newSize);
+char *arenaStrdup(pArena_t arena, const char *str);
+char *arenaStrndup(pArena_t arena, const char *str, size_t len);
+void resetArena(pArena_t arena);
+void freeArena(pArena_t arena);
+
+#endif
@@ -0,0 +1,770 @@
+/*
+    Arithmetic expansion of QuYsh: "$(( expression ))" is evaluated by the Shell itself, without forking "expr".
+    An expression is compiled once into the instructions of a small stack machine, kept in a cache indexed
+    by its text: the body of a loop, expanded again at each iteration, only runs the instructions.
+    Integers are 64 bits (operations wrap around), with the operators of C and their precedence:
+        , (lowest)   = += -= *= /= %= <<= >>= &= ^= |=   ?:   ||   &&   |   ^   &   == !=   < <= > >=   << >>
+        + -   * / %   unary + - ! ~ and prefix ++ --   postfix ++ -- (highest)
+    Variables are read from the environment (an unset or empty variable is 0), assignments go through a setter:
+    "i++" and "++i" are assignments of i, compiled as "i += 1" (the postfix form keeps the previous value).
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include "arith.h"
+
+/* Instructions of the stack machine */
+#define OP_PUSH 0         // Pushes the operand
+#define OP_LOAD 1         // Pushes the value of the variable of index operand
+#define OP_STORE 2        // Assigns the top of the stack to the variable of index operand (the value stays)
+#define OP_POP 3          // Drops the top of the stack
+#define OP_JUMP 4         // Goes on at the instruction of index operand
+#define OP_JUMP_ZERO 5    // Pops a value, and jumps if it is 0
+#define OP_JUMP_NONZERO 6 // Pops a value, and jumps if it is not 0
+#define OP_NEG 7
+#define OP_NOT 8
+#define OP_BITNOT 9
+#define OP_MUL 10 // Binary operations: pop two values, push the result
+#define OP_DIV 11
+#define OP_MOD 12
+#define OP_ADD 13
+#define OP_SUB 14
+#define OP_SHL 15
+#define OP_SHR 16
+#define OP_LT 17
+#define OP_LE 18
+#define OP_GT 19
+#define OP_GE 20
+#define OP_EQ 21
+#define OP_NE 22
+#define OP_AND 23
+#define OP_XOR 24
+#define OP_OR 25
+#define OP_LOGICAL -1 // && and ||, compiled into jumps
+
+/* Tokens */
+#define TOK_END 0
+#define TOK_NUMBER 1
+#define TOK_NAME 2
+#define TOK_OPERATOR 3
+
+/*
+ * Structure: arithOperator
+ * ------------------------
+ * A binary or assignment operator
+ *
+ *  text:       The operator
+ *  precedence: The higher, the tighter it binds (binary operators only)
+ *  code:       The instruction computing it (-1 for a plain assignment)
+ */
+typedef struct arithOperator
+{
+    const char *text;
+    int precedence;
+    int code;
+} arithOperator_t;
+
+const arithOperator_t BINARY_OPERATORS[] = {
+    {"||", 1, OP_LOGICAL}, {"&&", 2, OP_LOGICAL}, {"|", 3, OP_OR}, {"^", 4, OP_XOR}, {"&", 5, OP_AND},
+    {"==", 6, OP_EQ}, {"!=", 6, OP_NE}, {"<", 7, OP_LT}, {"<=", 7, OP_LE}, {">", 7, OP_GT}, {">=", 7, OP_GE},
+    {"<<", 8, OP_SHL}, {">>", 8, OP_SHR}, {"+", 9, OP_ADD}, {"-", 9, OP_SUB},
+    {"*", 10, OP_MUL}, {"/", 10, OP_DIV}, {"%", 10, OP_MOD}, {NULL, 0, 0}};
+
+const arithOperator_t ASSIGNMENT_OPERATORS[] = {
+    {"=", 0, -1}, {"+=", 0, OP_ADD}, {"-=", 0, OP_SUB}, {"*=", 0, OP_MUL}, {"/=", 0, OP_DIV}, {"%=", 0, OP_MOD},
+    {"<<=", 0, OP_SHL}, {">>=", 0, OP_SHR}, {"&=", 0, OP_AND}, {"^=", 0, OP_XOR}, {"|=", 0, OP_OR}, {NULL, 0, 0}};
+
+/* Every operator, the longest ones first so that "<<=" is not read as "<<" */
+const char *OPERATOR_TOKENS[] = {
+    "<<=", ">>=", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "++", "--", "+=", "-=", "*=", "/=", "%=", "&=", "^=", "|=",
+    "+", "-", "*", "/", "%", "<", ">", "&", "^", "|", "!", "~", "(", ")", "?", ":", "=", ",", NULL};
+
+/*
+ * Structure: arithParser
+ * ----------------------
+ * The state of the compilation of an expression
+ *
+ *  cur:     The next character to read
+ *  token:   The type of the current token
+ *  start:   The text of the current token
+ *  len:     The length of the current token
+ *  number:  The value of the current token (TOK_NUMBER)
+ *  program: The program being compiled
+ *  error:   Receives the first error (the compilation fails once it is set)
+ */
+typedef struct arithParser
+{
+    const char *cur;
+    int token;
+    const char *start;
+    int len;
+    long long number;
+    pArithProgram_t program;
+    char *error;
+} arithParser_t, *pArithParser_t;
+
+/*
+ * Structure: arithCacheEntry
+ * --------------------------
+ * A compiled expression kept in the cache
+ *
+ *  text:    The text of the expression
+ *  program: The compiled expression
+ */
+typedef struct arithCacheEntry
+{
+    char *text;
+    pArithProgram_t program;
+} arithCacheEntry_t, *pArithCacheEntry_t;
+
+arithCacheEntry_t arithCache[ARITH_CACHE_SLOTS];
+
+void nextToken(pArithParser_t parser);
+int isToken(pArithParser_t parser, const char *text);
+void setArithError(pArithParser_t parser, const char *message);
+int emitOp(pArithParser_t parser, int code, long long operand);
+int variableIndex(pArithParser_t parser, const char *name, int len);
+void parseComma(pArithParser_t parser);
+void parseAssignment(pArithParser_t parser);
+void parseConditional(pArithParser_t parser);
+void parseBinary(pArithParser_t parser, int minPrecedence);
+void parseUnary(pArithParser_t parser);
+void parsePrimary(pArithParser_t parser);
+int loadVariable(const char *name, long long *value, char *error);
+long long applyBinary(int code, long long a, long long b);
+
+/*
+ * Function: compileArith
+ * ----------------------
+ * Compiles an arithmetic expression (an empty expression is 0)
+ *
+ *  text:    The expression
+ *  error:   Receives the error message if the expression is invalid (ARITH_ERROR_LEN bytes)
+ *
+ *  Returns: A pointer to the newly allocated program, NULL if the expression is invalid
+ */
+pArithProgram_t compileArith(const char *text, char *error)
+{
+    arithParser_t parser;
+
+    error[0] = '\0';
+    parser.cur = text;
+    parser.error = error;
+    parser.program = (pArithProgram_t)calloc(1, sizeof(arithProgram_t));
+
+    nextToken(&parser);
+    if (parser.token == TOK_END && error[0] == '\0')
+        emitOp(&parser, OP_PUSH, 0);
+    else
+        parseComma(&parser);
+
+    if (error[0] == '\0' && parser.token != TOK_END)
+        setArithError(&parser, "syntax error");
+
+    if (error[0] != '\0')
+    {
+        freeArith(parser.program);
+        return NULL;
+    }
+
+    // Only forward jumps: every instruction runs once at most, and pushes one value at most
+    parser.program->stack = (long long *)malloc((parser.program->count + 1) * sizeof(long long));
+
+    return parser.program;
+}
+
+/*
+ * Function: runArith
+ * ------------------
+ * Evaluates a compiled expression
+ *
+ *  program: The compiled expression
+ *  setter:  Sets the variables assigned by the expression
+ *  result:  Receives the value of the expression
+ *  error:   Receives the error message if the evaluation fails (ARITH_ERROR_LEN bytes)
+ *
+ *  Returns: 0 if the expression has been evaluated, -1 otherwise (division by zero, variable which is not a number)
+ */
+int runArith(pArithProgram_t program, arithSetter_t setter, long long *result, char *error)
+{
+    long long *stack = program->stack;
+    int top = 0;
+
+    for (int pc = 0; pc < program->count; pc++)
+    {
+        pArithOp_t op = &(program->ops[pc]);
+        char value[24];
+
+        switch (op->code)
+        {
+        case OP_PUSH:
+            stack[top++] = op->operand;
+            break;
+        case OP_LOAD:
+            if (loadVariable(program->names[op->operand], &(stack[top]), error) == -1)
+                return -1;
+            top++;
+            break;
+        case OP_STORE:
+            snprintf(value, sizeof(value), "%lld", stack[top - 1]);
+            setter(program->names[op->operand], value);
+            break;
+        case OP_POP:
+            top--;
+            break;
+        case OP_JUMP:
+            pc = op->operand - 1;
+            break;
+        case OP_JUMP_ZERO:
+            if (stack[--top] == 0)
+                pc = op->operand - 1;
+            break;
+        case OP_JUMP_NONZERO:
+            if (stack[--top] != 0)
+                pc = op->operand - 1;
+            break;
+        case OP_NEG:
+            stack[top - 1] = (long long)(0ULL - (unsigned long long)stack[top - 1]);
+            break;
+        case OP_NOT:
+            stack[top - 1] = !stack[top - 1];
+            break;
+        case OP_BITNOT:
+            stack[top - 1] = ~stack[top - 1];
+            break;
+        default:
+            top--;
+            if ((op->code == OP_DIV || op->code == OP_MOD) && stack[top] == 0)
+            {
+                snprintf(error, ARITH_ERROR_LEN, "division by zero");
+                return -1;
+            }
+            stack[top - 1] = applyBinary(op->code, stack[top - 1], stack[top]);
+            break;
+        }
+    }
+
+    *result = stack[top - 1];
+
+    return 0;
+}
+
+/*
+ * Function: cachedArith
+ * ---------------------
+ * Gets the compiled form of an expression, compiling it only if it is not in the cache yet
+ *
+ *  text:    The expression
+ *  error:   Receives the error message if the expression is invalid (ARITH_ERROR_LEN bytes)
+ *
+ *  Returns: The compiled expression (owned by the cache), NULL if the expression is invalid
+ */
+pArithProgram_t cachedArith(const char *text, char *error)
+{
+    unsigned long hash = 5381;
+    pArithCacheEntry_t entry;
+    pArithProgram_t program;
+
+    for (const char *c = text; *c != '\0'; c++)
+        hash = hash * 33 + (unsigned char)*c;
+    entry = &(arithCache[hash % ARITH_CACHE_SLOTS]);
+
+    if (entry->text != NULL && strcmp(entry->text, text) == 0)
+        return entry->program;
+
+    program = compileArith(text, error);
+    if (program == NULL)
+        return NULL;
+
+    if (entry->text != NULL)
+    {
+        free(entry->text);
+        freeArith(entry->program);
+    }
+    entry->text = strdup(text);
+    entry->program = program;
+
+    return program;
+}
+
+/*
+ * Function: freeArith
+ * -------------------
+ * Deallocates a compiled expression
+ *
+ *  program: The compiled expression
+ */
+void freeArith(pArithProgram_t program)
+{
+    for (int i = 0; i < program->nameCount; i++)
+        free(program->names[i]);
+    free(program->names);
+    free(program->ops);
+    free(program->stack);
+    free(program);
+}
+
+/*
+ * Function: nextToken
+ * -------------------
+ * Reads the next token of an expression
+ *
+ *  parser:  The parser
+ */
+void nextToken(pArithParser_t parser)
+{
+    const char *cur = parser->cur;
+
+    while (isspace((unsigned char)*cur))
+        cur++;
+
+    parser->start = cur;
+    parser->len = 0;
+
+    if (*cur == '\0')
+    {
+        parser->token = TOK_END;
+    }
+    else if (isdigit((unsigned char)*cur))
+    {
+        char *end;
+
+        errno = 0;
+        parser->number = strtoll(cur, &end, 0);
+        parser->token = TOK_NUMBER;
+        parser->len = end - cur;
+        if (errno == ERANGE)
+            setArithError(parser, "number too large");
+        else if (isalnum((unsigned char)*end) || *end == '_')
+            setArithError(parser, "invalid number");
+    }
+    else if (isalpha((unsigned char)*cur) || *cur == '_')
+    {
+        while (isalnum((unsigned char)cur[parser->len]) || cur[parser->len] == '_')
+            parser->len++;
+        parser->token = TOK_NAME;
+    }
+    else
+    {
+        parser->token = TOK_OPERATOR;
+        for (int i = 0; OPERATOR_TOKENS[i] != NULL; i++)
+        {
+            if (strncmp(cur, OPERATOR_TOKENS[i], strlen(OPERATOR_TOKENS[i])) == 0)
+            {
+                parser->len = strlen(OPERATOR_TOKENS[i]);
+                break;
+            }
+        }
+
+        if (parser->len == 0)
+        {
+            parser->len = 1;
+            setArithError(parser, "unexpected character");
+        }
+    }
+
+    parser->cur = cur + parser->len;
+}
+
+/*
+ * Function: isToken
+ * -----------------
+ *  Returns: 1 if the current token is the given operator, 0 otherwise
+ */
+int isToken(pArithParser_t parser, const char *text)
+{
+    return parser->token == TOK_OPERATOR && (size_t)parser->len == strlen(text) && strncmp(parser->start, text, parser->len) == 0;
+}
+
+/*
+ * Function: setArithError
+ * -----------------------
+ * Records an error at the current token (only the first error is kept), and stops the compilation
+ *
+ *  parser:  The parser
+ *  message: The error
+ */
+void setArithError(pArithParser_t parser, const char *message)
+{
+    if (parser->error[0] != '\0')
+        return;
+
+    if (*parser->start == '\0')
+        snprintf(parser->error, ARITH_ERROR_LEN, "%s at end of expression", message);
+    else
+        snprintf(parser->error, ARITH_ERROR_LEN, "%s near \"%.*s\"", message, parser->len > 0 ? parser->len : 1, parser->start);
+
+    parser->token = TOK_END;
+}
+
+/*
+ * Function: emitOp
+ * ----------------
+ * Appends an instruction to the program being compiled
+ *
+ *  parser:  The parser
+ *  code:    The operation
+ *  operand: Its operand
+ *
+ *  Returns: The index of the instruction (to set the target of a jump once it is known)
+ */
+int emitOp(pArithParser_t parser, int code, long long operand)
+{
+    pArithProgram_t program = parser->program;
+
+    if (program->count == program->capacity)
+    {
+        program->capacity = (program->capacity == 0) ? 16 : program->capacity * 2;
+        program->ops = (pArithOp_t)realloc(program->ops, program->capacity * sizeof(arithOp_t));
+    }
+
+    program->ops[program->count].code = code;
+    program->ops[program->count].operand = operand;
+
+    return program->count++;
+}
+
+/*
+ * Function: variableIndex
+ * -----------------------
+ *  Returns: The index of a variable in the names of the program being compiled (added if it is new)
+ */
+int variableIndex(pArithParser_t parser, const char *name, int len)
+{
+    pArithProgram_t program = parser->program;
+
+    for (int i = 0; i < program->nameCount; i++)
+        if (strncmp(program->names[i], name, len) == 0 && program->names[i][len] == '\0')
+            return i;
+
+    program->names = (char **)realloc(program->names, (program->nameCount + 1) * sizeof(char *));
+    program->names[program->nameCount] = strndup(name, len);
+
+    return program->nameCount++;
+}
+
+/*
+ * Function: parseComma
+ * --------------------
+ * expression , expression ...: the value is the one of the last expression
+ */
+void parseComma(pArithParser_t parser)
+{
+    parseAssignment(parser);
+
+    while (isToken(parser, ","))
+    {
+        emitOp(parser, OP_POP, 0);
+        nextToken(parser);
+        parseAssignment(parser);
+    }
+}
+
+/*
+ * Function: parseAssignment
+ * -------------------------
+ * name = expression, name op= expression (right-associative), or a conditional expression
+ */
+void parseAssignment(pArithParser_t parser)
+{
+    arithParser_t saved = *parser;
+
+    if (parser->token == TOK_NAME)
+    {
+        int index = variableIndex(parser, parser->start, parser->len);
+
+        nextToken(parser);
+        for (int i = 0; ASSIGNMENT_OPERATORS[i].text != NULL; i++)
+        {
+            if (isToken(parser, ASSIGNMENT_OPERATORS[i].text))
+            {
+                int code = ASSIGNMENT_OPERATORS[i].code;
+
+                nextToken(parser);
+                if (code != -1)
+                    emitOp(parser, OP_LOAD, index);
+                parseAssignment(parser);
+                if (code != -1)
+                    emitOp(parser, code, 0);
+                emitOp(parser, OP_STORE, index);
+                return;
+            }
+        }
+
+        // Not an assignment: the name is read again as the start of an expression
+        saved.program = parser->program;
+        *parser = saved;
+    }
+
+    parseConditional(parser);
+}
+
+/*
+ * Function: parseConditional
+ * --------------------------
+ * condition ? expression : expression (only the chosen expression is evaluated)
+ */
+void parseConditional(pArithParser_t parser)
+{
+    int jumpToElse, jumpToEnd;
+
+    parseBinary(parser, 1);
+    if (!isToken(parser, "?"))
+        return;
+
+    nextToken(parser);
+    jumpToElse = emitOp(parser, OP_JUMP_ZERO, 0);
+    parseAssignment(parser);
+    if (!isToken(parser, ":"))
+    {
+        setArithError(parser, "expected ':'");
+        return;
+    }
+    jumpToEnd = emitOp(parser, OP_JUMP, 0);
+
+    nextToken(parser);
+    parser->program->ops[jumpToElse].operand = parser->program->count;
+    parseConditional(parser);
+    parser->program->ops[jumpToEnd].operand = parser->program->count;
+}
+
+/*
+ * Function: parseBinary
+ * ---------------------
+ * Binary operators, by precedence climbing: parses the operators binding at least as tightly as minPrecedence
+ * && and || only evaluate their right operand if needed, and give 0 or 1
+ */
+void parseBinary(pArithParser_t parser, int minPrecedence)
+{
+    parseUnary(parser);
+
+    for (;;)
+    {
+        const arithOperator_t *operator = NULL;
+
+        for (int i = 0; BINARY_OPERATORS[i].text != NULL && operator == NULL; i++)
+            if (BINARY_OPERATORS[i].precedence >= minPrecedence && isToken(parser, BINARY_OPERATORS[i].text))
+                operator = &(BINARY_OPERATORS[i]);
+
+        if (operator == NULL)
+            return;
+
+        nextToken(parser);
+
+        if (operator->code == OP_LOGICAL)
+        {
+            int isOr = (operator->text[0] == '|');
+            int shortCut = emitOp(parser, isOr ? OP_JUMP_NONZERO : OP_JUMP_ZERO, 0);
+            int jumpToEnd;
+
+            parseBinary(parser, operator->precedence + 1);
+            emitOp(parser, OP_NOT, 0);
+            emitOp(parser, OP_NOT, 0);
+            jumpToEnd = emitOp(parser, OP_JUMP, 0);
+
+            parser->program->ops[shortCut].operand = parser->program->count;
+            emitOp(parser, OP_PUSH, isOr);
+            parser->program->ops[jumpToEnd].operand = parser->program->count;
+        }
+        else
+        {
+            parseBinary(parser, operator->precedence + 1);
+            emitOp(parser, operator->code, 0);
+        }
+    }
+}
+
+/*
+ * Function: parseUnary
+ * --------------------
+ * + - ! ~ followed by an operand, or ++ -- followed by a variable
+ */
+void parseUnary(pArithParser_t parser)
+{
+    int code;
+
+    if (isToken(parser, "++") || isToken(parser, "--"))
+    {
+        code = (parser->start[0] == '+') ? OP_ADD : OP_SUB;
+
+        nextToken(parser);
+        if (parser->token == TOK_NAME)
+        {
+            int index = variableIndex(parser, parser->start, parser->len);
+
+            emitOp(parser, OP_LOAD, index);
+            emitOp(parser, OP_PUSH, 1);
+            emitOp(parser, code, 0);
+            emitOp(parser, OP_STORE, index);
+            nextToken(parser);
+            return;
+        }
+
+        // Before anything else than a variable, "--" is read as "- -" and "++" as "+ +", as in other shells
+        parseUnary(parser);
+        return;
+    }
+
+    if (isToken(parser, "+"))
+        code = -1;
+    else if (isToken(parser, "-"))
+        code = OP_NEG;
+    else if (isToken(parser, "!"))
+        code = OP_NOT;
+    else if (isToken(parser, "~"))
+        code = OP_BITNOT;
+    else
+    {
+        parsePrimary(parser);
+        return;
+    }
+
+    nextToken(parser);
+    parseUnary(parser);
+    if (code != -1)
+        emitOp(parser, code, 0);
+}
+
+/*
+ * Function: parsePrimary
+ * ----------------------
+ * A number, a variable (possibly followed by ++ or --), or an expression between parentheses
+ */
+void parsePrimary(pArithParser_t parser)
+{
+    if (parser->token == TOK_NUMBER)
+    {
+        emitOp(parser, OP_PUSH, parser->number);
+        nextToken(parser);
+    }
+    else if (parser->token == TOK_NAME)
+    {
+        int index = variableIndex(parser, parser->start, parser->len);
+
+        emitOp(parser, OP_LOAD, index);
+        nextToken(parser);
+
+        // The previous value stays below the new one, which is dropped once stored
+        if (isToken(parser, "++") || isToken(parser, "--"))
+        {
+            emitOp(parser, OP_LOAD, index);
+            emitOp(parser, OP_PUSH, 1);
+            emitOp(parser, (parser->start[0] == '+') ? OP_ADD : OP_SUB, 0);
+            emitOp(parser, OP_STORE, index);
+            emitOp(parser, OP_POP, 0);
+            nextToken(parser);
+        }
+    }
+    else if (isToken(parser, "("))
+    {
+        nextToken(parser);
+        parseComma(parser);
+        if (!isToken(parser, ")"))
+        {
+            setArithError(parser, "expected ')'");
+            return;
+        }
+        nextToken(parser);
+    }
+    else
+    {
+        setArithError(parser, "syntax error");
+    }
+}
+
+/*
+ * Function: loadVariable
+ * ----------------------
+ * Reads the value of a variable (an unset or empty variable is 0)
+ *
+ *  name:    The name of the variable
+ *  value:   Receives its value
+ *  error:   Receives the error message if the variable is not a number (ARITH_ERROR_LEN bytes)
+ *
+ *  Returns: 0 if the variable has been read, -1 otherwise
+ */
+int loadVariable(const char *name, long long *value, char *error)
+{
+    const char *text = getenv(name);
+    char *end;
+
+    *value = 0;
+    if (text == NULL)
+        return 0;
+
+    while (isspace((unsigned char)*text))
+        text++;
+    if (*text == '\0')
+        return 0;
+
+    errno = 0;
+    *value = strtoll(text, &end, 0);
+    while (isspace((unsigned char)*end))
+        end++;
+
+    if (*end != '\0' || errno == ERANGE)
+    {
+        snprintf(error, ARITH_ERROR_LEN, "%s: not a number: \"%s\"", name, text);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function: applyBinary
+ * ---------------------
+ * Computes a binary operation. Additions, subtractions, multiplications and left shifts wrap around,
+ * shifts only use the 6 lowest bits of their count, and the overflowing division (min / -1) wraps as well
+ *
+ *  code:    The operation
+ *  a:       The left operand
+ *  b:       The right operand (not 0 for divisions)
+ *
+ *  Returns: The result
+ */
+long long applyBinary(int code, long long a, long long b)
+{
+    unsigned long long ua = (unsigned long long)a;
+    unsigned long long ub = (unsigned long long)b;
+
+    switch (code)
+    {
+    case OP_MUL:
+        return (long long)(ua * ub);
+    case OP_DIV:
+        return (b == -1) ? (long long)(0ULL - ua) : a / b;
+    case OP_MOD:
+        return (b == -1) ? 0 : a % b;
+    case OP_ADD:
+        return (long long)(ua + ub);
+    case OP_SUB:
+        return (long long)(ua - ub);
+    case OP_SHL:
+        return (long long)(ua << (b & 63));
+    case OP_SHR:
+        return a >> (b & 63);
+    case OP_LT:
+        return a < b;
+    case OP_LE:
+        return a <= b;
+    case OP_GT:
+        return a > b;
+    case OP_GE:
+        return a >= b;
+    case OP_EQ:
+        return a == b;
+    case OP_NE:
+        return a != b;
+    case OP_AND:
+        return a & b;
+    case OP_XOR:
+        return a ^ b;
+    default:
+        return a | b;
+    }
+}
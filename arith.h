@@ -0,0 +1,51 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+#define ARITH_CACHE_SLOTS 256 // The number of compiled expressions kept (a new expression replaces the one in its slot)
+#define ARITH_ERROR_LEN 128   // The size of the buffers receiving the error messages
+
+/*
+ * Structure: arithOp
+ * ------------------
+ * An instruction of a compiled expression, run by a stack machine
+ *
+ *  code:    The operation (one of the OP_ values of arith.c)
+ *  operand: The number pushed, the index of the variable loaded or stored, or the target of a jump
+ */
+typedef struct arithOp
+{
+    int code;
+    long long operand;
+} arithOp_t, *pArithOp_t;
+
+/*
+ * Structure: arithProgram
+ * -----------------------
+ * A compiled arithmetic expression
+ *
+ *  ops:       The instructions
+ *  count:     The number of instructions
+ *  capacity:  The number of instructions the array can hold
+ *  names:     The names of the variables of the expression
+ *  nameCount: The number of variables
+ *  stack:     The stack of the machine (as deep as the number of instructions)
+ */
+typedef struct arithProgram
+{
+    pArithOp_t ops;
+    int count;
+    int capacity;
+    char **names;
+    int nameCount;
+    long long *stack;
+} arithProgram_t, *pArithProgram_t;
+
+/* Sets a variable assigned by an expression */
+typedef void (*arithSetter_t)(const char *name, const char *value);
+
+pArithProgram_t compileArith(const char *text, char *error);
+int runArith(pArithProgram_t program, arithSetter_t setter, long long *result, char *error);
+pArithProgram_t cachedArith(const char *text, char *error);
+void freeArith(pArithProgram_t program);
+
+#endif
@@ -0,0 +1,844 @@
+/*
+    Builtins of QuYsh which can be stages of a pipeline: test (or [), echo, printf, true and false.
+    They are the commands scripts run the most, for almost no work: the Shell runs them itself instead of forking
+    and executing a binary. Each of them writes its output to a stream given by the Shell (which sends it to
+    the terminal, the file or the pipe the process would have written to) and its errors to stderr.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "builtins.h"
+
+#define TEST_TRUE 0
+#define TEST_FALSE 1
+#define TEST_ERROR 2
+
+/*
+ * Structure: stageBuiltinEntry
+ * ----------------------------
+ * A builtin which can be a stage of a pipeline
+ *
+ *  name: The name of the builtin
+ *  run:  The function running it
+ */
+typedef struct stageBuiltinEntry
+{
+    const char *name;
+    stageBuiltin_t run;
+} stageBuiltinEntry_t;
+
+const stageBuiltinEntry_t STAGE_BUILTINS[] = {
+    {"test", testBuiltin}, {"[", testBuiltin}, {"echo", echoBuiltin}, {"printf", printfBuiltin},
+    {"true", trueBuiltin}, {"false", falseBuiltin}, {NULL, NULL}};
+
+/*
+ * Structure: testParser
+ * ---------------------
+ * The state of the evaluation of the arguments of test
+ *
+ *  name:  The name test was called with ("test" or "[")
+ *  args:  The arguments (without the name and the closing "]")
+ *  count: The number of arguments
+ *  pos:   The next argument to read
+ *  error: 1 once an error has been reported
+ */
+typedef struct testParser
+{
+    const char *name;
+    char **args;
+    int count;
+    int pos;
+    int error;
+} testParser_t, *pTestParser_t;
+
+int testOr(pTestParser_t parser);
+int testAnd(pTestParser_t parser);
+int testNot(pTestParser_t parser);
+int testPrimary(pTestParser_t parser);
+int isUnaryTest(const char *op);
+int isBinaryTest(const char *op);
+int unaryTest(pTestParser_t parser, const char *op, const char *operand);
+int binaryTest(pTestParser_t parser, const char *left, const char *op, const char *right);
+int testInteger(pTestParser_t parser, const char *text, long long *value);
+void testError(pTestParser_t parser, const char *message, const char *word);
+int writeEscapes(const char *text, FILE *out, int inFormat);
+int printfConversion(const char *spec, int specLen, char conversion, char **args, int argCount, int *argPos, FILE *out);
+int numericArgument(const char *text, long long *value);
+
+/*
+ * Function: findStageBuiltin
+ * --------------------------
+ *  Returns: The builtin of the given name, NULL if it is not one of the builtins which can be stages of a pipeline
+ */
+stageBuiltin_t findStageBuiltin(const char *name)
+{
+    for (int i = 0; STAGE_BUILTINS[i].name != NULL; i++)
+        if (strcmp(STAGE_BUILTINS[i].name, name) == 0)
+            return STAGE_BUILTINS[i].run;
+
+    return NULL;
+}
+
+/*
+ * Function: trueBuiltin
+ * ---------------------
+ * Builtin "true": does nothing, successfully
+ */
+int trueBuiltin(int argc, char **argv, FILE *out)
+{
+    return 0;
+}
+
+/*
+ * Function: falseBuiltin
+ * ----------------------
+ * Builtin "false": does nothing, unsuccessfully
+ */
+int falseBuiltin(int argc, char **argv, FILE *out)
+{
+    return 1;
+}
+
+/*
+ * Function: testBuiltin
+ * ---------------------
+ * Builtin "test expression" (or "[ expression ]"): evaluates a condition
+ *  Files:    -e -f -d -r -w -x -s -L (or -h) -b -c -p -S file, file1 -nt -ot -ef file2, -t fd
+ *  Strings:  -n -z string, string, s1 = s2 (or ==), s1 != s2
+ *  Integers: n1 -eq -ne -lt -le -gt -ge n2
+ *  Logic:    ! expression, e1 -a e2, e1 -o e2, ( expression )
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    The arguments
+ *  out:     Unused (test only has an exit status)
+ *
+ *  Returns: 0 if the condition is true, 1 if it is false, 2 if the expression is invalid
+ */
+int testBuiltin(int argc, char **argv, FILE *out)
+{
+    testParser_t parser = {argv[0], argv + 1, argc - 1, 0, 0};
+    int res;
+
+    if (strcmp(argv[0], "[") == 0)
+    {
+        if (argc < 2 || strcmp(argv[argc - 1], "]") != 0)
+        {
+            fprintf(stderr, "quysh: [: missing `]'\n");
+            return TEST_ERROR;
+        }
+        parser.count--;
+    }
+
+    if (parser.count == 0)
+        return TEST_FALSE;
+
+    res = testOr(&parser);
+    if (!parser.error && parser.pos < parser.count)
+        testError(&parser, "unexpected argument", parser.args[parser.pos]);
+
+    return parser.error ? TEST_ERROR : (res ? TEST_TRUE : TEST_FALSE);
+}
+
+/*
+ * Function: testOr
+ * ----------------
+ * e1 -o e2 (the lowest precedence)
+ *
+ *  Returns: 1 if the expression is true, 0 otherwise
+ */
+int testOr(pTestParser_t parser)
+{
+    int res = testAnd(parser);
+
+    while (!parser->error && parser->pos < parser->count && strcmp(parser->args[parser->pos], "-o") == 0)
+    {
+        parser->pos++;
+        res = testAnd(parser) || res;
+    }
+
+    return res;
+}
+
+/*
+ * Function: testAnd
+ * -----------------
+ * e1 -a e2
+ *
+ *  Returns: 1 if the expression is true, 0 otherwise
+ */
+int testAnd(pTestParser_t parser)
+{
+    int res = testNot(parser);
+
+    while (!parser->error && parser->pos < parser->count && strcmp(parser->args[parser->pos], "-a") == 0)
+    {
+        parser->pos++;
+        res = testNot(parser) && res;
+    }
+
+    return res;
+}
+
+/*
+ * Function: testNot
+ * -----------------
+ * ! expression (a "!" alone, or followed by a binary operator, is a string)
+ *
+ *  Returns: 1 if the expression is true, 0 otherwise
+ */
+int testNot(pTestParser_t parser)
+{
+    int remaining = parser->count - parser->pos;
+
+    if (remaining >= 2 && strcmp(parser->args[parser->pos], "!") == 0 &&
+        !(remaining == 3 && isBinaryTest(parser->args[parser->pos + 1])))
+    {
+        parser->pos++;
+        return !testNot(parser);
+    }
+
+    return testPrimary(parser);
+}
+
+/*
+ * Function: testPrimary
+ * ---------------------
+ * A binary test, a unary test, an expression between parentheses, or a string (true if it is not empty)
+ * A binary operator is looked for first, so that "[ -n = -n ]" compares two strings
+ *
+ *  Returns: 1 if the expression is true, 0 otherwise
+ */
+int testPrimary(pTestParser_t parser)
+{
+    int remaining = parser->count - parser->pos;
+    char **args = parser->args + parser->pos;
+
+    if (remaining <= 0)
+    {
+        testError(parser, "argument expected", NULL);
+        return 0;
+    }
+
+    if (remaining >= 3 && isBinaryTest(args[1]))
+    {
+        parser->pos += 3;
+        return binaryTest(parser, args[0], args[1], args[2]);
+    }
+
+    if (strcmp(args[0], "(") == 0 && remaining >= 2)
+    {
+        int res;
+
+        parser->pos++;
+        res = testOr(parser);
+        if (parser->pos >= parser->count || strcmp(parser->args[parser->pos], ")") != 0)
+        {
+            testError(parser, "missing `)'", NULL);
+            return 0;
+        }
+        parser->pos++;
+        return res;
+    }
+
+    if (remaining >= 2 && isUnaryTest(args[0]))
+    {
+        parser->pos += 2;
+        return unaryTest(parser, args[0], args[1]);
+    }
+
+    parser->pos++;
+    return args[0][0] != '\0';
+}
+
+/*
+ * Function: isUnaryTest
+ * ---------------------
+ *  Returns: 1 if the word is a unary operator of test, 0 otherwise
+ */
+int isUnaryTest(const char *op)
+{
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("edfrwxsLhbcpStnz", op[1]) != NULL;
+}
+
+/*
+ * Function: isBinaryTest
+ * ----------------------
+ *  Returns: 1 if the word is a binary operator of test, 0 otherwise
+ */
+int isBinaryTest(const char *op)
+{
+    const char *OPERATORS[] = {"=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef", NULL};
+
+    for (int i = 0; OPERATORS[i] != NULL; i++)
+        if (strcmp(OPERATORS[i], op) == 0)
+            return 1;
+
+    return 0;
+}
+
+/*
+ * Function: unaryTest
+ * -------------------
+ * Evaluates a unary test
+ *
+ *  parser:  The parser
+ *  op:      The operator
+ *  operand: The operand
+ *
+ *  Returns: 1 if the test is true, 0 otherwise
+ */
+int unaryTest(pTestParser_t parser, const char *op, const char *operand)
+{
+    struct stat fileStat;
+    long long fd;
+
+    switch (op[1])
+    {
+    case 'n':
+        return operand[0] != '\0';
+    case 'z':
+        return operand[0] == '\0';
+    case 't':
+        return testInteger(parser, operand, &fd) && isatty((int)fd);
+    case 'r':
+        return access(operand, R_OK) == 0;
+    case 'w':
+        return access(operand, W_OK) == 0;
+    case 'x':
+        return access(operand, X_OK) == 0;
+    case 'L':
+    case 'h':
+        return lstat(operand, &fileStat) == 0 && S_ISLNK(fileStat.st_mode);
+    }
+
+    if (stat(operand, &fileStat) != 0)
+        return 0;
+
+    switch (op[1])
+    {
+    case 'f':
+        return S_ISREG(fileStat.st_mode);
+    case 'd':
+        return S_ISDIR(fileStat.st_mode);
+    case 's':
+        return fileStat.st_size > 0;
+    case 'b':
+        return S_ISBLK(fileStat.st_mode);
+    case 'c':
+        return S_ISCHR(fileStat.st_mode);
+    case 'p':
+        return S_ISFIFO(fileStat.st_mode);
+    case 'S':
+        return S_ISSOCK(fileStat.st_mode);
+    default: // -e
+        return 1;
+    }
+}
+
+/*
+ * Function: binaryTest
+ * --------------------
+ * Evaluates a binary test
+ *
+ *  parser:  The parser
+ *  left:    The left operand
+ *  op:      The operator
+ *  right:   The right operand
+ *
+ *  Returns: 1 if the test is true, 0 otherwise
+ */
+int binaryTest(pTestParser_t parser, const char *left, const char *op, const char *right)
+{
+    long long a, b;
+    struct stat leftStat, rightStat;
+
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+        return strcmp(left, right) == 0;
+    if (strcmp(op, "!=") == 0)
+        return strcmp(left, right) != 0;
+
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0)
+    {
+        int leftExists = (stat(left, &leftStat) == 0);
+        int rightExists = (stat(right, &rightStat) == 0);
+
+        if (op[1] == 'e')
+            return leftExists && rightExists && leftStat.st_dev == rightStat.st_dev && leftStat.st_ino == rightStat.st_ino;
+
+        // A file which does not exist is older than any file which does
+        if (!leftExists || !rightExists)
+            return (op[1] == 'n') ? leftExists : rightExists;
+        if (leftStat.st_mtim.tv_sec != rightStat.st_mtim.tv_sec)
+            return (op[1] == 'n') ? leftStat.st_mtim.tv_sec > rightStat.st_mtim.tv_sec : leftStat.st_mtim.tv_sec < rightStat.st_mtim.tv_sec;
+        return (op[1] == 'n') ? leftStat.st_mtim.tv_nsec > rightStat.st_mtim.tv_nsec : leftStat.st_mtim.tv_nsec < rightStat.st_mtim.tv_nsec;
+    }
+
+    if (!testInteger(parser, left, &a) || !testInteger(parser, right, &b))
+        return 0;
+
+    if (strcmp(op, "-eq") == 0)
+        return a == b;
+    if (strcmp(op, "-ne") == 0)
+        return a != b;
+    if (strcmp(op, "-lt") == 0)
+        return a < b;
+    if (strcmp(op, "-le") == 0)
+        return a <= b;
+    if (strcmp(op, "-gt") == 0)
+        return a > b;
+    return a >= b;
+}
+
+/*
+ * Function: testInteger
+ * ---------------------
+ * Reads an integer operand (blanks around it are allowed)
+ *
+ *  parser:  The parser
+ *  text:    The operand
+ *  value:   Receives its value
+ *
+ *  Returns: 1 if the operand is an integer, 0 otherwise (the error is reported)
+ */
+int testInteger(pTestParser_t parser, const char *text, long long *value)
+{
+    if (!numericArgument(text, value))
+    {
+        testError(parser, "integer expression expected", text);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Function: testError
+ * -------------------
+ * Reports an error of test (only the first one)
+ *
+ *  parser:  The parser
+ *  message: The error
+ *  word:    The argument the error is about (may be NULL)
+ */
+void testError(pTestParser_t parser, const char *message, const char *word)
+{
+    if (parser->error)
+        return;
+
+    if (word != NULL)
+        fprintf(stderr, "quysh: %s: %s: %s\n", parser->name, word, message);
+    else
+        fprintf(stderr, "quysh: %s: %s\n", parser->name, message);
+    parser->error = 1;
+}
+
+/*
+ * Function: echoBuiltin
+ * ---------------------
+ * Builtin "echo [-neE] [word...]": writes the words separated by spaces, followed by a newline
+ *  -n: no newline
+ *  -e: interprets the escapes of the words (\n, \t, \\, \0nnn, \xHH, \c stops the output...)
+ *  -E: does not interpret them (default)
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    The arguments
+ *  out:     The output
+ *
+ *  Returns: 0
+ */
+int echoBuiltin(int argc, char **argv, FILE *out)
+{
+    int newline = 1;
+    int escapes = 0;
+    int i;
+
+    // Options are only recognized as long as they are made of n, e and E
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0' && strspn(argv[i] + 1, "neE") == strlen(argv[i] + 1); i++)
+    {
+        for (char *opt = argv[i] + 1; *opt != '\0'; opt++)
+        {
+            if (*opt == 'n')
+                newline = 0;
+            else
+                escapes = (*opt == 'e');
+        }
+    }
+
+    for (int first = i; i < argc; i++)
+    {
+        if (i > first)
+            fputc(' ', out);
+
+        if (!escapes)
+            fputs(argv[i], out);
+        else if (writeEscapes(argv[i], out, 0))
+            return 0; // \c
+    }
+
+    if (newline)
+        fputc('\n', out);
+
+    return 0;
+}
+
+/*
+ * Function: writeEscapes
+ * ----------------------
+ * Writes a text, interpreting its backslash escapes
+ *
+ *  text:     The text
+ *  out:      The output
+ *  inFormat: 1 for the format of printf (octal escapes are \nnn), 0 for echo -e and %b (they are \0nnn)
+ *
+ *  Returns: 1 if the text contains \c (the output has to stop), 0 otherwise
+ */
+int writeEscapes(const char *text, FILE *out, int inFormat)
+{
+    for (const char *cur = text; *cur != '\0'; cur++)
+    {
+        int value = 0;
+        int digits = 0;
+
+        if (*cur != '\\' || cur[1] == '\0')
+        {
+            fputc(*cur, out);
+            continue;
+        }
+
+        cur++;
+        switch (*cur)
+        {
+        case 'a':
+            fputc('\a', out);
+            break;
+        case 'b':
+            fputc('\b', out);
+            break;
+        case 'c':
+            if (inFormat)
+                fputs("\\c", out);
+            else
+                return 1;
+            break;
+        case 'e':
+            fputc('\033', out);
+            break;
+        case 'f':
+            fputc('\f', out);
+            break;
+        case 'n':
+            fputc('\n', out);
+            break;
+        case 'r':
+            fputc('\r', out);
+            break;
+        case 't':
+            fputc('\t', out);
+            break;
+        case 'v':
+            fputc('\v', out);
+            break;
+        case '\\':
+            fputc('\\', out);
+            break;
+        case 'x':
+            while (digits < 2 && strchr("0123456789abcdefABCDEF", cur[1]) != NULL && cur[1] != '\0')
+            {
+                cur++;
+                value = value * 16 + ((*cur <= '9') ? *cur - '0' : (*cur | 0x20) - 'a' + 10);
+                digits++;
+            }
+            if (digits == 0)
+                fputs("\\x", out);
+            else
+                fputc(value, out);
+            break;
+        default:
+            if (*cur >= '0' && *cur <= '7')
+            {
+                // \0nnn for echo, \nnn for printf
+                if (!inFormat && *cur == '0')
+                    cur++;
+                else
+                    cur--;
+                while (digits < 3 && cur[1] >= '0' && cur[1] <= '7')
+                {
+                    cur++;
+                    value = value * 8 + (*cur - '0');
+                    digits++;
+                }
+                fputc(value, out);
+                if (!inFormat && digits == 0 && cur[0] == '\0')
+                    return 0;
+            }
+            else
+            {
+                fputc('\\', out);
+                fputc(*cur, out);
+            }
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Function: printfBuiltin
+ * -----------------------
+ * Builtin "printf format [argument...]": writes the arguments as described by the format
+ * Conversions: %s %b (escapes interpreted) %c %d %i %u %o %x %X %e %E %f %F %g %G %a %A %%, with flags, width and
+ * precision ('*' takes them from the arguments). The format is reused as long as arguments are left;
+ * a missing argument is an empty string or 0. A numeric argument can be a character code ('c or "c)
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    The arguments
+ *  out:     The output
+ *
+ *  Returns: 0 if all the arguments were valid, 1 otherwise
+ */
+int printfBuiltin(int argc, char **argv, FILE *out)
+{
+    char **args = argv + 2;
+    int argCount = argc - 2;
+    int argPos = 0;
+    int status = 0;
+    const char *format;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "quysh: printf: usage: printf format [argument...]\n");
+        return 2;
+    }
+    format = argv[1];
+
+    do
+    {
+        int consumed = argPos;
+
+        for (const char *cur = format; *cur != '\0'; cur++)
+        {
+            const char *spec;
+            int res;
+
+            if (*cur == '\\')
+            {
+                // One escape at a time: \c stops everything
+                char escape[5] = {'\\', '\0', '\0', '\0', '\0'};
+                int len = 1;
+
+                while (len < 4 && cur[len] != '\0' && (len == 1 || (cur[1] >= '0' && cur[1] <= '7' && cur[len] >= '0' && cur[len] <= '7') ||
+                                                       (cur[1] == 'x' && strchr("0123456789abcdefABCDEF", cur[len]) != NULL && len < 4)))
+                {
+                    escape[len] = cur[len];
+                    len++;
+                }
+                if (strcmp(escape, "\\c") == 0)
+                    return status;
+                writeEscapes(escape, out, 1);
+                cur += len - 1;
+                continue;
+            }
+
+            if (*cur != '%')
+            {
+                fputc(*cur, out);
+                continue;
+            }
+
+            if (cur[1] == '%')
+            {
+                fputc('%', out);
+                cur++;
+                continue;
+            }
+
+            spec = cur;
+            cur++;
+            while (*cur != '\0' && strchr("-+ #0", *cur) != NULL)
+                cur++;
+            while ((*cur >= '0' && *cur <= '9') || *cur == '*')
+                cur++;
+            if (*cur == '.')
+            {
+                cur++;
+                while ((*cur >= '0' && *cur <= '9') || *cur == '*')
+                    cur++;
+            }
+
+            if (*cur == '\0' || strchr("sbcdiuoxXeEfFgGaA", *cur) == NULL)
+            {
+                fprintf(stderr, "quysh: printf: %.*s: invalid conversion\n", (int)(cur - spec + (*cur != '\0')), spec);
+                return 1;
+            }
+
+            res = printfConversion(spec, cur - spec, *cur, args, argCount, &argPos, out);
+            if (res == -1)
+                return status; // %b with \c
+            if (res == 1)
+                status = 1;
+        }
+
+        // A format without conversion is only written once
+        if (argPos == consumed)
+            break;
+    } while (argPos < argCount);
+
+    return status;
+}
+
+/*
+ * Function: printfConversion
+ * --------------------------
+ * Writes one argument of printf
+ *
+ *  spec:       The beginning of the conversion ('%', flags, width and precision)
+ *  specLen:    The length of spec
+ *  conversion: The conversion character
+ *  args:       The arguments of printf
+ *  argCount:   The number of arguments
+ *  argPos:     The next argument to use (updated)
+ *  out:        The output
+ *
+ *  Returns: 0 if the argument was written, 1 if it was invalid, -1 if %b found \c (the output has to stop)
+ */
+int printfConversion(const char *spec, int specLen, char conversion, char **args, int argCount, int *argPos, FILE *out)
+{
+    char format[64];
+    int len = 0;
+    int status = 0;
+    const char *arg;
+
+    // Flags, width and precision, '*' being replaced with the next argument
+    for (int i = 0; i < specLen && len < (int)sizeof(format) - 24; i++)
+    {
+        if (spec[i] == '*')
+        {
+            long long value = 0;
+
+            if (*argPos < argCount && !numericArgument(args[(*argPos)++], &value))
+                status = 1;
+            len += snprintf(format + len, sizeof(format) - len, "%d", (int)value);
+        }
+        else
+        {
+            format[len++] = spec[i];
+        }
+    }
+    format[len] = '\0';
+
+    arg = (*argPos < argCount) ? args[(*argPos)++] : NULL;
+
+    switch (conversion)
+    {
+    case 's':
+        strcat(format, "s");
+        fprintf(out, format, (arg != NULL) ? arg : "");
+        break;
+    case 'b':
+    {
+        char *expanded = NULL;
+        size_t expandedLen = 0;
+        FILE *expandedOut = open_memstream(&expanded, &expandedLen);
+        int stop = writeEscapes((arg != NULL) ? arg : "", expandedOut, 0);
+
+        fclose(expandedOut);
+        strcat(format, "s");
+        fprintf(out, format, expanded);
+        free(expanded);
+        if (stop)
+            return -1;
+        break;
+    }
+    case 'c':
+        strcat(format, "c");
+        if (arg != NULL && arg[0] != '\0')
+            fprintf(out, format, arg[0]);
+        else if (specLen > 1)
+            fprintf(out, format, ' ');
+        break;
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+    {
+        long long value = 0;
+
+        if (arg != NULL && !numericArgument(arg, &value))
+        {
+            fprintf(stderr, "quysh: printf: %s: invalid number\n", arg);
+            status = 1;
+        }
+        snprintf(format + len, sizeof(format) - len, "ll%c", conversion);
+        fprintf(out, format, value);
+        break;
+    }
+    default:
+    {
+        double value = 0;
+        char *end;
+
+        if (arg != NULL)
+        {
+            value = strtod(arg, &end);
+            if (*end != '\0' || end == arg)
+            {
+                long long code;
+
+                if (numericArgument(arg, &code))
+                {
+                    value = (double)code;
+                }
+                else
+                {
+                    fprintf(stderr, "quysh: printf: %s: invalid number\n", arg);
+                    status = 1;
+                }
+            }
+        }
+        snprintf(format + len, sizeof(format) - len, "%c", conversion);
+        fprintf(out, format, value);
+        break;
+    }
+    }
+
+    return status;
+}
+
+/*
+ * Function: numericArgument
+ * -------------------------
+ * Reads an integer argument: decimal, octal (0nnn), hexadecimal (0xnn), or the code of a character ('c or "c)
+ *
+ *  text:    The argument
+ *  value:   Receives its value
+ *
+ *  Returns: 1 if the argument is an integer, 0 otherwise
+ */
+int numericArgument(const char *text, long long *value)
+{
+    char *end;
+
+    if (text[0] == '\'' || text[0] == '"')
+    {
+        *value = (unsigned char)text[1];
+        return 1;
+    }
+
+    while (*text == ' ' || *text == '\t')
+        text++;
+
+    errno = 0;
+    *value = strtoll(text, &end, 0);
+    while (*end == ' ' || *end == '\t')
+        end++;
+
+    return end != text && *end == '\0' && errno != ERANGE;
+}
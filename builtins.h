@@ -0,0 +1,17 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <stdio.h>
+
+/* Runs a builtin which can be a stage of a pipeline: writes to out, returns its exit status */
+typedef int (*stageBuiltin_t)(int argc, char **argv, FILE *out);
+
+stageBuiltin_t findStageBuiltin(const char *name);
+
+int testBuiltin(int argc, char **argv, FILE *out);
+int echoBuiltin(int argc, char **argv, FILE *out);
+int printfBuiltin(int argc, char **argv, FILE *out);
+int trueBuiltin(int argc, char **argv, FILE *out);
+int falseBuiltin(int argc, char **argv, FILE *out);
+
+#endif
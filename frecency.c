@@ -0,0 +1,410 @@
+/*
+    Frecency index of QuYsh: the directories visited with "cd", ranked by how often and how recently they have been
+    visited, and kept in a small text file. "cd -j" (or "z") jumps to the best match of a few fragments of a path,
+    found in the index in memory without scanning the filesystem.
+    The index is bounded: the ranks are aged once their total grows too large, and the least frecent
+    directories are forgotten beyond DIRS_MAX entries.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "frecency.h"
+
+#define DIRS_HEADER "# quysh dirs 1" // The first line of an index file
+
+/* Weights of the rank of a directory, depending on the time since its last visit */
+#define HOUR 3600
+#define DAY (24 * HOUR)
+#define WEEK (7 * DAY)
+
+void readDirIndex(pDirIndex_t index);
+void statDirIndex(pDirIndex_t index, long long *sec, long long *nsec);
+void addDir(pDirIndex_t index, const char *path, double rank, long long time);
+void removeDir(pDirIndex_t index, int pos);
+double frecency(pDirEntry_t entry, long long now);
+int matchFragments(const char *path, char **fragments, int count, int ignoreCase);
+
+/*
+ * Function: loadDirIndex
+ * ----------------------
+ * Reads an index file (a missing file is an empty index)
+ *
+ *  file:    The index file (NULL for an index which is not saved)
+ *
+ *  Returns: A pointer to the newly allocated index
+ */
+pDirIndex_t loadDirIndex(const char *file)
+{
+    pDirIndex_t index = (pDirIndex_t)calloc(1, sizeof(dirIndex_t));
+
+    if (file != NULL)
+    {
+        index->file = strdup(file);
+        readDirIndex(index);
+    }
+
+    return index;
+}
+
+/*
+ * Function: refreshDirIndex
+ * -------------------------
+ * Reads the index file again if another Shell has written it since it was last read or written
+ *
+ *  index:   The index
+ */
+void refreshDirIndex(pDirIndex_t index)
+{
+    long long sec, nsec;
+
+    if (index->file == NULL)
+        return;
+
+    statDirIndex(index, &sec, &nsec);
+    if (sec != index->mtimeSec || nsec != index->mtimeNsec)
+        readDirIndex(index);
+}
+
+/*
+ * Function: visitDir
+ * ------------------
+ * Records a visit of a directory
+ *
+ *  index:   The index
+ *  path:    The absolute path of the directory
+ *  now:     The current time
+ */
+void visitDir(pDirIndex_t index, const char *path, long long now)
+{
+    double total = 0;
+    int found = 0;
+
+    // A line of the index file holds a single directory
+    if (strchr(path, '\n') != NULL)
+        return;
+
+    for (int i = 0; i < index->count; i++)
+    {
+        if (!found && strcmp(index->entries[i].path, path) == 0)
+        {
+            index->entries[i].rank++;
+            index->entries[i].time = now;
+            found = 1;
+        }
+        total += index->entries[i].rank;
+    }
+
+    if (!found)
+    {
+        addDir(index, path, 1, now);
+        total++;
+    }
+
+    // Aging: the directories which are not visited anymore fade away
+    if (total > DIRS_MAX_RANK)
+    {
+        for (int i = index->count - 1; i >= 0; i--)
+        {
+            index->entries[i].rank *= DIRS_AGING;
+            if (index->entries[i].rank < 1)
+                removeDir(index, i);
+        }
+    }
+
+    // The least frecent directory makes room for the new one
+    while (index->count > DIRS_MAX)
+    {
+        int worst = 0;
+
+        for (int i = 1; i < index->count; i++)
+            if (frecency(&(index->entries[i]), now) < frecency(&(index->entries[worst]), now))
+                worst = i;
+        removeDir(index, worst);
+    }
+}
+
+/*
+ * Function: forgetDir
+ * -------------------
+ * Removes a directory from the index (it does not exist anymore)
+ *
+ *  index:   The index
+ *  path:    The absolute path of the directory
+ */
+void forgetDir(pDirIndex_t index, const char *path)
+{
+    for (int i = 0; i < index->count; i++)
+    {
+        if (strcmp(index->entries[i].path, path) == 0)
+        {
+            removeDir(index, i);
+            return;
+        }
+    }
+}
+
+/*
+ * Function: matchDir
+ * ------------------
+ * Finds the most frecent directory matching fragments of a path
+ * The fragments have to appear in the path in the same order, and the last one in the last component of the path
+ * (unless it contains a '/'). The case of the fragments only matters if a directory matches them exactly
+ *
+ *  index:     The index
+ *  fragments: The fragments
+ *  count:     The number of fragments
+ *  exclude:   A directory which cannot be the match (the current directory), may be NULL
+ *  now:       The current time
+ *
+ *  Returns: The path of the directory (owned by the index), NULL if no directory matches
+ */
+const char *matchDir(pDirIndex_t index, char **fragments, int count, const char *exclude, long long now)
+{
+    for (int ignoreCase = 0; ignoreCase <= 1; ignoreCase++)
+    {
+        pDirEntry_t best = NULL;
+        double bestScore = 0;
+
+        for (int i = 0; i < index->count; i++)
+        {
+            pDirEntry_t entry = &(index->entries[i]);
+            double score;
+
+            if ((exclude != NULL && strcmp(entry->path, exclude) == 0) || !matchFragments(entry->path, fragments, count, ignoreCase))
+                continue;
+
+            score = frecency(entry, now);
+            if (best == NULL || score > bestScore)
+            {
+                best = entry;
+                bestScore = score;
+            }
+        }
+
+        if (best != NULL)
+            return best->path;
+    }
+
+    return NULL;
+}
+
+/*
+ * Function: saveDirIndex
+ * ----------------------
+ * Writes an index to its file
+ * The file is written next to the previous one, then renamed over it: a Shell never reads a partial index
+ *
+ *  index:   The index
+ *
+ *  Returns: 0 if the index has been written, -1 otherwise
+ */
+int saveDirIndex(pDirIndex_t index)
+{
+    char tmpFile[4096];
+    FILE *out;
+    int res = 0;
+
+    if (index->file == NULL)
+        return -1;
+
+    snprintf(tmpFile, sizeof(tmpFile), "%s.%d", index->file, getpid());
+    out = fopen(tmpFile, "w");
+    if (out == NULL)
+        return -1;
+
+    fprintf(out, "%s\n", DIRS_HEADER);
+    for (int i = 0; i < index->count; i++)
+        fprintf(out, "%.3f %lld %s\n", index->entries[i].rank, index->entries[i].time, index->entries[i].path);
+
+    if (fclose(out) != 0 || rename(tmpFile, index->file) == -1)
+    {
+        unlink(tmpFile);
+        res = -1;
+    }
+
+    statDirIndex(index, &(index->mtimeSec), &(index->mtimeNsec));
+
+    return res;
+}
+
+/*
+ * Function: freeDirIndex
+ * ----------------------
+ * Deallocates an index
+ *
+ *  index:   The index
+ */
+void freeDirIndex(pDirIndex_t index)
+{
+    for (int i = 0; i < index->count; i++)
+        free(index->entries[i].path);
+    free(index->entries);
+    free(index->file);
+    free(index);
+}
+
+/*
+ * Function: readDirIndex
+ * ----------------------
+ * Replaces the directories of an index with the ones of its file
+ * Each line of the file is "rank time path". A file without the header is ignored
+ *
+ *  index:   The index
+ */
+void readDirIndex(pDirIndex_t index)
+{
+    FILE *in;
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t len;
+
+    for (int i = 0; i < index->count; i++)
+        free(index->entries[i].path);
+    index->count = 0;
+
+    statDirIndex(index, &(index->mtimeSec), &(index->mtimeNsec));
+
+    in = fopen(index->file, "r");
+    if (in == NULL)
+        return;
+
+    if (getline(&line, &lineCapacity, in) > 0 && strncmp(line, DIRS_HEADER, strlen(DIRS_HEADER)) == 0)
+    {
+        while ((len = getline(&line, &lineCapacity, in)) > 0)
+        {
+            double rank;
+            long long time;
+            int pathPos = 0;
+
+            if (line[len - 1] == '\n')
+                line[len - 1] = '\0';
+
+            if (sscanf(line, "%lf %lld %n", &rank, &time, &pathPos) == 2 && pathPos > 0 && line[pathPos] == '/' &&
+                index->count < DIRS_MAX)
+                addDir(index, line + pathPos, rank, time);
+        }
+    }
+
+    free(line);
+    fclose(in);
+}
+
+/*
+ * Function: statDirIndex
+ * ----------------------
+ * Gets the modification time of the file of an index (0 if it does not exist)
+ *
+ *  index:   The index
+ *  sec:     Receives the seconds of the modification time
+ *  nsec:    Receives the nanoseconds of the modification time
+ */
+void statDirIndex(pDirIndex_t index, long long *sec, long long *nsec)
+{
+    struct stat fileStat;
+
+    *sec = 0;
+    *nsec = 0;
+    if (stat(index->file, &fileStat) == 0)
+    {
+        *sec = fileStat.st_mtim.tv_sec;
+        *nsec = fileStat.st_mtim.tv_nsec;
+    }
+}
+
+/*
+ * Function: addDir
+ * ----------------
+ * Appends a directory to an index
+ *
+ *  index:   The index
+ *  path:    The absolute path of the directory
+ *  rank:    The rank of the directory
+ *  time:    The time of the last visit of the directory
+ */
+void addDir(pDirIndex_t index, const char *path, double rank, long long time)
+{
+    if (index->count == index->capacity)
+    {
+        index->capacity = (index->capacity == 0) ? 64 : index->capacity * 2;
+        index->entries = (pDirEntry_t)realloc(index->entries, index->capacity * sizeof(dirEntry_t));
+    }
+
+    index->entries[index->count].path = strdup(path);
+    index->entries[index->count].rank = rank;
+    index->entries[index->count].time = time;
+    index->count++;
+}
+
+/*
+ * Function: removeDir
+ * -------------------
+ * Removes a directory from an index (the last directory takes its place)
+ *
+ *  index:   The index
+ *  pos:     The position of the directory
+ */
+void removeDir(pDirIndex_t index, int pos)
+{
+    free(index->entries[pos].path);
+    index->entries[pos] = index->entries[index->count - 1];
+    index->count--;
+}
+
+/*
+ * Function: frecency
+ * ------------------
+ *  Returns: The rank of a directory, weighted by the time since its last visit
+ */
+double frecency(pDirEntry_t entry, long long now)
+{
+    long long age = now - entry->time;
+
+    if (age < HOUR)
+        return entry->rank * 4;
+    if (age < DAY)
+        return entry->rank * 2;
+    if (age < WEEK)
+        return entry->rank / 2;
+
+    return entry->rank / 4;
+}
+
+/*
+ * Function: matchFragments
+ * ------------------------
+ * Checks that fragments appear in a path in the given order, the last one in the last component of the path
+ *
+ *  path:       The path
+ *  fragments:  The fragments
+ *  count:      The number of fragments
+ *  ignoreCase: 1 to ignore the case of the fragments
+ *
+ *  Returns: 1 if the path matches the fragments, 0 otherwise
+ */
+int matchFragments(const char *path, char **fragments, int count, int ignoreCase)
+{
+    const char *base = strrchr(path, '/') + 1;
+    const char *pos = path;
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *found = ignoreCase ? strcasestr(pos, fragments[i]) : strstr(pos, fragments[i]);
+
+        if (found == NULL)
+            return 0;
+
+        if (i == count - 1 && strchr(fragments[i], '/') == NULL)
+        {
+            // The last fragment names the directory itself
+            if (found < base && (ignoreCase ? strcasestr(base, fragments[i]) : strstr(base, fragments[i])) == NULL)
+                return 0;
+        }
+        pos = found + strlen(fragments[i]);
+    }
+
+    return 1;
+}
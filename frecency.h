@@ -0,0 +1,54 @@
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#define DIRS_MAX 500        // The number of directories kept in the index (the least frecent ones are forgotten)
+#define DIRS_MAX_RANK 5000  // Above this total rank, every rank is aged (the ones falling below 1 are forgotten)
+#define DIRS_AGING 0.9      // The factor applied to every rank when the index is aged
+
+/*
+ * Structure: dirEntry
+ * -------------------
+ * A directory of the index
+ *
+ *  path: The absolute path of the directory
+ *  rank: Grows by one at each visit, shrinks when the index is aged
+ *  time: The time of the last visit (seconds since the Epoch)
+ */
+typedef struct dirEntry
+{
+    char *path;
+    double rank;
+    long long time;
+} dirEntry_t, *pDirEntry_t;
+
+/*
+ * Structure: dirIndex
+ * -------------------
+ * The frecency index of the visited directories, and the file it is kept in
+ *
+ *  entries:   The directories
+ *  count:     The number of directories
+ *  capacity:  The number of directories the array can hold
+ *  file:      The index file (NULL for an index which is not saved)
+ *  mtimeSec:  The modification time of the file when it was last read or written
+ *  mtimeNsec: (other Shells may have changed it since: it is read again before being used)
+ */
+typedef struct dirIndex
+{
+    pDirEntry_t entries;
+    int count;
+    int capacity;
+    char *file;
+    long long mtimeSec;
+    long long mtimeNsec;
+} dirIndex_t, *pDirIndex_t;
+
+pDirIndex_t loadDirIndex(const char *file);
+void refreshDirIndex(pDirIndex_t index);
+void visitDir(pDirIndex_t index, const char *path, long long now);
+void forgetDir(pDirIndex_t index, const char *path);
+const char *matchDir(pDirIndex_t index, char **fragments, int count, const char *exclude, long long now);
+int saveDirIndex(pDirIndex_t index);
+void freeDirIndex(pDirIndex_t index);
+
+#endif
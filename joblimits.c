@@ -0,0 +1,499 @@
+/*
+    Resource limits of the jobs launched by QuYsh.
+    Limits are applied with setrlimit(2) in every stage of a job and, when a cgroup v2 hierarchy
+    with the cpu and memory controllers is writable, by placing the whole job in its own cgroup.
+    A cgroup which holds processes cannot give controllers to its children (unless it is the root):
+    the Shell first moves into a leaf of its own, and the job cgroups are created next to it.
+        <cgroup of the Shell>/quysh-<pid>/shell     the Shell
+        <cgroup of the Shell>/quysh-<pid>/job-<n>   a limited job
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "joblimits.h"
+
+#define CGROUP_PATH_LEN 4096
+#define CPU_PERIOD_US 100000 // Period of the cgroup CPU bandwidth controller
+
+/* State of the cgroup v2 hierarchy */
+#define CGROUP_UNKNOWN 0     // Not probed yet
+#define CGROUP_AVAILABLE 1   // Job cgroups can be created
+#define CGROUP_UNAVAILABLE 2 // No writable cgroup v2 hierarchy with the cpu and memory controllers
+
+int cgroupState = CGROUP_UNKNOWN;
+char cgroupHome[CGROUP_PATH_LEN]; // The cgroup the Shell was started in
+char cgroupBase[CGROUP_PATH_LEN]; // The cgroup of the Shell and of its jobs, created in cgroupHome
+int cgroupSerial = 0;             // Makes the names of job cgroups unique
+
+long long parseSize(char *value);
+int probeCgroup();
+void leaveCgroup();
+int writeFile(char *path, char *value);
+
+/*
+ * Function: clearLimits
+ * ---------------------
+ * Removes all the limits of a set of limits
+ *
+ *  limits: The set of limits
+ */
+void clearLimits(pJobLimits_t limits)
+{
+    limits->memBytes = LIMIT_NONE;
+    limits->cpuPercent = LIMIT_NONE;
+    limits->cpuSeconds = LIMIT_NONE;
+    limits->fileSize = LIMIT_NONE;
+    limits->files = LIMIT_NONE;
+}
+
+/*
+ * Function: hasLimits
+ * -------------------
+ * Checks whether at least one resource is limited
+ *
+ *  limits: The set of limits
+ *
+ *  Returns: 1 if a resource is limited, 0 otherwise
+ */
+int hasLimits(pJobLimits_t limits)
+{
+    return limits->memBytes != LIMIT_NONE || limits->cpuPercent != LIMIT_NONE || limits->cpuSeconds != LIMIT_NONE ||
+           limits->fileSize != LIMIT_NONE || limits->files != LIMIT_NONE;
+}
+
+/*
+ * Function: mergeLimits
+ * ---------------------
+ * Completes a set of limits with default values for the resources it does not limit
+ *
+ *  limits:   The set of limits to complete
+ *  defaults: The default limits
+ */
+void mergeLimits(pJobLimits_t limits, pJobLimits_t defaults)
+{
+    if (limits->memBytes == LIMIT_NONE)
+        limits->memBytes = defaults->memBytes;
+    if (limits->cpuPercent == LIMIT_NONE)
+        limits->cpuPercent = defaults->cpuPercent;
+    if (limits->cpuSeconds == LIMIT_NONE)
+        limits->cpuSeconds = defaults->cpuSeconds;
+    if (limits->fileSize == LIMIT_NONE)
+        limits->fileSize = defaults->fileSize;
+    if (limits->files == LIMIT_NONE)
+        limits->files = defaults->files;
+}
+
+/*
+ * Function: parseLimit
+ * --------------------
+ * Parses a limit given as "resource=value" and stores it in a set of limits
+ * Known resources: mem=SIZE, cpu=PERCENT%, time=SECONDS, fsize=SIZE, files=COUNT
+ * SIZE accepts the K, M, G and T suffixes, and "none" removes the limit
+ *
+ *  word:    The limit to parse
+ *  limits:  The set of limits receiving the value
+ *
+ *  Returns: 1 if the word is a valid limit
+ *           0 if the word is not a limit (no '=' or unknown resource)
+ *           -1 if the value of the limit is invalid
+ */
+int parseLimit(char *word, pJobLimits_t limits)
+{
+    char *value = strchr(word, '=');
+    long long *target;
+    long long parsed;
+    char *end;
+
+    if (value == NULL)
+        return 0;
+
+    int keyLen = value - word;
+    value++;
+
+    if (keyLen == 3 && strncmp(word, "mem", 3) == 0)
+        target = &(limits->memBytes);
+    else if (keyLen == 3 && strncmp(word, "cpu", 3) == 0)
+        target = &(limits->cpuPercent);
+    else if (keyLen == 4 && strncmp(word, "time", 4) == 0)
+        target = &(limits->cpuSeconds);
+    else if (keyLen == 5 && strncmp(word, "fsize", 5) == 0)
+        target = &(limits->fileSize);
+    else if (keyLen == 5 && strncmp(word, "files", 5) == 0)
+        target = &(limits->files);
+    else
+        return 0;
+
+    if (strcmp(value, "none") == 0)
+    {
+        *target = LIMIT_NONE;
+        return 1;
+    }
+
+    if (target == &(limits->memBytes) || target == &(limits->fileSize))
+    {
+        parsed = parseSize(value);
+    }
+    else
+    {
+        parsed = strtoll(value, &end, 10);
+        if (end == value || (*end != '\0' && !(target == &(limits->cpuPercent) && strcmp(end, "%") == 0)))
+            parsed = -1;
+    }
+
+    if (parsed <= 0)
+        return -1;
+
+    *target = parsed;
+    return 1;
+}
+
+/*
+ * Function: parseSize
+ * -------------------
+ * Parses a size such as "4096", "512K", "1.5G"
+ *
+ *  value:   The size to parse
+ *
+ *  Returns: The size in bytes, -1 if the size is invalid
+ */
+long long parseSize(char *value)
+{
+    char *end;
+    double size = strtod(value, &end);
+
+    if (end == value)
+        return -1;
+
+    switch (*end)
+    {
+    case 'T':
+    case 't':
+        size *= 1024;
+        // fall through
+    case 'G':
+    case 'g':
+        size *= 1024;
+        // fall through
+    case 'M':
+    case 'm':
+        size *= 1024;
+        // fall through
+    case 'K':
+    case 'k':
+        size *= 1024;
+        end++;
+        break;
+    }
+
+    if (*end != '\0' && strcmp(end, "B") != 0)
+        return -1;
+
+    return (long long)size;
+}
+
+/*
+ * Function: formatLimits
+ * ----------------------
+ * Formats a set of limits as "mem=1.0G cpu=50% time=60s" (only the limited resources are listed)
+ *
+ *  limits:    The set of limits
+ *  buffer:    The buffer receiving the formatted string
+ *  bufferLen: The size of the buffer
+ */
+void formatLimits(pJobLimits_t limits, char *buffer, int bufferLen)
+{
+    int len = 0;
+
+    buffer[0] = '\0';
+
+    if (limits->memBytes >= 1073741824LL)
+        len += snprintf(buffer + len, bufferLen - len, "mem=%.1fG ", limits->memBytes / 1073741824.0);
+    else if (limits->memBytes != LIMIT_NONE)
+        len += snprintf(buffer + len, bufferLen - len, "mem=%.1fM ", limits->memBytes / 1048576.0);
+    if (limits->cpuPercent != LIMIT_NONE && len < bufferLen)
+        len += snprintf(buffer + len, bufferLen - len, "cpu=%lld%% ", limits->cpuPercent);
+    if (limits->cpuSeconds != LIMIT_NONE && len < bufferLen)
+        len += snprintf(buffer + len, bufferLen - len, "time=%llds ", limits->cpuSeconds);
+    if (limits->fileSize != LIMIT_NONE && len < bufferLen)
+        len += snprintf(buffer + len, bufferLen - len, "fsize=%.1fM ", limits->fileSize / 1048576.0);
+    if (limits->files != LIMIT_NONE && len < bufferLen)
+        len += snprintf(buffer + len, bufferLen - len, "files=%lld ", limits->files);
+
+    // Removes the trailing space
+    if (len > 0 && len <= bufferLen)
+        buffer[len - 1] = '\0';
+}
+
+/*
+ * Function: createJobCgroup
+ * -------------------------
+ * Creates a cgroup enforcing the memory and CPU bandwidth limits of a job
+ *
+ *  limits:  The limits of the job
+ *
+ *  Returns: The path of the newly created cgroup (must be freed by removeJobCgroup)
+ *           NULL if the job has no memory or CPU limit, or if no cgroup could be created
+ */
+char *createJobCgroup(pJobLimits_t limits)
+{
+    char file[CGROUP_PATH_LEN + 64];
+    char value[64];
+    char *cgroup;
+
+    if (limits->memBytes == LIMIT_NONE && limits->cpuPercent == LIMIT_NONE)
+        return NULL;
+
+    if (!probeCgroup())
+        return NULL;
+
+    cgroup = (char *)malloc((CGROUP_PATH_LEN + 32) * sizeof(char));
+    snprintf(cgroup, CGROUP_PATH_LEN + 32, "%s/job-%d", cgroupBase, ++cgroupSerial);
+
+    if (mkdir(cgroup, 0755) == -1)
+    {
+        free(cgroup);
+        return NULL;
+    }
+
+    if (limits->memBytes != LIMIT_NONE)
+    {
+        snprintf(file, sizeof(file), "%s/memory.max", cgroup);
+        snprintf(value, sizeof(value), "%lld", limits->memBytes);
+        if (writeFile(file, value) == -1)
+        {
+            removeJobCgroup(cgroup);
+            return NULL;
+        }
+    }
+
+    if (limits->cpuPercent != LIMIT_NONE)
+    {
+        snprintf(file, sizeof(file), "%s/cpu.max", cgroup);
+        snprintf(value, sizeof(value), "%lld %d", limits->cpuPercent * CPU_PERIOD_US / 100, CPU_PERIOD_US);
+        if (writeFile(file, value) == -1)
+        {
+            removeJobCgroup(cgroup);
+            return NULL;
+        }
+    }
+
+    return cgroup;
+}
+
+/*
+ * Function: removeJobCgroup
+ * -------------------------
+ * Removes the cgroup of a job once all of its processes have been reaped
+ *
+ *  cgroup:  The path of the cgroup (may be NULL)
+ */
+void removeJobCgroup(char *cgroup)
+{
+    if (cgroup == NULL)
+        return;
+
+    rmdir(cgroup);
+    free(cgroup);
+}
+
+/*
+ * Function: releaseCgroup
+ * -----------------------
+ * Moves the Shell back to the cgroup it was started in, and removes its own cgroups
+ * (those of jobs which are still running, and of the children left in its leaf, are kept)
+ */
+void releaseCgroup()
+{
+    if (cgroupState == CGROUP_AVAILABLE)
+        leaveCgroup();
+
+    cgroupState = CGROUP_UNKNOWN;
+}
+
+/*
+ * Function: applyLimits
+ * ---------------------
+ * Applies the limits of a job to the calling process. Must be called in the child, before execve
+ *
+ *  limits:  The limits of the job
+ *  cgroup:  The cgroup of the job, NULL if the job has none
+ */
+void applyLimits(pJobLimits_t limits, char *cgroup)
+{
+    struct rlimit rlim;
+    char file[CGROUP_PATH_LEN + 64];
+
+    if (cgroup != NULL)
+    {
+        // Writing 0 moves the writing process itself
+        snprintf(file, sizeof(file), "%s/cgroup.procs", cgroup);
+        if (writeFile(file, "0") == -1)
+            cgroup = NULL;
+    }
+
+    // Without cgroup, the address space is the closest per-process memory limit
+    if (limits->memBytes != LIMIT_NONE && cgroup == NULL)
+    {
+        rlim.rlim_cur = rlim.rlim_max = limits->memBytes;
+        setrlimit(RLIMIT_AS, &rlim);
+    }
+
+    if (limits->cpuSeconds != LIMIT_NONE)
+    {
+        rlim.rlim_cur = rlim.rlim_max = limits->cpuSeconds;
+        setrlimit(RLIMIT_CPU, &rlim);
+    }
+
+    if (limits->fileSize != LIMIT_NONE)
+    {
+        rlim.rlim_cur = rlim.rlim_max = limits->fileSize;
+        setrlimit(RLIMIT_FSIZE, &rlim);
+    }
+
+    if (limits->files != LIMIT_NONE)
+    {
+        rlim.rlim_cur = rlim.rlim_max = limits->files;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+}
+
+/*
+ * Function: probeCgroup
+ * ---------------------
+ * Looks for the cgroup v2 hierarchy and the cgroup of the Shell, moves the Shell into the leaf of its own cgroup,
+ * and enables the cpu and memory controllers for the job cgroups. The result is computed once
+ *
+ *  Returns: 1 if job cgroups can be created, 0 otherwise
+ */
+int probeCgroup()
+{
+    char line[CGROUP_PATH_LEN];
+    char mountPoint[CGROUP_PATH_LEN] = "";
+    char file[CGROUP_PATH_LEN + 32];
+    char pid[32];
+    FILE *stream;
+
+    if (cgroupState != CGROUP_UNKNOWN)
+        return cgroupState == CGROUP_AVAILABLE;
+
+    cgroupState = CGROUP_UNAVAILABLE;
+
+    // The cgroup2 filesystem may be mounted on /sys/fs/cgroup or elsewhere (ex: /sys/fs/cgroup/unified)
+    stream = fopen("/proc/self/mounts", "r");
+    if (stream == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), stream) != NULL)
+    {
+        char device[64], dir[CGROUP_PATH_LEN], type[64];
+        if (sscanf(line, "%63s %4095s %63s", device, dir, type) == 3 && strcmp(type, "cgroup2") == 0)
+        {
+            strcpy(mountPoint, dir);
+            break;
+        }
+    }
+    fclose(stream);
+
+    if (mountPoint[0] == '\0')
+        return 0;
+
+    // In /proc/self/cgroup, the cgroup v2 line is "0::/path"
+    stream = fopen("/proc/self/cgroup", "r");
+    if (stream == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), stream) != NULL)
+    {
+        if (strncmp(line, "0::", 3) == 0)
+        {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(cgroupHome, CGROUP_PATH_LEN, "%s%s", mountPoint, strcmp(line + 3, "/") == 0 ? "" : line + 3);
+            break;
+        }
+    }
+    fclose(stream);
+
+    if (cgroupHome[0] == '\0')
+        return 0;
+
+    // The Shell leaves its cgroup (shared with the processes of the session) for a leaf which holds it alone
+    snprintf(cgroupBase, CGROUP_PATH_LEN, "%.4000s/quysh-%d", cgroupHome, getpid());
+    snprintf(file, sizeof(file), "%s/shell", cgroupBase);
+    if (mkdir(cgroupBase, 0755) == -1 || mkdir(file, 0755) == -1)
+    {
+        rmdir(cgroupBase);
+        return 0;
+    }
+
+    snprintf(file, sizeof(file), "%s/shell/cgroup.procs", cgroupBase);
+    snprintf(pid, sizeof(pid), "%d", getpid());
+    if (writeFile(file, pid) == -1)
+    {
+        leaveCgroup();
+        return 0;
+    }
+
+    // The controllers reach the job cgroups through the former cgroup of the Shell: they may already be enabled there
+    // (delegation), or be enabled now that the Shell has left it, unless other processes remain in it
+    snprintf(file, sizeof(file), "%s/cgroup.subtree_control", cgroupHome);
+    writeFile(file, "+memory +cpu");
+
+    // The cgroup of the Shell only has children: it can give them its controllers if it has received them
+    snprintf(file, sizeof(file), "%s/cgroup.subtree_control", cgroupBase);
+    if (writeFile(file, "+memory +cpu") == -1)
+    {
+        leaveCgroup();
+        return 0;
+    }
+
+    cgroupState = CGROUP_AVAILABLE;
+    return 1;
+}
+
+/*
+ * Function: leaveCgroup
+ * ---------------------
+ * Moves the Shell back to the cgroup it was started in, and removes its leaf and its cgroup if they are empty
+ */
+void leaveCgroup()
+{
+    char file[CGROUP_PATH_LEN + 32];
+    char pid[32];
+
+    snprintf(file, sizeof(file), "%s/cgroup.procs", cgroupHome);
+    snprintf(pid, sizeof(pid), "%d", getpid());
+    writeFile(file, pid);
+
+    snprintf(file, sizeof(file), "%s/shell", cgroupBase);
+    rmdir(file);
+    rmdir(cgroupBase);
+}
+
+/*
+ * Function: writeFile
+ * -------------------
+ * Writes a value into a (cgroup) file
+ *
+ *  path:    The path of the file
+ *  value:   The value to write
+ *
+ *  Returns: 0 if the value was written, -1 otherwise
+ */
+int writeFile(char *path, char *value)
+{
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    int len = strlen(value);
+    int res;
+
+    if (fd == -1)
+        return -1;
+
+    res = write(fd, value, len);
+    close(fd);
+
+    return (res == len) ? 0 : -1;
+}
@@ -0,0 +1,37 @@
+#ifndef JOBLIMITS_H
+#define JOBLIMITS_H
+
+#define LIMIT_NONE -1 // The resource is not limited
+
+/*
+ * Structure: jobLimits
+ * --------------------
+ * The resource limits applied to every stage of a job
+ *
+ *  memBytes:   The maximum amount of memory (cgroup memory.max, or RLIMIT_AS without cgroup)
+ *  cpuPercent: The maximum CPU bandwidth in percent of one core (cgroup cpu.max only)
+ *  cpuSeconds: The maximum CPU time of each process (RLIMIT_CPU)
+ *  fileSize:   The maximum size of a file written by a process (RLIMIT_FSIZE)
+ *  files:      The maximum number of open file descriptors of each process (RLIMIT_NOFILE)
+ */
+typedef struct jobLimits
+{
+    long long memBytes;
+    long long cpuPercent;
+    long long cpuSeconds;
+    long long fileSize;
+    long long files;
+} jobLimits_t, *pJobLimits_t;
+
+void clearLimits(pJobLimits_t limits);
+int hasLimits(pJobLimits_t limits);
+void mergeLimits(pJobLimits_t limits, pJobLimits_t defaults);
+int parseLimit(char *word, pJobLimits_t limits);
+void formatLimits(pJobLimits_t limits, char *buffer, int bufferLen);
+
+char *createJobCgroup(pJobLimits_t limits);
+void removeJobCgroup(char *cgroup);
+void releaseCgroup();
+void applyLimits(pJobLimits_t limits, char *cgroup);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef LIBQUYSH_H
+#define LIBQUYSH_H
+
+/*
+    libquysh: the QuYsh Shell as a library, to run command lines from a C program without spawning /bin/sh.
+    A context keeps its state between calls (command cache, "$?", background jobs, variables, current directory),
+    and can capture the outputs of its commands. A context starts with a copy of the environment and of the current
+    directory of the program: neither is changed by the commands it runs.
+    Contexts are independent, but they must not run at the same time (from several threads).
+    The Shell only waits for the processes of its own jobs: the other children of the program are left to it.
+*/
+
+#include <stddef.h>
+
+/* Results of quysh_run */
+#define QUYSH_OK 0    // The command line has run
+#define QUYSH_ERROR 1 // The last command could not run (syntax error, invalid arguments of a builtin, ...)
+#define QUYSH_EXIT 2  // The "exit" builtin has been run
+
+typedef struct quyshCtx quyshCtx_t, *pQuyshCtx_t;
+
+/*
+ * Type: quyshOutput
+ * -----------------
+ * A callback receiving the output of the commands of a context
+ *
+ *  data:     The bytes written by the commands
+ *  len:      The number of bytes
+ *  userData: The pointer given to quysh_set_output
+ */
+typedef void (*quyshOutput_t)(const char *data, size_t len, void *userData);
+
+pQuyshCtx_t quysh_ctx_new();
+void quysh_ctx_free(pQuyshCtx_t ctx);
+void quysh_set_output(pQuyshCtx_t ctx, quyshOutput_t output, quyshOutput_t error, void *userData);
+int quysh_run(pQuyshCtx_t ctx, const char *line, int *status);
+void quysh_interact(pQuyshCtx_t ctx);
+
+#endif
@@ -0,0 +1,684 @@
+/*
+    Line editor of QuYsh: reads a command line from a terminal in raw mode, with editing keys and a history.
+    Every key only sends the escape sequences needed to update what changed on the screen (never the prompt
+    and the whole line again), and all the output of the keys read at once is sent with a single write.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "lineedit.h"
+
+#define EDIT_INPUT_LEN 256 // The largest number of bytes read from the terminal at once
+#define ESCAPE_DELAY 50    // Milliseconds to wait for the rest of an escape sequence after ESC
+
+/* Keys which are not characters */
+#define KEY_NONE -2
+#define KEY_EOF -1
+#define KEY_UP 1000
+#define KEY_DOWN 1001
+#define KEY_RIGHT 1002
+#define KEY_LEFT 1003
+#define KEY_HOME 1004
+#define KEY_END 1005
+#define KEY_DELETE 1006
+
+#define CONTROL_KEY(c) ((c) & 0x1f)
+#define IS_CONTINUATION(c) (((unsigned char)(c) & 0xc0) == 0x80) // Continuation byte of a UTF-8 character
+
+/*
+ * Structure: lineEditor
+ * ---------------------
+ * The state of the line being edited
+ *
+ *  line:        The line (not null-terminated)
+ *  len:         The length of the line in bytes
+ *  capacity:    The number of bytes allocated for the line
+ *  cursor:      The position of the cursor in the line (in bytes)
+ *  out:         The output waiting to be written to the terminal
+ *  outLen:      The length of the output
+ *  outCapacity: The number of bytes allocated for the output
+ *  in:          The bytes read from the terminal
+ *  inLen:       The number of bytes read
+ *  inPos:       The position of the next byte to decode
+ *  historyPos:  The entry of the history being displayed (historyLen for the new line)
+ *  saved:       The new line, saved while an entry of the history is displayed
+ */
+typedef struct lineEditor
+{
+    char *line;
+    size_t len;
+    size_t capacity;
+    size_t cursor;
+    char *out;
+    size_t outLen;
+    size_t outCapacity;
+    unsigned char in[EDIT_INPUT_LEN];
+    int inLen;
+    int inPos;
+    int historyPos;
+    char *saved;
+} lineEditor_t, *pLineEditor_t;
+
+/* History: a ring of the last HISTORY_MAX lines */
+char *history[HISTORY_MAX];
+int historyStart = 0;
+int historyLen = 0;
+
+int readByte(pLineEditor_t editor, int wait);
+int readKey(pLineEditor_t editor, char *utf8, int *utf8Len);
+void emit(pLineEditor_t editor, const char *text, size_t len);
+void emitMove(pLineEditor_t editor, size_t from, size_t to);
+void flushOutput(pLineEditor_t editor);
+size_t columns(const char *text, size_t from, size_t to);
+size_t previousChar(pLineEditor_t editor, size_t pos);
+size_t nextChar(pLineEditor_t editor, size_t pos);
+void insertText(pLineEditor_t editor, const char *text, size_t len);
+void deleteRange(pLineEditor_t editor, size_t from, size_t to);
+void replaceLine(pLineEditor_t editor, const char *text);
+void browseHistory(pLineEditor_t editor, int pos);
+
+/*
+ * Function: editLine
+ * ------------------
+ * Reads a line from the terminal (standard input) in raw mode. The prompt has already been printed
+ * Keys: arrows, Home/End (Ctrl-A/E), Delete, Backspace, Ctrl-B/F (left/right), Ctrl-P/N (history),
+ *       Ctrl-K (kill to the end), Ctrl-U (kill to the start), Ctrl-W (kill the previous word),
+ *       Ctrl-C (discard the line), Ctrl-D (end of input on an empty line)
+ *
+ *  arena:   The arena from which the line is allocated (malloc is used if it is NULL)
+ *
+ *  Returns: The line (without its newline), NULL at the end of the input
+ */
+char *editLine(pArena_t arena)
+{
+    static lineEditor_t editor;
+    struct termios cooked;
+    struct termios raw;
+    int done = 0;
+    char *result;
+
+    if (tcgetattr(STDIN_FILENO, &cooked) == -1)
+        return NULL;
+
+    // Output processing is kept: '\n' is still sent as "\r\n"
+    raw = cooked;
+    raw.c_iflag &= ~(ICRNL | IXON | BRKINT | ISTRIP | INPCK);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+    editor.len = 0;
+    editor.cursor = 0;
+    editor.outLen = 0;
+    editor.inLen = 0;
+    editor.inPos = 0;
+    editor.historyPos = historyLen;
+    editor.saved = NULL;
+
+    while (!done)
+    {
+        char utf8[4];
+        int utf8Len = 0;
+        int key = readKey(&editor, utf8, &utf8Len);
+
+        switch (key)
+        {
+        case KEY_EOF:
+            done = -1;
+            break;
+        case '\r':
+        case '\n':
+            emit(&editor, "\n", 1);
+            done = 1;
+            break;
+        case CONTROL_KEY('C'):
+            emit(&editor, "^C\n", 3);
+            editor.len = 0;
+            done = 1;
+            break;
+        case CONTROL_KEY('D'):
+            if (editor.len == 0)
+            {
+                emit(&editor, "\n", 1);
+                done = -1;
+            }
+            else if (editor.cursor < editor.len)
+            {
+                deleteRange(&editor, editor.cursor, nextChar(&editor, editor.cursor));
+            }
+            break;
+        case KEY_DELETE:
+            if (editor.cursor < editor.len)
+                deleteRange(&editor, editor.cursor, nextChar(&editor, editor.cursor));
+            break;
+        case 127:
+        case CONTROL_KEY('H'):
+            if (editor.cursor > 0)
+                deleteRange(&editor, previousChar(&editor, editor.cursor), editor.cursor);
+            break;
+        case KEY_LEFT:
+        case CONTROL_KEY('B'):
+            if (editor.cursor > 0)
+            {
+                size_t pos = previousChar(&editor, editor.cursor);
+                emitMove(&editor, editor.cursor, pos);
+                editor.cursor = pos;
+            }
+            break;
+        case KEY_RIGHT:
+        case CONTROL_KEY('F'):
+            if (editor.cursor < editor.len)
+            {
+                size_t pos = nextChar(&editor, editor.cursor);
+                emitMove(&editor, editor.cursor, pos);
+                editor.cursor = pos;
+            }
+            break;
+        case KEY_HOME:
+        case CONTROL_KEY('A'):
+            emitMove(&editor, editor.cursor, 0);
+            editor.cursor = 0;
+            break;
+        case KEY_END:
+        case CONTROL_KEY('E'):
+            emitMove(&editor, editor.cursor, editor.len);
+            editor.cursor = editor.len;
+            break;
+        case CONTROL_KEY('K'):
+            deleteRange(&editor, editor.cursor, editor.len);
+            break;
+        case CONTROL_KEY('U'):
+            deleteRange(&editor, 0, editor.cursor);
+            break;
+        case CONTROL_KEY('W'):
+        {
+            size_t pos = editor.cursor;
+
+            while (pos > 0 && editor.line[pos - 1] == ' ')
+                pos--;
+            while (pos > 0 && editor.line[pos - 1] != ' ')
+                pos--;
+            deleteRange(&editor, pos, editor.cursor);
+            break;
+        }
+        case KEY_UP:
+        case CONTROL_KEY('P'):
+            browseHistory(&editor, editor.historyPos - 1);
+            break;
+        case KEY_DOWN:
+        case CONTROL_KEY('N'):
+            browseHistory(&editor, editor.historyPos + 1);
+            break;
+        default:
+            if (utf8Len > 0)
+                insertText(&editor, utf8, utf8Len);
+            break;
+        }
+    }
+
+    flushOutput(&editor);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &cooked);
+    free(editor.saved);
+    editor.saved = NULL;
+
+    if (done == -1)
+        return NULL;
+
+    result = (arena != NULL) ? (char *)arenaAlloc(arena, editor.len + 1) : (char *)malloc(editor.len + 1);
+    memcpy(result, editor.line, editor.len);
+    result[editor.len] = '\0';
+
+    return result;
+}
+
+/*
+ * Function: addHistory
+ * --------------------
+ * Adds a line to the history, unless it is empty or the same as the last one
+ * The oldest line is forgotten once the history holds HISTORY_MAX lines
+ *
+ *  line:    The line to add
+ */
+void addHistory(const char *line)
+{
+    int last = (historyStart + historyLen - 1) % HISTORY_MAX;
+
+    if (line[0] == '\0' || (historyLen > 0 && strcmp(history[last], line) == 0))
+        return;
+
+    if (historyLen == HISTORY_MAX)
+    {
+        free(history[historyStart]);
+        history[historyStart] = strdup(line);
+        historyStart = (historyStart + 1) % HISTORY_MAX;
+    }
+    else
+    {
+        history[(historyStart + historyLen) % HISTORY_MAX] = strdup(line);
+        historyLen++;
+    }
+}
+
+/*
+ * Function: historyCount
+ * ----------------------
+ *  Returns: The number of lines of the history
+ */
+int historyCount()
+{
+    return historyLen;
+}
+
+/*
+ * Function: historyEntry
+ * ----------------------
+ * Returns a line of the history
+ *
+ *  index:   The index of the line, from 0 (the oldest) to historyCount() - 1 (the most recent)
+ *
+ *  Returns: The line
+ */
+const char *historyEntry(int index)
+{
+    return history[(historyStart + index) % HISTORY_MAX];
+}
+
+/*
+ * Function: readByte
+ * ------------------
+ * Returns the next byte typed on the terminal
+ * The pending output is written before blocking, so all the keys read at once are answered by a single write
+ *
+ *  editor:  The line editor
+ *  wait:    -1 to wait as long as needed, or the number of milliseconds to wait for a byte
+ *
+ *  Returns: The byte, KEY_NONE if none came in time, KEY_EOF at the end of the input
+ */
+int readByte(pLineEditor_t editor, int wait)
+{
+    if (editor->inPos == editor->inLen)
+    {
+        int res;
+
+        flushOutput(editor);
+
+        if (wait >= 0)
+        {
+            struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+
+            if (poll(&input, 1, wait) <= 0)
+                return KEY_NONE;
+        }
+
+        do
+            res = read(STDIN_FILENO, editor->in, EDIT_INPUT_LEN);
+        while (res == -1 && errno == EINTR);
+
+        if (res <= 0)
+            return KEY_EOF;
+
+        editor->inLen = res;
+        editor->inPos = 0;
+    }
+
+    return editor->in[editor->inPos++];
+}
+
+/*
+ * Function: readKey
+ * -----------------
+ * Decodes the next key typed on the terminal: escape sequences become KEY_* codes,
+ * characters are gathered whole (all the bytes of a UTF-8 character)
+ *
+ *  editor:  The line editor
+ *  utf8:    Receives the bytes of a character
+ *  utf8Len: Receives the number of bytes of the character (0 if the key is not a character)
+ *
+ *  Returns: The key
+ */
+int readKey(pLineEditor_t editor, char *utf8, int *utf8Len)
+{
+    int c = readByte(editor, -1);
+    int expected;
+
+    *utf8Len = 0;
+
+    if (c == 27)
+    {
+        int kind = readByte(editor, ESCAPE_DELAY);
+        int param = 0;
+
+        if (kind != '[' && kind != 'O')
+            return KEY_NONE;
+
+        c = readByte(editor, ESCAPE_DELAY);
+        while (c >= '0' && c <= '9')
+        {
+            param = param * 10 + c - '0';
+            c = readByte(editor, ESCAPE_DELAY);
+        }
+        while (c == ';' || (c >= '0' && c <= '9')) // Modifiers are ignored
+            c = readByte(editor, ESCAPE_DELAY);
+
+        switch (c)
+        {
+        case 'A':
+            return KEY_UP;
+        case 'B':
+            return KEY_DOWN;
+        case 'C':
+            return KEY_RIGHT;
+        case 'D':
+            return KEY_LEFT;
+        case 'H':
+            return KEY_HOME;
+        case 'F':
+            return KEY_END;
+        case '~':
+            if (param == 1 || param == 7)
+                return KEY_HOME;
+            if (param == 4 || param == 8)
+                return KEY_END;
+            if (param == 3)
+                return KEY_DELETE;
+            return KEY_NONE;
+        default:
+            return KEY_NONE;
+        }
+    }
+
+    if (c < 32 || c == 127)
+        return c;
+
+    // A UTF-8 character is inserted once all of its bytes have been read
+    utf8[0] = c;
+    expected = (c >= 0xf0) ? 4 : (c >= 0xe0) ? 3 : (c >= 0xc0) ? 2 : 1;
+    for (*utf8Len = 1; *utf8Len < expected; (*utf8Len)++)
+    {
+        int next = readByte(editor, -1);
+
+        if (next < 0 || !IS_CONTINUATION(next))
+            break;
+        utf8[*utf8Len] = next;
+    }
+
+    return c;
+}
+
+/*
+ * Function: emit
+ * --------------
+ * Appends bytes to the output waiting to be written to the terminal
+ *
+ *  editor:  The line editor
+ *  text:    The bytes
+ *  len:     The number of bytes
+ */
+void emit(pLineEditor_t editor, const char *text, size_t len)
+{
+    if (editor->outLen + len > editor->outCapacity)
+    {
+        while (editor->outLen + len > editor->outCapacity)
+            editor->outCapacity = (editor->outCapacity == 0) ? 256 : editor->outCapacity * 2;
+        editor->out = (char *)realloc(editor->out, editor->outCapacity);
+    }
+
+    memcpy(editor->out + editor->outLen, text, len);
+    editor->outLen += len;
+}
+
+/*
+ * Function: emitMove
+ * ------------------
+ * Moves the cursor of the terminal from one position of the line to another with the shortest output:
+ * backspaces or the characters themselves for short moves, a CUB/CUF sequence otherwise
+ *
+ *  editor:  The line editor
+ *  from:    The current position (in bytes)
+ *  to:      The new position (in bytes)
+ */
+void emitMove(pLineEditor_t editor, size_t from, size_t to)
+{
+    char sequence[32];
+    size_t cols;
+    int len;
+
+    if (to < from)
+    {
+        cols = columns(editor->line, to, from);
+        len = snprintf(sequence, sizeof(sequence), "\x1b[%zuD", cols);
+        if (cols <= (size_t)len)
+        {
+            for (size_t i = 0; i < cols; i++)
+                emit(editor, "\b", 1);
+            return;
+        }
+        emit(editor, sequence, len);
+    }
+    else if (to > from)
+    {
+        cols = columns(editor->line, from, to);
+        len = snprintf(sequence, sizeof(sequence), "\x1b[%zuC", cols);
+        if (to - from <= (size_t)len)
+        {
+            emit(editor, editor->line + from, to - from);
+            return;
+        }
+        emit(editor, sequence, len);
+    }
+}
+
+/*
+ * Function: flushOutput
+ * ---------------------
+ * Writes the pending output to the terminal with a single write
+ *
+ *  editor:  The line editor
+ */
+void flushOutput(pLineEditor_t editor)
+{
+    size_t written = 0;
+
+    while (written < editor->outLen)
+    {
+        ssize_t res = write(STDOUT_FILENO, editor->out + written, editor->outLen - written);
+
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        written += res;
+    }
+
+    editor->outLen = 0;
+}
+
+/*
+ * Function: columns
+ * -----------------
+ * Counts the characters of a part of a text (each character is assumed to take one column)
+ *
+ *  text:    The text
+ *  from:    The start of the part (in bytes)
+ *  to:      The end of the part (in bytes)
+ *
+ *  Returns: The number of characters
+ */
+size_t columns(const char *text, size_t from, size_t to)
+{
+    size_t cols = 0;
+
+    for (size_t i = from; i < to; i++)
+        if (!IS_CONTINUATION(text[i]))
+            cols++;
+
+    return cols;
+}
+
+/*
+ * Function: previousChar
+ * ----------------------
+ *  Returns: The position of the character before a position of the line
+ */
+size_t previousChar(pLineEditor_t editor, size_t pos)
+{
+    do
+        pos--;
+    while (pos > 0 && IS_CONTINUATION(editor->line[pos]));
+
+    return pos;
+}
+
+/*
+ * Function: nextChar
+ * ------------------
+ *  Returns: The position of the character after a position of the line
+ */
+size_t nextChar(pLineEditor_t editor, size_t pos)
+{
+    do
+        pos++;
+    while (pos < editor->len && IS_CONTINUATION(editor->line[pos]));
+
+    return pos;
+}
+
+/*
+ * Function: insertText
+ * --------------------
+ * Inserts text at the cursor. At the end of the line the text is simply printed, elsewhere the shortest of
+ * "insert blank characters (ICH) then print the text" and "print the text and the rest of the line, then move back"
+ *
+ *  editor:  The line editor
+ *  text:    The text to insert
+ *  len:     The length of the text
+ */
+void insertText(pLineEditor_t editor, const char *text, size_t len)
+{
+    size_t tail = editor->len - editor->cursor;
+
+    if (editor->len + len > editor->capacity)
+    {
+        while (editor->len + len > editor->capacity)
+            editor->capacity = (editor->capacity == 0) ? 256 : editor->capacity * 2;
+        editor->line = (char *)realloc(editor->line, editor->capacity);
+    }
+
+    memmove(editor->line + editor->cursor + len, editor->line + editor->cursor, tail);
+    memcpy(editor->line + editor->cursor, text, len);
+    editor->len += len;
+
+    if (tail == 0)
+    {
+        emit(editor, text, len);
+    }
+    else
+    {
+        char sequence[32];
+        size_t tailCols = columns(editor->line, editor->cursor + len, editor->len);
+        int insertLen = snprintf(sequence, sizeof(sequence), "\x1b[%zu@", columns(text, 0, len));
+        int backLen = snprintf(NULL, 0, "\x1b[%zuD", tailCols);
+
+        if ((size_t)insertLen <= tail + (size_t)backLen)
+        {
+            emit(editor, sequence, insertLen);
+            emit(editor, text, len);
+        }
+        else
+        {
+            emit(editor, editor->line + editor->cursor, len + tail);
+            emitMove(editor, editor->len, editor->cursor + len);
+        }
+    }
+
+    editor->cursor += len;
+}
+
+/*
+ * Function: deleteRange
+ * ---------------------
+ * Deletes a part of the line and leaves the cursor at its start. The characters are removed from the screen
+ * with DCH, or with EL when nothing follows them
+ *
+ *  editor:  The line editor
+ *  from:    The start of the part (in bytes)
+ *  to:      The end of the part (in bytes)
+ */
+void deleteRange(pLineEditor_t editor, size_t from, size_t to)
+{
+    char sequence[32];
+    int len;
+
+    if (from >= to)
+        return;
+
+    emitMove(editor, editor->cursor, from);
+
+    if (to == editor->len)
+        len = snprintf(sequence, sizeof(sequence), "\x1b[K");
+    else
+        len = snprintf(sequence, sizeof(sequence), "\x1b[%zuP", columns(editor->line, from, to));
+    emit(editor, sequence, len);
+
+    memmove(editor->line + from, editor->line + to, editor->len - to);
+    editor->len -= to - from;
+    editor->cursor = from;
+}
+
+/*
+ * Function: replaceLine
+ * ---------------------
+ * Replaces the whole line (history). Only what follows the prefix shared by both lines is printed again
+ *
+ *  editor:  The line editor
+ *  text:    The new line
+ */
+void replaceLine(pLineEditor_t editor, const char *text)
+{
+    size_t len = strlen(text);
+    size_t common = 0;
+
+    while (common < editor->len && common < len && editor->line[common] == text[common])
+        common++;
+    while (common > 0 && common < editor->len && IS_CONTINUATION(editor->line[common]))
+        common--;
+
+    emitMove(editor, editor->cursor, common);
+    if (common < editor->len)
+        emit(editor, "\x1b[K", 3);
+
+    editor->len = common;
+    editor->cursor = common;
+    if (len > common)
+        insertText(editor, text + common, len - common);
+}
+
+/*
+ * Function: browseHistory
+ * -----------------------
+ * Displays an entry of the history (or the new line, after the most recent entry)
+ *
+ *  editor:  The line editor
+ *  pos:     The entry to display
+ */
+void browseHistory(pLineEditor_t editor, int pos)
+{
+    if (pos < 0 || pos > historyLen)
+        return;
+
+    // The new line is kept while the history is browsed
+    if (editor->historyPos == historyLen)
+    {
+        free(editor->saved);
+        editor->saved = strndup(editor->line != NULL ? editor->line : "", editor->len);
+    }
+
+    editor->historyPos = pos;
+    replaceLine(editor, (pos == historyLen) ? editor->saved : historyEntry(pos));
+}
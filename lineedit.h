@@ -0,0 +1,13 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include "arena.h"
+
+#define HISTORY_MAX 1000 // The number of lines kept in the history
+
+char *editLine(pArena_t arena);
+void addHistory(const char *line);
+int historyCount();
+const char *historyEntry(int index);
+
+#endif
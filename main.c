@@ -0,0 +1,15 @@
+/*
+    Entry point of the QuYsh Shell: runs the interactive loop of libquysh on the standard input.
+*/
+
+#include "libquysh.h"
+
+int main(int argc, char **argv, char **envp)
+{
+    pQuyshCtx_t ctx = quysh_ctx_new();
+
+    quysh_interact(ctx);
+    quysh_ctx_free(ctx);
+
+    return 0;
+}
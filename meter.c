@@ -0,0 +1,266 @@
+/*
+    Pipeline meter of QuYsh: a relay interposed on every pipe of a pipeline ("meter" builtin).
+    A single process moves the data of all the hops with splice (never through user space) and measures,
+    for each hop, the bytes relayed and the time spent waiting for each side. A hop waiting for its upstream stage
+    is starved, a hop waiting for its downstream stage is blocked: the stage waited for the most is the bottleneck.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "meter.h"
+#include "procstat.h"
+
+int pumpHop(pMeterHop_t hop);
+void endHop(pMeterHop_t hop);
+void formatRate(double bytesPerSec, char *buffer, int bufferLen);
+void printMeterStatus(pMeterHop_t hops, int count, double elapsed);
+void printMeterSummary(pMeterHop_t hops, int count);
+
+/*
+ * Function: setHopName
+ * --------------------
+ * Sets the name of a stage of a hop: the last component of its command, truncated
+ *
+ *  name:    The name to set (METER_NAME_LEN bytes)
+ *  command: The command of the stage
+ */
+void setHopName(char *name, const char *command)
+{
+    const char *base = strrchr(command, '/');
+
+    snprintf(name, METER_NAME_LEN, "%s", (base != NULL && base[1] != '\0') ? base + 1 : command);
+}
+
+/*
+ * Function: runMeter
+ * ------------------
+ * Relays the data of the hops of a pipeline until all of them are done, then prints a summary on stderr
+ * Each hop is polled on a single side: its input while it is starved, its output while it is blocked,
+ * so the meter sleeps as long as no data can move, and the time slept is charged to the side waited for
+ *
+ *  hops:    The hops
+ *  count:   The number of hops
+ *  live:    1 to update a one-line status on stderr every METER_INTERVAL
+ */
+void runMeter(pMeterHop_t hops, int count, int live)
+{
+    struct pollfd *fds = (struct pollfd *)calloc(count, sizeof(struct pollfd));
+    double start = monotonicTime();
+    double last = start;
+    double lastStatus = start;
+    int active = count;
+
+    for (int i = 0; i < count; i++)
+    {
+        fcntl(hops[i].inFd, F_SETFL, fcntl(hops[i].inFd, F_GETFL) | O_NONBLOCK);
+        fcntl(hops[i].outFd, F_SETFL, fcntl(hops[i].outFd, F_GETFL) | O_NONBLOCK);
+        hops[i].state = HOP_STARVED;
+    }
+
+    while (active > 0)
+    {
+        double now;
+
+        for (int i = 0; i < count; i++)
+        {
+            fds[i].fd = (hops[i].state == HOP_DONE) ? -1 : (hops[i].state == HOP_STARVED) ? hops[i].inFd : hops[i].outFd;
+            fds[i].events = (hops[i].state == HOP_STARVED) ? POLLIN : POLLOUT;
+            fds[i].revents = 0;
+        }
+
+        if (poll(fds, count, live ? (int)(METER_INTERVAL * 1000) : -1) == -1 && errno != EINTR)
+            break;
+
+        now = monotonicTime();
+        for (int i = 0; i < count; i++)
+        {
+            if (hops[i].state == HOP_STARVED)
+                hops[i].starved += now - last;
+            else if (hops[i].state == HOP_BLOCKED)
+                hops[i].blocked += now - last;
+        }
+        last = now;
+
+        for (int i = 0; i < count; i++)
+        {
+            if (fds[i].revents != 0 && pumpHop(&(hops[i])))
+            {
+                hops[i].duration = now - start;
+                active--;
+            }
+        }
+
+        if (live && now - lastStatus >= METER_INTERVAL)
+        {
+            printMeterStatus(hops, count, now - lastStatus);
+            lastStatus = now;
+        }
+    }
+
+    if (live)
+        fprintf(stderr, "\r\033[K");
+
+    printMeterSummary(hops, count);
+    free(fds);
+}
+
+/*
+ * Function: pumpHop
+ * -----------------
+ * Moves all the data which can be moved through a hop, and finds out what the hop waits for next
+ *
+ *  hop:     The hop
+ *
+ *  Returns: 1 if the hop has just ended, 0 otherwise
+ */
+int pumpHop(pMeterHop_t hop)
+{
+    for (;;)
+    {
+        ssize_t moved = splice(hop->inFd, NULL, hop->outFd, NULL, METER_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        int pending = 0;
+
+        if (moved > 0)
+        {
+            hop->bytes += moved;
+            continue;
+        }
+
+        if (moved == -1 && errno == EINTR)
+            continue;
+
+        // Nothing can move: either the input is empty, or the output is full
+        if (moved == -1 && errno == EAGAIN)
+        {
+            ioctl(hop->inFd, FIONREAD, &pending);
+            hop->state = (pending > 0) ? HOP_BLOCKED : HOP_STARVED;
+            return 0;
+        }
+
+        // The upstream stage has ended (0), or the downstream one (EPIPE)
+        endHop(hop);
+        return 1;
+    }
+}
+
+/*
+ * Function: endHop
+ * ----------------
+ * Closes both sides of a hop: the downstream stage reads the end of its input,
+ * the upstream stage gets SIGPIPE if it writes again
+ *
+ *  hop:     The hop
+ */
+void endHop(pMeterHop_t hop)
+{
+    close(hop->inFd);
+    close(hop->outFd);
+    hop->state = HOP_DONE;
+}
+
+/*
+ * Function: formatRate
+ * --------------------
+ * Converts a number of bytes per second into a human-readable rate (e.g. "512 B/s", "3.2 MB/s")
+ *
+ *  bytesPerSec: The rate
+ *  buffer:      The buffer to write into
+ *  bufferLen:   The size of the buffer
+ */
+void formatRate(double bytesPerSec, char *buffer, int bufferLen)
+{
+    const char *UNITS[4] = {"B/s", "KB/s", "MB/s", "GB/s"};
+    int unit = 0;
+
+    while (bytesPerSec >= 1024 && unit < 3)
+    {
+        bytesPerSec /= 1024;
+        unit++;
+    }
+
+    if (unit == 0)
+        snprintf(buffer, bufferLen, "%.0f %s", bytesPerSec, UNITS[unit]);
+    else
+        snprintf(buffer, bufferLen, "%.1f %s", bytesPerSec, UNITS[unit]);
+}
+
+/*
+ * Function: printMeterStatus
+ * --------------------------
+ * Rewrites the live status line: the rate of each hop since the last update, and the stage it waits for
+ *
+ *  hops:    The hops
+ *  count:   The number of hops
+ *  elapsed: The time since the last update (seconds)
+ */
+void printMeterStatus(pMeterHop_t hops, int count, double elapsed)
+{
+    char line[1024];
+    int len = 0;
+
+    for (int i = 0; i < count && len < (int)sizeof(line); i++)
+    {
+        pMeterHop_t hop = &(hops[i]);
+        char rate[32];
+
+        formatRate((hop->bytes - hop->lastBytes) / elapsed, rate, sizeof(rate));
+        hop->lastBytes = hop->bytes;
+
+        len += snprintf(line + len, sizeof(line) - len, "%s%s>%s %s %s", (i > 0) ? " | " : "", hop->from, hop->to, rate,
+                        (hop->state == HOP_DONE) ? "done" : (hop->state == HOP_STARVED) ? "<wait" : "wait>");
+    }
+
+    fprintf(stderr, "\r\033[K%s", line);
+}
+
+/*
+ * Function: printMeterSummary
+ * ---------------------------
+ * Prints the bytes, the average rate and the share of time each hop has waited for each side,
+ * then the stage which has been waited for the most
+ *
+ *  hops:    The hops
+ *  count:   The number of hops
+ */
+void printMeterSummary(pMeterHop_t hops, int count)
+{
+    const char *slowest = NULL;
+    double slowestWait = 0;
+
+    fprintf(stderr, "meter: %-33s %14s %12s %8s %8s\n", "hop", "bytes", "rate", "starved", "blocked");
+
+    for (int i = 0; i < count; i++)
+    {
+        pMeterHop_t hop = &(hops[i]);
+        double duration = (hop->duration > 0) ? hop->duration : 1e-9;
+        char name[64];
+        char rate[32];
+
+        snprintf(name, sizeof(name), "%s > %s", hop->from, hop->to);
+        formatRate(hop->bytes / duration, rate, sizeof(rate));
+        fprintf(stderr, "meter: %-33s %14llu %12s %7.0f%% %7.0f%%\n", name, hop->bytes, rate,
+                100 * hop->starved / duration, 100 * hop->blocked / duration);
+
+        // A starved hop waits for its upstream stage, a blocked hop for its downstream stage
+        if (hop->starved > slowestWait)
+        {
+            slowest = hop->from;
+            slowestWait = hop->starved;
+        }
+        if (hop->blocked > slowestWait)
+        {
+            slowest = hop->to;
+            slowestWait = hop->blocked;
+        }
+    }
+
+    if (slowest != NULL)
+        fprintf(stderr, "meter: slowest stage: %s (waited for %.2fs)\n", slowest, slowestWait);
+}
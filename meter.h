@@ -0,0 +1,46 @@
+#ifndef METER_H
+#define METER_H
+
+#define METER_NAME_LEN 16   // The longest name of a stage kept for the status
+#define METER_INTERVAL 0.5  // Seconds between two updates of the live status
+#define METER_CHUNK (1024 * 1024) // The largest number of bytes moved by one call to splice
+
+/* States of a hop */
+#define HOP_STARVED 0 // Waiting for the upstream stage to write
+#define HOP_BLOCKED 1 // Waiting for the downstream stage to read
+#define HOP_DONE 2    // One of the two stages has ended
+
+/*
+ * Structure: meterHop
+ * -------------------
+ * A pipe between two stages of a metered pipeline, cut in two by the meter which relays the data
+ *
+ *  inFd:       The read end of the pipe written by the upstream stage
+ *  outFd:      The write end of the pipe read by the downstream stage
+ *  from:       The name of the upstream stage
+ *  to:         The name of the downstream stage
+ *  state:      HOP_STARVED, HOP_BLOCKED or HOP_DONE
+ *  bytes:      The number of bytes relayed
+ *  lastBytes:  The number of bytes relayed at the last update of the live status
+ *  starved:    The time spent waiting for the upstream stage (seconds)
+ *  blocked:    The time spent waiting for the downstream stage (seconds)
+ *  duration:   The time between the start of the meter and the end of the hop (seconds)
+ */
+typedef struct meterHop
+{
+    int inFd;
+    int outFd;
+    char from[METER_NAME_LEN];
+    char to[METER_NAME_LEN];
+    int state;
+    unsigned long long bytes;
+    unsigned long long lastBytes;
+    double starved;
+    double blocked;
+    double duration;
+} meterHop_t, *pMeterHop_t;
+
+void setHopName(char *name, const char *command);
+void runMeter(pMeterHop_t hops, int count, int live);
+
+#endif
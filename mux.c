@@ -0,0 +1,394 @@
+/*
+    Output multiplexer of QuYsh ("mux" builtin): a process which receives the standard output and the standard error
+    of each background job as a pair of pipes (passed over a socket), waits for all of them with epoll,
+    and writes their lines whole, prefixed with the ID of their job, to its own standard output and error.
+    Each output is buffered up to MUX_LINE_MAX bytes, and the lines are written with blocking writes:
+    while the terminal does not keep up, the pipes fill up and the jobs block (backpressure).
+    The output of a job can also be written, without prefix, to a log file given along with its pipes.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "mux.h"
+
+/*
+ * Structure: muxJob
+ * -----------------
+ * A job whose output is multiplexed
+ *
+ *  id:          The ID of the job, which prefixes its lines
+ *  logFd:       The log file of the job (-1 if none)
+ *  openStreams: The number of outputs of the job which have not ended yet
+ */
+typedef struct muxJob
+{
+    int id;
+    int logFd;
+    int openStreams;
+} muxJob_t, *pMuxJob_t;
+
+/*
+ * Structure: muxStream
+ * --------------------
+ * One output of a job (standard output or standard error)
+ *
+ *  fd:      The read end of the pipe of the output
+ *  target:  The descriptor the lines are written to (STDOUT_FILENO or STDERR_FILENO)
+ *  job:     The job
+ *  buffer:  The beginning of a line which has not been completed yet
+ *  len:     The number of bytes in the buffer
+ */
+typedef struct muxStream
+{
+    int fd;
+    int target;
+    pMuxJob_t job;
+    char buffer[MUX_LINE_MAX];
+    size_t len;
+} muxStream_t, *pMuxStream_t;
+
+void runMux(int control);
+int receiveMuxJob(int control, int epollFd);
+void addMuxStream(int epollFd, int fd, int target, pMuxJob_t job);
+int readMuxStream(pMuxStream_t stream);
+void writeMuxLine(pMuxStream_t stream, const char *line, size_t len);
+void writeFully(int fd, const char *buffer, size_t len);
+
+char muxLine[MUX_LINE_MAX + 32]; // A line and its prefix, written at once
+
+/*
+ * Function: startMux
+ * ------------------
+ * Forks the multiplexer, which writes to the standard output and error of the Shell at the time of the call
+ *
+ *  muxPid:  Receives the PID of the multiplexer
+ *
+ *  Returns: The socket to which the Shell sends the jobs, -1 if the multiplexer could not be started
+ */
+int startMux(int *muxPid)
+{
+    int sockets[2];
+    int pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) == -1)
+        return -1;
+
+    fflush(stdout);
+
+    pid = fork();
+    switch (pid)
+    {
+    case -1:
+        close(sockets[0]);
+        close(sockets[1]);
+        return -1;
+    case 0:
+        // Ends once the Shell has closed its socket and the last job has closed its outputs
+        signal(SIGINT, SIG_IGN);
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGTSTP, SIG_IGN);
+        signal(SIGTTOU, SIG_IGN);
+        signal(SIGPIPE, SIG_IGN);
+        close(sockets[0]);
+        runMux(sockets[1]);
+        _exit(EXIT_SUCCESS);
+    default:
+        close(sockets[1]);
+        *muxPid = pid;
+        return sockets[0];
+    }
+}
+
+/*
+ * Function: sendMuxJob
+ * --------------------
+ * Hands the outputs of a job over to the multiplexer (the Shell can close its descriptors afterwards)
+ *
+ *  control: The socket returned by startMux
+ *  id:      The ID of the job
+ *  outFd:   The read end of the pipe of the standard output of the job
+ *  errFd:   The read end of the pipe of the standard error of the job
+ *  logFd:   The log file of the job (-1 if none)
+ *
+ *  Returns: 0 if the job has been sent, -1 if the multiplexer is gone
+ */
+int sendMuxJob(int control, int id, int outFd, int errFd, int logFd)
+{
+    int fds[3] = {outFd, errFd, logFd};
+    int count = (logFd == -1) ? 2 : 3;
+    union
+    {
+        char buffer[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } ancillary;
+    struct iovec iov = {&id, sizeof(id)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ancillary.buffer;
+    msg.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+
+    return (sendmsg(control, &msg, MSG_NOSIGNAL) == -1) ? -1 : 0;
+}
+
+/*
+ * Function: runMux
+ * ----------------
+ * The loop of the multiplexer: receives the jobs from the Shell and relays the lines of their outputs
+ * The outputs are read once per wake-up, so that a job writing a lot does not starve the others
+ *
+ *  control: The socket from which the jobs are received
+ */
+void runMux(int control)
+{
+    struct epoll_event events[MUX_EVENTS];
+    struct epoll_event event;
+    int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    int streams = 0;
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, control, &event);
+
+    while (control != -1 || streams > 0)
+    {
+        int count = epoll_wait(epollFd, events, MUX_EVENTS, -1);
+
+        if (count == -1 && errno != EINTR)
+            break;
+
+        for (int i = 0; i < count; i++)
+        {
+            pMuxStream_t stream = (pMuxStream_t)events[i].data.ptr;
+
+            if (stream == NULL)
+            {
+                int received = receiveMuxJob(control, epollFd);
+
+                if (received == -1)
+                {
+                    // The Shell is gone (or has turned the multiplexer off): only the current jobs are left
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, control, NULL);
+                    close(control);
+                    control = -1;
+                }
+                else
+                {
+                    streams += received;
+                }
+            }
+            else if (readMuxStream(stream))
+            {
+                pMuxJob_t job = stream->job;
+
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, stream->fd, NULL);
+                close(stream->fd);
+                free(stream);
+                streams--;
+
+                if (--job->openStreams == 0)
+                {
+                    if (job->logFd != -1)
+                        close(job->logFd);
+                    free(job);
+                }
+            }
+        }
+    }
+
+    close(epollFd);
+}
+
+/*
+ * Function: receiveMuxJob
+ * -----------------------
+ * Receives a job from the Shell: its ID, the pipes of its outputs and its log file
+ *
+ *  control: The socket from which the job is received
+ *  epollFd: The epoll instance to which the outputs are added
+ *
+ *  Returns: The number of outputs added, -1 if the Shell has closed the socket
+ */
+int receiveMuxJob(int control, int epollFd)
+{
+    union
+    {
+        char buffer[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } ancillary;
+    int id;
+    int fds[3] = {-1, -1, -1};
+    struct iovec iov = {&id, sizeof(id)};
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t received;
+    pMuxJob_t job;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ancillary.buffer;
+    msg.msg_controllen = sizeof(ancillary.buffer);
+
+    do
+        received = recvmsg(control, &msg, MSG_CMSG_CLOEXEC);
+    while (received == -1 && errno == EINTR);
+
+    if (received <= 0)
+        return -1;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (received != sizeof(id) || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len < CMSG_LEN(2 * sizeof(int)))
+        return 0;
+
+    memcpy(fds, CMSG_DATA(cmsg), cmsg->cmsg_len - CMSG_LEN(0));
+
+    job = (pMuxJob_t)malloc(sizeof(muxJob_t));
+    job->id = id;
+    job->logFd = fds[2];
+    job->openStreams = 2;
+
+    addMuxStream(epollFd, fds[0], STDOUT_FILENO, job);
+    addMuxStream(epollFd, fds[1], STDERR_FILENO, job);
+
+    return 2;
+}
+
+/*
+ * Function: addMuxStream
+ * ----------------------
+ * Starts waiting for the lines of an output of a job
+ *
+ *  epollFd: The epoll instance
+ *  fd:      The read end of the pipe of the output
+ *  target:  The descriptor the lines are written to
+ *  job:     The job
+ */
+void addMuxStream(int epollFd, int fd, int target, pMuxJob_t job)
+{
+    pMuxStream_t stream = (pMuxStream_t)malloc(sizeof(muxStream_t));
+    struct epoll_event event;
+
+    stream->fd = fd;
+    stream->target = target;
+    stream->job = job;
+    stream->len = 0;
+
+    event.events = EPOLLIN;
+    event.data.ptr = stream;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/*
+ * Function: readMuxStream
+ * -----------------------
+ * Reads what an output of a job holds, and writes the lines it completes
+ * A line which does not fit into the buffer is written in pieces, each of them ended by a newline
+ *
+ *  stream:  The output
+ *
+ *  Returns: 1 if the output has ended (its last line has been written), 0 otherwise
+ */
+int readMuxStream(pMuxStream_t stream)
+{
+    ssize_t readLen = read(stream->fd, stream->buffer + stream->len, MUX_LINE_MAX - stream->len);
+    char *start = stream->buffer;
+    char *end;
+    char *newline;
+
+    if (readLen == -1 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+
+    if (readLen <= 0)
+    {
+        if (stream->len > 0)
+            writeMuxLine(stream, stream->buffer, stream->len);
+        return 1;
+    }
+
+    stream->len += readLen;
+    end = stream->buffer + stream->len;
+
+    while ((newline = memchr(start, '\n', end - start)) != NULL)
+    {
+        writeMuxLine(stream, start, newline + 1 - start);
+        start = newline + 1;
+    }
+
+    // A line filling the whole buffer is cut
+    if (start == stream->buffer && stream->len == MUX_LINE_MAX)
+    {
+        writeMuxLine(stream, stream->buffer, MUX_LINE_MAX);
+        start = end;
+    }
+
+    stream->len = end - start;
+    memmove(stream->buffer, start, stream->len);
+
+    return 0;
+}
+
+/*
+ * Function: writeMuxLine
+ * ----------------------
+ * Writes a line of a job with a single write, prefixed with the ID of the job, and to the log file of the job
+ *
+ *  stream:  The output of the job
+ *  line:    The line (a newline is added if it does not end with one)
+ *  len:     The length of the line
+ */
+void writeMuxLine(pMuxStream_t stream, const char *line, size_t len)
+{
+    int prefixLen = snprintf(muxLine, sizeof(muxLine), "[%d] ", stream->job->id);
+    int complete = (line[len - 1] == '\n');
+
+    memcpy(muxLine + prefixLen, line, len);
+    if (!complete)
+        muxLine[prefixLen + len++] = '\n';
+
+    writeFully(stream->target, muxLine, prefixLen + len);
+    if (stream->job->logFd != -1)
+        writeFully(stream->job->logFd, muxLine + prefixLen, len);
+}
+
+/*
+ * Function: writeFully
+ * --------------------
+ * Writes a whole buffer, whatever the number of calls to write it takes (gives up on an error)
+ *
+ *  fd:      The descriptor to write to
+ *  buffer:  The buffer
+ *  len:     The length of the buffer
+ */
+void writeFully(int fd, const char *buffer, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t written = write(fd, buffer, len);
+
+        if (written == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buffer += written;
+        len -= written;
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef MUX_H
+#define MUX_H
+
+#define MUX_LINE_MAX 65536 // The buffer of each output of a job: a longer line is cut
+#define MUX_EVENTS 64      // The largest number of events handled by one call to epoll_wait
+
+int startMux(int *muxPid);
+int sendMuxJob(int control, int id, int outFd, int errFd, int logFd);
+
+#endif
@@ -0,0 +1,496 @@
+/*
+    Parameter expansion of QuYsh: the operators of "${...}" work on the variables of the Shell itself, so that
+    a script does not have to fork basename, dirname, sed or cut to take a string apart.
+        ${name}                   The value of the variable
+        ${#name}                  Its length
+        ${name:-word} ${name-word}  word if the variable is empty or unset (unset only, without ':')
+        ${name:=word} ${name=word}  Same, and the variable is set to word
+        ${name:+word} ${name+word}  word if the variable is set and not empty (set only, without ':')
+        ${name:?word} ${name?word}  An error (word is the message) if the variable is empty or unset
+        ${name#pattern} ${name##pattern}  The value without its shortest (longest) prefix matching pattern
+        ${name%pattern} ${name%%pattern}  The value without its shortest (longest) suffix matching pattern
+        ${name:offset} ${name:offset:length}  A substring (arithmetic expressions, negative ones count from the end)
+        ${name/pattern/string} ${name//pattern/string}  The first (every) match of pattern replaced with string
+        ${name/#pattern/string} ${name/%pattern/string}  A match at the beginning (end) replaced with string
+    Patterns are the ones of the file names (* ? [...]), matched with fnmatch; a pattern without any of them is
+    compared as it is. The words of the operators are expanded only when they are used.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include "arith.h"
+#include "param.h"
+
+/*
+ * Structure: paramPattern
+ * -----------------------
+ * A pattern matched against parts of a value
+ *
+ *  text:    The pattern
+ *  len:     Its length
+ *  literal: 1 if the pattern has no special character (it is compared as it is)
+ *  value:   The value
+ *  scratch: A buffer as long as the value, to which the parts given to fnmatch are copied
+ */
+typedef struct paramPattern
+{
+    const char *text;
+    size_t len;
+    int literal;
+    const char *value;
+    char *scratch;
+} paramPattern_t, *pParamPattern_t;
+
+int isParamNameChar(char c, int first);
+char *findOperand(char *text, char separator);
+char *substring(const char *value, char *operand, paramSetter_t setter, paramExpander_t expander, char *error);
+int evaluateIndex(char *text, paramSetter_t setter, paramExpander_t expander, long long *result, char *error);
+char *removeMatch(const char *value, char op, int longest, char *pattern);
+char *replaceMatches(const char *value, char *operand, paramExpander_t expander);
+void initPattern(pParamPattern_t pattern, const char *text, const char *value);
+int matchPart(pParamPattern_t pattern, size_t start, size_t end);
+
+/*
+ * Function: expandParameter
+ * -------------------------
+ * Evaluates a parameter expansion
+ *
+ *  body:     What is between the braces of "${...}"
+ *  getter:   Gives the values of the variables
+ *  setter:   Sets the variables assigned by := and by the arithmetic of substrings
+ *  expander: Expands the words of the operators
+ *  error:    Receives the error message (PARAM_ERROR_LEN bytes)
+ *
+ *  Returns: The value of the expansion (to be freed), NULL on error
+ */
+char *expandParameter(const char *body, paramGetter_t getter, paramSetter_t setter, paramExpander_t expander, char *error)
+{
+    char *copy = strdup(body);
+    char *name = copy;
+    char *rest;
+    const char *value;
+    char *res = NULL;
+    int length = 0;
+
+    if (name[0] == '#' && name[1] != '\0')
+    {
+        length = 1;
+        name++;
+    }
+
+    // The name of a variable, or "?"
+    rest = name;
+    if (*rest == '?')
+        rest++;
+    else
+        while (isParamNameChar(*rest, rest == name))
+            rest++;
+
+    if (rest == name || (length && *rest != '\0'))
+    {
+        snprintf(error, PARAM_ERROR_LEN, "${%s}: bad substitution", body);
+        free(copy);
+        return NULL;
+    }
+
+    {
+        char op = *rest;
+        int colon = 0;
+
+        *rest = '\0';
+        value = getter(name);
+        *rest = op;
+
+        if (length)
+        {
+            res = (char *)malloc(24);
+            snprintf(res, 24, "%zu", (value != NULL) ? strlen(value) : 0);
+            free(copy);
+            return res;
+        }
+
+        if (op == ':' && rest[1] != '\0' && strchr("-=+?", rest[1]) != NULL)
+        {
+            colon = 1;
+            op = *(++rest);
+        }
+        rest++;
+
+        switch (op)
+        {
+        case '\0':
+            res = strdup((value != NULL) ? value : "");
+            break;
+        case '-':
+        case '=':
+        case '+':
+        case '?':
+        {
+            // Without ':', an empty variable counts as set
+            int set = (value != NULL && (!colon || value[0] != '\0'));
+
+            if (op == '+')
+            {
+                res = strdup(set ? expander(rest) : "");
+            }
+            else if (set)
+            {
+                res = strdup(value);
+            }
+            else if (op == '?')
+            {
+                rest[-1 - colon] = '\0';
+                snprintf(error, PARAM_ERROR_LEN, "%s: %s", name, (*rest != '\0') ? expander(rest) : "parameter null or not set");
+            }
+            else
+            {
+                res = strdup(expander(rest));
+                if (op == '=')
+                {
+                    rest[-1 - colon] = '\0';
+                    setter(name, res);
+                }
+            }
+            break;
+        }
+        case ':':
+            res = substring((value != NULL) ? value : "", rest, setter, expander, error);
+            break;
+        case '#':
+        case '%':
+        {
+            int longest = (*rest == op);
+
+            res = removeMatch((value != NULL) ? value : "", op, longest, expander(rest + longest));
+            break;
+        }
+        case '/':
+            res = replaceMatches((value != NULL) ? value : "", rest, expander);
+            break;
+        default:
+            snprintf(error, PARAM_ERROR_LEN, "${%s}: bad substitution", body);
+            break;
+        }
+    }
+
+    free(copy);
+    return res;
+}
+
+/*
+ * Function: isParamNameChar
+ * -------------------------
+ *  Returns: 1 if the character can be part of the name of a variable (first: 1 for the first character), 0 otherwise
+ */
+int isParamNameChar(char c, int first)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (!first && c >= '0' && c <= '9');
+}
+
+/*
+ * Function: findOperand
+ * ---------------------
+ * Finds the separator between two operands, outside of quotes, of nested expansions and of escapes
+ *
+ *  text:      The operands
+ *  separator: The separator
+ *
+ *  Returns: A pointer to the separator, NULL if there is none
+ */
+char *findOperand(char *text, char separator)
+{
+    char quote = 0;
+    int depth = 0;
+
+    for (char *cur = text; *cur != '\0'; cur++)
+    {
+        if (quote)
+        {
+            if (*cur == quote)
+                quote = 0;
+        }
+        else if (*cur == '\\' && cur[1] != '\0')
+        {
+            cur++;
+        }
+        else if (*cur == '"' || *cur == '\'')
+        {
+            quote = *cur;
+        }
+        else if (*cur == '(' || *cur == '{')
+        {
+            depth++;
+        }
+        else if (*cur == ')' || *cur == '}')
+        {
+            depth--;
+        }
+        else if (*cur == separator && depth == 0)
+        {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Function: substring
+ * -------------------
+ * ${name:offset} and ${name:offset:length}
+ * A negative offset counts from the end of the value, a negative length is a position counted from the end
+ *
+ *  value:    The value of the variable
+ *  operand:  What follows the first ':'
+ *  setter:   Sets the variables assigned by the expressions
+ *  expander: Expands the expressions
+ *  error:    Receives the error message
+ *
+ *  Returns: The substring (to be freed), NULL on error
+ */
+char *substring(const char *value, char *operand, paramSetter_t setter, paramExpander_t expander, char *error)
+{
+    long long valueLen = strlen(value);
+    char *lengthText = findOperand(operand, ':');
+    long long offset;
+    long long end = valueLen;
+
+    if (lengthText != NULL)
+        *(lengthText++) = '\0';
+
+    if (evaluateIndex(operand, setter, expander, &offset, error) == -1)
+        return NULL;
+    if (lengthText != NULL && evaluateIndex(lengthText, setter, expander, &end, error) == -1)
+        return NULL;
+
+    if (offset < 0)
+        offset = (valueLen + offset < 0) ? 0 : valueLen + offset;
+    if (offset > valueLen)
+        offset = valueLen;
+
+    if (lengthText != NULL)
+    {
+        if (end < 0)
+        {
+            end += valueLen;
+            if (end < offset)
+            {
+                snprintf(error, PARAM_ERROR_LEN, "%s: substring expression < 0", lengthText);
+                return NULL;
+            }
+        }
+        else
+        {
+            end = (end > valueLen - offset) ? valueLen : offset + end;
+        }
+    }
+
+    return strndup(value + offset, end - offset);
+}
+
+/*
+ * Function: evaluateIndex
+ * -----------------------
+ * Evaluates the offset or the length of a substring (an empty expression is 0)
+ *
+ *  text:     The expression
+ *  setter:   Sets the variables assigned by the expression
+ *  expander: Expands the expression
+ *  result:   Receives the value
+ *  error:    Receives the error message
+ *
+ *  Returns: 0, -1 on error
+ */
+int evaluateIndex(char *text, paramSetter_t setter, paramExpander_t expander, long long *result, char *error)
+{
+    char arithError[ARITH_ERROR_LEN];
+    char *expanded = expander(text);
+    pArithProgram_t program;
+
+    if (strspn(expanded, " \t") == strlen(expanded))
+    {
+        *result = 0;
+        return 0;
+    }
+
+    program = cachedArith(expanded, arithError);
+    if (program == NULL || runArith(program, setter, result, arithError) == -1)
+    {
+        snprintf(error, PARAM_ERROR_LEN, "%s", arithError);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function: removeMatch
+ * ---------------------
+ * ${name#pattern}, ${name##pattern}, ${name%pattern} and ${name%%pattern}
+ *
+ *  value:   The value of the variable
+ *  op:      '#' to remove a prefix, '%' to remove a suffix
+ *  longest: 1 to remove the longest match, 0 to remove the shortest one
+ *  pattern: The pattern (already expanded)
+ *
+ *  Returns: The value without the match (to be freed), the whole value if nothing matches
+ */
+char *removeMatch(const char *value, char op, int longest, char *pattern)
+{
+    paramPattern_t match;
+    size_t len = strlen(value);
+    char *res = NULL;
+
+    initPattern(&match, pattern, value);
+
+    for (size_t i = 0; i <= len && res == NULL; i++)
+    {
+        // The candidate end of the prefix, or start of the suffix
+        size_t bound = (op == '#') ? (longest ? len - i : i) : (longest ? i : len - i);
+
+        if (op == '#' && matchPart(&match, 0, bound))
+            res = strdup(value + bound);
+        else if (op == '%' && matchPart(&match, bound, len))
+            res = strndup(value, bound);
+    }
+
+    free(match.scratch);
+    return (res != NULL) ? res : strdup(value);
+}
+
+/*
+ * Function: replaceMatches
+ * ------------------------
+ * ${name/pattern/string}, ${name//pattern/string}, ${name/#pattern/string} and ${name/%pattern/string}
+ * Each replaced match is the longest one starting at its position
+ *
+ *  value:    The value of the variable
+ *  operand:  What follows the first '/'
+ *  expander: Expands the pattern and the string
+ *
+ *  Returns: The value with the matches replaced (to be freed)
+ */
+char *replaceMatches(const char *value, char *operand, paramExpander_t expander)
+{
+    char mode = (*operand == '/' || *operand == '#' || *operand == '%') ? *(operand++) : '\0';
+    char *stringText = findOperand(operand, '/');
+    const char *string;
+    paramPattern_t match;
+    size_t len = strlen(value);
+    size_t pos = 0;
+    char *res = NULL;
+    size_t resLen = 0;
+    FILE *out;
+
+    if (stringText != NULL)
+        *(stringText++) = '\0';
+
+    initPattern(&match, expander(operand), value);
+    string = (stringText != NULL) ? expander(stringText) : "";
+
+    if (match.len == 0)
+    {
+        free(match.scratch);
+        return strdup(value);
+    }
+
+    out = open_memstream(&res, &resLen);
+
+    if (mode == '#' || mode == '%')
+    {
+        size_t bound = len + 1;
+
+        for (size_t i = 0; i <= len && bound > len; i++)
+        {
+            if (mode == '#' && matchPart(&match, 0, len - i))
+                bound = len - i;
+            else if (mode == '%' && matchPart(&match, i, len))
+                bound = i;
+        }
+
+        if (bound > len)
+            fputs(value, out);
+        else if (mode == '#')
+            fprintf(out, "%s%s", string, value + bound);
+        else
+            fprintf(out, "%.*s%s", (int)bound, value, string);
+    }
+    else
+    {
+        while (pos < len)
+        {
+            size_t end = 0;
+
+            if (match.literal)
+            {
+                // A plain string is searched for directly
+                char *found = strstr(value + pos, match.text);
+
+                if (found == NULL)
+                    break;
+                fwrite(value + pos, 1, found - value - pos, out);
+                pos = found - value;
+                end = pos + match.len;
+            }
+            else
+            {
+                for (end = len; end > pos && !matchPart(&match, pos, end); end--)
+                    ;
+            }
+
+            if (end > pos)
+            {
+                fputs(string, out);
+                pos = end;
+                if (mode != '/')
+                    break;
+            }
+            else
+            {
+                fputc(value[pos++], out);
+            }
+        }
+        fputs(value + pos, out);
+    }
+
+    fclose(out);
+    free(match.scratch);
+    return res;
+}
+
+/*
+ * Function: initPattern
+ * ---------------------
+ * Prepares a pattern to be matched against parts of a value
+ *
+ *  pattern: The pattern to initialize
+ *  text:    The text of the pattern
+ *  value:   The value
+ */
+void initPattern(pParamPattern_t pattern, const char *text, const char *value)
+{
+    pattern->text = text;
+    pattern->len = strlen(text);
+    pattern->literal = (strpbrk(text, "*?[\\") == NULL);
+    pattern->value = value;
+    pattern->scratch = pattern->literal ? NULL : (char *)malloc(strlen(value) + 1);
+}
+
+/*
+ * Function: matchPart
+ * -------------------
+ *  Returns: 1 if the part [start, end) of the value matches the whole pattern, 0 otherwise
+ */
+int matchPart(pParamPattern_t pattern, size_t start, size_t end)
+{
+    if (pattern->literal)
+        return end - start == pattern->len && memcmp(pattern->value + start, pattern->text, pattern->len) == 0;
+
+    memcpy(pattern->scratch, pattern->value + start, end - start);
+    pattern->scratch[end - start] = '\0';
+
+    return fnmatch(pattern->text, pattern->scratch, 0) == 0;
+}
@@ -0,0 +1,15 @@
+#ifndef PARAM_H
+#define PARAM_H
+
+#define PARAM_ERROR_LEN 256 // The size of the buffers receiving the error messages
+
+/* Gives the value of a variable (NULL if it is not set) */
+typedef const char *(*paramGetter_t)(const char *name);
+/* Sets a variable assigned by an expansion */
+typedef void (*paramSetter_t)(const char *name, const char *value);
+/* Expands the word of an operator ($NAME, $(cmd), quotes...) into a single string, which the callee owns */
+typedef char *(*paramExpander_t)(char *word);
+
+char *expandParameter(const char *body, paramGetter_t getter, paramSetter_t setter, paramExpander_t expander, char *error);
+
+#endif
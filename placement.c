@@ -0,0 +1,495 @@
+/*
+    CPU placement of the jobs launched by QuYsh.
+    The topology (packages, physical cores and shared caches) is read once from
+    /sys/devices/system/cpu, and stages are pinned with sched_setaffinity(2) in the child.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "placement.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_PATH_LEN 256
+
+/*
+ * Structure: cpuInfo
+ * ------------------
+ * The position of a logical CPU in the topology
+ *
+ *  cpu:     The number of the logical CPU
+ *  package: The physical package (socket)
+ *  core:    The physical core inside the package
+ *  l2:      The first CPU sharing the L2 cache with this one
+ *  l3:      The first CPU sharing the last level cache with this one
+ */
+typedef struct cpuInfo
+{
+    int cpu;
+    int package;
+    int core;
+    int l2;
+    int l3;
+} cpuInfo_t, *pCpuInfo_t;
+
+/*
+ * Structure: coreInfo
+ * -------------------
+ * A physical core and its hardware threads
+ *
+ *  package: The physical package (socket)
+ *  core:    The physical core inside the package
+ *  rank:    The position of the core among the cores of its package
+ *  threads: The logical CPUs of the core
+ */
+typedef struct coreInfo
+{
+    int package;
+    int core;
+    int rank;
+    cpu_set_t threads;
+} coreInfo_t, *pCoreInfo_t;
+
+int topologyLoaded = 0;
+int cpuCount = 0;
+cpuInfo_t *compactOrder = NULL; // Usable CPUs, ordered so that neighbours share as much cache as possible
+int coreCount = 0;
+coreInfo_t *spreadOrder = NULL; // Usable physical cores, alternating between packages
+int compactCursor = 0;
+int spreadCursor = 0;
+
+void loadTopology();
+int readSysInt(char *path);
+int readCacheGroups(int cpu, pCpuInfo_t info);
+int parseCpuList(char *list, cpu_set_t *cpus);
+int compareCompact(const void *a, const void *b);
+int compareCore(const void *a, const void *b);
+
+/*
+ * Function: parsePlacement
+ * ------------------------
+ * Parses a placement: "none", "compact", "spread", or a list of CPUs ("cpus=0-3,8" or "0-3,8")
+ *
+ *  word:      The placement to parse
+ *  placement: The placement receiving the value
+ *
+ *  Returns: 1 if the word is a valid placement, 0 otherwise
+ */
+int parsePlacement(char *word, pPlacement_t placement)
+{
+    if (strcmp(word, "none") == 0)
+        placement->policy = PLACE_NONE;
+    else if (strcmp(word, "compact") == 0)
+        placement->policy = PLACE_COMPACT;
+    else if (strcmp(word, "spread") == 0)
+        placement->policy = PLACE_SPREAD;
+    else
+    {
+        if (strncmp(word, "cpus=", 5) == 0)
+            word += 5;
+        if (word[0] < '0' || word[0] > '9' || parseCpuList(word, &(placement->cpus)) <= 0)
+            return 0;
+        placement->policy = PLACE_CPUS;
+    }
+
+    placement->base = 0;
+    return 1;
+}
+
+/*
+ * Function: reservePlacement
+ * --------------------------
+ * Reserves the CPUs of a new job. Successive jobs get successive slots of the topology so that they do not pile up
+ * on the same CPUs. With the compact policy, a pipeline which fits in one last level cache is not split over two
+ *
+ *  placement:  The placement of the job
+ *  stageCount: The number of stages of the job
+ */
+void reservePlacement(pPlacement_t placement, int stageCount)
+{
+    loadTopology();
+
+    if (placement->policy == PLACE_COMPACT && cpuCount > 0)
+    {
+        int start = compactCursor;
+        int groupStart = start;
+        int groupEnd = start;
+
+        // Looks for the last level cache domain of the cursor
+        while (groupStart > 0 && compactOrder[groupStart - 1].l3 == compactOrder[start].l3)
+            groupStart--;
+        while (groupEnd < cpuCount && compactOrder[groupEnd].l3 == compactOrder[start].l3)
+            groupEnd++;
+
+        // A pipeline which fits in a domain but not in what is left of the current one starts on the next domain
+        if (stageCount <= groupEnd - groupStart && start + stageCount > groupEnd)
+            start = (groupEnd == cpuCount) ? 0 : groupEnd;
+
+        placement->base = start;
+        compactCursor = (start + stageCount) % cpuCount;
+    }
+    else if (placement->policy == PLACE_SPREAD && coreCount > 0)
+    {
+        placement->base = spreadCursor;
+        spreadCursor = (spreadCursor + 1) % coreCount;
+    }
+}
+
+/*
+ * Function: stagePlacement
+ * ------------------------
+ * Computes the CPUs a stage of a job has to be pinned to
+ *
+ *  placement: The placement of the job
+ *  stage:     The index of the stage in its pipeline
+ *  cpus:      The set receiving the CPUs of the stage
+ *
+ *  Returns: 1 if the stage has to be pinned, 0 if it keeps the affinity of the Shell
+ */
+int stagePlacement(pPlacement_t placement, int stage, cpu_set_t *cpus)
+{
+    switch (placement->policy)
+    {
+    case PLACE_CPUS:
+        *cpus = placement->cpus;
+        return 1;
+    case PLACE_COMPACT:
+        if (cpuCount == 0)
+            return 0;
+        CPU_ZERO(cpus);
+        CPU_SET(compactOrder[(placement->base + stage) % cpuCount].cpu, cpus);
+        return 1;
+    case PLACE_SPREAD:
+        if (coreCount == 0)
+            return 0;
+        *cpus = spreadOrder[placement->base % coreCount].threads;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Function: formatPlacement
+ * -------------------------
+ * Formats a placement as "compact", "spread" or "cpus=0-3"
+ *
+ *  placement: The placement
+ *  buffer:    The buffer receiving the formatted string
+ *  bufferLen: The size of the buffer
+ */
+void formatPlacement(pPlacement_t placement, char *buffer, int bufferLen)
+{
+    switch (placement->policy)
+    {
+    case PLACE_COMPACT:
+        snprintf(buffer, bufferLen, "compact");
+        break;
+    case PLACE_SPREAD:
+        snprintf(buffer, bufferLen, "spread");
+        break;
+    case PLACE_CPUS:
+        snprintf(buffer, bufferLen, "cpus=");
+        formatCpuList(&(placement->cpus), buffer + 5, bufferLen - 5);
+        break;
+    default:
+        snprintf(buffer, bufferLen, "none");
+        break;
+    }
+}
+
+/*
+ * Function: formatCpuList
+ * -----------------------
+ * Formats a set of CPUs as a list of ranges ("0-3,8")
+ *
+ *  cpus:      The set of CPUs
+ *  buffer:    The buffer receiving the formatted string
+ *  bufferLen: The size of the buffer
+ */
+void formatCpuList(cpu_set_t *cpus, char *buffer, int bufferLen)
+{
+    int len = 0;
+
+    buffer[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && len < bufferLen; cpu++)
+    {
+        int last = cpu;
+
+        if (!CPU_ISSET(cpu, cpus))
+            continue;
+
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+
+        if (last == cpu)
+            len += snprintf(buffer + len, bufferLen - len, "%s%d", len ? "," : "", cpu);
+        else
+            len += snprintf(buffer + len, bufferLen - len, "%s%d-%d", len ? "," : "", cpu, last);
+
+        cpu = last;
+    }
+}
+
+/*
+ * Function: printTopology
+ * -----------------------
+ * Prints the topology as seen by the placement policies
+ */
+void printTopology()
+{
+    char list[256];
+
+    loadTopology();
+
+    printf("%d cpu(s), %d physical core(s)\n", cpuCount, coreCount);
+
+    printf("compact order:");
+    for (int i = 0; i < cpuCount; i++)
+        printf(" %d", compactOrder[i].cpu);
+    printf("\n");
+
+    printf("spread order:");
+    for (int i = 0; i < coreCount; i++)
+    {
+        formatCpuList(&(spreadOrder[i].threads), list, sizeof(list));
+        printf(" [%s]", list);
+    }
+    printf("\n");
+}
+
+/*
+ * Function: loadTopology
+ * ----------------------
+ * Reads the topology of the CPUs the Shell is allowed to run on (done once)
+ */
+void loadTopology()
+{
+    cpu_set_t allowed;
+    char path[SYSFS_PATH_LEN];
+
+    if (topologyLoaded)
+        return;
+    topologyLoaded = 1;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+        return;
+
+    compactOrder = (cpuInfo_t *)malloc(CPU_COUNT(&allowed) * sizeof(cpuInfo_t));
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        pCpuInfo_t info = &(compactOrder[cpuCount++]);
+        info->cpu = cpu;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        info->package = readSysInt(path);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        info->core = readSysInt(path);
+
+        // Without topology information, every CPU is considered as a core of its own
+        if (info->core == -1)
+            info->core = cpu;
+
+        readCacheGroups(cpu, info);
+    }
+
+    qsort(compactOrder, cpuCount, sizeof(cpuInfo_t), compareCompact);
+
+    // Groups the hardware threads of each physical core
+    spreadOrder = (coreInfo_t *)malloc(cpuCount * sizeof(coreInfo_t));
+
+    for (int i = 0; i < cpuCount; i++)
+    {
+        pCoreInfo_t core = NULL;
+
+        for (int j = 0; j < coreCount && core == NULL; j++)
+            if (spreadOrder[j].package == compactOrder[i].package && spreadOrder[j].core == compactOrder[i].core)
+                core = &(spreadOrder[j]);
+
+        if (core == NULL)
+        {
+            core = &(spreadOrder[coreCount++]);
+            core->package = compactOrder[i].package;
+            core->core = compactOrder[i].core;
+            core->rank = 0;
+            for (int j = 0; j < coreCount - 1; j++)
+                if (spreadOrder[j].package == core->package)
+                    core->rank++;
+            CPU_ZERO(&(core->threads));
+        }
+
+        CPU_SET(compactOrder[i].cpu, &(core->threads));
+    }
+
+    // Alternates between packages: the n-th core of each package comes before the (n+1)-th core of any package
+    qsort(spreadOrder, coreCount, sizeof(coreInfo_t), compareCore);
+}
+
+/*
+ * Function: readCacheGroups
+ * -------------------------
+ * Identifies the CPUs sharing the L2 and the last level cache with a CPU
+ *
+ *  cpu:     The number of the CPU
+ *  info:    The topology information receiving the cache groups
+ *
+ *  Returns: The highest cache level found, 0 if no cache information is available
+ */
+int readCacheGroups(int cpu, pCpuInfo_t info)
+{
+    char path[SYSFS_PATH_LEN];
+    char list[256];
+    int maxLevel = 0;
+
+    info->l2 = cpu;
+    info->l3 = cpu;
+
+    for (int index = 0;; index++)
+    {
+        cpu_set_t shared;
+        FILE *file;
+        int level, first;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", cpu, index);
+        level = readSysInt(path);
+        if (level == -1)
+            break;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        file = fopen(path, "r");
+        if (file == NULL)
+            continue;
+        if (fgets(list, sizeof(list), file) == NULL)
+            list[0] = '\0';
+        fclose(file);
+
+        if (parseCpuList(list, &shared) <= 0)
+            continue;
+
+        for (first = 0; !CPU_ISSET(first, &shared); first++)
+            ;
+
+        if (level == 2)
+            info->l2 = first;
+        if (level >= maxLevel)
+        {
+            maxLevel = level;
+            info->l3 = first;
+        }
+    }
+
+    return maxLevel;
+}
+
+/*
+ * Function: readSysInt
+ * --------------------
+ * Reads an integer from a sysfs file
+ *
+ *  path:    The path of the file
+ *
+ *  Returns: The integer, -1 if the file could not be read
+ */
+int readSysInt(char *path)
+{
+    int value = -1;
+    FILE *file = fopen(path, "r");
+
+    if (file != NULL)
+    {
+        if (fscanf(file, "%d", &value) != 1)
+            value = -1;
+        fclose(file);
+    }
+
+    return value;
+}
+
+/*
+ * Function: parseCpuList
+ * ----------------------
+ * Parses a list of CPUs in the sysfs format ("0-3,8,10-11")
+ *
+ *  list:    The list to parse
+ *  cpus:    The set receiving the CPUs
+ *
+ *  Returns: The number of CPUs in the list, -1 if the list is invalid
+ */
+int parseCpuList(char *list, cpu_set_t *cpus)
+{
+    char *cur = list;
+
+    CPU_ZERO(cpus);
+
+    while (*cur != '\0' && *cur != '\n')
+    {
+        char *end;
+        long first = strtol(cur, &end, 10);
+        long last = first;
+
+        if (end == cur)
+            return -1;
+
+        if (*end == '-')
+        {
+            cur = end + 1;
+            last = strtol(cur, &end, 10);
+            if (end == cur)
+                return -1;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            return -1;
+
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+
+        cur = end;
+        if (*cur == ',')
+            cur++;
+        else if (*cur != '\0' && *cur != '\n')
+            return -1;
+    }
+
+    return CPU_COUNT(cpus);
+}
+
+/*
+ * Function: compareCompact
+ * ------------------------
+ * Orders CPUs by package, last level cache, L2 cache and physical core
+ */
+int compareCompact(const void *a, const void *b)
+{
+    const cpuInfo_t *x = a, *y = b;
+
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->l3 != y->l3)
+        return x->l3 - y->l3;
+    if (x->l2 != y->l2)
+        return x->l2 - y->l2;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+/*
+ * Function: compareCore
+ * ---------------------
+ * Orders physical cores by rank inside their package, then by package
+ */
+int compareCore(const void *a, const void *b)
+{
+    const coreInfo_t *x = a, *y = b;
+
+    if (x->rank != y->rank)
+        return x->rank - y->rank;
+    return x->package - y->package;
+}
@@ -0,0 +1,35 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <sched.h>
+
+/* Placement policies */
+#define PLACE_NONE 0    // Stages inherit the affinity of the Shell
+#define PLACE_COMPACT 1 // Each stage gets its own CPU, consecutive stages on CPUs sharing their caches
+#define PLACE_SPREAD 2  // Each job gets its own physical core, shared by all of its stages
+#define PLACE_CPUS 3    // All the stages are pinned to a set of CPUs given by the user
+
+/*
+ * Structure: placement
+ * --------------------
+ * Describes on which CPUs the stages of a job run
+ *
+ *  policy: One of the placement policies above
+ *  cpus:   The set of CPUs (PLACE_CPUS only)
+ *  base:   The first slot of the topology reserved for the job (PLACE_COMPACT and PLACE_SPREAD only)
+ */
+typedef struct placement
+{
+    int policy;
+    cpu_set_t cpus;
+    int base;
+} placement_t, *pPlacement_t;
+
+int parsePlacement(char *word, pPlacement_t placement);
+void reservePlacement(pPlacement_t placement, int stageCount);
+int stagePlacement(pPlacement_t placement, int stage, cpu_set_t *cpus);
+void formatPlacement(pPlacement_t placement, char *buffer, int bufferLen);
+void formatCpuList(cpu_set_t *cpus, char *buffer, int bufferLen);
+void printTopology();
+
+#endif
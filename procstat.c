@@ -0,0 +1,256 @@
+/*
+    Resource sampling of child processes through the /proc filesystem.
+    Used by the "jobs -l" builtin of QuYsh.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "procstat.h"
+
+#define PROC_BUFFER_LEN 1024
+
+int readProcFile(int procFd, int pid, const char *name, char *buffer, int bufferLen);
+void parseStat(char *buffer, pProcSample_t sample);
+void parseIo(char *buffer, pProcSample_t sample);
+
+/*
+ * Function: sampleProcesses
+ * -------------------------
+ * Reads /proc/<pid>/stat, statm and io for several processes in a single pass
+ * The /proc directory is opened once and every file is read with a single read(2) into a shared buffer,
+ * so sampling hundreds of processes only costs three small reads per process
+ *
+ *  samples: An array of samples whose pid field is set by the caller
+ *  count:   The number of samples in the array
+ *
+ *  Returns: The number of processes that could be sampled
+ *           -1 if /proc is not available
+ */
+int sampleProcesses(pProcSample_t samples, int count)
+{
+    char buffer[PROC_BUFFER_LEN];
+    long pageSize = sysconf(_SC_PAGESIZE);
+    int sampled = 0;
+    int procFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (procFd == -1)
+        return -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        pProcSample_t sample = &(samples[i]);
+        int pid = sample->pid;
+
+        memset(sample, 0, sizeof(procSample_t));
+        sample->pid = pid;
+
+        // Without stat, the process is gone (or has never been ours)
+        if (readProcFile(procFd, pid, "stat", buffer, PROC_BUFFER_LEN) <= 0)
+            continue;
+        parseStat(buffer, sample);
+
+        if (readProcFile(procFd, pid, "statm", buffer, PROC_BUFFER_LEN) > 0)
+        {
+            unsigned long long size, resident;
+            if (sscanf(buffer, "%llu %llu", &size, &resident) == 2)
+                sample->rssBytes = resident * pageSize;
+        }
+
+        // io may be unreadable (e.g. the process changed credentials), it is not fatal
+        if (readProcFile(procFd, pid, "io", buffer, PROC_BUFFER_LEN) > 0)
+            parseIo(buffer, sample);
+
+        sample->valid = 1;
+        sampled++;
+    }
+
+    close(procFd);
+
+    return sampled;
+}
+
+/*
+ * Function: readProcFile
+ * ----------------------
+ * Reads a small file of /proc/<pid> into a buffer and null-terminates it
+ *
+ *  procFd:    A file descriptor on the /proc directory
+ *  pid:       The PID of the process
+ *  name:      The name of the file inside /proc/<pid>
+ *  buffer:    The buffer receiving the content of the file
+ *  bufferLen: The size of the buffer
+ *
+ *  Returns: The number of bytes read
+ *           -1 if the file could not be read
+ */
+int readProcFile(int procFd, int pid, const char *name, char *buffer, int bufferLen)
+{
+    char relPath[64];
+    int fd, len;
+
+    snprintf(relPath, sizeof(relPath), "%d/%s", pid, name);
+
+    fd = openat(procFd, relPath, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    len = read(fd, buffer, bufferLen - 1);
+    close(fd);
+
+    if (len < 0)
+        return -1;
+
+    buffer[len] = '\0';
+    return len;
+}
+
+/*
+ * Function: parseStat
+ * -------------------
+ * Extracts the name, state, CPU time, start time and current CPU of a process from the content of /proc/<pid>/stat
+ *
+ *  buffer: The content of /proc/<pid>/stat
+ *  sample: The sample to fill
+ */
+void parseStat(char *buffer, pProcSample_t sample)
+{
+    // The name of the executable is enclosed in parentheses and may itself contain spaces or parentheses
+    char *nameStart = strchr(buffer, '(');
+    char *nameEnd = strrchr(buffer, ')');
+    char *field;
+    int fieldNum = 3; // The state is the third field of the file
+    unsigned long long utime = 0, stime = 0;
+
+    if (nameStart == NULL || nameEnd == NULL || nameEnd < nameStart)
+        return;
+
+    int commLen = nameEnd - nameStart - 1;
+    if (commLen >= PROC_COMM_LEN)
+        commLen = PROC_COMM_LEN - 1;
+    strncpy(sample->comm, nameStart + 1, commLen);
+    sample->comm[commLen] = '\0';
+
+    field = strtok(nameEnd + 1, " ");
+    while (field != NULL && fieldNum <= 39)
+    {
+        switch (fieldNum)
+        {
+        case 3:
+            sample->state = field[0];
+            break;
+        case 14:
+            utime = strtoull(field, NULL, 10);
+            break;
+        case 15:
+            stime = strtoull(field, NULL, 10);
+            break;
+        case 22:
+            sample->startTicks = strtoull(field, NULL, 10);
+            break;
+        case 39:
+            sample->processor = atoi(field);
+            break;
+        }
+        field = strtok(NULL, " ");
+        fieldNum++;
+    }
+
+    sample->cpuTicks = utime + stime;
+}
+
+/*
+ * Function: parseIo
+ * -----------------
+ * Extracts the number of bytes read and written by a process from the content of /proc/<pid>/io
+ *
+ *  buffer: The content of /proc/<pid>/io
+ *  sample: The sample to fill
+ */
+void parseIo(char *buffer, pProcSample_t sample)
+{
+    char *line = strtok(buffer, "\n");
+
+    while (line != NULL)
+    {
+        if (strncmp(line, "rchar:", 6) == 0)
+            sample->readBytes = strtoull(line + 6, NULL, 10);
+        else if (strncmp(line, "wchar:", 6) == 0)
+            sample->writeBytes = strtoull(line + 6, NULL, 10);
+
+        line = strtok(NULL, "\n");
+    }
+}
+
+/*
+ * Function: procUptime
+ * --------------------
+ * Returns the number of seconds elapsed since boot, as read from /proc/uptime
+ *
+ *  Returns: The uptime in seconds
+ *           0 if it could not be read
+ */
+double procUptime()
+{
+    double uptime = 0;
+    FILE *file = fopen("/proc/uptime", "r");
+
+    if (file != NULL)
+    {
+        if (fscanf(file, "%lf", &uptime) != 1)
+            uptime = 0;
+        fclose(file);
+    }
+
+    return uptime;
+}
+
+/*
+ * Function: procCpuPercent
+ * ------------------------
+ * Converts a number of CPU clock ticks consumed during a period into a CPU usage
+ *
+ *  ticks:   The number of clock ticks consumed
+ *  seconds: The duration of the period
+ *
+ *  Returns: The CPU usage in percent of one core
+ */
+double procCpuPercent(unsigned long long ticks, double seconds)
+{
+    if (seconds <= 0)
+        return 0;
+
+    return 100.0 * ticks / sysconf(_SC_CLK_TCK) / seconds;
+}
+
+/*
+ * Function: procElapsed
+ * ---------------------
+ * Computes for how long a sampled process has been running
+ *
+ *  sample: The sample of the process
+ *  uptime: The uptime of the system, as returned by procUptime()
+ *
+ *  Returns: The number of seconds elapsed since the process started
+ */
+double procElapsed(pProcSample_t sample, double uptime)
+{
+    return uptime - (double)sample->startTicks / sysconf(_SC_CLK_TCK);
+}
+
+/*
+ * Function: monotonicTime
+ * -----------------------
+ * Returns the current time of the monotonic clock
+ *
+ *  Returns: The time in seconds
+ */
+double monotonicTime()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
@@ -0,0 +1,42 @@
+#ifndef PROCSTAT_H
+#define PROCSTAT_H
+
+#define PROC_COMM_LEN 16
+
+/*
+ * Structure: procSample
+ * ---------------------
+ * A snapshot of the resources used by a process, as read from /proc/<pid>
+ *
+ *  pid:        The PID of the sampled process
+ *  valid:      1 if the process could be sampled, 0 if it has vanished
+ *  state:      The state letter of the process (R, S, D, T, Z, ...)
+ *  processor:  The CPU the process last ran on
+ *  comm:       The name of the executable
+ *  cpuTicks:   The user and system CPU time consumed so far (in clock ticks)
+ *  startTicks: The time at which the process started after boot (in clock ticks)
+ *  rssBytes:   The resident set size
+ *  readBytes:  The number of bytes read through read-like system calls
+ *  writeBytes: The number of bytes written through write-like system calls
+ */
+typedef struct procSample
+{
+    int pid;
+    int valid;
+    char state;
+    int processor;
+    char comm[PROC_COMM_LEN];
+    unsigned long long cpuTicks;
+    unsigned long long startTicks;
+    unsigned long long rssBytes;
+    unsigned long long readBytes;
+    unsigned long long writeBytes;
+} procSample_t, *pProcSample_t;
+
+int sampleProcesses(pProcSample_t samples, int count);
+double procUptime();
+double procCpuPercent(unsigned long long ticks, double seconds);
+double procElapsed(pProcSample_t sample, double uptime);
+double monotonicTime();
+
+#endif
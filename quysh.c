@@ -8,18 +8,41 @@
         Paul LAMBERT
     
     @ Last Modification:
-        29-11-2020 (DMY Formats)
+        19-10-2026 (DMY Formats)
  
-    @ Version: 0.99.1 (File Revolution)
+    @ Version: 2.11 (Marathon)
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include "readline.h"
+#include "lineedit.h"
+#include "procstat.h"
+#include "joblimits.h"
+#include "placement.h"
+#include "arena.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "libquysh.h"
+#include "frecency.h"
+#include "meter.h"
+#include "mux.h"
+#include "arith.h"
+#include "builtins.h"
+#include "param.h"
+#include "reader.h"
 
 #define SHELL_NAME "quysh"
 
@@ -37,6 +60,13 @@
 #define RED_NONE 0 // Current process does not output to a file
 #define RED_OVER 1 // Current process outputs to a file by overriding it
 #define RED_APPE 2 // Current process outputs to a file by appending to it
+#define RED_TEE_OVER 3 // Current process outputs to several files (teeFiles) by overriding them
+#define RED_TEE_APPE 4 // Current process outputs to several files (teeFiles) by appending to them
+
+/* Job state */
+#define JOB_RUNNING 0 // At least one stage of the job is running
+#define JOB_STOPPED 1 // The job has been suspended (Ctrl-Z, SIGSTOP, ...)
+#define JOB_DONE 2    // All the stages of the job have ended, but the job has not been reported yet
 
 /* Pipe ends */
 #define READ_END 0
@@ -45,8 +75,36 @@
 int pipeA[2] = {-1, -1};
 int pipeB[2] = {-1, -1};
 
+/* Input redirections */
+#define HERE_DOC_PROMPT "> " // Prompt of the lines of a here-document
+#define CONTINUATION_PROMPT "> " // Prompt of the lines completing a loop
+
+int hereFd = -1; // The here-document or here-string given to the command being launched (-1 if none)
+
+/* Multi-target output redirections */
+#define TEE_CHUNK (1024 * 1024) // The largest number of bytes moved by one call to tee or splice
+#define TEE_BUFFER_LEN 65536    // Buffer of the outputs which cannot be spliced into
+
+char **teeFiles = NULL; // The files of the multi-target redirection (">|" or ">>|") of the command being launched
+
+/* Pipeline meter */
+int meterNext = 0;           // Set by the "meter" prefix, picked up by the next job
+int pipeMetered = 0;         // 1 if every pipe of pipeJob goes through the meter
+pMeterHop_t meterHops = NULL; // The hops of pipeJob, relayed by the meter once the last stage is launched
+int meterHopCount = 0;
+int meterHopCapacity = 0;
+
+/* Output multiplexing of background jobs */
+int muxControl = -1;      // The socket to which the outputs of background jobs are sent (-1 while "mux" is off)
+int muxPid = 0;           // The PID of the multiplexer
+char *muxLogDir = NULL;   // The directory of the log files of the jobs (NULL if they are not logged)
+int jobOut[2] = {-1, -1}; // The standard output of pipeJob, when it is multiplexed
+int jobErr[2] = {-1, -1}; // The standard error of pipeJob, when it is multiplexed
+
 /* Shell basic constants */
 #define MAX_PATH_LEN 4096
+#define LINE_ARENA_BLOCK 16384 // Default size of the blocks of the per-line arena
+#define REAP_INTERVAL 10000000 // Nanoseconds between two polls of the jobs while another child of the program is pending
 #define MAX_FORK 32 // TODO: UNUSED
 
 /* Shell command feedback constants */
@@ -57,11 +115,46 @@ int pipeB[2] = {-1, -1};
 const int SHELL_OPE_COUNT = 3;
 const char SHELL_OPE[3] = {'&', '|', '>'};
 
+/* Builtins run by the Shell itself, indexes in SHELL_BUILTINS (the stage builtins of builtins.c run in the stages of jobs) */
+#define BUILTIN_NONE -1
+#define BUILTIN_CD 0
+#define BUILTIN_JUMP 1
+#define BUILTIN_PRINT 2
+#define BUILTIN_SET 3
+#define BUILTIN_JOBS 4
+#define BUILTIN_FG 5
+#define BUILTIN_BG 6
+#define BUILTIN_KILL 7
+#define BUILTIN_WAIT 8
+#define BUILTIN_READ 9
+#define BUILTIN_LIMIT 10
+#define BUILTIN_PLACE 11
+#define BUILTIN_METER 12
+#define BUILTIN_MUX 13
+#define BUILTIN_STATS 14
+#define BUILTIN_EXIT 15
+
+const int SHELL_BUILTIN_COUNT = 16;
+const char *SHELL_BUILTINS[16] = {"cd", "z", "print", "set", "jobs", "fg", "bg", "kill",
+                                  "wait", "read", "limit", "place", "meter", "mux", "stats", "exit"};
+
 /* Shell GUI constants [EDITABLE BY USER] */
 #define ENABLE_COLORS 1
 #define HIDE_CWD 0
 #define DEBUG 0
 
+typedef struct signalName
+{
+    const char *name;
+    int sig;
+} signalName_t;
+
+const int SIGNAL_NAME_COUNT = 12;
+const signalName_t SIGNAL_NAMES[12] = {
+    {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT}, {"KILL", SIGKILL},
+    {"USR1", SIGUSR1}, {"USR2", SIGUSR2}, {"PIPE", SIGPIPE}, {"ALRM", SIGALRM},
+    {"TERM", SIGTERM}, {"CONT", SIGCONT}, {"STOP", SIGSTOP}, {"TSTP", SIGTSTP}};
+
 typedef struct path
 {
     char *path_text;
@@ -74,25 +167,66 @@ typedef struct paths
     pPath_t first;
 } paths_t, *pPaths_t;
 
+/*
+ * Structure: jobStage
+ * -------------------
+ * Represents one process of a job (a job made of a pipeline has one stage per command)
+ *
+ *  pid:        The PID of the process
+ *  alive:      1 until the process has been reaped
+ *  lastTicks:  The CPU time of the process when it was last sampled by "jobs -l"
+ *  lastSample: The time of the last sample (0 if the process has never been sampled)
+ *  started:    The time at which the process has been launched (statsClock)
+ *  statsSlot:  The statistics of the name of the command (-1 for a process which is not a command)
+ */
+typedef struct jobStage
+{
+    int pid;
+    int alive;
+    unsigned long long lastTicks;
+    double lastSample;
+    uint64_t started;
+    int statsSlot;
+} jobStage_t, *pJobStage_t;
+
 /*
  * Structure: childProgram
  * -----------------------
- * Represents a child program running in the background
+ * Represents a child program (a job) running in the background
  * 
- *  id:   A serial number corresponding to its date of creation
- *        The bigger the ID, the younger the child is
- *  pid:  The PID of the child program
- *  argc: The number of arguments given to the child program
- *  argv: An array containing all the arguments given to the child program
- *  next: A pointer to the next child program
- *        NULL if the current child program is the youngest
+ *  id:         A serial number corresponding to its date of creation
+ *              The bigger the ID, the younger the child is
+ *              0 while the job runs in foreground and has never been stopped
+ *  pid:        The PID of the last stage of the child program
+ *  pgid:       The process group shared by all the stages of the child program
+ *  state:      JOB_RUNNING, JOB_STOPPED or JOB_DONE
+ *  status:     The wait status of the last stage, once it has ended
+ *  stageCount: The number of processes launched for the child program
+ *  liveStages: The number of processes which have not been reaped yet
+ *  stages:     An array containing all the processes of the child program
+ *  argc:       The number of arguments given to the child program
+ *  argv:       An array containing all the arguments given to the child program
+ *  limits:     The resource limits applied to all the stages of the child program
+ *  cgroup:     The path of the cgroup of the child program (NULL if it has none)
+ *  placement:  The CPUs on which the stages of the child program run
+ *  next:       A pointer to the next child program
+ *              NULL if the current child program is the youngest
  */
 typedef struct childProgram
 {
     int id;
     int pid;
+    int pgid;
+    int state;
+    int status;
+    int stageCount;
+    int liveStages;
+    pJobStage_t stages;
     int argc;
     char **argv;
+    jobLimits_t limits;
+    char *cgroup;
+    placement_t placement;
     struct childProgram *next;
 } childProgram_t, *pChildProgram_t;
 
@@ -114,33 +248,618 @@ typedef struct programDescriptor
     pChildProgram_t first;
 } progDesc_t, *pProgDesc_t;
 
+/*
+ * Structure: wordList
+ * -------------------
+ * A growable array of words allocated from the line arena
+ *
+ *  words:    The words
+ *  count:    The number of words
+ *  capacity: The number of words the array can hold
+ */
+typedef struct wordList
+{
+    char **words;
+    int count;
+    int capacity;
+} wordList_t, *pWordList_t;
+
+/*
+ * Structure: textBuffer
+ * ---------------------
+ * A growable null-terminated string allocated from the line arena
+ *
+ *  text:     The string (NULL while it is empty)
+ *  len:      The length of the string
+ *  capacity: The number of bytes allocated for the string
+ */
+typedef struct textBuffer
+{
+    char *text;
+    size_t len;
+    size_t capacity;
+} textBuffer_t, *pTextBuffer_t;
+
+/* Types of shell nodes */
+#define NODE_COMMAND 0  // A simple command (a pipeline, possibly launched in background)
+#define NODE_FOR 1      // for NAME in WORDS; do BODY; done
+#define NODE_WHILE 2    // while CONDITION; do BODY; done
+#define NODE_PIPE_INTO 3 // PIPELINE | COMPOUND (the compound command runs in the Shell, reading the pipeline)
+#define NODE_GROUP 4    // { BODY; } (always runs in the Shell)
+#define NODE_SUBSHELL 5 // ( BODY ) (runs in a fork of the Shell only when BODY changes the state of the Shell)
+
+/* How the command of a NODE_COMMAND runs, decided once when it is parsed */
+#define PLAN_PARSE 0   // Parsed each time it runs (pipeline, redirection, here-document, expanded name)
+#define PLAN_BUILTIN 1 // A builtin, found once: only its words are expanded again
+#define PLAN_BINARY 2  // A binary or a stage builtin, looked up once: only its words are expanded again
+
+/*
+ * Structure: shellNode
+ * --------------------
+ * A command of a command line, parsed once and run as many times as needed (loops)
+ * A compound command (loop, group or subshell) may be followed by "> FILE", "> > FILE", "| PIPELINE" or "&"
+ *
+ *  type:      One of the types of shell nodes above
+ *  words:     The words of the command (NODE_COMMAND and NODE_PIPE_INTO) or of the list of values (NODE_FOR), not expanded
+ *  variable:  The name of the variable of the loop (NODE_FOR)
+ *  condition: The commands of the condition of the loop (NODE_WHILE)
+ *  body:      The commands of the body (NODE_FOR, NODE_WHILE, NODE_GROUP and NODE_SUBSHELL), the compound command itself (NODE_PIPE_INTO)
+ *  outFile:   The file receiving the output of a compound command (NULL if none), not expanded
+ *  append:    1 if the output is appended to outFile
+ *  pipeWords: The pipeline reading the output of a compound command (NULL if none), not expanded
+ *  background: 1 if the compound command runs in background
+ *  plan:      How the command runs (NODE_COMMAND), one of the plans above
+ *  builtin:   The builtin run by the command (PLAN_BUILTIN)
+ *  binPath:   The complete path of the binary run by the command (PLAN_BINARY), NULL until it first runs
+ *  arena:     The arena the node has been allocated from, which also holds binPath
+ *  next:      The next command of the list
+ */
+typedef struct shellNode
+{
+    int type;
+    char **words;
+    char *variable;
+    struct shellNode *condition;
+    struct shellNode *body;
+    char *outFile;
+    int append;
+    char **pipeWords;
+    int background;
+    int plan;
+    int builtin;
+    char *binPath;
+    pArena_t arena;
+    struct shellNode *next;
+} shellNode_t, *pShellNode_t;
+
+/*
+ * Structure: tokenStream
+ * ----------------------
+ * The words read by the parser of command lines. More lines are read when a loop is not complete
+ *
+ *  words: The words of the current line
+ *  pos:   The position of the next word
+ */
+typedef struct tokenStream
+{
+    char **words;
+    int pos;
+} tokenStream_t, *pTokenStream_t;
+
+/* Everything that only lives as long as a command line is allocated from this arena, which is reset after each line */
+pArena_t lineArena = NULL;
+
+/*
+ * Structure: variable
+ * -------------------
+ * A variable of the environment of the Shell. Its binding ("NAME=value") is owned by the Shell, which frees it
+ * when the variable is set again (setenv keeps all the bindings it has ever allocated)
+ *
+ *  binding:   The binding, referenced by the environment
+ *  nameLen:   The length of the name of the variable
+ *  inherited: 1 if the variable comes from the environment of the program and has not been set by the Shell
+ *  next:      The next variable
+ */
+typedef struct variable
+{
+    char *binding;
+    size_t nameLen;
+    int inherited;
+    struct variable *next;
+} variable_t, *pVariable_t;
+
+/* The environment of the running context: environ points to an array owned by the Shell, whose bindings are variables */
+pVariable_t variables = NULL;
+size_t envCount = 0;    // The number of bindings of environ
+size_t envCapacity = 0; // The number of entries allocated for environ
+char **hostEnviron = NULL; // The environment of the program, given back to it when the context stops running
+int hostCwd = -1;          // The current directory of the program, given back to it when the context stops running
+
+/*
+ * Structure: commandEntry
+ * -----------------------
+ * A slot of the command cache, which remembers where the commands have been found in the PATH
+ *
+ *  name: The name of the command (NULL for an empty slot)
+ *  path: The complete path of the command (NULL if it has to be searched again)
+ */
+typedef struct commandEntry
+{
+    char *name;
+    char *path;
+} commandEntry_t, *pCommandEntry_t;
+
+/* Command cache: open addressing, kept at most half full */
+#define COMMAND_CACHE_MIN 64 // The initial number of slots of the command cache
+
+pCommandEntry_t commandCache = NULL;
+int commandSlots = 0;
+int commandCount = 0;
+
+/* Session snapshot */
+#define SNAPSHOT_FILE ".quysh_snapshot" // The snapshot file, in the home directory (QUYSH_SNAPSHOT overrides it, empty disables it)
+
+pSnapshot_t snapshot = NULL; // The snapshot mapped at startup (NULL if there was none or if it was stale)
+
+/* Frecency index of the visited directories */
+#define DIRS_FILE ".quysh_dirs" // The index file, in the home directory (QUYSH_DIRS overrides it, empty disables it)
+
+pDirIndex_t dirIndex = NULL; // Loaded the first time a directory is changed to
+
+/* Contexts (libquysh) */
+#define CAPTURE_STREAMS 2    // The standard output and the standard error
+#define CAPTURE_CHUNK 65536 // The largest number of bytes given to an output callback at once
+
+/*
+ * Structure: capture
+ * ------------------
+ * An output of a context (standard output or standard error) captured in a memory file
+ *
+ *  callback: The callback receiving the output (NULL if it is not captured)
+ *  fd:       The memory file (-1 until the output has been captured once)
+ *  offset:   The number of bytes of the memory file already given to the callback
+ *  savedFd:  The output of the program while the context runs (-1 otherwise)
+ */
+typedef struct capture
+{
+    quyshOutput_t callback;
+    int fd;
+    off_t offset;
+    int savedFd;
+} capture_t, *pCapture_t;
+
+/*
+ * Structure: quyshCtx
+ * -------------------
+ * A Shell run by a program (see libquysh.h). The state of the Shell is kept in globals: they are swapped with the
+ * ones of a context while it runs. Contexts are independent, but only one of them runs at a time.
+ * Each context has its own environment and its own current directory: the ones of the program are put back
+ * when the context stops running
+ *
+ *  path:         The PATH of the context
+ *  paths:        The directories of the PATH
+ *  proDes:       The child programs of the context
+ *  arena:        The arena of the lines run by the context (lineArena)
+ *  commandCache: The command cache of the context (with commandSlots and commandCount)
+ *  lastStatus:   The exit status of the last job of the context ("$?")
+ *  env:          The environment of the context (environ while it runs), with envCount and envCapacity
+ *  variables:    The variables of the context, whose bindings env references
+ *  cwdFd:        The current directory of the context (while it does not run)
+ *  captures:     The standard output and the standard error of the context
+ *  userData:     Given to the callbacks of the captures
+ *  next:         The next context of the program
+ */
+struct quyshCtx
+{
+    char *path;
+    pPaths_t paths;
+    pProgDesc_t proDes;
+    pArena_t arena;
+    pCommandEntry_t commandCache;
+    int commandSlots;
+    int commandCount;
+    int lastStatus;
+    char **env;
+    size_t envCount;
+    size_t envCapacity;
+    pVariable_t variables;
+    int cwdFd;
+    capture_t captures[CAPTURE_STREAMS];
+    void *userData;
+    struct quyshCtx *next;
+};
+
+pQuyshCtx_t contexts = NULL;  // All the contexts of the program
+int shellInitialized = 0;     // 1 once job control has been set up
+const char *scriptInput = NULL; // The lines given to quysh_run which have not been read yet (NULL: reads the standard input)
+
+/* Word expansion */
+int wordsExpanded = 0;      // Set by prefix builtins ("limit", "place"): the command they run has already been expanded
+char *substBuffer = NULL;   // Receives the output of command substitutions, kept between substitutions
+size_t substCapacity = 0;
+pPaths_t operandPaths = NULL;       // The paths and the Program Descriptor with which the words of the operators of
+pProgDesc_t operandProDes = NULL;   // parameter expansion are expanded (the callbacks of param.c only take the word)
+
+/* Job control */
+int shellInteractive = 0;       // 1 if the Shell reads its commands from a terminal
+int shellPgid = 0;              // The process group of the Shell, which owns the terminal between two commands
+pChildProgram_t pipeJob = NULL; // The job whose stages are being launched (NULL outside of a command line)
+int pipeBackground = 0;         // 1 if pipeJob has been launched with '&'
+int lastStatus = 0;             // The exit status of the last job ("$?")
+int loopInput = 0;              // The number of "| while" loops running: the standard input is then not the one of the commands
+
+/* Resource limits */
+jobLimits_t nextLimits; // Limits given by a "limit" prefix, applied to the next job
+jobLimits_t bgLimits;   // Default limits of the jobs launched with '&'
+
+/* CPU placement */
+placement_t nextPlacement;    // Placement given by a "place" prefix, applied to the next job
+placement_t defaultPlacement; // Default placement of every job
+
+void initShell();
+pPaths_t newPaths(const char *PATH_RAW);
+void freePaths(pPaths_t paths);
+void enterContext(pQuyshCtx_t ctx);
+void leaveContext(pQuyshCtx_t ctx);
+int runInputLine(char *line, pPaths_t paths, pProgDesc_t proDes);
+int runCommandLine(char **cmd, pPaths_t paths, pProgDesc_t proDes);
+pShellNode_t parseList(pTokenStream_t stream, const char *terminator, int *error);
+pShellNode_t parseCompound(pTokenStream_t stream, int *error);
+pShellNode_t parseLoop(pTokenStream_t stream, int *error);
+pShellNode_t parseGroup(pTokenStream_t stream, int *error);
+int parseRedirections(pTokenStream_t stream, pShellNode_t node);
+pShellNode_t newShellNode(int type);
+char *peekWord(pTokenStream_t stream, int needMore);
+int expectWord(pTokenStream_t stream, const char *word);
+int runNodes(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+void planCommand(pShellNode_t node);
+int runPlannedCommand(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+int runLoop(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+int runCompound(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+int runCompoundHere(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+int forkCompound(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+int launchConsumer(char **words, pPaths_t paths, pProgDesc_t proDes);
+int redirectOutput(char *file, int append, pPaths_t paths, pProgDesc_t proDes);
+int runPipedCompound(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes);
+int changesState(pShellNode_t node);
+char **copyWords(char **words);
+void setVariable(const char *name, const char *value);
+int isKeyword(char *word);
+int startsCompound(char *word);
+int isNameChar(char c, int first);
 int parseCommand(char **cmd, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes);
+int findBuiltin(char *name);
+int runBuiltin(int builtin, int argCount, int localArgsCount, char **cmd, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes);
+void startJob(char **cmd, pProgDesc_t proDes);
 int executeCommand(char *path, int argc, char **argv, char **envp, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, char *outFile, pProgDesc_t proDes);
+void finishStage(char *name, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, pProgDesc_t proDes);
+int runBuiltinStage(stageBuiltin_t run, int argc, char **argv, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, char *outFile, pProgDesc_t proDes);
+void launchBuiltinWriter(int fd, const char *output, size_t len);
 char *getPwd();
 char *getBinPath(char *filename, pPaths_t paths);
 int fileExists(char *filename);
 int isOperator(char c);
 int printShellPrefix();
+char *lookupCommand(char *name);
+void cacheCommand(char *name, char *path);
+char *getSnapshotFile();
+void restoreSnapshot();
+void writeSnapshot(const char *path);
+char *readInputLine(pArena_t arena);
+char *readScriptLine(pArena_t arena);
+void closePipeEnd(int pipeFd[2], int end);
+int pipelineLength(char **cmd, int *background);
+
+char **expandCommand(char **cmd, pPaths_t paths, pProgDesc_t proDes);
+void expandWord(char *word, pWordList_t fields, pPaths_t paths, pProgDesc_t proDes);
+char *commandSubstitution(char *command, pPaths_t paths, pProgDesc_t proDes);
+char *arithmeticExpansion(char *expression, pPaths_t paths, pProgDesc_t proDes);
+char *parameterExpansion(char *body, pPaths_t paths, pProgDesc_t proDes);
+const char *getParameter(const char *name);
+char *expandOperand(char *word);
+char *findClosingBracket(char *open);
+void addWord(pWordList_t list, char *word);
+void appendText(pTextBuffer_t buffer, const char *text, size_t len);
+
+char **takeHereDocuments(char **cmd);
+void readHereDocument(char *delimiter, pTextBuffer_t body);
+int openHereDocument(const char *text, size_t len);
+int writeAll(int fd, const char *buffer, size_t len);
+
+void launchTeeRelay(int teePipe[2], int append);
+void addMeterHop(int givePipe[2], char *from);
+void launchMeter(pChildProgram_t child, int live);
+void closeMeterHops();
+void openJobOutput();
+void sendJobOutput(int id);
+void closeJobOutput();
+void relayOutput(int inFd, char **files, int append);
+ssize_t spliceOutput(int fromFd, int toFd, size_t len);
+
+int cdCommand(int argc, char **argv);
+int jumpCommand(char *name, int argc, char **argv);
+pDirIndex_t getDirIndex();
+void recordVisit();
+int jobsCommand(int argc, char **argv, pProgDesc_t proDes);
+int fgCommand(int argc, char **argv, pProgDesc_t proDes);
+int bgCommand(int argc, char **argv, pProgDesc_t proDes);
+int killCommand(int argc, char **argv, pProgDesc_t proDes);
+int waitCommand(int argc, char **argv, pProgDesc_t proDes);
+int statsCommand(int argc, char **argv);
+int limitCommand(int argc, char **argv, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes);
+int placeCommand(int argc, char **argv, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes);
+int meterCommand(int argc, char **argv, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes);
+int muxCommand(int argc, char **argv);
+int readCommand(int argc, char **argv);
+void assignReadFields(char *line, size_t len, char **names, int count, int raw);
+int isFieldBlank(char c, const char *ifs);
+int parseSignal(char *name);
+void formatBytes(unsigned long long bytes, char *buffer, int bufferLen);
 
 pProgDesc_t newProgramDescriptor();
 void freeProgramDescriptor(pProgDesc_t proDes);
-pChildProgram_t addProgram(int pid, int argc, char **argv, pProgDesc_t proDes);
+pChildProgram_t addProgram(int argc, char **argv, pProgDesc_t proDes);
+void addStage(int pid, pChildProgram_t child);
 int removeProgram(int id, pProgDesc_t proDes);
 pChildProgram_t findProgram(int pid, pProgDesc_t proDes);
+pJobStage_t findStage(int pid, pChildProgram_t child);
+pChildProgram_t findJob(char *spec, pProgDesc_t proDes);
+void printProgram(pChildProgram_t child, char *status);
+int finishPipeline(int state, pProgDesc_t proDes);
+int waitProgram(pChildProgram_t child, pProgDesc_t proDes);
+void reapChildren(pProgDesc_t proDes);
+int waitNextChild(pProgDesc_t proDes);
+int collectJobs(pProgDesc_t proDes, int *live);
+int pollStages(pProgDesc_t proDes, int *live);
+void collectChild(int childPid, int status, pProgDesc_t proDes);
+void endStage(pChildProgram_t child, pJobStage_t stage, int status);
+int exitStatus(int status);
+
+/*
+ * Function: quysh_ctx_new
+ * -----------------------
+ * Creates a Shell context, which runs command lines with the PATH of the program at the time of its creation
+ * The first context also sets up job control for the whole program
+ *
+ *  Returns: A pointer to the newly allocated context
+ */
+pQuyshCtx_t quysh_ctx_new()
+{
+    pQuyshCtx_t ctx = (pQuyshCtx_t)calloc(1, sizeof(struct quyshCtx));
+    const char *path = getenv("PATH");
+
+    if (!shellInitialized)
+        initShell();
+
+    ctx->path = strdup((path != NULL) ? path : "");
+    ctx->paths = newPaths(ctx->path);
+    ctx->proDes = newProgramDescriptor();
+    ctx->arena = newArena(LINE_ARENA_BLOCK);
+
+    // The context starts with a copy of the environment and of the current directory of the program
+    while (environ[ctx->envCount] != NULL)
+        ctx->envCount++;
+    ctx->envCapacity = ctx->envCount + 16;
+    ctx->env = (char **)malloc(ctx->envCapacity * sizeof(char *));
+    for (size_t i = 0; i < ctx->envCount; i++)
+    {
+        pVariable_t variable = (pVariable_t)malloc(sizeof(variable_t));
+        char *equal = strchr(environ[i], '=');
+
+        variable->binding = strdup(environ[i]);
+        variable->nameLen = (equal != NULL) ? (size_t)(equal - environ[i]) : strlen(environ[i]);
+        variable->inherited = 1;
+        variable->next = ctx->variables;
+        ctx->variables = variable;
+        ctx->env[i] = variable->binding;
+    }
+    ctx->env[ctx->envCount] = NULL;
+    ctx->cwdFd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+
+    for (int i = 0; i < CAPTURE_STREAMS; i++)
+    {
+        ctx->captures[i].fd = -1;
+        ctx->captures[i].savedFd = -1;
+    }
+
+    ctx->next = contexts;
+    contexts = ctx;
+
+    return ctx;
+}
+
+/*
+ * Function: quysh_ctx_free
+ * ------------------------
+ * Deallocates a Shell context. Its child programs are forgotten (they are not killed)
+ * The last context moves the program back to the cgroup it was started in (see probeCgroup in joblimits.c)
+ *
+ *  ctx:     The context
+ */
+void quysh_ctx_free(pQuyshCtx_t ctx)
+{
+    pQuyshCtx_t *it = &contexts;
+
+    while (*it != ctx)
+        it = &((*it)->next);
+    *it = ctx->next;
+
+    for (int i = 0; i < ctx->commandSlots; i++)
+    {
+        free(ctx->commandCache[i].name);
+        free(ctx->commandCache[i].path);
+    }
+    free(ctx->commandCache);
+
+    for (int i = 0; i < CAPTURE_STREAMS; i++)
+        if (ctx->captures[i].fd != -1)
+            close(ctx->captures[i].fd);
+
+    while (ctx->variables != NULL)
+    {
+        pVariable_t next = ctx->variables->next;
+
+        free(ctx->variables->binding);
+        free(ctx->variables);
+        ctx->variables = next;
+    }
+    free(ctx->env);
+    if (ctx->cwdFd != -1)
+        close(ctx->cwdFd);
+
+    freeProgramDescriptor(ctx->proDes);
+    freeArena(ctx->arena);
+    freePaths(ctx->paths);
+    free(ctx->path);
+    free(ctx);
+
+    // The last context gives back the cgroup the program was started in
+    if (contexts == NULL)
+        releaseCgroup();
+}
+
+/*
+ * Function: quysh_set_output
+ * --------------------------
+ * Captures the standard output and the standard error of the commands run by a context
+ * The output of a background job which is still running is given to the callback by the next calls to quysh_run
+ *
+ *  ctx:      The context
+ *  output:   The callback receiving the standard output (NULL to leave it to the program)
+ *  error:    The callback receiving the standard error (NULL to leave it to the program)
+ *  userData: Given to the callbacks
+ */
+void quysh_set_output(pQuyshCtx_t ctx, quyshOutput_t output, quyshOutput_t error, void *userData)
+{
+    ctx->captures[0].callback = output;
+    ctx->captures[1].callback = error;
+    ctx->userData = userData;
+}
+
+/*
+ * Function: quysh_run
+ * -------------------
+ * Runs a command line, as if it had been typed in the Shell. Several lines can be given, separated by '\n':
+ * a loop or a here-document is completed by the following lines, as in an interactive Shell
+ *
+ *  ctx:     The context
+ *  line:    The command line
+ *  status:  Receives the exit status of the last command ("$?"), may be NULL
+ *
+ *  Returns: QUYSH_OK, QUYSH_ERROR if the last command could not run (syntax error, invalid arguments of a builtin)
+ *           or QUYSH_EXIT if the "exit" builtin has been run (the following lines are ignored)
+ */
+int quysh_run(pQuyshCtx_t ctx, const char *line, int *status)
+{
+    int fb = OK_SIG;
+    char *text;
+
+    enterContext(ctx);
+    scriptInput = line;
+
+    // Reports the background jobs of the previous calls which have ended
+    reapChildren(ctx->proDes);
+
+    while (fb != EXIT_SIG && (text = readInputLine(lineArena)) != NULL)
+        fb = runInputLine(text, ctx->paths, ctx->proDes);
+
+    scriptInput = NULL;
+    leaveContext(ctx);
+
+    if (status != NULL)
+        *status = ctx->lastStatus;
+
+    if (fb == EXIT_SIG)
+        return QUYSH_EXIT;
+
+    return (fb == ERROR_SIG) ? QUYSH_ERROR : QUYSH_OK;
+}
+
+/*
+ * Function: quysh_interact
+ * ------------------------
+ * Runs the interactive loop of the Shell on the standard input: prompt, line editor, history and session snapshot
+ * when it is a terminal. Returns when the input ends or when the "exit" builtin is run
+ *
+ *  ctx:     The context
+ */
+void quysh_interact(pQuyshCtx_t ctx)
+{
+    enterContext(ctx);
+
+    // An interactive Shell starts from the state saved by the previous one
+    if (shellInteractive)
+        restoreSnapshot();
+
+    // Shell Loop
+    for (;;)
+    {
+        // Looks for terminated children
+        reapChildren(ctx->proDes);
+
+        printShellPrefix();
+        fflush(stdout);
+        char *line = readInputLine(lineArena);
+
+        // End of the input (Ctrl-D)
+        if (line == NULL)
+            break;
+        if (shellInteractive)
+            addHistory(line);
+
+        if (runInputLine(line, ctx->paths, ctx->proDes) == EXIT_SIG)
+            break;
+    }
+
+    if (shellInteractive)
+        writeSnapshot(ctx->path);
+
+    leaveContext(ctx);
+}
 
-int main(int argc, char **argv, char **envp)
+/*
+ * Function: initShell
+ * -------------------
+ * Sets up what the Shell shares between all of its contexts: job control and the default limits and placement
+ */
+void initShell()
 {
     if (DEBUG)
         printf("--< DEBUG mode is activated >--\n\n");
 
-    const char *PATH_RAW = getenv("PATH");
+    // Every job runs in its own process group: the Shell has to hand the terminal over to foreground jobs and take it back
+    shellInteractive = isatty(STDIN_FILENO);
+    shellPgid = getpgrp();
+    signal(SIGTTOU, SIG_IGN);
+
+    clearLimits(&nextLimits);
+    clearLimits(&bgLimits);
+
+    parsePlacement("none", &defaultPlacement);
+    nextPlacement = defaultPlacement;
+
+    shellInitialized = 1;
+}
+
+/*
+ * Function: newPaths
+ * ------------------
+ * Splits a PATH into the list of its directories
+ *
+ *  PATH_RAW: The PATH
+ *
+ *  Returns: A pointer to the newly allocated list of paths
+ */
+pPaths_t newPaths(const char *PATH_RAW)
+{
     const int PATH_RAW_LEN = strlen(PATH_RAW);
     const char PATH_DELIM[2] = ":";
 
-    char *PATH_RAW_CPY = (char *)malloc(PATH_RAW_LEN * sizeof(char));
+    char *PATH_RAW_CPY = (char *)malloc((PATH_RAW_LEN + 1) * sizeof(char));
 
-    char *str_it;    // An iterator over the RAW_PATH where elements are delimited by the PATH_DELIM character
-    pPath_t path_it; // A path iterator
+    char *str_it;            // An iterator over the RAW_PATH where elements are delimited by the PATH_DELIM character
+    pPath_t path_it = NULL;  // A path iterator
+    pPath_t prev_pt = NULL;
 
     pPaths_t paths = (pPaths_t)malloc(sizeof(paths_t));
     paths->count = 0;
@@ -154,16 +873,18 @@ int main(int argc, char **argv, char **envp)
 
     // Splits the RAW_PATH into multiple individual path structures
     str_it = strtok(PATH_RAW_CPY, PATH_DELIM);
-    path_it = (pPath_t)malloc(sizeof(path_t));
     while (str_it != NULL)
     {
         // Initializes a path
-        path_it->path_text = (char *)malloc(MAX_PATH_LEN * sizeof(char));
+        path_it = (pPath_t)malloc(sizeof(path_t));
+        path_it->path_text = (char *)malloc((strlen(str_it) + 1) * sizeof(char));
         path_it->next = NULL;
 
-        // References the first path to the paths structure
-        if (paths->count == 0)
+        // References the first path to the paths structure, or links it to the previous one
+        if (prev_pt == NULL)
             paths->first = path_it;
+        else
+            prev_pt->next = path_it;
 
         // Copies the values from the RAW_PATH iterator to our custom path structure
         strcpy(path_it->path_text, str_it);
@@ -173,75 +894,27 @@ int main(int argc, char **argv, char **envp)
             printf("\t%s\n", path_it->path_text);
 
         // Continues to the next entry
+        prev_pt = path_it;
         str_it = strtok(NULL, PATH_DELIM);
-        if (str_it != NULL)
-            path_it->next = (pPath_t)malloc(sizeof(path_t));
-        path_it = path_it->next;
     }
 
-    pProgDesc_t proDes = newProgramDescriptor();
-
-    // Shell Loop
-    for (;;)
-    {
-        // Looks for terminated children
-        int status;
-        int childPid;
-
-        while ((childPid = waitpid(-1, &status, WNOHANG)) > 0)
-        {
-            pChildProgram_t child = findProgram(childPid, proDes);
-
-            if (child != NULL)
-            {
-                printf("[%d]  Done\t\t", child->id);
-                for (int i = 0; i < child->argc; i++)
-                {
-                    printf("%s ", child->argv[i]);
-                }
-                printf("\n");
-
-                removeProgram(child->id, proDes);
-            }
-            else
-            {
-                printf("Couldn't find %d", childPid);
-                exit(-1);
-            }
-        }
-
-        if (DEBUG)
-        {
-            if (childPid != -1)
-            {
-                if (childPid == 0)
-                {
-                    printf("My heirs are doing me proud.\n");
-                }
-                else
-                {
-                    printf("Ended %d... They will be remembered. [%d]\n", childPid, status);
-                }
-            }
-        }
-
-        printShellPrefix();
-        fflush(stdout);
-        char *line = readline();
-
-        int fb = parseCommand(split_in_words(line), paths, 0, 0, proDes); // There is no pipe at the start
-
-        if (fb == EXIT_SIG)
-            break;
-
-        free(line);
-    }
+    free(PATH_RAW_CPY);
 
-    freeProgramDescriptor(proDes);
+    return paths;
+}
 
-    // Frees the allocated memory
-    path_it = paths->first;
+/*
+ * Function: freePaths
+ * -------------------
+ * Deallocates a list of paths
+ *
+ *  paths:   The list of paths
+ */
+void freePaths(pPaths_t paths)
+{
+    pPath_t path_it = paths->first;
     pPath_t prev_pt;
+
     while (path_it != NULL)
     {
         free(path_it->path_text);
@@ -250,528 +923,4740 @@ int main(int argc, char **argv, char **envp)
         free(prev_pt);
     }
     free(paths);
-
-    free(PATH_RAW_CPY);
-
-    return 0;
 }
 
 /*
- * Function: parseCommand
+ * Function: enterContext
  * ----------------------
- * Evaluates a given command
+ * Makes a context the one the Shell runs: its state replaces the globals of the Shell,
+ * and the outputs it captures are sent to its memory files
  *
- *  line:           The user input
- *  paths:          The structure containing all paths referenced in the PATH environement variable
- *  readFromPipe:   1 if the given command was prefixed by a '|'
- *                  0 otherwise
- *  pipeCount:      The number of pipes preceeding the given command
- *
- *  Returns: 0 if the command was processed correctly
- *           EXIT_SIG if the user wants to exit the Shell 
+ *  ctx:     The context
  */
-int parseCommand(char **cmd, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes)
+void enterContext(pQuyshCtx_t ctx)
 {
-    int fb = OK_SIG;
-    int argCount;
-    int localArgsCount = 0;
-    int reached = 0;
+    lineArena = ctx->arena;
+    commandCache = ctx->commandCache;
+    commandSlots = ctx->commandSlots;
+    commandCount = ctx->commandCount;
+    lastStatus = ctx->lastStatus;
 
-    // Counts command arguments (command name included)
-    // And replaces the "~" character in commands by "/home/usr" as well
-    for (argCount = 0; cmd[argCount] != NULL; argCount++)
+    // The environment and the directory of the program are kept aside while the context runs
+    variables = ctx->variables;
+    envCount = ctx->envCount;
+    envCapacity = ctx->envCapacity;
+    hostEnviron = environ;
+    environ = ctx->env;
+    hostCwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (ctx->cwdFd != -1)
+        fchdir(ctx->cwdFd);
+
+    // What the program has printed so far must not be captured
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = 0; i < CAPTURE_STREAMS; i++)
     {
-        if (strcmp(cmd[argCount], "~") == 0)
-            cmd[argCount] = getenv("HOME");
+        pCapture_t capture = &(ctx->captures[i]);
 
-        if (!reached && (strcmp(cmd[argCount], "&") == 0 || strcmp(cmd[argCount], "|") == 0))
-            reached = 1;
+        if (capture->callback == NULL)
+            continue;
 
-        if (!reached)
-            localArgsCount++;
+        // The children share the offset of the memory file: with O_APPEND, they never overwrite each other
+        if (capture->fd == -1)
+        {
+            capture->fd = memfd_create((i == 0) ? "quysh-output" : "quysh-error", MFD_CLOEXEC);
+            if (capture->fd == -1)
+                continue;
+            fcntl(capture->fd, F_SETFL, O_APPEND);
+        }
+
+        capture->savedFd = fcntl(STDOUT_FILENO + i, F_DUPFD_CLOEXEC, 0);
+        if (capture->savedFd != -1)
+            dup2(capture->fd, STDOUT_FILENO + i);
+    }
+}
+
+/*
+ * Function: leaveContext
+ * ----------------------
+ * Saves the state of the context which has run, gives the outputs back to the program,
+ * and passes what has been captured to the callbacks of the context
+ *
+ *  ctx:     The context
+ */
+void leaveContext(pQuyshCtx_t ctx)
+{
+    char buffer[CAPTURE_CHUNK];
+    ssize_t len;
+
+    ctx->arena = lineArena;
+    ctx->commandCache = commandCache;
+    ctx->commandSlots = commandSlots;
+    ctx->commandCount = commandCount;
+    ctx->lastStatus = lastStatus;
+
+    ctx->variables = variables;
+    ctx->env = environ;
+    ctx->envCount = envCount;
+    ctx->envCapacity = envCapacity;
+    environ = hostEnviron;
+    if (ctx->cwdFd != -1)
+        close(ctx->cwdFd);
+    ctx->cwdFd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (hostCwd != -1)
+    {
+        fchdir(hostCwd);
+        close(hostCwd);
+        hostCwd = -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = 0; i < CAPTURE_STREAMS; i++)
+    {
+        pCapture_t capture = &(ctx->captures[i]);
+
+        if (capture->savedFd == -1)
+            continue;
+
+        dup2(capture->savedFd, STDOUT_FILENO + i);
+        close(capture->savedFd);
+        capture->savedFd = -1;
+
+        while ((len = pread(capture->fd, buffer, sizeof(buffer), capture->offset)) > 0)
+        {
+            capture->offset += len;
+            capture->callback(buffer, len, ctx->userData);
+        }
+
+        // Once the context has no child program left, nothing writes to the memory file anymore
+        if (ctx->proDes->first == NULL && capture->offset > 0)
+        {
+            ftruncate(capture->fd, 0);
+            capture->offset = 0;
+        }
+    }
+}
+
+/*
+ * Function: runInputLine
+ * ----------------------
+ * Splits a line of input into words and runs it. Everything allocated for the line is freed afterwards
+ *
+ *  line:    The line
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the command line (EXIT_SIG if the user wants to exit the Shell)
+ */
+int runInputLine(char *line, pPaths_t paths, pProgDesc_t proDes)
+{
+    uint64_t parseStart = statsClock();
+    char **words = split_in_words_in(line, lineArena);
+    int fb;
+
+    countStat(STAT_LINES);
+    recordLatency(STAT_PARSE, statsClock() - parseStart);
+
+    fb = runCommandLine(words, paths, proDes);
+
+    if (DEBUG)
+        printf("Arena: %zu bytes in %zu allocations (high-water mark: %zu bytes, capacity: %zu bytes)\n",
+               lineArena->used, lineArena->allocations, lineArena->highWater, lineArena->capacity);
+
+    // Frees the line, its words and everything allocated while running it
+    resetArena(lineArena);
+
+    return fb;
+}
+
+/*
+ * Function: runCommandLine
+ * ------------------------
+ * Parses a command line into a list of commands separated by ';' (including loops, groups and subshells), then runs them
+ * A compound command which is not complete on the line is completed by reading more lines
+ *
+ *  cmd:     The words of the command line
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the last command, ERROR_SIG on a syntax error
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runCommandLine(char **cmd, pPaths_t paths, pProgDesc_t proDes)
+{
+    tokenStream_t stream = {cmd, 0};
+    pShellNode_t list;
+    int error = 0;
+    int i;
+
+    // A single command does not need to be parsed into a list
+    for (i = 0; cmd[i] != NULL; i++)
+        if (strcmp(cmd[i], ";") == 0 || (strcmp(cmd[i], "|") == 0 && cmd[i + 1] != NULL && startsCompound(cmd[i + 1])))
+            break;
+    if (cmd[i] == NULL && (cmd[0] == NULL || !isKeyword(cmd[0])))
+        return parseCommand(cmd, paths, 0, 0, proDes); // There is no pipe at the start
+
+    list = parseList(&stream, NULL, &error);
+    if (error)
+        return ERROR_SIG;
+
+    return runNodes(list, paths, proDes);
+}
+
+/*
+ * Function: parseList
+ * -------------------
+ * Parses commands separated by ';' up to a terminator ("do", "done", "}" or ")") or to the end of the line
+ *
+ *  stream:     The words to parse
+ *  terminator: The word ending the list (not consumed), NULL for the end of the line
+ *  error:      Set to 1 on a syntax error
+ *
+ *  Returns: The first command of the list (NULL if it is empty)
+ */
+pShellNode_t parseList(pTokenStream_t stream, const char *terminator, int *error)
+{
+    pShellNode_t first = NULL;
+    pShellNode_t last = NULL;
+
+    for (;;)
+    {
+        char *word = peekWord(stream, terminator != NULL);
+        pShellNode_t node;
+
+        if (word == NULL || (terminator != NULL && strcmp(word, terminator) == 0))
+            break;
+
+        if (strcmp(word, ";") == 0)
+        {
+            stream->pos++;
+            continue;
+        }
+
+        if (startsCompound(word))
+        {
+            node = parseCompound(stream, error);
+            if (node == NULL)
+                return NULL;
+        }
+        else if (isKeyword(word))
+        {
+            printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, word);
+            *error = 1;
+            return NULL;
+        }
+        else
+        {
+            wordList_t words = {NULL, 0, 0};
+
+            while ((word = peekWord(stream, 0)) != NULL && strcmp(word, ";") != 0)
+            {
+                // "| while", "| {" or "| (" gives the output of the pipeline to a compound command
+                if (strcmp(word, "|") == 0 && stream->words[stream->pos + 1] != NULL && startsCompound(stream->words[stream->pos + 1]))
+                    break;
+                // Inside a subshell, ")" ends the command
+                if (terminator != NULL && strcmp(terminator, ")") == 0 && strcmp(word, ")") == 0)
+                    break;
+                addWord(&words, word);
+                stream->pos++;
+            }
+
+            if (word != NULL && strcmp(word, "|") == 0 && words.count == 0)
+            {
+                printf("%s: syntax error near unexpected token `|'\n", SHELL_NAME);
+                *error = 1;
+                return NULL;
+            }
+            addWord(&words, NULL);
+
+            node = newShellNode(NODE_COMMAND);
+            node->words = words.words;
+            planCommand(node);
+
+            if (word != NULL && strcmp(word, "|") == 0)
+            {
+                stream->pos++;
+                node->type = NODE_PIPE_INTO;
+                node->body = parseCompound(stream, error);
+                if (node->body == NULL)
+                    return NULL;
+
+                // "&" sends the pipeline to the background together with the command reading it
+                node->background = node->body->background;
+                node->body->background = 0;
+            }
+        }
+
+        // A compound command is ended by ';', '&', the end of the line or the terminator of the enclosing list
+        word = peekWord(stream, 0);
+        if (node->type != NODE_COMMAND && !node->background && word != NULL && strcmp(word, ";") != 0 && (terminator == NULL || strcmp(word, terminator) != 0))
+        {
+            printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, word);
+            *error = 1;
+            return NULL;
+        }
+
+        node->next = NULL;
+        if (last != NULL)
+            last->next = node;
+        else
+            first = node;
+        last = node;
+    }
+
+    return first;
+}
+
+/*
+ * Function: parseCompound
+ * -----------------------
+ * Parses a compound command (a loop, a group or a subshell) and what may follow it:
+ * "> FILE" or "> > FILE" (its output goes to FILE), "| PIPELINE" (its output goes to PIPELINE) and "&"
+ *
+ *  stream:  The words to parse, starting at "for", "while", "{" or "("
+ *  error:   Set to 1 on a syntax error
+ *
+ *  Returns: The compound command, NULL on a syntax error
+ */
+pShellNode_t parseCompound(pTokenStream_t stream, int *error)
+{
+    char *word = peekWord(stream, 1);
+    pShellNode_t node;
+
+    if (strcmp(word, "{") == 0 || strcmp(word, "(") == 0)
+        node = parseGroup(stream, error);
+    else
+        node = parseLoop(stream, error);
+
+    if (node == NULL)
+        return NULL;
+
+    if (!parseRedirections(stream, node))
+    {
+        *error = 1;
+        return NULL;
+    }
+
+    return node;
+}
+
+/*
+ * Function: parseLoop
+ * -------------------
+ * Parses "for NAME in WORDS; do BODY; done" or "while CONDITION; do BODY; done"
+ *
+ *  stream:  The words to parse, starting at "for" or "while"
+ *  error:   Set to 1 on a syntax error
+ *
+ *  Returns: The loop, NULL on a syntax error
+ */
+pShellNode_t parseLoop(pTokenStream_t stream, int *error)
+{
+    pShellNode_t node = newShellNode(NODE_WHILE);
+    char *word = peekWord(stream, 1);
+
+    stream->pos++;
+
+    if (strcmp(word, "for") == 0)
+    {
+        wordList_t values = {NULL, 0, 0};
+
+        node->type = NODE_FOR;
+
+        word = peekWord(stream, 1);
+        if (word == NULL)
+        {
+            printf("%s: syntax error: unexpected end of file\n", SHELL_NAME);
+            *error = 1;
+            return NULL;
+        }
+        if (!isNameChar(word[0], 1))
+        {
+            printf("%s: for: `%s': not a valid identifier\n", SHELL_NAME, word);
+            *error = 1;
+            return NULL;
+        }
+        for (int i = 1; word[i] != '\0'; i++)
+        {
+            if (!isNameChar(word[i], 0))
+            {
+                printf("%s: for: `%s': not a valid identifier\n", SHELL_NAME, word);
+                *error = 1;
+                return NULL;
+            }
+        }
+        node->variable = word;
+        stream->pos++;
+
+        if (!expectWord(stream, "in"))
+        {
+            *error = 1;
+            return NULL;
+        }
+
+        // The values end with the line or with ';'
+        while ((word = peekWord(stream, 0)) != NULL && strcmp(word, ";") != 0)
+        {
+            addWord(&values, word);
+            stream->pos++;
+        }
+        addWord(&values, NULL);
+        node->words = values.words;
+    }
+    else
+    {
+        node->condition = parseList(stream, "do", error);
+        if (*error)
+            return NULL;
+        if (node->condition == NULL)
+        {
+            printf("%s: syntax error near unexpected token `do'\n", SHELL_NAME);
+            *error = 1;
+            return NULL;
+        }
+    }
+
+    while ((word = peekWord(stream, 1)) != NULL && strcmp(word, ";") == 0)
+        stream->pos++;
+
+    if (!expectWord(stream, "do"))
+    {
+        *error = 1;
+        return NULL;
+    }
+
+    node->body = parseList(stream, "done", error);
+    if (*error)
+        return NULL;
+
+    if (!expectWord(stream, "done"))
+    {
+        *error = 1;
+        return NULL;
+    }
+
+    return node;
+}
+
+/*
+ * Function: parseGroup
+ * --------------------
+ * Parses "{ BODY; }" or "( BODY )"
+ *
+ *  stream:  The words to parse, starting at "{" or "("
+ *  error:   Set to 1 on a syntax error
+ *
+ *  Returns: The group or the subshell, NULL on a syntax error
+ */
+pShellNode_t parseGroup(pTokenStream_t stream, int *error)
+{
+    int subshell = (strcmp(peekWord(stream, 1), "(") == 0);
+    const char *closing = subshell ? ")" : "}";
+    pShellNode_t node = newShellNode(subshell ? NODE_SUBSHELL : NODE_GROUP);
+
+    stream->pos++;
+
+    node->body = parseList(stream, closing, error);
+    if (*error)
+        return NULL;
+    if (node->body == NULL)
+    {
+        printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, closing);
+        *error = 1;
+        return NULL;
+    }
+
+    if (!expectWord(stream, closing))
+    {
+        *error = 1;
+        return NULL;
+    }
+
+    return node;
+}
+
+/*
+ * Function: parseRedirections
+ * ---------------------------
+ * Parses what may follow a compound command: "> FILE", "> > FILE", then "| PIPELINE" or "&"
+ * The pipeline ends with ';' or with the line
+ *
+ *  stream:  The words to parse, just after the compound command
+ *  node:    The compound command
+ *
+ *  Returns: 1 on success, 0 on a syntax error (which is printed)
+ */
+int parseRedirections(pTokenStream_t stream, pShellNode_t node)
+{
+    char *word = peekWord(stream, 0);
+
+    if (word != NULL && strcmp(word, ">") == 0)
+    {
+        stream->pos++;
+        word = peekWord(stream, 0);
+        if (word != NULL && strcmp(word, ">") == 0)
+        {
+            node->append = 1;
+            stream->pos++;
+            word = peekWord(stream, 0);
+        }
+
+        if (word == NULL || isOperator(word[0]) || strcmp(word, ";") == 0 || strcmp(word, "&") == 0)
+        {
+            printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, (word != NULL) ? word : "newline");
+            return 0;
+        }
+        node->outFile = word;
+        stream->pos++;
+        word = peekWord(stream, 0);
+    }
+
+    if (word != NULL && strcmp(word, "|") == 0)
+    {
+        wordList_t words = {NULL, 0, 0};
+
+        stream->pos++;
+        while ((word = peekWord(stream, 0)) != NULL && strcmp(word, ";") != 0)
+        {
+            addWord(&words, word);
+            stream->pos++;
+        }
+
+        if (words.count == 0)
+        {
+            printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, (word != NULL) ? word : "newline");
+            return 0;
+        }
+        addWord(&words, NULL);
+        node->pipeWords = words.words;
+    }
+    else if (word != NULL && strcmp(word, "&") == 0)
+    {
+        node->background = 1;
+        stream->pos++;
+    }
+
+    return 1;
+}
+
+/*
+ * Function: newShellNode
+ * ----------------------
+ * Allocates a shell node from the line arena, all of whose fields are empty
+ *
+ *  type:    One of the types of shell nodes
+ *
+ *  Returns: The node
+ */
+pShellNode_t newShellNode(int type)
+{
+    pShellNode_t node = (pShellNode_t)arenaAlloc(lineArena, sizeof(shellNode_t));
+
+    memset(node, 0, sizeof(shellNode_t));
+    node->type = type;
+    node->arena = lineArena;
+
+    return node;
+}
+
+/*
+ * Function: peekWord
+ * ------------------
+ * Returns the next word of a token stream without consuming it
+ * Inside a loop, the end of the line is read as a ';' followed by the words of the next line
+ *
+ *  stream:   The token stream
+ *  needMore: 1 to read another line at the end of the current one (the loop is not complete yet)
+ *
+ *  Returns: The next word, NULL at the end of the line
+ */
+char *peekWord(pTokenStream_t stream, int needMore)
+{
+    if (stream->words[stream->pos] == NULL && needMore)
+    {
+        wordList_t words = {NULL, 0, 0};
+        char *line;
+        char **next;
+
+        if (shellInteractive && scriptInput == NULL)
+        {
+            printf(CONTINUATION_PROMPT);
+            fflush(stdout);
+        }
+
+        line = readInputLine(lineArena);
+        if (line == NULL)
+            return NULL;
+        next = split_in_words_in(line, lineArena);
+
+        addWord(&words, ";");
+        for (int i = 0; next[i] != NULL; i++)
+            addWord(&words, next[i]);
+        addWord(&words, NULL);
+
+        stream->words = words.words;
+        stream->pos = 0;
+    }
+
+    return stream->words[stream->pos];
+}
+
+/*
+ * Function: expectWord
+ * --------------------
+ * Consumes the next word of a token stream, which has to be a given keyword
+ *
+ *  stream:  The token stream
+ *  word:    The expected keyword
+ *
+ *  Returns: 1 if the keyword has been consumed, 0 otherwise (a syntax error is printed)
+ */
+int expectWord(pTokenStream_t stream, const char *word)
+{
+    char *next = peekWord(stream, 1);
+
+    if (next == NULL)
+    {
+        printf("%s: syntax error: unexpected end of file (expected `%s')\n", SHELL_NAME, word);
+        return 0;
+    }
+
+    if (strcmp(next, word) != 0)
+    {
+        printf("%s: syntax error near unexpected token `%s' (expected `%s')\n", SHELL_NAME, next, word);
+        return 0;
+    }
+
+    stream->pos++;
+
+    return 1;
+}
+
+/*
+ * Function: runNodes
+ * ------------------
+ * Runs a list of commands, one after the other
+ *
+ *  node:    The first command of the list
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the last command
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runNodes(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    int fb = OK_SIG;
+
+    for (; node != NULL && fb != EXIT_SIG; node = node->next)
+    {
+        // The words are copied: parsing a command modifies them
+        if (node->type == NODE_COMMAND && node->plan != PLAN_PARSE)
+            fb = runPlannedCommand(node, paths, proDes);
+        else if (node->type == NODE_COMMAND)
+            fb = parseCommand(copyWords(node->words), paths, 0, 0, proDes);
+        else
+            fb = runCompound(node, paths, proDes);
+    }
+
+    return fb;
+}
+
+/*
+ * Function: planCommand
+ * ---------------------
+ * Decides once how a command of a list runs. A single builtin or binary whose name is not expanded only has its
+ * words expanded each time it runs: the builtin is found, and the binary looked up, once for all the iterations
+ * of a loop. Pipelines, redirections, background jobs and here-documents are parsed each time they run
+ *
+ *  node:    The command (NODE_COMMAND)
+ */
+void planCommand(pShellNode_t node)
+{
+    char **words = node->words;
+
+    node->plan = PLAN_PARSE;
+    if (words[0] == NULL || strpbrk(words[0], "$\"'~") != NULL)
+        return;
+
+    for (int i = 0; words[i] != NULL; i++)
+        if (isOperator(words[i][0]) || strcmp(words[i], "<") == 0)
+            return;
+
+    node->builtin = findBuiltin(words[0]);
+    node->plan = (node->builtin != BUILTIN_NONE) ? PLAN_BUILTIN : PLAN_BINARY;
+}
+
+/*
+ * Function: runPlannedCommand
+ * ---------------------------
+ * Runs a command planned as a single builtin or binary (see planCommand): its words are expanded, then the builtin
+ * is called, or the binary launched as a job of one stage, without parsing the command again
+ * An expansion which gives an operator turns the command into a pipeline or a redirection: it is then parsed
+ *
+ *  node:    The command (PLAN_BUILTIN or PLAN_BINARY)
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the command
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runPlannedCommand(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    char **words = copyWords(node->words);
+    char **cmd;
+    int argCount;
+    int fb = OK_SIG;
+    uint64_t started = statsClock();
+
+    cmd = expandCommand(words, paths, proDes);
+    recordLatency(STAT_EXPAND, statsClock() - started);
+
+    for (argCount = 0; cmd[argCount] != NULL; argCount++)
+    {
+        if (cmd != words && (isOperator(cmd[argCount][0]) || strcmp(cmd[argCount], "<") == 0))
+        {
+            wordsExpanded = 1;
+            return parseCommand(cmd, paths, 0, 0, proDes);
+        }
+    }
+
+    started = statsClock();
+
+    if (node->plan == PLAN_BUILTIN)
+    {
+        fb = runBuiltin(node->builtin, argCount, argCount, cmd, paths, 0, 0, proDes);
+        countStat(STAT_BUILTINS);
+        recordCommandTime(commandStatsSlot(cmd[0]), statsClock() - started, fb == ERROR_SIG);
+        return fb;
+    }
+
+    // The binary is looked up when the command first runs (a command not found yet is looked up again)
+    if (node->binPath == NULL)
+    {
+        char *binPath = (findStageBuiltin(cmd[0]) != NULL) ? cmd[0] : getBinPath(cmd[0], paths);
+
+        recordLatency(STAT_LOOKUP, statsClock() - started);
+        if (binPath == NULL)
+        {
+            wordsExpanded = 1;
+            return parseCommand(cmd, paths, 0, 0, proDes);
+        }
+        node->binPath = arenaStrdup(node->arena, binPath);
+    }
+
+    startJob(cmd, proDes);
+    executeCommand(node->binPath, argCount, cmd, __environ, BIN_FG, PIP_NONE, pipeB, pipeA, RED_NONE, NULL, proDes);
+
+    // As in parseCommand, a job which could not be launched still has to be closed
+    if (pipeJob != NULL)
+    {
+        closePipeEnd(pipeA, READ_END);
+        closePipeEnd(pipeA, WRITE_END);
+        closePipeEnd(pipeB, READ_END);
+        closePipeEnd(pipeB, WRITE_END);
+        finishPipeline(BIN_FG, proDes);
+    }
+
+    return fb;
+}
+
+/*
+ * Function: runCompound
+ * ---------------------
+ * Runs a compound command (a loop, a group, a subshell or a pipeline read by one of them)
+ * It runs in the Shell itself, unless it runs in background or is a subshell changing the state of the Shell:
+ * only then is the Shell forked
+ *
+ *  node:    The compound command
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the last command of the compound command
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runCompound(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    if (node->background || (node->type == NODE_SUBSHELL && changesState(node->body)))
+        return forkCompound(node, paths, proDes);
+
+    return runCompoundHere(node, paths, proDes);
+}
+
+/*
+ * Function: runCompoundHere
+ * -------------------------
+ * Runs a compound command in the current process. Its output is given to its file or to its pipeline by moving the
+ * standard output of the Shell, which is saved and restored afterwards: the file is opened once for all of its commands
+ *
+ *  node:    The compound command
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the last command of the compound command
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runCompoundHere(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    int savedStdout = -1;
+    int consumerPid = -1;
+    int fb = OK_SIG;
+
+    if (node->outFile != NULL || node->pipeWords != NULL)
+    {
+        fflush(stdout);
+        savedStdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    }
+
+    // The pipeline is launched first, so that it gets the standard output of the Shell
+    if (node->pipeWords != NULL)
+    {
+        consumerPid = launchConsumer(node->pipeWords, paths, proDes);
+        if (consumerPid == -1)
+            fb = ERROR_SIG;
+    }
+
+    if (fb == OK_SIG && node->outFile != NULL && !redirectOutput(node->outFile, node->append, paths, proDes))
+    {
+        lastStatus = 1;
+        fb = ERROR_SIG;
+    }
+
+    if (fb == OK_SIG)
+    {
+        if (node->type == NODE_PIPE_INTO)
+            fb = runPipedCompound(node, paths, proDes);
+        else if (node->type == NODE_GROUP || node->type == NODE_SUBSHELL)
+            fb = runNodes(node->body, paths, proDes);
+        else
+            fb = runLoop(node, paths, proDes);
+    }
+
+    if (savedStdout != -1)
+    {
+        fflush(stdout);
+        dup2(savedStdout, STDOUT_FILENO);
+        close(savedStdout);
+    }
+
+    // The pipeline reads until the last copy of the write end of its pipe is closed, then its status becomes the status
+    if (consumerPid != -1)
+    {
+        int status;
+        int waitRes;
+
+        do
+            waitRes = waitpid(consumerPid, &status, 0);
+        while (waitRes == -1 && errno == EINTR);
+
+        if (waitRes == consumerPid)
+            lastStatus = exitStatus(status);
+    }
+
+    return fb;
+}
+
+/*
+ * Function: forkCompound
+ * ----------------------
+ * Runs a compound command in a fork of the Shell, as a job of its own (in background, or waited for in foreground)
+ * The changes it makes to the Shell (directory, variables...) are lost with the fork
+ *
+ *  node:    The compound command
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: OK_SIG, ERROR_SIG if the Shell could not be forked
+ */
+int forkCompound(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    char *labels[][3] = {{"", "", ""}, {"for", "...;", "done"}, {"while", "...;", "done"}, {"|", "...", ""}, {"{", "...;", "}"}, {"(", "...", ")"}};
+    wordList_t label = {NULL, 0, 0};
+    int childPid;
+    int fb;
+
+    // The job is shown as the first words of the compound command
+    if (node->type == NODE_PIPE_INTO)
+        for (int i = 0; node->words[i] != NULL; i++)
+            addWord(&label, node->words[i]);
+    for (int i = 0; i < 3; i++)
+        if (labels[node->type][i][0] != '\0')
+            addWord(&label, labels[node->type][i]);
+
+    pipeJob = addProgram(label.count, label.words, proDes);
+    pipeJob->placement.policy = PLACE_NONE;
+    pipeBackground = node->background;
+
+    // The outputs of a background job go to the multiplexer, which prefixes their lines with the job ID
+    if (pipeBackground && muxControl != -1)
+        openJobOutput();
+
+    fflush(stdout);
+
+    childPid = fork();
+    switch (childPid)
+    {
+    case -1:
+        perror("fork");
+        countStat(STAT_FORK_FAILURES);
+        finishPipeline(BIN_FG, proDes);
+        pipeBackground = 0;
+        lastStatus = 126;
+        return ERROR_SIG;
+    case 0:
+        setpgid(0, 0);
+        if (shellInteractive && !pipeBackground)
+            tcsetpgrp(STDIN_FILENO, getpid());
+        signal(SIGTTOU, SIG_DFL);
+
+        if (jobErr[WRITE_END] != -1)
+            dup2(jobErr[WRITE_END], STDERR_FILENO);
+        if (jobOut[WRITE_END] != -1)
+            dup2(jobOut[WRITE_END], STDOUT_FILENO);
+        closeJobOutput();
+
+        shellInteractive = 0;
+        pipeJob = NULL;
+        pipeBackground = 0;
+
+        fb = runCompoundHere(node, paths, proDes);
+
+        // _exit: flushing the input of the Shell would move the offset it shares with the Shell
+        fflush(stdout);
+        _exit((fb == ERROR_SIG && lastStatus == 0) ? EXIT_FAILURE : lastStatus);
+    default:
+        break;
+    }
+
+    // Same as in the child: whichever of the two runs first sets the process group
+    pipeJob->pgid = childPid;
+    setpgid(childPid, childPid);
+    if (shellInteractive && !pipeBackground)
+        tcsetpgrp(STDIN_FILENO, childPid);
+
+    addStage(childPid, pipeJob);
+    finishPipeline(pipeBackground ? BIN_BG : BIN_FG, proDes);
+    pipeBackground = 0;
+
+    return OK_SIG;
+}
+
+/*
+ * Function: launchConsumer
+ * ------------------------
+ * Launches the pipeline reading the output of a compound command in a fork of the Shell, then gives the write end
+ * of its pipe to the standard output of the Shell
+ *
+ *  words:   The words of the pipeline, not expanded
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The PID of the fork, -1 on error
+ */
+int launchConsumer(char **words, pPaths_t paths, pProgDesc_t proDes)
+{
+    int consumerPipe[2];
+    int childPid;
+
+    if (pipe2(consumerPipe, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    childPid = fork();
+    switch (childPid)
+    {
+    case -1:
+        perror("fork");
+        countStat(STAT_FORK_FAILURES);
+        closePipeEnd(consumerPipe, READ_END);
+        closePipeEnd(consumerPipe, WRITE_END);
+        return -1;
+    case 0:
+        dup2(consumerPipe[READ_END], STDIN_FILENO);
+        closePipeEnd(consumerPipe, READ_END);
+        closePipeEnd(consumerPipe, WRITE_END);
+
+        shellInteractive = 0;
+        pipeJob = NULL;
+        pipeBackground = 0;
+        loopInput++;
+
+        runCommandLine(copyWords(words), paths, proDes);
+
+        // _exit: flushing the input of the Shell would move the offset it shares with the Shell
+        fflush(stdout);
+        _exit(lastStatus);
+    default:
+        break;
+    }
+
+    dup2(consumerPipe[WRITE_END], STDOUT_FILENO);
+    closePipeEnd(consumerPipe, READ_END);
+    closePipeEnd(consumerPipe, WRITE_END);
+
+    return childPid;
+}
+
+/*
+ * Function: redirectOutput
+ * ------------------------
+ * Gives a file to the standard output of the Shell (the caller has saved it)
+ *
+ *  file:    The name of the file, not expanded
+ *  append:  1 to append to the file, 0 to truncate it
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: 1 on success, 0 if the file could not be opened (the error is printed)
+ */
+int redirectOutput(char *file, int append, pPaths_t paths, pProgDesc_t proDes)
+{
+    wordList_t fields = {NULL, 0, 0};
+    int outFd;
+
+    expandWord(file, &fields, paths, proDes);
+    if (fields.count != 1)
+    {
+        printf("%s: %s: ambiguous redirect\n", SHELL_NAME, file);
+        return 0;
+    }
+
+    outFd = open(fields.words[0], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+    if (outFd == -1)
+    {
+        printf("%s: %s: %s\n", SHELL_NAME, fields.words[0], strerror(errno));
+        return 0;
+    }
+
+    dup2(outFd, STDOUT_FILENO);
+    close(outFd);
+
+    return 1;
+}
+
+/*
+ * Function: changesState
+ * ----------------------
+ * Determines whether or not a list of commands may change the state of the Shell: its directory, its variables,
+ * its jobs or its settings. A subshell only has to be forked when its commands may
+ *
+ *  node:    The first command of the list
+ *
+ *  Returns: 1 if one of the commands may change the state of the Shell, 0 otherwise
+ */
+int changesState(pShellNode_t node)
+{
+    const char *stateCommands[] = {"cd", "z", "set", "read", "exit", "fg", "bg", "kill", "wait", "limit", "place", "meter", "mux", NULL};
+
+    for (; node != NULL; node = node->next)
+    {
+        if (node->type == NODE_FOR || node->background)
+            return 1;
+
+        if ((node->type == NODE_WHILE && changesState(node->condition)) || ((node->type == NODE_WHILE || node->type == NODE_GROUP || node->type == NODE_PIPE_INTO) && changesState(node->body)))
+            return 1;
+
+        // The pipeline of NODE_PIPE_INTO runs in a fork, and a subshell keeps its changes to itself
+        if (node->type != NODE_COMMAND)
+            continue;
+
+        for (int i = 0; node->words[i] != NULL; i++)
+        {
+            char *word = node->words[i];
+
+            // Background jobs, and assignments made by expansions ($((n = 1)), $((n++)), ${NAME:=word})
+            if (strcmp(word, "&") == 0 || (strchr(word, '=') != NULL && (strstr(word, "$((") != NULL || strstr(word, "${") != NULL)))
+                return 1;
+            if (strstr(word, "$((") != NULL && (strstr(word, "++") != NULL || strstr(word, "--") != NULL))
+                return 1;
+
+            if (i > 0 && strcmp(node->words[i - 1], "|") != 0)
+                continue;
+            for (int j = 0; stateCommands[j] != NULL; j++)
+                if (strcmp(word, stateCommands[j]) == 0)
+                    return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Function: runLoop
+ * -----------------
+ * Runs a "for" or "while" loop. The body has been parsed once: each iteration only expands the words of its
+ * builtins and binaries (see planCommand), its pipelines and redirections are parsed by each iteration
+ * Each iteration allocates from its own arena, which is reset after the iteration, so that the memory used
+ * by a loop does not depend on its number of iterations
+ *
+ *  node:    The loop
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the last command of the loop
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runLoop(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    pArena_t outerArena = lineArena;
+    pArena_t iterationArena = newArena(LINE_ARENA_BLOCK);
+    char **values = NULL;
+    int fb = OK_SIG;
+
+    if (node->type == NODE_FOR)
+        values = expandCommand(copyWords(node->words), paths, proDes);
+
+    for (int i = 0; fb != EXIT_SIG; i++)
+    {
+        int run = 1;
+
+        lineArena = iterationArena;
+
+        if (node->type == NODE_FOR)
+        {
+            if (values[i] == NULL)
+                run = 0;
+            else
+                setVariable(node->variable, values[i]);
+        }
+        else
+        {
+            fb = runNodes(node->condition, paths, proDes);
+            if (fb == EXIT_SIG || lastStatus != 0)
+                run = 0;
+        }
+
+        if (run)
+            fb = runNodes(node->body, paths, proDes);
+
+        lineArena = outerArena;
+        resetArena(iterationArena);
+
+        // Background jobs launched by the loop are collected as it goes, and Ctrl-C ends the loop
+        reapChildren(proDes);
+        if (!run || lastStatus == 128 + SIGINT)
+            break;
+    }
+
+    freeArena(iterationArena);
+
+    return fb;
+}
+
+/*
+ * Function: runPipedCompound
+ * --------------------------
+ * Runs "pipeline | while ..." (or "pipeline | { ...; }"): the pipeline runs in a fork of the Shell (as a command
+ * substitution), the compound command in the Shell itself with the output of the pipeline as its standard input,
+ * so that the variables it sets stay set
+ *
+ *  node:    The pipeline and its compound command
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the last command of the compound command
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runPipedCompound(pShellNode_t node, pPaths_t paths, pProgDesc_t proDes)
+{
+    int loopPipe[2];
+    int savedStdin;
+    int childPid;
+    int fb;
+
+    if (pipe2(loopPipe, O_CLOEXEC) < 0)
+    {
+        perror("pipe");
+        return ERROR_SIG;
+    }
+
+    fflush(stdout);
+
+    childPid = fork();
+    switch (childPid)
+    {
+    case -1:
+        perror("fork");
+        countStat(STAT_FORK_FAILURES);
+        closePipeEnd(loopPipe, READ_END);
+        closePipeEnd(loopPipe, WRITE_END);
+        return ERROR_SIG;
+    case 0:
+        dup2(loopPipe[WRITE_END], STDOUT_FILENO);
+        closePipeEnd(loopPipe, READ_END);
+        closePipeEnd(loopPipe, WRITE_END);
+
+        shellInteractive = 0;
+        pipeJob = NULL;
+        pipeBackground = 0;
+
+        fb = runCommandLine(copyWords(node->words), paths, proDes);
+
+        // _exit: flushing the input of the Shell would move the offset it shares with the Shell
+        fflush(stdout);
+        _exit((fb == OK_SIG) ? EXIT_SUCCESS : EXIT_FAILURE);
+    default:
+        break;
+    }
+
+    closePipeEnd(loopPipe, WRITE_END);
+    savedStdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(loopPipe[READ_END], STDIN_FILENO);
+    closePipeEnd(loopPipe, READ_END);
+    loopInput++;
+
+    fb = runCompound(node->body, paths, proDes);
+
+    // What the compound command has not read is dropped: the pipeline gets SIGPIPE if it is still writing
+    loopInput--;
+    dropLineReader(STDIN_FILENO);
+    dup2(savedStdin, STDIN_FILENO);
+    close(savedStdin);
+
+    waitpid(childPid, NULL, 0);
+
+    return fb;
+}
+
+/*
+ * Function: copyWords
+ * -------------------
+ * Copies a null-terminated array of words (the words themselves are not copied)
+ *
+ *  words:   The words
+ *
+ *  Returns: The copy, allocated from the line arena
+ */
+char **copyWords(char **words)
+{
+    int count = 0;
+    char **copy;
+
+    while (words[count] != NULL)
+        count++;
+
+    copy = (char **)arenaAlloc(lineArena, (count + 1) * sizeof(char *));
+    memcpy(copy, words, (count + 1) * sizeof(char *));
+
+    return copy;
+}
+
+/*
+ * Function: setVariable
+ * ---------------------
+ * Sets a variable in the environment of the running context, without leaking its previous value
+ *
+ *  name:    The name of the variable
+ *  value:   The value of the variable
+ */
+void setVariable(const char *name, const char *value)
+{
+    size_t nameLen = strlen(name);
+    size_t valueLen = strlen(value);
+    pVariable_t it = variables;
+    char *binding = (char *)malloc(nameLen + valueLen + 2);
+
+    memcpy(binding, name, nameLen);
+    binding[nameLen] = '=';
+    memcpy(binding + nameLen + 1, value, valueLen + 1);
+
+    while (it != NULL && !(it->nameLen == nameLen && strncmp(it->binding, name, nameLen) == 0))
+        it = it->next;
+
+    // The previous binding is replaced in the environment, which no longer references it
+    if (it != NULL)
+    {
+        for (size_t i = 0; i < envCount; i++)
+        {
+            if (environ[i] == it->binding)
+            {
+                environ[i] = binding;
+                break;
+            }
+        }
+        free(it->binding);
+    }
+    else
+    {
+        if (envCount + 1 >= envCapacity)
+        {
+            envCapacity = (envCapacity > 0) ? envCapacity * 2 : 64;
+            environ = (char **)realloc(environ, envCapacity * sizeof(char *));
+        }
+        environ[envCount++] = binding;
+        environ[envCount] = NULL;
+
+        it = (pVariable_t)malloc(sizeof(variable_t));
+        it->nameLen = nameLen;
+        it->next = variables;
+        variables = it;
+    }
+    it->binding = binding;
+    it->inherited = 0;
+}
+
+/*
+ * Function: isKeyword
+ * -------------------
+ * Determines whether or not a word is a keyword of the loops, groups and subshells
+ *
+ *  word:    The word to test
+ *
+ *  Returns: 1 if word is "for", "while", "do", "done", "{", "}", "(" or ")", 0 otherwise
+ */
+int isKeyword(char *word)
+{
+    return (strcmp(word, "for") == 0 || strcmp(word, "while") == 0 || strcmp(word, "do") == 0 || strcmp(word, "done") == 0 ||
+            strcmp(word, "{") == 0 || strcmp(word, "}") == 0 || strcmp(word, "(") == 0 || strcmp(word, ")") == 0);
+}
+
+/*
+ * Function: startsCompound
+ * ------------------------
+ * Determines whether or not a word starts a compound command
+ *
+ *  word:    The word to test
+ *
+ *  Returns: 1 if word is "for", "while", "{" or "(", 0 otherwise
+ */
+int startsCompound(char *word)
+{
+    return (strcmp(word, "for") == 0 || strcmp(word, "while") == 0 || strcmp(word, "{") == 0 || strcmp(word, "(") == 0);
+}
+
+/*
+ * Function: isNameChar
+ * --------------------
+ * Determines whether or not a character may be part of the name of a variable
+ *
+ *  c:       The character to test
+ *  first:   1 if it is the first character of the name (which cannot be a digit)
+ *
+ *  Returns: 1 if c may be part of a name, 0 otherwise
+ */
+int isNameChar(char c, int first)
+{
+    return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || (!first && c >= '0' && c <= '9'));
+}
+
+/*
+ * Function: parseCommand
+ * ----------------------
+ * Evaluates a given command
+ *
+ *  line:           The user input
+ *  paths:          The structure containing all paths referenced in the PATH environement variable
+ *  readFromPipe:   1 if the given command was prefixed by a '|'
+ *                  0 otherwise
+ *  pipeCount:      The number of pipes preceeding the given command
+ *
+ *  Returns: 0 if the command was processed correctly
+ *           EXIT_SIG if the user wants to exit the Shell 
+ */
+int parseCommand(char **cmd, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes)
+{
+    int fb = OK_SIG;
+    int argCount;
+    int localArgsCount = 0;
+    int reached = 0;
+    int builtin = 1;
+    int builtinId;
+    uint64_t started = statsClock();
+
+    // Expands the words of the current command (the following commands are expanded when they are reached)
+    if (wordsExpanded)
+    {
+        wordsExpanded = 0;
+    }
+    else
+    {
+        cmd = expandCommand(cmd, paths, proDes);
+        recordLatency(STAT_EXPAND, statsClock() - started);
+    }
+
+    // Here-documents and here-strings become the standard input of the command
+    cmd = takeHereDocuments(cmd);
+    if (cmd == NULL)
+        return ERROR_SIG;
+
+    // Counts command arguments (command name included)
+    // And replaces the "~" character in commands by "/home/usr" as well
+    for (argCount = 0; cmd[argCount] != NULL; argCount++)
+    {
+        if (strcmp(cmd[argCount], "~") == 0)
+            cmd[argCount] = getenv("HOME");
+
+        if (!reached && (strcmp(cmd[argCount], "&") == 0 || strcmp(cmd[argCount], "|") == 0))
+            reached = 1;
+
+        if (!reached)
+            localArgsCount++;
+    }
+
+    if (DEBUG)
+    {
+        printf("Command: %s [%d arg(s) provided]\n", cmd[0], argCount);
+        for (int i = 0; i < argCount; i++)
+            printf("\targ[%d]='%s'\n", i, cmd[i]);
+        printf("\n");
+    }
+
+    if (argCount >= 1)
+    {
+        started = statsClock();
+
+        if (isOperator(cmd[0][0]))
+        {
+            printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, cmd[0]);
+            fb = ERROR_SIG;
+            builtin = 0;
+        }
+        else if ((builtinId = findBuiltin(cmd[0])) != BUILTIN_NONE)
+        {
+            fb = runBuiltin(builtinId, argCount, localArgsCount, cmd, paths, readFromPipe, pipeCount, proDes);
+        }
+        else
+        {
+            char *binPath = (findStageBuiltin(cmd[0]) != NULL) ? cmd[0] : getBinPath(cmd[0], paths);
+            int binState = BIN_FG;
+            int subArgC = 0;
+            int pipeState;
+            int piping = 0;
+            int *getPipe, *givePipe;
+
+            recordLatency(STAT_LOOKUP, statsClock() - started);
+            builtin = 0;
+
+            // Swaps the pipes as explained further below
+            if (pipeCount % 2 == 0)
+            {
+                getPipe = pipeB;
+                givePipe = pipeA;
+            }
+            else
+            {
+                getPipe = pipeA;
+                givePipe = pipeB;
+            }
+
+            if (binPath == NULL)
+            {
+                printf("%s: command not found\n", cmd[0]);
+                lastStatus = 127;
+            }
+            else
+            {
+                // The first command of a pipeline creates the job that all its stages will belong to
+                if (!readFromPipe)
+                    startJob(cmd, proDes);
+
+                for (subArgC = 0; subArgC < argCount; subArgC++)
+                {
+                    if (strcmp(cmd[subArgC], "&") == 0)
+                    {
+                        binState = BIN_BG;
+
+                        if (readFromPipe) // Prefixed by '|'
+                            pipeState = PIP_READ;
+                        else
+                            pipeState = PIP_NONE;
+
+                        executeCommand(binPath, subArgC, cmd, __environ, binState, pipeState, getPipe, givePipe, RED_NONE, NULL, proDes);
+
+                        if (subArgC + 1 < argCount)
+                            parseCommand(&(cmd[subArgC + 1]), paths, 0, pipeCount, proDes); // Since we read a "&", this command won't cannot pipe to the next one
+                        break;
+                    }
+                    else if (strcmp(cmd[subArgC], "|") == 0) // The command will AT LEAST write to STDOUT
+                    {
+                        // The current command is going to send its output to the next one
+                        piping = 1;
+
+                        // TODO: Test if last command is of the form: cmd |
+                        // This could prove troublesome since no command is placed after
+                        // Try in Linux Shell to get ideas
+                        // NB: I tried it and it does not seem to break anything but make sure to test things anyway
+
+                        /* 
+                         * In order to allow for a command to receive its input from its predecessor and send its output to its successor, it is required
+                         * to use another pipe. So, each command will use two pipes: one for its input and the other for its output. Please refer to the
+                         * following scenario to understand better:
+                         * 
+                         * > ls -al | grep read | grep readline.c
+                         * 
+                         * ls -al:
+                         *      in: pipeB (unused) -> uses STDIN instead
+                         *      out: pipeA
+                         * 
+                         * grep read
+                         *      in: pipeA
+                         *      out: pipeB
+                         * 
+                         * grep readline.c
+                         *      in: pipeB
+                         *      out: pipeA (unused) -> uses STDOUT instead
+                         * 
+                         * While two pipes are enough for it to work, we need to make sure that the in and out pipes are swapped for each command. This is the purpose
+                         * of pipeCount. If it is odd, then the case will be the same as "ls -al" or "grep readline.c" in the scenario above. If it is even, the case
+                         * will be the same as "grep read".
+                         */
+                        if (pipeCount % 2 == 0)
+                        {
+                            if (pipe(pipeA) < 0)
+                            {
+                                fprintf(stderr, "pipe A creation failed\n");
+                            }
+                        }
+                        else
+                        {
+                            if (pipe(pipeB) < 0)
+                            {
+                                fprintf(stderr, "pipe B creation failed\n");
+                            }
+                        }
+
+                        if (readFromPipe) // Prefixed by '|'
+                            pipeState = PIP_BOTH;
+                        else
+                            pipeState = PIP_WRITE;
+
+                        executeCommand(binPath, subArgC, cmd, __environ, BIN_FG, pipeState, getPipe, givePipe, RED_NONE, NULL, proDes);
+
+                        if (subArgC + 1 < argCount)
+                        {
+                            parseCommand(&(cmd[subArgC + 1]), paths, 1, pipeCount + 1, proDes); // Since it is "|", it pipes the next command
+                        }
+                        break;
+                    }
+                    else if (strcmp(cmd[subArgC], ">") == 0)
+                    {
+                        // The current command is going to send its output to a file
+                        piping = 1;
+
+                        if (readFromPipe) // Prefixed by '|'
+                            pipeState = PIP_BOTH;
+                        else
+                            pipeState = PIP_WRITE;
+
+                        int redirState;
+
+                        int outFilePos = subArgC + 1;
+
+                        // ">| file..." and ">>| file..." send the output to several files
+                        int teePos = (cmd[outFilePos] != NULL && strcmp(cmd[outFilePos], ">") == 0) ? outFilePos + 1 : outFilePos;
+                        if (cmd[teePos] != NULL && strcmp(cmd[teePos], "|") == 0)
+                        {
+                            wordList_t files = {NULL, 0, 0};
+                            int nextPos;
+
+                            for (nextPos = teePos + 1; cmd[nextPos] != NULL; nextPos++)
+                            {
+                                if (strcmp(cmd[nextPos], "&") == 0 || strcmp(cmd[nextPos], ";") == 0 || isOperator(cmd[nextPos][0]))
+                                    break;
+                                addWord(&files, cmd[nextPos]);
+                            }
+
+                            if (files.count == 0)
+                            {
+                                printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, (cmd[nextPos] != NULL) ? cmd[nextPos] : "newline");
+                                fb = ERROR_SIG;
+                                break;
+                            }
+                            addWord(&files, NULL);
+                            teeFiles = files.words;
+
+                            if (cmd[nextPos] != NULL && strcmp(cmd[nextPos], "&") == 0)
+                                binState = BIN_BG;
+
+                            // Same pipe as the one which would feed the next command
+                            if (pipe(givePipe) < 0)
+                            {
+                                fprintf(stderr, "pipe creation failed\n");
+                            }
+
+                            redirState = (teePos == outFilePos) ? RED_TEE_OVER : RED_TEE_APPE;
+                            executeCommand(binPath, subArgC, cmd, __environ, binState, pipeState, getPipe, givePipe, redirState, NULL, proDes);
+                            teeFiles = NULL;
+
+                            if (cmd[nextPos] != NULL && cmd[nextPos + 1] != NULL)
+                            {
+                                parseCommand(&(cmd[nextPos + 1]), paths, 0, pipeCount, proDes);
+                            }
+                            break;
+                        }
+
+                        // If the operator is '>>' instead of '>'
+                        if (strcmp(cmd[outFilePos], ">") == 0)
+                        {
+                            outFilePos++;
+                            // If the operator is '>>>' or any weird stuff like that
+                            if (isOperator(cmd[outFilePos][0]))
+                            {
+                                printf("%s: syntax error near unexpected token `%c'\n", SHELL_NAME, cmd[outFilePos][0]);
+                                fb = ERROR_SIG;
+                                break;
+                            }
+                            redirState = RED_APPE;
+                        }
+                        else
+                        {
+                            redirState = RED_OVER;
+                        }
+                        // A '&' may follow the name of the file
+                        if (cmd[outFilePos + 1] != NULL && strcmp(cmd[outFilePos + 1], "&") == 0)
+                            binState = BIN_BG;
+
+                        executeCommand(binPath, subArgC, cmd, __environ, binState, pipeState, getPipe, givePipe, redirState, cmd[outFilePos], proDes);
+
+                        if (outFilePos + 2 < argCount)
+                        {
+                            parseCommand(&(cmd[outFilePos + 2]), paths, 0, pipeCount, proDes); // Since it is "|", it pipes the next command
+                        }
+                        break;
+                    }
+                }
+
+                if (binState == BIN_FG && !piping)
+                {
+                    if (DEBUG)
+                    {
+                        printf("%d pipes were found in the command line\n", pipeCount);
+                    }
+
+                    if (readFromPipe)
+                        pipeState = PIP_READ;
+                    else
+                        pipeState = PIP_NONE;
+
+                    executeCommand(binPath, subArgC, cmd, __environ, binState, pipeState, getPipe, givePipe, RED_NONE, NULL, proDes);
+                }
+            }
+        }
+
+        if (builtin)
+        {
+            countStat(STAT_BUILTINS);
+            recordCommandTime(commandStatsSlot(cmd[0]), statsClock() - started, fb == ERROR_SIG);
+        }
+    }
+
+    // A here-document which has not been given to any process (builtin, unknown command)
+    if (hereFd != -1)
+    {
+        close(hereFd);
+        hereFd = -1;
+    }
+
+    // A pipeline cut short (unknown command, builtin or trailing '|') still has stages to close and wait for
+    if (pipeJob != NULL && !readFromPipe)
+    {
+        closePipeEnd(pipeA, READ_END);
+        closePipeEnd(pipeA, WRITE_END);
+        closePipeEnd(pipeB, READ_END);
+        closePipeEnd(pipeB, WRITE_END);
+        finishPipeline(BIN_FG, proDes);
+    }
+
+    return fb;
+}
+
+/*
+ * Function: findBuiltin
+ * ---------------------
+ * Looks for a builtin run by the Shell itself
+ *
+ *  name:    The name of the command
+ *
+ *  Returns: The index of the builtin in SHELL_BUILTINS, BUILTIN_NONE if the command is not one of them
+ */
+int findBuiltin(char *name)
+{
+    for (int i = 0; i < SHELL_BUILTIN_COUNT; i++)
+        if (strcmp(SHELL_BUILTINS[i], name) == 0)
+            return i;
+
+    return BUILTIN_NONE;
+}
+
+/*
+ * Function: runBuiltin
+ * --------------------
+ * Runs a builtin in the Shell itself
+ *
+ *  builtin:        The index of the builtin in SHELL_BUILTINS
+ *  argCount:       The number of words of the command line (prefix builtins run the command following them)
+ *  localArgsCount: The number of arguments of the builtin (command name included)
+ *  cmd:            The words of the command line, expanded
+ *  paths:          The structure containing all paths referenced in the PATH environement variable
+ *  readFromPipe:   1 if the given command was prefixed by a '|'
+ *                  0 otherwise
+ *  pipeCount:      The number of pipes preceeding the given command
+ *  proDes:         A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the builtin
+ *           EXIT_SIG if the user wants to exit the Shell
+ */
+int runBuiltin(int builtin, int argCount, int localArgsCount, char **cmd, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes)
+{
+    int fb = OK_SIG;
+
+    switch (builtin)
+    {
+    case BUILTIN_CD: // TODO: For cd, print and set, argCount will lead to command failure if there are other commands on the same line
+        fb = cdCommand(localArgsCount, cmd);
+        break;
+    case BUILTIN_JUMP:
+        fb = jumpCommand("z", localArgsCount, cmd);
+        break;
+    case BUILTIN_PRINT:
+        if (localArgsCount <= 2)
+        {
+            if (localArgsCount == 1)
+            {
+                for (int i = 0; __environ[i] != NULL; i++)
+                    printf("%s\n", __environ[i]);
+            }
+            else
+            {
+                char *var = getenv(cmd[1]);
+
+                if (var == NULL)
+                    printf("\n");
+                else
+                    printf("%s\n", getenv(cmd[1]));
+            }
+        }
+        else
+        {
+            printf("%s: print: too many arguments\n", SHELL_NAME);
+            fb = -1;
+        }
+        break;
+    case BUILTIN_SET:
+        if (localArgsCount == 3)
+        {
+            setVariable(cmd[1], cmd[2]);
+        }
+        else if (localArgsCount < 3)
+        {
+            printf("%s: set: not enough arguments\n", SHELL_NAME);
+            fb = ERROR_SIG;
+        }
+        else
+        {
+            printf("%s: set: too many arguments\n", SHELL_NAME);
+            fb = ERROR_SIG;
+        }
+        break;
+    case BUILTIN_JOBS:
+        fb = jobsCommand(localArgsCount, cmd, proDes);
+        break;
+    case BUILTIN_FG:
+        fb = fgCommand(localArgsCount, cmd, proDes);
+        break;
+    case BUILTIN_BG:
+        fb = bgCommand(localArgsCount, cmd, proDes);
+        break;
+    case BUILTIN_KILL:
+        fb = killCommand(localArgsCount, cmd, proDes);
+        break;
+    case BUILTIN_WAIT:
+        fb = waitCommand(localArgsCount, cmd, proDes);
+        break;
+    case BUILTIN_READ:
+        fb = readCommand(localArgsCount, cmd);
+        break;
+    case BUILTIN_LIMIT:
+        fb = limitCommand(argCount, cmd, paths, readFromPipe, pipeCount, proDes);
+        break;
+    case BUILTIN_PLACE:
+        fb = placeCommand(argCount, cmd, paths, readFromPipe, pipeCount, proDes);
+        break;
+    case BUILTIN_METER:
+        fb = meterCommand(argCount, cmd, paths, readFromPipe, pipeCount, proDes);
+        break;
+    case BUILTIN_MUX:
+        fb = muxCommand(localArgsCount, cmd);
+        break;
+    case BUILTIN_STATS:
+        fb = statsCommand(localArgsCount, cmd);
+        break;
+    case BUILTIN_EXIT:
+        if (DEBUG)
+            printf("%s: Successfully exited\n", SHELL_NAME);
+        fb = EXIT_SIG;
+        break;
+    }
+
+    return fb;
+}
+
+/*
+ * Function: startJob
+ * ------------------
+ * Creates the job of the pipeline starting at the given command, which all its stages will belong to (pipeJob):
+ * limits, cgroup, CPU placement, meter and output multiplexing
+ *
+ *  cmd:     The command line, starting at the first command of the pipeline (expanded)
+ *  proDes:  A pointer to the Program Descriptor
+ */
+void startJob(char **cmd, pProgDesc_t proDes)
+{
+    int jobArgc = pipelineLength(cmd, &pipeBackground);
+    int stageCount = 1;
+
+    pipeJob = addProgram(jobArgc, cmd, proDes);
+
+    // Limits given by a "limit" prefix, completed by the defaults of background jobs
+    pipeJob->limits = nextLimits;
+    clearLimits(&nextLimits);
+    if (pipeBackground)
+        mergeLimits(&(pipeJob->limits), &bgLimits);
+
+    pipeJob->cgroup = createJobCgroup(&(pipeJob->limits));
+    if (pipeJob->limits.cpuPercent != LIMIT_NONE && pipeJob->cgroup == NULL)
+        printf("%s: limit: cpu limit ignored (no writable cgroup v2)\n", SHELL_NAME);
+
+    // CPUs are reserved for all the stages of the pipeline at once
+    for (int i = 0; i < jobArgc; i++)
+        if (strcmp(cmd[i], "|") == 0)
+            stageCount++;
+
+    pipeJob->placement = nextPlacement;
+    nextPlacement = defaultPlacement;
+    reservePlacement(&(pipeJob->placement), stageCount);
+
+    pipeMetered = meterNext;
+    meterNext = 0;
+
+    // The outputs of a background job go to the multiplexer, which prefixes their lines with the job ID
+    if (pipeBackground && muxControl != -1)
+        openJobOutput();
+}
+
+/*
+ * Function: executeCommand
+ * ------------------------
+ * Launches a specific binary in a specific state
+ * The binary becomes a stage of pipeJob. When it is the last stage of its pipeline, the pipeline is either
+ * waited for (foreground) or announced as a background job
+ *
+ *  path:       The complete path of the binary to be launched
+ *  argc:       The number of arguments
+ *  argv:       An array containing all the arguments
+ *  envp:       An array containing the environment variables
+ *  state:      The state in which the binary has to be launched (BIN_FG to launch normally or BIN_BG to launch it in the background)
+ *  pipeState:  Determines the IO actions of the command (Refer to the enumerations at the top of this file for further information)
+ *  getPipe:    The pipe from which the command will potentially read (getPipe > STDIN)
+ *  givePipe:   The pipe to which the command will eventually write (STDOUT > givePipe)
+ *  redirState: Determines if and how the program outputs goes to a file (Refer to the enumerations at the top for further information)
+ *  outFile:    The name of file in which the command output will be redirected (NULL if the command output is not redirected to a file)
+ *
+ *  Returns: 0 if all went well, -1 if the process could not be forked
+ */
+int executeCommand(char *path, int argc, char **argv, char **envp, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, char *outFile, pProgDesc_t proDes)
+{
+    char **argvCpy;
+    cpu_set_t stageCpus;
+    int pgid = pipeJob->pgid; // 0 for the first stage, which becomes the leader of the process group
+    int childPid;
+    int execPipe[2];   // Closed by a successful execve, or receives its errno
+    int execError = 0;
+    uint64_t spawnStart = statsClock();
+    stageBuiltin_t stageBuiltin = findStageBuiltin(argv[0]);
+
+    // A builtin runs in the Shell itself, unless it has to run alongside it (background job) or feed a relay
+    if (stageBuiltin != NULL && state == BIN_FG && !pipeBackground && (redirState == RED_NONE || redirState == RED_OVER || redirState == RED_APPE))
+        return runBuiltinStage(stageBuiltin, argc, argv, state, pipeState, getPipe, givePipe, redirState, outFile, proDes);
+
+    if (pipe2(execPipe, O_CLOEXEC) == -1)
+        execPipe[READ_END] = execPipe[WRITE_END] = -1;
+
+    // The child must not inherit (and later flush) what the Shell has not printed yet
+    fflush(stdout);
+
+    childPid = fork(); // Creates a child process
+
+    // Identifies who is the current process and performs specific tasks accordingly
+    switch (childPid)
+    {
+    case -1: // An error occured: the Shell goes on, without this stage
+        perror("fork");
+        countStat(STAT_FORK_FAILURES);
+        closePipeEnd(execPipe, READ_END);
+        closePipeEnd(execPipe, WRITE_END);
+
+        if (hereFd != -1)
+        {
+            close(hereFd);
+            hereFd = -1;
+        }
+        closePipeEnd(getPipe, READ_END);
+        closePipeEnd(getPipe, WRITE_END);
+        closePipeEnd(givePipe, READ_END);
+        closePipeEnd(givePipe, WRITE_END);
+
+        if (!((pipeState == PIP_WRITE || pipeState == PIP_BOTH) && redirState == RED_NONE))
+            finishPipeline(state, proDes);
+        lastStatus = 126;
+        return -1;
+    case 0: // The current process is a child
+        closePipeEnd(execPipe, READ_END);
+
+        // Joins the process group of its pipeline, and takes the terminal if the pipeline runs in foreground
+        setpgid(0, pgid);
+        if (shellInteractive && !pipeBackground && pgid == 0)
+            tcsetpgrp(STDIN_FILENO, getpid());
+        signal(SIGTTOU, SIG_DFL);
+
+        applyLimits(&(pipeJob->limits), pipeJob->cgroup);
+
+        // The number of stages already launched is the index of this one in the pipeline
+        if (stagePlacement(&(pipeJob->placement), pipeJob->stageCount, &stageCpus))
+            sched_setaffinity(0, sizeof(stageCpus), &stageCpus);
+
+        // Makes a null-terminated copy of argv (argv holds the rest of the command line after argc)
+        argvCpy = (char **)arenaAlloc(lineArena, (argc + 1) * sizeof(char *));
+        for (int i = 0; i < argc; i++)
+            argvCpy[i] = argv[i];
+        argvCpy[argc] = NULL; // Very important!!
+
+        // TODO: These switches are a mess. Please find the resolve to make them organized, handsome and commented as well.
+        switch (pipeState)
+        {
+        case PIP_NONE: // Does not use any pipe
+            closePipeEnd(getPipe, WRITE_END);
+            closePipeEnd(getPipe, READ_END);
+
+            closePipeEnd(givePipe, WRITE_END);
+            closePipeEnd(givePipe, READ_END);
+            break;
+        case PIP_WRITE:
+            if (redirState == RED_OVER || redirState == RED_APPE)
+            {
+                if (redirState == RED_OVER)
+                    freopen(outFile, "w", stdout);
+                else
+                    freopen(outFile, "a+", stdout);
+            }
+            else
+            {
+                dup2(givePipe[WRITE_END], STDOUT_FILENO);
+            }
+            closePipeEnd(givePipe, WRITE_END);
+            closePipeEnd(givePipe, READ_END);
+            break;
+        case PIP_READ:
+            dup2(getPipe[READ_END], STDIN_FILENO);
+            closePipeEnd(getPipe, WRITE_END);
+            closePipeEnd(getPipe, READ_END);
+            break;
+        case PIP_BOTH:
+            dup2(getPipe[READ_END], STDIN_FILENO);
+            if (redirState == RED_OVER || redirState == RED_APPE)
+            {
+                if (redirState == RED_OVER)
+                    freopen(outFile, "w", stdout);
+                else
+                    freopen(outFile, "a+", stdout);
+            }
+            else
+            {
+                dup2(givePipe[WRITE_END], STDOUT_FILENO);
+            }
+
+            closePipeEnd(getPipe, READ_END);
+            closePipeEnd(givePipe, WRITE_END);
+            closePipeEnd(givePipe, READ_END);
+            break;
+        default:
+            fprintf(stderr, "Unknown pipe state");
+            exit(-1);
+            break;
+        }
+
+        // A here-document replaces the input given by the pipeline (the original descriptor is closed by execve)
+        if (hereFd != -1)
+            dup2(hereFd, STDIN_FILENO);
+
+        // Every stage of a multiplexed job writes its errors to the multiplexer, the last one its output too
+        if (jobErr[WRITE_END] != -1)
+            dup2(jobErr[WRITE_END], STDERR_FILENO);
+        if (jobOut[WRITE_END] != -1 && (pipeState == PIP_NONE || pipeState == PIP_READ) && redirState == RED_NONE)
+            dup2(jobOut[WRITE_END], STDOUT_FILENO);
+
+        // Otherwise, the builtin runs in this fork of the Shell
+        if (stageBuiltin != NULL)
+        {
+            int status = stageBuiltin(argc, argvCpy, stdout);
+
+            // _exit: flushing the input of the Shell would move the offset it shares with the Shell
+            fflush(stdout);
+            _exit(status);
+        }
+
+        execve(path, argvCpy, envp);
+        execError = errno;
+        perror("execve failed");
+        if (execPipe[WRITE_END] != -1)
+            write(execPipe[WRITE_END], &execError, sizeof(execError));
+        exit(EXIT_FAILURE);
+        break;
+    default: // The current process is the parent
+        if (DEBUG)
+            printf("Is that you [%s] %d? Your father is right here kiddo!\n", path, childPid);
+
+        // Waits until the child has replaced itself with the binary (or has failed to): that is the spawn latency
+        closePipeEnd(execPipe, WRITE_END);
+        if (execPipe[READ_END] != -1)
+        {
+            ssize_t readRes;
+
+            do
+                readRes = read(execPipe[READ_END], &execError, sizeof(execError));
+            while (readRes == -1 && errno == EINTR);
+            closePipeEnd(execPipe, READ_END);
+
+            if (readRes == sizeof(execError))
+                countStat(STAT_EXEC_FAILURES);
+            else
+                execError = 0;
+        }
+
+        if (execError == 0)
+        {
+            countStat(STAT_COMMANDS);
+            recordLatency(STAT_SPAWN, statsClock() - spawnStart);
+        }
+
+        // Same as in the child: whichever of the two runs first sets the process group
+        if (pgid == 0)
+            pipeJob->pgid = childPid;
+        setpgid(childPid, pipeJob->pgid);
+        if (shellInteractive && !pipeBackground && pgid == 0)
+            tcsetpgrp(STDIN_FILENO, childPid);
+
+        addStage(childPid, pipeJob);
+        pipeJob->stages[pipeJob->stageCount - 1].started = spawnStart;
+        pipeJob->stages[pipeJob->stageCount - 1].statsSlot = commandStatsSlot(argv[0]);
+
+        finishStage(argv[0], state, pipeState, getPipe, givePipe, redirState, proDes);
+        break;
+    }
+
+    return 0;
+}
+
+/*
+ * Function: finishStage
+ * ---------------------
+ * Completes the launch of a stage of pipeJob in the Shell: closes the pipe ends the stage now owns, launches the relays
+ * its output goes through, and finishes the pipeline when this stage was its last one
+ *
+ *  name:       The command of the stage
+ *  state:      The state in which the pipeline runs (BIN_FG or BIN_BG)
+ *  pipeState:  The IO actions of the command
+ *  getPipe:    The pipe from which the stage reads
+ *  givePipe:   The pipe to which the stage writes
+ *  redirState: Determines if and how the output of the stage goes to files
+ */
+void finishStage(char *name, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, pProgDesc_t proDes)
+{
+    // This stage reads the last hop of a metered pipeline
+    if (meterHopCount > 0 && (pipeState == PIP_READ || pipeState == PIP_BOTH))
+        setHopName(meterHops[meterHopCount - 1].to, name);
+
+    if (hereFd != -1)
+    {
+        close(hereFd);
+        hereFd = -1;
+    }
+
+    // Closes the pipe ends which are now owned by the stage
+    switch (pipeState)
+    {
+    case PIP_NONE: // This command did not involve any pipes
+        closePipeEnd(getPipe, WRITE_END);
+        closePipeEnd(getPipe, READ_END);
+
+        closePipeEnd(givePipe, WRITE_END);
+        closePipeEnd(givePipe, READ_END);
+        break;
+    case PIP_WRITE: // This command is the first to be piped
+        closePipeEnd(givePipe, WRITE_END);
+        break;
+    case PIP_READ: // The command was the last to be piped
+        closePipeEnd(getPipe, READ_END);
+        break;
+    case PIP_BOTH:
+        closePipeEnd(getPipe, READ_END);
+
+        closePipeEnd(givePipe, WRITE_END);
+        break;
+    default:
+        fprintf(stderr, "Unknown pipe state");
+        exit(-1);
+        break;
+    }
+
+    // The output of a multi-target redirection is dispatched to its files by one more stage
+    if (redirState == RED_TEE_OVER || redirState == RED_TEE_APPE)
+        launchTeeRelay(givePipe, redirState == RED_TEE_APPE);
+
+    // In a metered pipeline, the next stage reads what the meter relays from this one
+    if (pipeMetered && (pipeState == PIP_WRITE || pipeState == PIP_BOTH) && redirState == RED_NONE)
+        addMeterHop(givePipe, name);
+
+    // Unless its output goes to the next command, this command was the last stage of the pipeline
+    if (!((pipeState == PIP_WRITE || pipeState == PIP_BOTH) && redirState == RED_NONE))
+        finishPipeline(state, proDes);
+}
+
+/*
+ * Function: runBuiltinStage
+ * -------------------------
+ * Runs a builtin stage of pipeJob in the Shell, without forking: its output is written to the file, the pipe or
+ * the standard output the stage would have written to. An output too large for its pipe (the next stage is not
+ * reading it yet) is written by a fork of the Shell instead, which becomes a stage of the pipeline
+ *
+ *  run:        The builtin
+ *  argc:       The number of arguments
+ *  argv:       An array containing all the arguments
+ *  state:      The state in which the pipeline runs (BIN_FG or BIN_BG)
+ *  pipeState:  The IO actions of the command
+ *  getPipe:    The pipe from which the stage would read (builtins do not read their input)
+ *  givePipe:   The pipe to which the stage writes
+ *  redirState: RED_NONE, RED_OVER or RED_APPE
+ *  outFile:    The file to which the output is redirected (NULL if none)
+ *
+ *  Returns: 0
+ */
+int runBuiltinStage(stageBuiltin_t run, int argc, char **argv, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, char *outFile, pProgDesc_t proDes)
+{
+    uint64_t started = statsClock();
+    char **argvCpy = (char **)arenaAlloc(lineArena, (argc + 1) * sizeof(char *));
+    char *output = NULL;
+    size_t outputLen = 0;
+    FILE *out = open_memstream(&output, &outputLen);
+    int outFd = STDOUT_FILENO;
+    int status;
+
+    for (int i = 0; i < argc; i++)
+        argvCpy[i] = argv[i];
+    argvCpy[argc] = NULL;
+
+    status = run(argc, argvCpy, out);
+    fclose(out);
+
+    if (redirState == RED_OVER || redirState == RED_APPE)
+    {
+        outFd = open(outFile, O_WRONLY | O_CREAT | O_CLOEXEC | ((redirState == RED_OVER) ? O_TRUNC : O_APPEND), 0666);
+        if (outFd == -1)
+        {
+            printf("%s: %s: %s\n", SHELL_NAME, outFile, strerror(errno));
+            status = 1;
+        }
+    }
+    else if (pipeState == PIP_WRITE || pipeState == PIP_BOTH)
+    {
+        outFd = givePipe[WRITE_END];
+    }
+    else
+    {
+        fflush(stdout);
+    }
+
+    if (outFd != -1 && outputLen > 0)
+    {
+        int capacity = (outFd == givePipe[WRITE_END]) ? fcntl(outFd, F_GETPIPE_SZ) : -1;
+
+        if (capacity != -1 && outputLen > (size_t)capacity)
+        {
+            // The pipe is grown if the system allows it, or the output is written by another process
+            capacity = fcntl(outFd, F_SETPIPE_SZ, (outputLen > INT_MAX) ? INT_MAX : (int)outputLen);
+            if (capacity == -1 || outputLen > (size_t)capacity)
+                launchBuiltinWriter(outFd, output, outputLen);
+            else
+                writeAll(outFd, output, outputLen);
+        }
+        else
+        {
+            writeAll(outFd, output, outputLen);
+        }
+    }
+
+    if (outFd != -1 && outFd != STDOUT_FILENO && outFd != givePipe[WRITE_END])
+        close(outFd);
+    free(output);
+
+    countStat(STAT_BUILTINS);
+    recordCommandTime(commandStatsSlot(argv[0]), statsClock() - started, status != 0);
+
+    finishStage(argv[0], state, pipeState, getPipe, givePipe, redirState, proDes);
+
+    // The status of a pipeline is the one of its last stage, even when the other stages were waited for
+    if (!((pipeState == PIP_WRITE || pipeState == PIP_BOTH) && redirState == RED_NONE))
+        lastStatus = status;
+
+    return 0;
+}
+
+/*
+ * Function: launchBuiltinWriter
+ * -----------------------------
+ * Launches the stage of pipeJob which writes the output of a builtin to the pipe of the next stage
+ * The writer is a fork of the Shell (nothing is executed) joining the process group of the job
+ *
+ *  fd:      The write end of the pipe
+ *  output:  The output of the builtin
+ *  len:     The length of the output
+ */
+void launchBuiltinWriter(int fd, const char *output, size_t len)
+{
+    int pgid = pipeJob->pgid;
+    int childPid;
+
+    fflush(stdout);
+
+    childPid = fork();
+    switch (childPid)
+    {
+    case -1:
+        perror("fork");
+        countStat(STAT_FORK_FAILURES);
+        break;
+    case 0:
+        setpgid(0, pgid);
+        signal(SIGTTOU, SIG_DFL);
+        closePipeEnd(pipeA, READ_END);
+        closePipeEnd(pipeB, READ_END);
+        closeMeterHops();
+        if (hereFd != -1)
+            close(hereFd);
+        writeAll(fd, output, len);
+        _exit(EXIT_SUCCESS);
+    default:
+        if (pgid == 0)
+            pipeJob->pgid = childPid;
+        setpgid(childPid, pipeJob->pgid);
+        if (shellInteractive && !pipeBackground && pgid == 0)
+            tcsetpgrp(STDIN_FILENO, childPid);
+        addStage(childPid, pipeJob);
+        break;
+    }
+}
+
+/*
+ * Function: cdCommand
+ * -------------------
+ * Builtin "cd":
+ *  cd [dir]            Changes the current directory (to the home directory without argument)
+ *  cd -j fragment...   Jumps to the most frecent visited directory matching the fragments (same as "z fragment...")
+ * The directories changed to by an interactive Shell are recorded in the frecency index (~/.quysh_dirs,
+ * or the file given by QUYSH_DIRS, an empty QUYSH_DIRS keeps the index in memory only)
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *
+ *  Returns: OK_SIG, ERROR_SIG if the arguments are invalid or if no directory matches the fragments
+ */
+int cdCommand(int argc, char **argv)
+{
+    char *dir;
+
+    if (argc >= 2 && strcmp(argv[1], "-j") == 0)
+        return jumpCommand("cd -j", argc - 1, argv + 1);
+
+    if (argc > 2)
+    {
+        printf("%s: cd: too many arguments\n", SHELL_NAME);
+        return ERROR_SIG;
+    }
+
+    dir = (argc == 1) ? getenv("HOME") : argv[1];
+    if (dir == NULL || chdir(dir) == -1)
+    {
+        printf("%s: cd: No such file or directory\n", SHELL_NAME);
+        return OK_SIG;
+    }
+
+    recordVisit();
+
+    return OK_SIG;
+}
+
+/*
+ * Function: jumpCommand
+ * ---------------------
+ * Builtin "z fragment..." (and "cd -j fragment..."): changes to the most frecent directory of the index whose path
+ * contains the fragments in the same order, the last one in its last component (see matchDir)
+ * Only the index is searched. A directory which does not exist anymore is forgotten, and the next match is tried
+ *
+ *  name:    The name of the builtin, for the error messages
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *
+ *  Returns: OK_SIG if the directory has been changed, ERROR_SIG otherwise
+ */
+int jumpCommand(char *name, int argc, char **argv)
+{
+    pDirIndex_t index = getDirIndex();
+    char cwd[MAX_PATH_LEN];
+    long long now = time(NULL);
+    const char *dir;
+    int forgotten = 0;
+
+    if (argc < 2)
+    {
+        printf("%s: %s: no fragment given\n", SHELL_NAME, name);
+        return ERROR_SIG;
+    }
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        cwd[0] = '\0';
+
+    refreshDirIndex(index);
+    while ((dir = matchDir(index, argv + 1, argc - 1, cwd, now)) != NULL)
+    {
+        if (chdir(dir) == 0)
+        {
+            recordVisit();
+            return OK_SIG;
+        }
+
+        forgetDir(index, dir);
+        forgotten = 1;
+    }
+
+    if (forgotten)
+        saveDirIndex(index);
+
+    printf("%s: %s: no directory matches", SHELL_NAME, name);
+    for (int i = 1; i < argc; i++)
+        printf(" %s", argv[i]);
+    printf("\n");
+
+    return ERROR_SIG;
+}
+
+/*
+ * Function: getDirIndex
+ * ---------------------
+ *  Returns: The frecency index of the visited directories, read from its file the first time it is needed
+ */
+pDirIndex_t getDirIndex()
+{
+    char *file = getenv("QUYSH_DIRS");
+    char *home = getenv("HOME");
+
+    if (dirIndex != NULL)
+        return dirIndex;
+
+    if (file == NULL && home != NULL)
+    {
+        file = (char *)arenaAlloc(lineArena, strlen(home) + strlen(DIRS_FILE) + 2);
+        sprintf(file, "%s/%s", home, DIRS_FILE);
+    }
+
+    dirIndex = loadDirIndex((file != NULL && file[0] != '\0') ? file : NULL);
+
+    return dirIndex;
+}
+
+/*
+ * Function: recordVisit
+ * ---------------------
+ * Records the current directory in the frecency index, if the Shell is interactive (scripts do not visit directories)
+ * The index file is read again first if another Shell has written it
+ */
+void recordVisit()
+{
+    pDirIndex_t index;
+    char cwd[MAX_PATH_LEN];
+
+    if (!shellInteractive || getcwd(cwd, sizeof(cwd)) == NULL)
+        return;
+
+    index = getDirIndex();
+    refreshDirIndex(index);
+    visitDir(index, cwd, time(NULL));
+    saveDirIndex(index);
+}
+
+/*
+ * Function: jobsCommand
+ * ---------------------
+ * Builtin "jobs [-l]": lists the child programs running in background or stopped
+ * With "-l", every stage is sampled from /proc to display its CPU usage, resident memory and I/O.
+ * The CPU usage is measured since the previous "jobs -l" (or since the start of the stage for the first one)
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: OK_SIG if the jobs were listed, ERROR_SIG otherwise
+ */
+int jobsCommand(int argc, char **argv, pProgDesc_t proDes)
+{
+    int details = 0;
+    int stageCount = 0;
+    pProcSample_t samples = NULL;
+    pChildProgram_t it;
+    double now, uptime;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-l") == 0)
+        {
+            details = 1;
+        }
+        else
+        {
+            printf("%s: jobs: %s: invalid option\n", SHELL_NAME, argv[i]);
+            return ERROR_SIG;
+        }
+    }
+
+    // Reports what has ended since the last prompt first, so that no finished job is listed as running
+    reapChildren(proDes);
+
+    if (details)
+    {
+        // All the stages of all the jobs are sampled in a single batch
+        for (it = proDes->first; it != NULL; it = it->next)
+            stageCount += it->liveStages;
+
+        samples = (pProcSample_t)malloc((stageCount + 1) * sizeof(procSample_t));
+        stageCount = 0;
+        for (it = proDes->first; it != NULL; it = it->next)
+            for (int i = 0; i < it->stageCount; i++)
+                if (it->stages[i].alive)
+                    samples[stageCount++].pid = it->stages[i].pid;
+
+        sampleProcesses(samples, stageCount);
+        uptime = procUptime();
+        now = monotonicTime();
+        stageCount = 0;
+    }
+
+    for (it = proDes->first; it != NULL; it = it->next)
+    {
+        if (it->id == 0)
+            continue;
+
+        printProgram(it, it->state == JOB_STOPPED ? "Stopped" : (it->state == JOB_DONE ? "Done" : "Running"));
+
+        if (hasLimits(&(it->limits)))
+        {
+            char limits[128];
+            formatLimits(&(it->limits), limits, sizeof(limits));
+            printf("\tlimits: %s%s\n", limits, it->cgroup != NULL ? " (cgroup)" : "");
+        }
+
+        if (it->placement.policy != PLACE_NONE)
+        {
+            char placement[128];
+            formatPlacement(&(it->placement), placement, sizeof(placement));
+            printf("\tplacement: %s\n", placement);
+        }
+
+        if (!details)
+            continue;
+
+        for (int i = 0; i < it->stageCount; i++)
+        {
+            pJobStage_t stage = &(it->stages[i]);
+            pProcSample_t sample;
+            char rss[16], readBytes[16], writeBytes[16];
+            double cpu;
+
+            if (!stage->alive)
+                continue;
+
+            sample = &(samples[stageCount++]);
+            if (!sample->valid)
+            {
+                printf("\t%7d  -\n", stage->pid);
+                continue;
+            }
+
+            if (stage->lastSample > 0)
+                cpu = procCpuPercent(sample->cpuTicks - stage->lastTicks, now - stage->lastSample);
+            else
+                cpu = procCpuPercent(sample->cpuTicks, procElapsed(sample, uptime));
+            stage->lastTicks = sample->cpuTicks;
+            stage->lastSample = now;
+
+            formatBytes(sample->rssBytes, rss, sizeof(rss));
+            formatBytes(sample->readBytes, readBytes, sizeof(readBytes));
+            formatBytes(sample->writeBytes, writeBytes, sizeof(writeBytes));
+
+            printf("\t%7d  %c  cpu %5.1f%% (#%d)  rss %7s  read %7s  written %7s  %s\n",
+                   sample->pid, sample->state, cpu, sample->processor, rss, readBytes, writeBytes, sample->comm);
+        }
+    }
+
+    free(samples);
+
+    return OK_SIG;
+}
+
+/*
+ * Function: fgCommand
+ * -------------------
+ * Builtin "fg [%id]": resumes a child program in foreground and waits for it
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: OK_SIG if the child program was resumed, ERROR_SIG otherwise
+ */
+int fgCommand(int argc, char **argv, pProgDesc_t proDes)
+{
+    pChildProgram_t child = findJob(argc > 1 ? argv[1] : NULL, proDes);
+
+    if (child == NULL)
+    {
+        printf("%s: fg: %s: no such job\n", SHELL_NAME, argc > 1 ? argv[1] : "current");
+        return ERROR_SIG;
+    }
+
+    for (int i = 0; i < child->argc; i++)
+        printf("%s ", child->argv[i]);
+    printf("\n");
+    fflush(stdout);
+
+    child->state = JOB_RUNNING;
+    if (shellInteractive)
+        tcsetpgrp(STDIN_FILENO, child->pgid);
+    kill(-child->pgid, SIGCONT);
+
+    waitProgram(child, proDes);
+
+    return OK_SIG;
+}
+
+/*
+ * Function: bgCommand
+ * -------------------
+ * Builtin "bg [%id]": resumes a stopped child program in background
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: OK_SIG if the child program was resumed, ERROR_SIG otherwise
+ */
+int bgCommand(int argc, char **argv, pProgDesc_t proDes)
+{
+    pChildProgram_t child = findJob(argc > 1 ? argv[1] : NULL, proDes);
+
+    if (child == NULL)
+    {
+        printf("%s: bg: %s: no such job\n", SHELL_NAME, argc > 1 ? argv[1] : "current");
+        return ERROR_SIG;
+    }
+
+    if (child->state == JOB_RUNNING)
+    {
+        printf("%s: bg: job %d already in background\n", SHELL_NAME, child->id);
+        return OK_SIG;
+    }
+
+    child->state = JOB_RUNNING;
+    kill(-child->pgid, SIGCONT);
+    printProgram(child, "Running");
+
+    return OK_SIG;
+}
+
+/*
+ * Function: killCommand
+ * ---------------------
+ * Builtin "kill [-SIGNAL | -s SIGNAL] %id|pid...": sends a signal (SIGTERM by default) to child programs or processes
+ * Signalling a child program signals all of its stages
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: OK_SIG if every target was signalled, ERROR_SIG otherwise
+ */
+int killCommand(int argc, char **argv, pProgDesc_t proDes)
+{
+    int sig = SIGTERM;
+    int first = 1;
+    int fb = OK_SIG;
+
+    if (argc > 2 && strcmp(argv[1], "-s") == 0)
+    {
+        sig = parseSignal(argv[2]);
+        first = 3;
+    }
+    else if (argc > 1 && argv[1][0] == '-')
+    {
+        sig = parseSignal(&(argv[1][1]));
+        first = 2;
+    }
+
+    if (sig == -1)
+    {
+        printf("%s: kill: %s: invalid signal specification\n", SHELL_NAME, argv[first - 1]);
+        return ERROR_SIG;
+    }
+
+    if (first >= argc)
+    {
+        printf("%s: kill: usage: kill [-s sigspec | -sigspec] pid | %%id ...\n", SHELL_NAME);
+        return ERROR_SIG;
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        if (argv[i][0] == '%')
+        {
+            pChildProgram_t child = findJob(argv[i], proDes);
+
+            if (child == NULL)
+            {
+                printf("%s: kill: %s: no such job\n", SHELL_NAME, argv[i]);
+                fb = ERROR_SIG;
+                continue;
+            }
+
+            kill(-child->pgid, sig);
+
+            // A stopped job would only receive the signal once resumed
+            if (child->state == JOB_STOPPED && sig != SIGSTOP && sig != SIGTSTP && sig != SIGKILL)
+                kill(-child->pgid, SIGCONT);
+        }
+        else
+        {
+            char *end;
+            long pid;
+
+            // "abc" would be pid 0, the Shell's own process group, and "12abc" pid 12
+            errno = 0;
+            pid = strtol(argv[i], &end, 10);
+            if (argv[i][0] == '\0' || *end != '\0' || errno != 0 || pid <= 0 || pid > INT_MAX)
+            {
+                printf("%s: kill: %s: invalid pid\n", SHELL_NAME, argv[i]);
+                fb = ERROR_SIG;
+                continue;
+            }
+
+            if (kill((pid_t)pid, sig) == -1)
+            {
+                printf("%s: kill: (%s) - No such process\n", SHELL_NAME, argv[i]);
+                fb = ERROR_SIG;
+            }
+        }
+    }
+
+    return fb;
+}
+
+/*
+ * Function: waitCommand
+ * ---------------------
+ * Builtin "wait":
+ *  wait               Waits until all the child programs running in background have ended
+ *  wait %id|pid ...   Waits until the given child programs have ended
+ *  wait -n            Waits until the next child program running in background ends
+ * The exit status of the last child program waited for becomes "$?" (127 if it does not exist)
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: OK_SIG if the child programs have been waited for, ERROR_SIG otherwise
+ */
+int waitCommand(int argc, char **argv, pProgDesc_t proDes)
+{
+    pChildProgram_t it;
+    int fb = OK_SIG;
+
+    if (argc == 1 || strcmp(argv[1], "-n") == 0)
+    {
+        int next = (argc > 1);
+
+        lastStatus = next ? 127 : 0;
+
+        for (;;)
+        {
+            int running = 0;
+
+            // The jobs which have ended in the meantime are removed silently: they have been waited for
+            it = proDes->first;
+            while (it != NULL)
+            {
+                pChildProgram_t nextIt = it->next;
+
+                if (it->id != 0 && it->state == JOB_DONE)
+                {
+                    if (next)
+                    {
+                        lastStatus = exitStatus(it->status);
+                        removeProgram(it->id, proDes);
+                        return OK_SIG;
+                    }
+                    removeProgram(it->id, proDes);
+                }
+                else if (it->id != 0 && it->state == JOB_RUNNING)
+                {
+                    running = 1;
+                }
+                it = nextIt;
+            }
+
+            if (!running || !waitNextChild(proDes))
+                break;
+        }
+
+        return next ? ERROR_SIG : OK_SIG;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        pChildProgram_t child = (argv[i][0] == '%') ? findJob(argv[i], proDes) : findProgram(atoi(argv[i]), proDes);
+
+        if (child == NULL)
+        {
+            printf("%s: wait: %s: no such job\n", SHELL_NAME, argv[i]);
+            lastStatus = 127;
+            fb = ERROR_SIG;
+            continue;
+        }
+
+        while (child->state == JOB_RUNNING)
+            if (!waitNextChild(proDes))
+                break;
+
+        if (child->state == JOB_STOPPED)
+        {
+            lastStatus = 128 + SIGTSTP;
+            continue;
+        }
+
+        lastStatus = exitStatus(child->status);
+        removeProgram(child->id, proDes);
+    }
+
+    return fb;
+}
+
+/*
+ * Function: statsCommand
+ * ----------------------
+ * Builtin "stats [-j] [-r]": prints the counters of the Shell, the latencies of the path of a command
+ * (parse, expansion, lookup, spawn) and the wall time of each command name
+ *  -j   Prints a JSON object instead of tables (durations in nanoseconds)
+ *  -r   Resets all the statistics once they have been printed
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *
+ *  Returns: OK_SIG if the statistics were printed, ERROR_SIG otherwise
+ */
+int statsCommand(int argc, char **argv)
+{
+    int json = 0;
+    int reset = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0)
+        {
+            json = 1;
+        }
+        else if (strcmp(argv[i], "-r") == 0)
+        {
+            reset = 1;
+        }
+        else
+        {
+            printf("%s: stats: %s: invalid option\n", SHELL_NAME, argv[i]);
+            return ERROR_SIG;
+        }
+    }
+
+    printStats(json);
+
+    if (reset)
+        resetStats();
+
+    return OK_SIG;
+}
+
+/*
+ * Function: limitCommand
+ * ----------------------
+ * Builtin "limit":
+ *  limit                         Shows the default limits of the jobs launched with '&'
+ *  limit -d resource=value...    Sets the default limits of the jobs launched with '&' ("resource=none" removes one)
+ *  limit resource=value... cmd   Runs cmd (and the rest of its pipeline) with the given limits
+ * Resources: mem=SIZE, cpu=PERCENT%, time=SECONDS, fsize=SIZE, files=COUNT
+ *
+ *  argc:         The number of words of the command line (command name included)
+ *  argv:         The command line
+ *  paths:        The structure containing all paths referenced in the PATH environement variable
+ *  readFromPipe: 1 if the command was prefixed by a '|', 0 otherwise
+ *  pipeCount:    The number of pipes preceeding the command
+ *  proDes:       A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the limited command, ERROR_SIG if a limit is invalid
+ */
+int limitCommand(int argc, char **argv, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes)
+{
+    jobLimits_t limits;
+    int setDefaults = (argc > 1 && strcmp(argv[1], "-d") == 0);
+    int i;
+    int fb;
+
+    if (argc == 1)
+    {
+        char buffer[128];
+        formatLimits(&bgLimits, buffer, sizeof(buffer));
+        printf("%s\n", hasLimits(&bgLimits) ? buffer : "unlimited");
+        return OK_SIG;
+    }
+
+    limits = setDefaults ? bgLimits : nextLimits;
+
+    for (i = setDefaults ? 2 : 1; i < argc; i++)
+    {
+        int res = parseLimit(argv[i], &limits);
+
+        if (res == 0)
+            break;
+
+        if (res == -1)
+        {
+            printf("%s: limit: %s: invalid limit\n", SHELL_NAME, argv[i]);
+            return ERROR_SIG;
+        }
+    }
+
+    if (setDefaults)
+    {
+        if (i < argc)
+        {
+            printf("%s: limit: %s: invalid limit\n", SHELL_NAME, argv[i]);
+            return ERROR_SIG;
+        }
+        bgLimits = limits;
+        return OK_SIG;
+    }
+
+    if (i == argc || isOperator(argv[i][0]))
+    {
+        printf("%s: limit: missing command\n", SHELL_NAME);
+        return ERROR_SIG;
+    }
+
+    // The limits are picked up by the job created for the command
+    nextLimits = limits;
+    wordsExpanded = 1;
+    fb = parseCommand(&(argv[i]), paths, readFromPipe, pipeCount, proDes);
+    clearLimits(&nextLimits);
+
+    return fb;
+}
+
+/*
+ * Function: placeCommand
+ * ----------------------
+ * Builtin "place":
+ *  place                 Shows the default placement and the CPU topology
+ *  place -d POLICY       Sets the default placement of every job
+ *  place POLICY cmd      Runs cmd (and the rest of its pipeline) with the given placement
+ * POLICY: none, compact (one CPU per stage, neighbouring stages sharing their caches),
+ *         spread (one physical core per job) or a list of CPUs (cpus=0-3,8)
+ *
+ *  argc:         The number of words of the command line (command name included)
+ *  argv:         The command line
+ *  paths:        The structure containing all paths referenced in the PATH environement variable
+ *  readFromPipe: 1 if the command was prefixed by a '|', 0 otherwise
+ *  pipeCount:    The number of pipes preceeding the command
+ *  proDes:       A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the placed command, ERROR_SIG if the placement is invalid
+ */
+int placeCommand(int argc, char **argv, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes)
+{
+    placement_t placement;
+    int setDefault = (argc > 1 && strcmp(argv[1], "-d") == 0);
+    int policyPos = setDefault ? 2 : 1;
+    int fb;
+
+    if (argc == 1)
+    {
+        char buffer[128];
+        formatPlacement(&defaultPlacement, buffer, sizeof(buffer));
+        printf("default: %s\n", buffer);
+        printTopology();
+        return OK_SIG;
+    }
+
+    if (policyPos >= argc || !parsePlacement(argv[policyPos], &placement))
+    {
+        printf("%s: place: %s: invalid placement\n", SHELL_NAME, policyPos < argc ? argv[policyPos] : "");
+        return ERROR_SIG;
+    }
+
+    if (setDefault)
+    {
+        defaultPlacement = placement;
+        nextPlacement = placement;
+        return OK_SIG;
+    }
+
+    if (policyPos + 1 >= argc || isOperator(argv[policyPos + 1][0]))
+    {
+        printf("%s: place: missing command\n", SHELL_NAME);
+        return ERROR_SIG;
+    }
+
+    // The placement is picked up by the job created for the command
+    nextPlacement = placement;
+    wordsExpanded = 1;
+    fb = parseCommand(&(argv[policyPos + 1]), paths, readFromPipe, pipeCount, proDes);
+    nextPlacement = defaultPlacement;
+
+    return fb;
+}
+
+/*
+ * Function: meterCommand
+ * ----------------------
+ * Builtin "meter":
+ *  meter cmd | cmd ...   Runs a pipeline through a meter which relays every pipe and measures its throughput:
+ *                        a live status on stderr while the pipeline runs in foreground (the rate of each hop,
+ *                        "<wait" if it waits for its writer, "wait>" for its reader), a summary once it ends
+ *
+ *  argc:         The number of words of the command line (command name included)
+ *  argv:         The command line
+ *  paths:        The structure containing all paths referenced in the PATH environement variable
+ *  readFromPipe: 1 if the command was prefixed by a '|', 0 otherwise
+ *  pipeCount:    The number of pipes preceeding the command
+ *  proDes:       A pointer to the Program Descriptor
+ *
+ *  Returns: The feedback of the metered command
+ */
+int meterCommand(int argc, char **argv, pPaths_t paths, int readFromPipe, int pipeCount, pProgDesc_t proDes)
+{
+    int fb;
+
+    if (argc == 1 || isOperator(argv[1][0]))
+    {
+        printf("%s: meter: missing command\n", SHELL_NAME);
+        return ERROR_SIG;
+    }
+
+    // Picked up by the job created for the command (in the middle of a pipeline, meters the rest of it)
+    meterNext = 1;
+    if (readFromPipe && pipeJob != NULL)
+        pipeMetered = 1;
+    wordsExpanded = 1;
+    fb = parseCommand(&(argv[1]), paths, readFromPipe, pipeCount, proDes);
+    meterNext = 0;
+
+    return fb;
+}
+
+/*
+ * Function: muxCommand
+ * --------------------
+ * Builtin "mux":
+ *  mux             Shows whether the outputs of background jobs are multiplexed
+ *  mux on [dir]    Multiplexes the standard output and error of the next background jobs: their lines are written
+ *                  whole, prefixed with "[ID]". With dir, the output of each job is also written to dir/jobID.log
+ *  mux off         Stops multiplexing (the jobs already multiplexed keep their prefix until they end)
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *
+ *  Returns: OK_SIG if the mode has been shown or changed, ERROR_SIG otherwise
+ */
+int muxCommand(int argc, char **argv)
+{
+    struct stat dirStat;
+
+    if (argc == 1)
+    {
+        if (muxControl == -1)
+            printf("off\n");
+        else if (muxLogDir != NULL)
+            printf("on, logged to %s\n", muxLogDir);
+        else
+            printf("on\n");
+        return OK_SIG;
+    }
+
+    if (strcmp(argv[1], "off") == 0 && argc == 2)
+    {
+        // The multiplexer ends once the jobs it already relays have ended
+        if (muxControl != -1)
+            close(muxControl);
+        muxControl = -1;
+        free(muxLogDir);
+        muxLogDir = NULL;
+        return OK_SIG;
+    }
+
+    if (strcmp(argv[1], "on") != 0 || argc > 3)
+    {
+        printf("%s: mux: usage: mux [on [dir] | off]\n", SHELL_NAME);
+        return ERROR_SIG;
+    }
+
+    if (argc == 3 && (stat(argv[2], &dirStat) == -1 || !S_ISDIR(dirStat.st_mode)))
+    {
+        printf("%s: mux: %s: not a directory\n", SHELL_NAME, argv[2]);
+        return ERROR_SIG;
+    }
+
+    if (muxControl == -1)
+    {
+        muxControl = startMux(&muxPid);
+        if (muxControl == -1)
+        {
+            perror("mux");
+            return ERROR_SIG;
+        }
+    }
+
+    free(muxLogDir);
+    muxLogDir = (argc == 3) ? strdup(argv[2]) : NULL;
+
+    return OK_SIG;
+}
+
+/*
+ * Function: readCommand
+ * ---------------------
+ * Builtin "read [-r] [name...]": reads a line of the standard input (or of a here-string), splits it into fields
+ * on the characters of IFS (blanks by default), and sets each variable to a field, the last one to the rest of
+ * the line (REPLY without name). Without -r, a backslash escapes the next character and joins lines
+ * The line is taken from a read-ahead buffer instead of being read one byte at a time: the buffer of stdin
+ * when the standard input also holds the commands of the Shell, the buffer of the descriptor otherwise
+ *
+ *  argc:    The number of arguments (command name included)
+ *  argv:    An array containing all the arguments
+ *
+ *  Returns: OK_SIG (the status is 0 if a line has been read, 1 at the end of the input), ERROR_SIG on a usage error
+ */
+int readCommand(int argc, char **argv)
+{
+    static char *stdinLine = NULL;
+    static size_t stdinCapacity = 0;
+    char *defaultName[] = {"REPLY"};
+    textBuffer_t line = {NULL, 0, 0};
+    int inputFd = (hereFd != -1) ? hereFd : STDIN_FILENO;
+    int raw = 0;
+    int complete = 0;
+    int first;
+
+    for (first = 1; first < argc && argv[first][0] == '-'; first++)
+    {
+        if (strcmp(argv[first], "-r") == 0)
+        {
+            raw = 1;
+        }
+        else if (strcmp(argv[first], "--") == 0)
+        {
+            first++;
+            break;
+        }
+        else
+        {
+            printf("%s: read: usage: read [-r] [name...]\n", SHELL_NAME);
+            lastStatus = 2;
+            return ERROR_SIG;
+        }
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        for (int j = 0; argv[i][j] != '\0' || j == 0; j++)
+        {
+            if (!isNameChar(argv[i][j], j == 0))
+            {
+                printf("%s: read: `%s': not a valid identifier\n", SHELL_NAME, argv[i]);
+                lastStatus = 2;
+                return ERROR_SIG;
+            }
+        }
+    }
+
+    for (;;)
+    {
+        char *part;
+        ssize_t len;
+
+        complete = 0;
+
+        // The commands of the Shell come from its standard input: both are read through the buffer of stdin
+        if (inputFd == STDIN_FILENO && loopInput == 0 && scriptInput == NULL)
+        {
+            len = getline(&stdinLine, &stdinCapacity, stdin);
+            part = stdinLine;
+            complete = (len > 0 && stdinLine[len - 1] == '\n');
+            if (complete)
+                len--;
+        }
+        else
+        {
+            len = readLine(getLineReader(inputFd), &part, &complete);
+        }
+
+        if (len == -1)
+            break;
+        appendText(&line, part, len);
+
+        // Without -r, a backslash at the end of a line joins the next one
+        if (!raw && complete)
+        {
+            size_t backslashes = 0;
+
+            while (backslashes < line.len && line.text[line.len - 1 - backslashes] == '\\')
+                backslashes++;
+            if (backslashes % 2 == 1)
+            {
+                line.text[--line.len] = '\0';
+                continue;
+            }
+        }
+        break;
+    }
+
+    if (hereFd != -1)
+    {
+        dropLineReader(hereFd);
+        close(hereFd);
+        hereFd = -1;
+    }
+
+    if (first < argc)
+        assignReadFields((line.text != NULL) ? line.text : "", line.len, &argv[first], argc - first, raw);
+    else
+        assignReadFields((line.text != NULL) ? line.text : "", line.len, defaultName, 1, raw);
+
+    // A last line without newline is still assigned, but ends the "while read" loops
+    lastStatus = complete ? 0 : 1;
+
+    return OK_SIG;
+}
+
+/*
+ * Function: assignReadFields
+ * --------------------------
+ * Splits a line read by "read" into fields and sets the variables: the blanks of IFS around the fields are
+ * dropped, any other character of IFS separates two fields (even empty), the last variable gets the rest of the line
+ *
+ *  line:    The line
+ *  len:     The length of the line
+ *  names:   The names of the variables
+ *  count:   The number of variables
+ *  raw:     0 if backslashes escape the next character
+ */
+void assignReadFields(char *line, size_t len, char **names, int count, int raw)
+{
+    const char *ifs = getenv("IFS");
+    size_t pos = 0;
+
+    if (ifs == NULL)
+        ifs = " \t\n";
+
+    while (pos < len && isFieldBlank(line[pos], ifs))
+        pos++;
+
+    for (int n = 0; n < count; n++)
+    {
+        textBuffer_t field = {NULL, 0, 0};
+        size_t kept = 0; // The length of the field without its trailing blanks
+        int last = (n == count - 1);
+
+        while (pos < len)
+        {
+            char c = line[pos];
+
+            if (!raw && c == '\\' && pos + 1 < len)
+            {
+                appendText(&field, &line[pos + 1], 1);
+                kept = field.len;
+                pos += 2;
+                continue;
+            }
+
+            if (c != '\0' && strchr(ifs, c) != NULL)
+            {
+                if (!last)
+                    break;
+                appendText(&field, &c, 1);
+                if (!isFieldBlank(c, ifs))
+                    kept = field.len;
+                pos++;
+                continue;
+            }
+
+            appendText(&field, &c, 1);
+            kept = field.len;
+            pos++;
+        }
+
+        // A separator is made of blanks, around at most one other character of IFS
+        if (!last)
+        {
+            while (pos < len && isFieldBlank(line[pos], ifs))
+                pos++;
+            if (pos < len && line[pos] != '\0' && strchr(ifs, line[pos]) != NULL)
+            {
+                pos++;
+                while (pos < len && isFieldBlank(line[pos], ifs))
+                    pos++;
+            }
+        }
+
+        if (field.text != NULL)
+            field.text[kept] = '\0';
+        setVariable(names[n], (field.text != NULL) ? field.text : "");
+    }
+}
+
+/*
+ * Function: isFieldBlank
+ * ----------------------
+ *  Returns: 1 if the character is a blank (space, tab or newline) which is part of IFS, 0 otherwise
+ */
+int isFieldBlank(char c, const char *ifs)
+{
+    return (c == ' ' || c == '\t' || c == '\n') && strchr(ifs, c) != NULL;
+}
+
+/*
+ * Function: parseSignal
+ * ---------------------
+ * Converts a signal given by its number ("9") or its name ("KILL" or "SIGKILL") into a signal number
+ *
+ *  name:    The signal to convert
+ *
+ *  Returns: The signal number, -1 if the signal is unknown
+ */
+int parseSignal(char *name)
+{
+    if (name[0] >= '0' && name[0] <= '9')
+        return atoi(name);
+
+    if (strncmp(name, "SIG", 3) == 0)
+        name += 3;
+
+    for (int i = 0; i < SIGNAL_NAME_COUNT; i++)
+        if (strcmp(SIGNAL_NAMES[i].name, name) == 0)
+            return SIGNAL_NAMES[i].sig;
+
+    return -1;
+}
+
+/*
+ * Function: formatBytes
+ * ---------------------
+ * Formats a number of bytes in a human readable way ("512B", "1.5K", "12.0M", ...)
+ *
+ *  bytes:     The number of bytes
+ *  buffer:    The buffer receiving the formatted string
+ *  bufferLen: The size of the buffer
+ */
+void formatBytes(unsigned long long bytes, char *buffer, int bufferLen)
+{
+    const char *units = "KMGTP";
+    double value = bytes;
+    int unit = -1;
+
+    while (value >= 1024 && unit < 4)
+    {
+        value /= 1024;
+        unit++;
+    }
+
+    if (unit == -1)
+        snprintf(buffer, bufferLen, "%lluB", bytes);
+    else
+        snprintf(buffer, bufferLen, "%.1f%c", value, units[unit]);
+}
+
+/*
+ * Function: getPwd
+ * ----------------
+ * Returns a char* corresponding the current working directory
+ *
+ *  Returns: The current working directory
+ */
+inline char *getPwd()
+{
+    char cwd[MAX_PATH_LEN];
+    return getcwd(cwd, sizeof(cwd));
+}
+
+/*
+ * Function: getBinPath
+ * --------------------
+ * Looks for the complete file path of a specific binary in the command cache, or by going through the list of paths
+ *
+ *  filename: The name of the binary to find
+ *  paths:    The structure containing all paths referenced in the PATH environement variable
+ *
+ *  Returns:  The complete path of a binary if it exists in one of the directories of paths (allocated from the line arena)
+ *            NULL if the binary could not be found (as well as a name longer than any file name)
+ */
+char *getBinPath(char *filename, pPaths_t paths)
+{
+    char *binaryPath;
+    char *cached;
+    size_t nameLen = strlen(filename);
+    size_t dirLen = 0;
+    pPath_t path_it = paths->first;
+
+    // No directory holds such a file: the word is not looked up, nor copied
+    if (nameLen > NAME_MAX)
+    {
+        countStat(STAT_NOT_FOUND);
+        return NULL;
+    }
+
+    cached = lookupCommand(filename);
+
+    // A command found before is only checked, unless it has disappeared
+    if (cached != NULL && fileExists(cached))
+    {
+        countStat(STAT_CACHE_HITS);
+        return arenaStrdup(lineArena, cached);
+    }
+    countStat(STAT_CACHE_MISSES);
+
+    // The candidates share one block, as long as the longest directory, a slash, the name and its terminator
+    for (path_it = paths->first; path_it != NULL; path_it = path_it->next)
+    {
+        if (strlen(path_it->path_text) > dirLen)
+            dirLen = strlen(path_it->path_text);
+    }
+    binaryPath = (char *)arenaAlloc(lineArena, (dirLen + 1 + nameLen + 1) * sizeof(char));
+
+    // Iterates over the Linked List of paths
+    path_it = paths->first;
+    while (path_it != NULL)
+    {
+        // Builds a possible complete path
+        snprintf(binaryPath, dirLen + 1 + nameLen + 1, "%s/%s", path_it->path_text, filename);
+
+        // If the binary exists, returns its complete path
+        if (fileExists(binaryPath))
+        {
+            if (DEBUG)
+                printf("Located '%s' at \"%s\"\n", filename, binaryPath);
+
+            cacheCommand(filename, binaryPath);
+            return binaryPath;
+        }
+        path_it = path_it->next;
+    }
+    countStat(STAT_NOT_FOUND);
+    return NULL; // The binary has not been found
+}
+
+/*
+ * Function: lookupCommand
+ * -----------------------
+ * Looks for a command in the command cache, then in the command table of the snapshot
+ *
+ *  name:    The name of the command
+ *
+ *  Returns: The complete path where the command has been found before, NULL if it is unknown
+ */
+char *lookupCommand(char *name)
+{
+    const char *found;
+
+    if (commandSlots > 0)
+    {
+        uint64_t slot = hashString(name) & (commandSlots - 1);
+
+        while (commandCache[slot].name != NULL)
+        {
+            if (strcmp(commandCache[slot].name, name) == 0)
+                return commandCache[slot].path;
+            slot = (slot + 1) & (commandSlots - 1);
+        }
+    }
+
+    // Commands of the snapshot join the cache (they are saved again with it)
+    if (snapshot != NULL && (found = snapshotLookup(snapshot, name)) != NULL)
+    {
+        cacheCommand(name, (char *)found);
+        return (char *)found;
+    }
+
+    return NULL;
+}
+
+/*
+ * Function: cacheCommand
+ * ----------------------
+ * Remembers where a command has been found
+ *
+ *  name:    The name of the command
+ *  path:    The complete path of the command
+ */
+void cacheCommand(char *name, char *path)
+{
+    uint64_t slot;
+
+    if (commandCount * 2 >= commandSlots)
+    {
+        pCommandEntry_t oldCache = commandCache;
+        int oldSlots = commandSlots;
+
+        commandSlots = (commandSlots == 0) ? COMMAND_CACHE_MIN : commandSlots * 2;
+        commandCache = (pCommandEntry_t)calloc(commandSlots, sizeof(commandEntry_t));
+
+        for (int i = 0; i < oldSlots; i++)
+        {
+            if (oldCache[i].name == NULL)
+                continue;
+
+            slot = hashString(oldCache[i].name) & (commandSlots - 1);
+            while (commandCache[slot].name != NULL)
+                slot = (slot + 1) & (commandSlots - 1);
+            commandCache[slot] = oldCache[i];
+        }
+        free(oldCache);
+    }
+
+    slot = hashString(name) & (commandSlots - 1);
+    while (commandCache[slot].name != NULL && strcmp(commandCache[slot].name, name) != 0)
+        slot = (slot + 1) & (commandSlots - 1);
+
+    if (commandCache[slot].name == NULL)
+    {
+        commandCache[slot].name = strdup(name);
+        commandCount++;
+    }
+    else
+    {
+        free(commandCache[slot].path);
+    }
+    commandCache[slot].path = strdup(path);
+}
+
+/*
+ * Function: getSnapshotFile
+ * -------------------------
+ *  Returns: The path of the snapshot file (allocated from the line arena), NULL if snapshots are disabled
+ */
+char *getSnapshotFile()
+{
+    char *file = getenv("QUYSH_SNAPSHOT");
+    char *home = getenv("HOME");
+    char *path;
+
+    if (file != NULL)
+        return (file[0] != '\0') ? file : NULL;
+
+    if (home == NULL)
+        return NULL;
+
+    path = (char *)arenaAlloc(lineArena, strlen(home) + strlen(SNAPSHOT_FILE) + 2);
+    sprintf(path, "%s/%s", home, SNAPSHOT_FILE);
+
+    return path;
+}
+
+/*
+ * Function: restoreSnapshot
+ * -------------------------
+ * Maps the snapshot of the previous session and restores its variables and its history
+ * Its command table stays mapped: commands are looked up in it as they are needed
+ */
+void restoreSnapshot()
+{
+    char *file = getSnapshotFile();
+    const char *entry;
+
+    if (file == NULL)
+        return;
+
+    snapshot = loadSnapshot(file, getenv("PATH"));
+    if (snapshot == NULL)
+    {
+        if (DEBUG)
+            printf("Snapshot: none or stale\n");
+        return;
+    }
+
+    for (int i = 0; (entry = snapshotVariable(snapshot, i)) != NULL; i++)
+    {
+        char *separator = strchr(entry, '=');
+
+        if (separator != NULL)
+            setVariable(arenaStrndup(lineArena, entry, separator - entry), separator + 1);
+    }
+
+    for (int i = 0; (entry = snapshotHistory(snapshot, i)) != NULL; i++)
+        addHistory(entry);
+
+    if (DEBUG)
+        printf("Snapshot: restored (commands %s)\n", snapshot->commandsValid ? "valid" : "stale");
+
+    resetArena(lineArena);
+}
+
+/*
+ * Function: writeSnapshot
+ * -----------------------
+ * Saves the command cache, the variables and the history for the next session
+ *
+ *  path:    The PATH of the Shell
+ */
+void writeSnapshot(const char *path)
+{
+    snapshotData_t data;
+    char *file = getSnapshotFile();
+    pVariable_t it;
+    int i;
+
+    if (file == NULL)
+        return;
+
+    data.path = path;
+
+    // Commands of the snapshot which have not been needed in this session are kept
+    for (uint32_t slot = 0; snapshot != NULL && slot < snapshot->header->cacheSlots; slot++)
+    {
+        const char *name = snapshotCommandName(snapshot, slot);
+
+        if (name != NULL)
+            lookupCommand((char *)name);
+    }
+
+    data.commandNames = (const char **)arenaAlloc(lineArena, (commandCount + 1) * sizeof(char *));
+    data.commandPaths = (const char **)arenaAlloc(lineArena, (commandCount + 1) * sizeof(char *));
+    data.commandCount = 0;
+    for (i = 0; i < commandSlots; i++)
+    {
+        if (commandCache[i].name != NULL && commandCache[i].path != NULL)
+        {
+            data.commandNames[data.commandCount] = commandCache[i].name;
+            data.commandPaths[data.commandCount++] = commandCache[i].path;
+        }
+    }
+
+    // Only the variables set by the Shell are saved: the others come from the environment of the next session
+    data.variableCount = 0;
+    for (it = variables; it != NULL; it = it->next)
+        if (!it->inherited)
+            data.variableCount++;
+    data.variables = (const char **)arenaAlloc(lineArena, (data.variableCount + 1) * sizeof(char *));
+    for (i = 0, it = variables; it != NULL; it = it->next)
+        if (!it->inherited)
+            data.variables[i++] = it->binding;
+
+    data.historyCount = historyCount();
+    data.history = (const char **)arenaAlloc(lineArena, (data.historyCount + 1) * sizeof(char *));
+    for (i = 0; i < data.historyCount; i++)
+        data.history[i] = historyEntry(i);
+
+    if (saveSnapshot(file, &data) == -1 && DEBUG)
+        printf("Snapshot: could not write %s\n", file);
+
+    freeSnapshot(snapshot);
+    snapshot = NULL;
+}
+
+/*
+ * Function: fileExists
+ * --------------------
+ * Checks whether or not a given file exists in the current working directory
+ *
+ *  filename: The name of the file to check
+ *
+ *  Returns:  0 if the file does not exist
+ *            1 if the file exists
+ */
+inline int fileExists(char *filename)
+{
+    return (access(filename, F_OK) != -1);
+}
+
+/*
+ * Function: isOperator
+ * --------------------
+ * Determines whether or not the given character corresponds to one of the Shell operators
+ * 
+ *  c:       The character to test
+ * 
+ *  Returns: 1 if c is a Shell operator, 0 otherwise
+ */
+int isOperator(char c)
+{
+    for (int i = 0; i < SHELL_OPE_COUNT; i++)
+        if (SHELL_OPE[i] == c)
+            return 1;
+
+    return 0;
+}
+
+/*
+ * Function: closePipeEnd
+ * ----------------------
+ * Closes one end of a pipe and marks it as closed, so that it is never closed twice
+ * (the descriptor number could have been reused in the meantime)
+ *
+ *  pipeFd: The pipe
+ *  end:    READ_END or WRITE_END
+ */
+void closePipeEnd(int pipeFd[2], int end)
+{
+    if (pipeFd[end] != -1)
+    {
+        close(pipeFd[end]);
+        pipeFd[end] = -1;
+    }
+}
+
+/*
+ * Function: pipelineLength
+ * ------------------------
+ * Counts the words of the pipeline starting at the given command
+ *
+ *  cmd:        The command line, starting at the first command of the pipeline
+ *  background: Set to 1 if the pipeline is terminated by a '&', 0 otherwise
+ *
+ *  Returns: The number of words of the pipeline (operators '|' and the final redirection included)
+ */
+int pipelineLength(char **cmd, int *background)
+{
+    int len;
+
+    *background = 0;
+    for (len = 0; cmd[len] != NULL; len++)
+    {
+        if (strcmp(cmd[len], ";") == 0)
+            break;
+
+        if (strcmp(cmd[len], "&") == 0)
+        {
+            *background = 1;
+            break;
+        }
+
+        // A redirection ends the pipeline: only a '&' may follow the name of the file
+        if (strcmp(cmd[len], ">") == 0)
+        {
+            while (cmd[len] != NULL && strcmp(cmd[len], ">") == 0)
+                len++;
+            if (cmd[len] != NULL && strcmp(cmd[len], "|") == 0)
+            {
+                // Several files
+                len++;
+                while (cmd[len] != NULL && strcmp(cmd[len], "&") != 0 && strcmp(cmd[len], ";") != 0 && !isOperator(cmd[len][0]))
+                    len++;
+            }
+            else if (cmd[len] != NULL)
+                len++;
+            if (cmd[len] != NULL && strcmp(cmd[len], "&") == 0)
+                *background = 1;
+            break;
+        }
+    }
+
+    return len;
+}
+
+/*
+ * Function: expandCommand
+ * -----------------------
+ * Expands the words of a command, up to the first '&', '|' or ';' (the redirection included):
+ * quotes are removed, variables are replaced by their value and command substitutions "$(...)" by the output of their command
+ * The rest of the command line is left as it is, it is expanded when its commands are parsed
+ *
+ *  cmd:     The command line, starting at the command to expand
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The expanded command line (allocated from the line arena), or cmd itself if there was nothing to expand
+ */
+char **expandCommand(char **cmd, pPaths_t paths, pProgDesc_t proDes)
+{
+    wordList_t expanded = {NULL, 0, 0};
+    int commandLen;
+    int i;
+
+    for (commandLen = 0; cmd[commandLen] != NULL; commandLen++)
+        if (strcmp(cmd[commandLen], "&") == 0 || strcmp(cmd[commandLen], "|") == 0 || strcmp(cmd[commandLen], ";") == 0)
+            break;
+
+    // Most commands have neither quotes nor substitutions: their words are used as they are
+    for (i = 0; i < commandLen; i++)
+        if (strpbrk(cmd[i], "$\"'~") != NULL)
+            break;
+    if (i == commandLen)
+        return cmd;
+
+    for (i = 0; i < commandLen; i++)
+        expandWord(cmd[i], &expanded, paths, proDes);
+    for (; cmd[i] != NULL; i++)
+        addWord(&expanded, cmd[i]);
+    addWord(&expanded, NULL);
+
+    return expanded.words;
+}
+
+/*
+ * Function: expandWord
+ * --------------------
+ * Expands a word into zero, one or several fields: variables ($NAME, ${NAME}, $?), parameter expansions
+ * (${NAME:-word}, ${NAME#pattern}...), command substitutions, arithmetic expansions and a leading "~"
+ * The value of an unquoted expansion is split on blanks, a quoted one always stays in its field.
+ * A word made only of an unquoted empty substitution disappears, a quoted empty word ("") gives an empty field
+ *
+ *  word:    The word to expand
+ *  fields:  The list to which the fields are added
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ */
+void expandWord(char *word, pWordList_t fields, pPaths_t paths, pProgDesc_t proDes)
+{
+    textBuffer_t field = {NULL, 0, 0};
+    int keepField = 0; // 1 if the field has to be kept even if it is empty
+    int quoted = 0;    // 1 inside double quotes
+    char *cur = word;
+
+    // "~" and "~/..." start with the home directory
+    if (*cur == '~' && (cur[1] == '/' || cur[1] == '\0') && getenv("HOME") != NULL)
+    {
+        appendText(&field, getenv("HOME"), strlen(getenv("HOME")));
+        cur++;
+    }
+
+    while (*cur != '\0')
+    {
+        if (*cur == '\'' && !quoted)
+        {
+            char *end = strchr(cur + 1, '\'');
+
+            if (end == NULL)
+                end = cur + strlen(cur);
+            appendText(&field, cur + 1, end - cur - 1);
+            keepField = 1;
+            cur = (*end != '\0') ? end + 1 : end;
+        }
+        else if (*cur == '"')
+        {
+            quoted = !quoted;
+            keepField = 1;
+            cur++;
+        }
+        else if (*cur == '$' && (cur[1] == '?' || cur[1] == '(' || cur[1] == '{' || isNameChar(cur[1], 1)))
+        {
+            char *value;
+
+            if (cur[1] == '?')
+            {
+                value = (char *)arenaAlloc(lineArena, 16);
+                snprintf(value, 16, "%d", lastStatus);
+                cur += 2;
+            }
+            else if (cur[1] == '(')
+            {
+                char *end = findClosingBracket(cur + 1);
+
+                // "$((" closed by "))" is an arithmetic expansion, anything else a command substitution
+                if (cur[2] == '(' && *end == ')' && end > cur + 3 && end[-1] == ')')
+                    value = arithmeticExpansion(arenaStrndup(lineArena, cur + 3, end - cur - 4), paths, proDes);
+                else
+                    value = commandSubstitution(arenaStrndup(lineArena, cur + 2, end - cur - 2), paths, proDes);
+                cur = (*end != '\0') ? end + 1 : end;
+            }
+            else if (cur[1] == '{')
+            {
+                char *end = findClosingBracket(cur + 1);
+                char *body = arenaStrndup(lineArena, cur + 2, end - cur - 2);
+                char *nameEnd = body;
+
+                while (isNameChar(*nameEnd, nameEnd == body))
+                    nameEnd++;
+
+                // ${NAME} is only a variable, anything else goes through the operators of parameter expansion
+                if (nameEnd != body && *nameEnd == '\0')
+                    value = getenv(body);
+                else
+                    value = parameterExpansion(body, paths, proDes);
+                cur = (*end != '\0') ? end + 1 : end;
+            }
+            else
+            {
+                char *end = cur + 1;
+
+                while (isNameChar(*end, 0))
+                    end++;
+                value = getenv(arenaStrndup(lineArena, cur + 1, end - cur - 1));
+                cur = end;
+            }
+
+            if (value == NULL)
+            {
+                // An unset variable expands to nothing
+            }
+            else if (quoted)
+            {
+                appendText(&field, value, strlen(value));
+            }
+            else
+            {
+                // Every blank ends the current field
+                for (char *out = value; *out != '\0'; out++)
+                {
+                    if (*out == ' ' || *out == '\t' || *out == '\n')
+                    {
+                        if (field.len > 0 || keepField)
+                            addWord(fields, (field.text != NULL) ? field.text : arenaStrdup(lineArena, ""));
+                        field.text = NULL;
+                        field.len = 0;
+                        field.capacity = 0;
+                        keepField = 0;
+                    }
+                    else
+                    {
+                        appendText(&field, out, 1);
+                    }
+                }
+            }
+        }
+        else
+        {
+            appendText(&field, cur, 1);
+            cur++;
+        }
+    }
+
+    if (field.len > 0 || keepField)
+        addWord(fields, (field.text != NULL) ? field.text : arenaStrdup(lineArena, ""));
+}
+
+/*
+ * Function: arithmeticExpansion
+ * -----------------------------
+ * Evaluates the expression of "$(( ))" in the Shell itself. The expression is compiled once and cached:
+ * a loop only compiles it at its first iteration. Expansions inside the expression ($NAME, $(cmd)) are done first
+ * (the compiled expression then depends on their values, so $NAME is better written NAME)
+ *
+ *  expression: The expression
+ *  paths:      The structure containing all paths referenced in the PATH environement variable
+ *  proDes:     A pointer to the Program Descriptor
+ *
+ *  Returns: The value of the expression (allocated from the line arena), NULL if it could not be evaluated
+ */
+char *arithmeticExpansion(char *expression, pPaths_t paths, pProgDesc_t proDes)
+{
+    char error[ARITH_ERROR_LEN];
+    pArithProgram_t program;
+    long long result;
+    char *value;
+
+    if (strchr(expression, '$') != NULL)
+    {
+        wordList_t fields = {NULL, 0, 0};
+        textBuffer_t joined = {NULL, 0, 0};
+
+        expandWord(expression, &fields, paths, proDes);
+        for (int i = 0; i < fields.count; i++)
+        {
+            if (i > 0)
+                appendText(&joined, " ", 1);
+            appendText(&joined, fields.words[i], strlen(fields.words[i]));
+        }
+        expression = (joined.text != NULL) ? joined.text : "";
+    }
+
+    program = cachedArith(expression, error);
+    if (program == NULL || runArith(program, setVariable, &result, error) == -1)
+    {
+        printf("%s: arithmetic: %s\n", SHELL_NAME, error);
+        lastStatus = 1;
+        return NULL;
+    }
+
+    value = (char *)arenaAlloc(lineArena, 24);
+    snprintf(value, 24, "%lld", result);
+
+    return value;
+}
+
+/*
+ * Function: parameterExpansion
+ * ----------------------------
+ * Evaluates the operators of "${...}" in the Shell itself (default values, length, prefix and suffix removal,
+ * substrings and replacements). Their words are expanded only when they are used
+ *
+ *  body:    What is between the braces
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The value of the expansion (allocated from the line arena), NULL if it could not be evaluated
+ */
+char *parameterExpansion(char *body, pPaths_t paths, pProgDesc_t proDes)
+{
+    char error[PARAM_ERROR_LEN];
+    pPaths_t outerPaths = operandPaths;
+    pProgDesc_t outerProDes = operandProDes;
+    char *value;
+    char *res;
+
+    operandPaths = paths;
+    operandProDes = proDes;
+    res = expandParameter(body, getParameter, setVariable, expandOperand, error);
+    operandPaths = outerPaths;
+    operandProDes = outerProDes;
+
+    if (res == NULL)
+    {
+        printf("%s: %s\n", SHELL_NAME, error);
+        lastStatus = 1;
+        return NULL;
+    }
+
+    value = arenaStrdup(lineArena, res);
+    free(res);
+
+    return value;
+}
+
+/*
+ * Function: getParameter
+ * ----------------------
+ * Gives the value of a variable to parameter expansion ("?" is the status of the last job)
+ *
+ *  Returns: The value, NULL if the variable is not set
+ */
+const char *getParameter(const char *name)
+{
+    if (strcmp(name, "?") == 0)
+    {
+        char *value = (char *)arenaAlloc(lineArena, 16);
+
+        snprintf(value, 16, "%d", lastStatus);
+        return value;
+    }
+
+    return getenv(name);
+}
+
+/*
+ * Function: expandOperand
+ * -----------------------
+ * Expands the word of an operator of parameter expansion into a single string (its fields joined by spaces)
+ *
+ *  word:    The word
+ *
+ *  Returns: The expanded word (allocated from the line arena)
+ */
+char *expandOperand(char *word)
+{
+    wordList_t fields = {NULL, 0, 0};
+    textBuffer_t joined = {NULL, 0, 0};
+
+    if (strpbrk(word, "$\"'~") == NULL)
+        return word;
+
+    expandWord(word, &fields, operandPaths, operandProDes);
+    for (int i = 0; i < fields.count; i++)
+    {
+        if (i > 0)
+            appendText(&joined, " ", 1);
+        appendText(&joined, fields.words[i], strlen(fields.words[i]));
     }
 
-    if (DEBUG)
+    return (joined.text != NULL) ? joined.text : arenaStrdup(lineArena, "");
+}
+
+/*
+ * Function: commandSubstitution
+ * -----------------------------
+ * Runs a command in a child Shell and captures its output through a pipe
+ * The output is read in large chunks into a buffer kept between substitutions, so no temporary file is involved
+ *
+ *  command: The command line to run
+ *  paths:   The structure containing all paths referenced in the PATH environement variable
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The output of the command without its trailing newlines (allocated from the line arena)
+ */
+char *commandSubstitution(char *command, pPaths_t paths, pProgDesc_t proDes)
+{
+    int outPipe[2];
+    size_t len = 0;
+    ssize_t res;
+    int childPid;
+
+    if (pipe(outPipe) < 0)
     {
-        printf("Command: %s [%d arg(s) provided]\n", cmd[0], argCount);
-        for (int i = 0; i < argCount; i++)
-            printf("\targ[%d]='%s'\n", i, cmd[i]);
-        printf("\n");
+        perror("pipe");
+        return arenaStrdup(lineArena, "");
     }
 
-    if (argCount >= 1)
+    fflush(stdout);
+
+    childPid = fork();
+    switch (childPid)
     {
-        if (isOperator(cmd[0][0]))
+    case -1:
+        perror("fork");
+        closePipeEnd(outPipe, READ_END);
+        closePipeEnd(outPipe, WRITE_END);
+        return arenaStrdup(lineArena, "");
+    case 0:
+        // The child Shell runs the command with its output going to the pipe, without any job of its own
+        dup2(outPipe[WRITE_END], STDOUT_FILENO);
+        closePipeEnd(outPipe, READ_END);
+        closePipeEnd(outPipe, WRITE_END);
+        closePipeEnd(pipeA, READ_END);
+        closePipeEnd(pipeA, WRITE_END);
+        closePipeEnd(pipeB, READ_END);
+        closePipeEnd(pipeB, WRITE_END);
+
+        shellInteractive = 0;
+        pipeJob = NULL;
+        pipeBackground = 0;
+
         {
-            printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, cmd[0]);
-            fb = ERROR_SIG;
+            int fb = runCommandLine(split_in_words_in(command, lineArena), paths, proDes);
+
+            // _exit: flushing the input of the Shell would move the offset it shares with the Shell
+            fflush(stdout);
+            _exit((fb == OK_SIG) ? EXIT_SUCCESS : EXIT_FAILURE);
         }
-        else if (strcmp(cmd[0], "cd") == 0) // TODO: For cd, print and set, argCount will lead to command failure if there are other commands on the same line
+    default:
+        break;
+    }
+
+    closePipeEnd(outPipe, WRITE_END);
+
+    for (;;)
+    {
+        if (len == substCapacity)
         {
-            if (localArgsCount <= 2)
-            {
-                if (localArgsCount == 1)
-                    cmd[1] = getenv("HOME");
+            substCapacity = (substCapacity == 0) ? 65536 : substCapacity * 2;
+            substBuffer = (char *)realloc(substBuffer, substCapacity);
+        }
 
-                if (chdir(cmd[1]) == -1)
-                {
-                    printf("%s: cd: No such file or directory\n", SHELL_NAME);
-                }
-            }
-            else
-            {
-                printf("%s: cd: too many arguments\n", SHELL_NAME);
-                fb = ERROR_SIG;
-            }
+        res = read(outPipe[READ_END], substBuffer + len, substCapacity - len);
+        if (res > 0)
+            len += res;
+        else if (res == 0 || errno != EINTR)
+            break;
+    }
+
+    closePipeEnd(outPipe, READ_END);
+    while (waitpid(childPid, NULL, 0) == -1 && errno == EINTR)
+        ;
+
+    while (len > 0 && substBuffer[len - 1] == '\n')
+        len--;
+
+    return arenaStrndup(lineArena, (len > 0) ? substBuffer : "", len);
+}
+
+/*
+ * Function: findClosingBracket
+ * ----------------------------
+ * Finds the parenthesis or the brace closing a substitution, skipping quotes and nested brackets of the same kind
+ *
+ *  open:    The opening parenthesis or brace
+ *
+ *  Returns: The closing bracket, or the end of the string if there is none
+ */
+char *findClosingBracket(char *open)
+{
+    char close = (*open == '{') ? '}' : ')';
+    char quote = 0;
+    int depth = 0;
+    char *cur;
+
+    for (cur = open; *cur != '\0'; cur++)
+    {
+        if (quote)
+        {
+            if (*cur == quote)
+                quote = 0;
+        }
+        else if (*cur == '"' || *cur == '\'')
+        {
+            quote = *cur;
+        }
+        else if (*cur == *open)
+        {
+            depth++;
+        }
+        else if (*cur == close && --depth == 0)
+        {
+            return cur;
         }
-        else if (strcmp(cmd[0], "print") == 0)
+    }
+
+    return cur;
+}
+
+/*
+ * Function: addWord
+ * -----------------
+ * Appends a word to a list of words
+ *
+ *  list:    The list
+ *  word:    The word to append (NULL to terminate the list)
+ */
+void addWord(pWordList_t list, char *word)
+{
+    if (list->count == list->capacity)
+    {
+        int capacity = (list->capacity == 0) ? 16 : list->capacity * 2;
+
+        list->words = (char **)arenaRealloc(lineArena, list->words, list->capacity * sizeof(char *), capacity * sizeof(char *));
+        list->capacity = capacity;
+    }
+
+    list->words[list->count++] = word;
+}
+
+/*
+ * Function: appendText
+ * --------------------
+ * Appends characters to a text buffer, which stays null-terminated
+ *
+ *  buffer:  The text buffer
+ *  text:    The characters to append
+ *  len:     The number of characters to append
+ */
+void appendText(pTextBuffer_t buffer, const char *text, size_t len)
+{
+    if (buffer->len + len + 1 > buffer->capacity)
+    {
+        size_t capacity = (buffer->capacity == 0) ? 32 : buffer->capacity;
+
+        while (buffer->len + len + 1 > capacity)
+            capacity *= 2;
+
+        buffer->text = (char *)arenaRealloc(lineArena, buffer->text, buffer->capacity, capacity);
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->text + buffer->len, text, len);
+    buffer->len += len;
+    buffer->text[buffer->len] = '\0';
+}
+
+/*
+ * Function: takeHereDocuments
+ * ---------------------------
+ * Removes the here-documents ("<< DELIMITER") and here-strings ("<<< word") from a command, up to
+ * the first '&', '|' or ';', and opens the last one as hereFd
+ * The lines of a here-document are read right away from the input of the Shell, up to DELIMITER.
+ * With "<<-", the leading tabs of the lines are removed
+ *
+ *  cmd:     The command line, starting at the command
+ *
+ *  Returns: The command line without its here-documents (cmd itself if it has none)
+ *           NULL if a here-document has no delimiter
+ */
+char **takeHereDocuments(char **cmd)
+{
+    wordList_t remaining = {NULL, 0, 0};
+    int i;
+
+    for (i = 0; cmd[i] != NULL; i++)
+        if (strcmp(cmd[i], "<") == 0 || strcmp(cmd[i], "&") == 0 || strcmp(cmd[i], "|") == 0 || strcmp(cmd[i], ";") == 0)
+            break;
+    if (cmd[i] == NULL || strcmp(cmd[i], "<") != 0 || cmd[i + 1] == NULL || strcmp(cmd[i + 1], "<") != 0)
+        return cmd;
+
+    for (i = 0; cmd[i] != NULL; i++)
+    {
+        if (strcmp(cmd[i], "&") == 0 || strcmp(cmd[i], "|") == 0 || strcmp(cmd[i], ";") == 0)
+            break;
+
+        if (strcmp(cmd[i], "<") == 0 && cmd[i + 1] != NULL && strcmp(cmd[i + 1], "<") == 0)
         {
-            if (localArgsCount <= 2)
+            textBuffer_t body = {NULL, 0, 0};
+            int hereString = (cmd[i + 2] != NULL && strcmp(cmd[i + 2], "<") == 0);
+            char *word = cmd[i + (hereString ? 3 : 2)];
+
+            if (word == NULL || isOperator(word[0]) || strcmp(word, "<") == 0 || strcmp(word, ";") == 0)
             {
-                if (localArgsCount == 1)
+                printf("%s: syntax error near unexpected token `%s'\n", SHELL_NAME, (word != NULL) ? word : "newline");
+                if (hereFd != -1)
                 {
-                    for (int i = 0; __environ[i] != NULL; i++)
-                        printf("%s\n", __environ[i]);
+                    close(hereFd);
+                    hereFd = -1;
                 }
-                else
-                {
-                    char *var = getenv(cmd[1]);
+                return NULL;
+            }
 
-                    if (var == NULL)
-                        printf("\n");
-                    else
-                        printf("%s\n", getenv(cmd[1]));
-                }
+            if (hereString)
+            {
+                appendText(&body, word, strlen(word));
+                appendText(&body, "\n", 1);
+                i += 3;
             }
             else
             {
-                printf("%s: print: too many arguments\n", SHELL_NAME);
-                fb = -1;
+                readHereDocument(word, &body);
+                i += 2;
             }
+
+            if (hereFd != -1)
+                close(hereFd);
+            hereFd = openHereDocument(body.text, body.len);
         }
-        else if (strcmp(cmd[0], "set") == 0)
+        else
         {
-            if (localArgsCount == 3)
-            {
-                setenv(cmd[1], cmd[2], 1);
-            }
-            else if (localArgsCount < 3)
-            {
-                printf("%s: set: not enough arguments\n", SHELL_NAME);
-                fb = ERROR_SIG;
-            }
-            else
-            {
-                printf("%s: set: too many arguments\n", SHELL_NAME);
-                fb = ERROR_SIG;
-            }
+            addWord(&remaining, cmd[i]);
         }
-        else if (strcmp(cmd[0], "exit") == 0)
+    }
+
+    for (; cmd[i] != NULL; i++)
+        addWord(&remaining, cmd[i]);
+    addWord(&remaining, NULL);
+
+    return remaining.words;
+}
+
+/*
+ * Function: readHereDocument
+ * --------------------------
+ * Reads the lines of a here-document from the input of the Shell
+ *
+ *  delimiter: The line ending the here-document (prefixed by '-' to remove the leading tabs of the lines)
+ *  body:      The text buffer receiving the lines
+ */
+void readHereDocument(char *delimiter, pTextBuffer_t body)
+{
+    int stripTabs = (delimiter[0] == '-' && delimiter[1] != '\0');
+
+    if (stripTabs)
+        delimiter++;
+
+    for (;;)
+    {
+        char *line;
+        char *start;
+
+        if (shellInteractive && scriptInput == NULL)
         {
-            if (DEBUG)
-                printf("%s: Successfully exited\n", SHELL_NAME);
-            fb = EXIT_SIG;
+            printf(HERE_DOC_PROMPT);
+            fflush(stdout);
         }
-        else
+
+        // The line is not taken from the arena, so that the body can keep growing in place
+        line = readInputLine(NULL);
+        if (line == NULL)
+            break;
+        start = line;
+        if (stripTabs)
+            while (*start == '\t')
+                start++;
+
+        if (strcmp(start, delimiter) == 0)
         {
-            char *binPath = getBinPath(cmd[0], paths);
-            int binState = BIN_FG;
-            int subArgC = 0;
-            int pipeState;
-            int piping = 0;
-            int *getPipe, *givePipe;
+            free(line);
+            break;
+        }
 
-            // Swaps the pipes as explained further below
-            if (pipeCount % 2 == 0)
-            {
-                getPipe = pipeB;
-                givePipe = pipeA;
-            }
-            else
-            {
-                getPipe = pipeA;
-                givePipe = pipeB;
-            }
+        appendText(body, start, strlen(start));
+        appendText(body, "\n", 1);
+        free(line);
+    }
+}
 
-            if (binPath == NULL)
-            {
-                printf("%s: command not found\n", cmd[0]);
-            }
-            else
-            {
-                for (subArgC = 0; subArgC < argCount; subArgC++)
-                {
-                    if (strcmp(cmd[subArgC], "&") == 0)
-                    {
-                        binState = BIN_BG;
+/*
+ * Function: openHereDocument
+ * --------------------------
+ * Gives a text to read through a file descriptor, without touching the filesystem:
+ * a text which fits in a pipe is written to a pipe, a larger one to an anonymous memory file (memfd)
+ *
+ *  text:    The text (NULL if it is empty)
+ *  len:     The length of the text
+ *
+ *  Returns: A descriptor positioned at the start of the text (close-on-exec), -1 if it could not be created
+ */
+int openHereDocument(const char *text, size_t len)
+{
+    int herePipe[2];
+    int fd;
 
-                        if (readFromPipe) // Prefixed by '|'
-                            pipeState = PIP_READ;
-                        else
-                            pipeState = PIP_NONE;
+    if (pipe2(herePipe, O_CLOEXEC) == 0)
+    {
+        // The whole text has to fit in the pipe: nobody reads it before the command is launched
+        if ((long)len <= fcntl(herePipe[WRITE_END], F_GETPIPE_SZ))
+        {
+            writeAll(herePipe[WRITE_END], text, len);
+            close(herePipe[WRITE_END]);
+            return herePipe[READ_END];
+        }
+        close(herePipe[READ_END]);
+        close(herePipe[WRITE_END]);
+    }
 
-                        executeCommand(binPath, subArgC, cmd, __environ, binState, pipeState, getPipe, givePipe, RED_NONE, NULL, proDes);
+    fd = memfd_create("quysh-here-document", MFD_CLOEXEC);
+    if (fd == -1)
+    {
+        perror("memfd_create");
+        return -1;
+    }
 
-                        if (subArgC + 1 < argCount)
-                            parseCommand(&(cmd[subArgC + 1]), paths, 0, pipeCount, proDes); // Since we read a "&", this command won't cannot pipe to the next one
-                        break;
-                    }
-                    else if (strcmp(cmd[subArgC], "|") == 0) // The command will AT LEAST write to STDOUT
-                    {
-                        // The current command is going to send its output to the next one
-                        piping = 1;
+    if (writeAll(fd, text, len) == -1 || lseek(fd, 0, SEEK_SET) == -1)
+    {
+        perror("here-document");
+        close(fd);
+        return -1;
+    }
 
-                        // TODO: Test if last command is of the form: cmd |
-                        // This could prove troublesome since no command is placed after
-                        // Try in Linux Shell to get ideas
-                        // NB: I tried it and it does not seem to break anything but make sure to test things anyway
+    return fd;
+}
 
-                        /* 
-                         * In order to allow for a command to receive its input from its predecessor and send its output to its successor, it is required
-                         * to use another pipe. So, each command will use two pipes: one for its input and the other for its output. Please refer to the
-                         * following scenario to understand better:
-                         * 
-                         * > ls -al | grep read | grep readline.c
-                         * 
-                         * ls -al:
-                         *      in: pipeB (unused) -> uses STDIN instead
-                         *      out: pipeA
-                         * 
-                         * grep read
-                         *      in: pipeA
-                         *      out: pipeB
-                         * 
-                         * grep readline.c
-                         *      in: pipeB
-                         *      out: pipeA (unused) -> uses STDOUT instead
-                         * 
-                         * While two pipes are enough for it to work, we need to make sure that the in and out pipes are swapped for each command. This is the purpose
-                         * of pipeCount. If it is odd, then the case will be the same as "ls -al" or "grep readline.c" in the scenario above. If it is even, the case
-                         * will be the same as "grep read".
-                         */
-                        if (pipeCount % 2 == 0)
-                        {
-                            if (pipe(pipeA) < 0)
-                            {
-                                fprintf(stderr, "pipe A creation failed\n");
-                            }
-                        }
-                        else
-                        {
-                            if (pipe(pipeB) < 0)
-                            {
-                                fprintf(stderr, "pipe B creation failed\n");
-                            }
-                        }
+/*
+ * Function: writeAll
+ * ------------------
+ * Writes a whole buffer to a file descriptor, whatever the number of calls to write it takes
+ *
+ *  fd:      The file descriptor
+ *  buffer:  The bytes to write
+ *  len:     The number of bytes to write
+ *
+ *  Returns: 0 if the whole buffer was written, -1 otherwise
+ */
+int writeAll(int fd, const char *buffer, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t res = write(fd, buffer, len);
+
+        if (res == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        buffer += res;
+        len -= res;
+    }
 
-                        if (readFromPipe) // Prefixed by '|'
-                            pipeState = PIP_BOTH;
-                        else
-                            pipeState = PIP_WRITE;
+    return 0;
+}
 
-                        executeCommand(binPath, subArgC, cmd, __environ, BIN_FG, pipeState, getPipe, givePipe, RED_NONE, NULL, proDes);
+/*
+ * Function: launchTeeRelay
+ * ------------------------
+ * Launches the stage of pipeJob which copies the output of the previous stage to the files of teeFiles
+ * The relay is a fork of the Shell (nothing is executed) joining the process group of the job
+ *
+ *  teePipe: The pipe to which the previous stage writes (its write end is already closed)
+ *  append:  1 to append to the files, 0 to override them
+ */
+void launchTeeRelay(int teePipe[2], int append)
+{
+    int childPid;
 
-                        if (subArgC + 1 < argCount)
-                        {
-                            parseCommand(&(cmd[subArgC + 1]), paths, 1, pipeCount + 1, proDes); // Since it is "|", it pipes the next command
-                        }
-                        break;
-                    }
-                    else if (strcmp(cmd[subArgC], ">") == 0)
-                    {
-                        // The current command is going to send its output to a file
-                        piping = 1;
+    fflush(stdout);
 
-                        if (readFromPipe) // Prefixed by '|'
-                            pipeState = PIP_BOTH;
-                        else
-                            pipeState = PIP_WRITE;
+    childPid = fork();
+    switch (childPid)
+    {
+    case -1:
+        perror("fork");
+        break;
+    case 0:
+        setpgid(0, pipeJob->pgid);
+        signal(SIGTTOU, SIG_DFL);
+        closePipeEnd(pipeA, WRITE_END);
+        closePipeEnd(pipeB, WRITE_END);
+        closeMeterHops();
+        relayOutput(teePipe[READ_END], teeFiles, append);
+        _exit(EXIT_SUCCESS); // Not exit: flushing the input of the Shell would move the offset it shares with the Shell
+    default:
+        setpgid(childPid, pipeJob->pgid);
+        addStage(childPid, pipeJob);
+        break;
+    }
 
-                        int redirState;
+    closePipeEnd(teePipe, READ_END);
+}
 
-                        int outFilePos = subArgC + 1;
+/*
+ * Function: addMeterHop
+ * ---------------------
+ * Cuts the pipe between a stage of pipeJob and the next one in two: the stage writes to the original pipe, the next
+ * stage reads a new one, and the meter relays the data from the first to the second
+ *
+ *  givePipe: The pipe to which the stage writes (its write end is already closed)
+ *  from:     The command of the stage
+ */
+void addMeterHop(int givePipe[2], char *from)
+{
+    int hopPipe[2];
+    pMeterHop_t hop;
 
-                        // If the operator is '>>' instead of '>'
-                        if (strcmp(cmd[outFilePos], ">") == 0)
-                        {
-                            outFilePos++;
-                            // If the operator is '>>>' or any weird stuff like that
-                            if (isOperator(cmd[outFilePos][0]))
-                            {
-                                printf("%s: syntax error near unexpected token `%c'\n", SHELL_NAME, cmd[outFilePos][0]);
-                                free(binPath);
-                                return ERROR_SIG;
-                            }
-                            redirState = RED_APPE;
-                        }
-                        else
-                        {
-                            redirState = RED_OVER;
-                        }
-                        executeCommand(binPath, subArgC, cmd, __environ, BIN_FG, pipeState, getPipe, givePipe, redirState, cmd[outFilePos], proDes);
+    if (pipe2(hopPipe, O_CLOEXEC) == -1)
+    {
+        perror("meter: pipe");
+        return;
+    }
 
-                        if (outFilePos + 2 < argCount)
-                        {
-                            parseCommand(&(cmd[outFilePos + 2]), paths, 0, pipeCount, proDes); // Since it is "|", it pipes the next command
-                        }
-                        break;
-                    }
-                }
+    if (meterHopCount == meterHopCapacity)
+    {
+        meterHopCapacity = (meterHopCapacity == 0) ? 8 : meterHopCapacity * 2;
+        meterHops = (pMeterHop_t)realloc(meterHops, meterHopCapacity * sizeof(meterHop_t));
+    }
 
-                if (binState == BIN_FG && !piping)
-                {
-                    if (DEBUG)
-                    {
-                        printf("%d pipes were found in the command line\n", pipeCount);
-                    }
+    // Only the meter keeps both sides: the stages forked until then close them when they execute their command
+    fcntl(givePipe[READ_END], F_SETFD, FD_CLOEXEC);
 
-                    if (readFromPipe)
-                        pipeState = PIP_READ;
-                    else
-                        pipeState = PIP_NONE;
+    hop = &(meterHops[meterHopCount++]);
+    memset(hop, 0, sizeof(meterHop_t));
+    hop->inFd = givePipe[READ_END];
+    hop->outFd = hopPipe[WRITE_END];
+    setHopName(hop->from, from);
+    strcpy(hop->to, "?");
 
-                    executeCommand(binPath, subArgC, cmd, __environ, binState, pipeState, getPipe, givePipe, RED_NONE, NULL, proDes);
-                }
-            }
+    givePipe[READ_END] = hopPipe[READ_END];
+}
+
+/*
+ * Function: launchMeter
+ * ---------------------
+ * Launches the stage of a job which relays all its hops. Like the tee relay, the meter is a fork of the Shell
+ * joining the process group of the job. It is not the last stage of the job: the status of the job remains
+ * the one of its last command
+ *
+ *  child:   The job
+ *  live:    1 to show the live status on stderr
+ */
+void launchMeter(pChildProgram_t child, int live)
+{
+    int childPid;
+
+    fflush(stdout);
+
+    childPid = fork();
+    switch (childPid)
+    {
+    case -1:
+        perror("meter: fork");
+        break;
+    case 0:
+        setpgid(0, child->pgid);
+        signal(SIGTTOU, SIG_DFL);
+        signal(SIGINT, SIG_IGN);  // The meter ends with the stages, and reports what they have done
+        signal(SIGQUIT, SIG_IGN);
+        signal(SIGPIPE, SIG_IGN);
+        closePipeEnd(pipeA, WRITE_END);
+        closePipeEnd(pipeB, WRITE_END);
+        runMeter(meterHops, meterHopCount, live);
+        _exit(EXIT_SUCCESS);
+    default:
+        setpgid(childPid, child->pgid);
+        addStage(childPid, child);
+
+        if (child->stageCount > 1)
+        {
+            jobStage_t meter = child->stages[child->stageCount - 1];
 
-            free(binPath);
+            child->stages[child->stageCount - 1] = child->stages[child->stageCount - 2];
+            child->stages[child->stageCount - 2] = meter;
+            child->pid = child->stages[child->stageCount - 1].pid;
         }
+        break;
     }
-
-    return fb;
 }
 
-// TODO: Try and find a way to free the child argvCpy
 /*
- * Function: executeCommand
+ * Function: closeMeterHops
  * ------------------------
- * Launches a specific binary in a specific state
- *
- *  path:       The complete path of the binary to be launched
- *  argc:       The number of arguments
- *  argv:       An array containing all the arguments
- *  envp:       An array containing the environment variables
- *  state:      The state in which the binary has to be launched (BIN_FG to launch normally or BIN_BG to launch it in the background)
- *  pipeState:  Determines the IO actions of the command (Refer to the enumerations at the top of this file for further information)
- *  getPipe:    The pipe from which the command will potentially read (getPipe > STDIN)
- *  givePipe:   The pipe to which the command will eventually write (STDOUT > givePipe)
- *  redirState: Determines if and how the program outputs goes to a file (Refer to the enumerations at the top for further information)
- *  outFile:    The name of file in which the command output will be redirected (NULL if the command output is not redirected to a file)
+ * Closes the descriptors of the hops of pipeJob (owned by the meter once it is launched)
+ */
+void closeMeterHops()
+{
+    for (int i = 0; i < meterHopCount; i++)
+    {
+        close(meterHops[i].inFd);
+        close(meterHops[i].outFd);
+    }
+    meterHopCount = 0;
+}
+
+/*
+ * Function: openJobOutput
+ * -----------------------
+ * Creates the pipes of the standard output and error of pipeJob, read by the multiplexer once the job is launched
+ */
+void openJobOutput()
+{
+    if (pipe2(jobOut, O_CLOEXEC) == -1 || pipe2(jobErr, O_CLOEXEC) == -1)
+    {
+        perror("mux: pipe");
+        closeJobOutput();
+    }
+}
+
+/*
+ * Function: sendJobOutput
+ * -----------------------
+ * Hands the outputs of pipeJob over to the multiplexer, along with its log file
+ * If the multiplexer is gone, multiplexing is turned off (the outputs of the job are lost)
  *
- *  Returns: 0 if all went well
+ *  id:      The ID of the job
  */
-int executeCommand(char *path, int argc, char **argv, char **envp, int state, int pipeState, int getPipe[2], int givePipe[2], int redirState, char *outFile, pProgDesc_t proDes)
+void sendJobOutput(int id)
 {
-    int status, waitRes;
-    char **argvCpy;
-    int childPid = fork(); // Creates a child process
+    int logFd = -1;
 
-    // Identifies who is the current process and performs specific tasks accordingly
-    switch (childPid)
+    if (muxLogDir != NULL)
     {
-    case -1: // An error occured
-        perror("fork: ");
-        exit(-1);
-    case 0: // The current process is a child
-        // Makes a copy of argv
-        argvCpy = (char **)(malloc((argc + 1) * sizeof(char *)));
-        for (int i = 0; i < argc; i++)
+        char logFile[MAX_PATH_LEN];
+
+        snprintf(logFile, sizeof(logFile), "%s/job%d.log", muxLogDir, id);
+        logFd = open(logFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (logFd == -1)
         {
-            argvCpy[i] = (char *)malloc(sizeof(char *));
-            strcpy(argvCpy[i], argv[i]);
+            printf("%s: mux: %s: ", SHELL_NAME, logFile);
+            fflush(stdout);
+            perror(NULL);
         }
-        argvCpy[argc] = NULL; // Very important!!
+    }
 
-        // TODO: These switches are a mess. Please find the resolve to make them organized, handsome and commented as well.
-        switch (pipeState)
+    if (muxPid == 0 || sendMuxJob(muxControl, id, jobOut[READ_END], jobErr[READ_END], logFd) == -1)
+    {
+        printf("%s: mux: the multiplexer is gone, multiplexing is off\n", SHELL_NAME);
+        close(muxControl);
+        muxControl = -1;
+    }
+
+    if (logFd != -1)
+        close(logFd);
+}
+
+/*
+ * Function: closeJobOutput
+ * ------------------------
+ * Closes the descriptors of the outputs of pipeJob which are still held by the Shell
+ */
+void closeJobOutput()
+{
+    closePipeEnd(jobOut, READ_END);
+    closePipeEnd(jobOut, WRITE_END);
+    closePipeEnd(jobErr, READ_END);
+    closePipeEnd(jobErr, WRITE_END);
+}
+
+/*
+ * Function: relayOutput
+ * ---------------------
+ * Copies everything read from a pipe to several files, without copying the data through user space:
+ * tee(2) duplicates the pending data of the pipe into one extra pipe per file but the last one, the copies are
+ * spliced into their files, then the data itself is spliced into the last file (which consumes it)
+ *
+ *  inFd:    The read end of the pipe
+ *  files:   The null-terminated list of the files
+ *  append:  1 to append to the files, 0 to override them
+ */
+void relayOutput(int inFd, char **files, int append)
+{
+    int fileCount = 0;
+    int *fds;
+    int (*copies)[2];
+    int pipeSize = fcntl(inFd, F_GETPIPE_SZ);
+
+    while (files[fileCount] != NULL)
+        fileCount++;
+
+    fds = (int *)arenaAlloc(lineArena, fileCount * sizeof(int));
+    copies = (int (*)[2])arenaAlloc(lineArena, fileCount * sizeof(int[2]));
+
+    for (int i = 0; i < fileCount; i++)
+    {
+        // splice cannot write to a file opened with O_APPEND: appending starts at the end of the file instead
+        fds[i] = open(files[i], O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC), 0666);
+        if (fds[i] == -1)
         {
-        case PIP_NONE: // Does not use any pipe
-            close(getPipe[WRITE_END]);
-            close(getPipe[READ_END]);
+            fprintf(stderr, "%s: %s: ", SHELL_NAME, files[i]);
+            perror(NULL);
+            _exit(EXIT_FAILURE);
+        }
+        if (append)
+            lseek(fds[i], 0, SEEK_END);
 
-            close(givePipe[WRITE_END]);
-            close(givePipe[READ_END]);
-            break;
-        case PIP_WRITE:
-            if (redirState != RED_NONE)
-            {
-                if (redirState == RED_OVER)
-                    freopen(outFile, "w", stdout);
-                else
-                    freopen(outFile, "a+", stdout);
-            }
-            else
-            {
-                dup2(givePipe[WRITE_END], STDOUT_FILENO);
-            }
-            close(givePipe[READ_END]);
-            break;
-        case PIP_READ:
-            dup2(getPipe[READ_END], STDIN_FILENO);
-            close(getPipe[WRITE_END]);
-            break;
-        case PIP_BOTH:
-            dup2(getPipe[READ_END], STDIN_FILENO);
-            if (redirState != RED_NONE)
-            {
-                if (redirState == RED_OVER)
-                    freopen(outFile, "w", stdout);
-                else
-                    freopen(outFile, "a+", stdout);
-            }
-            else
+        // The copies are as large as the pipe: an empty copy can always receive everything the pipe holds
+        if (i < fileCount - 1)
+        {
+            if (pipe(copies[i]) < 0)
             {
-                dup2(givePipe[WRITE_END], STDOUT_FILENO);
+                perror("pipe");
+                _exit(EXIT_FAILURE);
             }
-
-            close(givePipe[READ_END]);
-            break;
-        default:
-            fprintf(stderr, "Unknown pipe state");
-            exit(-1);
-            break;
+            if (pipeSize > 0)
+                fcntl(copies[i][WRITE_END], F_SETPIPE_SZ, pipeSize);
         }
+    }
 
-        execve(path, argvCpy, envp);
-        perror("execve failed");
-        exit(EXIT_FAILURE);
-        break;
-    default: // The current process is the parent
-        if (DEBUG)
-            printf("Is that you [%s] %d? Your father is right here kiddo!\n", path, childPid);
+    for (;;)
+    {
+        ssize_t len = TEE_CHUNK;
 
-        // If the child process has been executed normally, waits for it to terminate
-        if (state == BIN_FG)
+        for (int i = 0; i < fileCount - 1; i++)
         {
-            switch (pipeState)
-            {
-            case PIP_NONE: // This command did not involve any pipes
-                close(getPipe[WRITE_END]);
-                close(getPipe[READ_END]);
-
-                close(givePipe[WRITE_END]);
-                close(givePipe[READ_END]);
-                break;
-            case PIP_WRITE: // This command is the first to be piped
-                close(givePipe[WRITE_END]);
-                break;
-            case PIP_READ: // The executed command was the last to be piped
-                close(getPipe[READ_END]);
-                break;
-            case PIP_BOTH:
-                close(getPipe[READ_END]);
+            ssize_t res = tee(inFd, copies[i][WRITE_END], len, 0);
 
-                close(givePipe[WRITE_END]);
-                break;
-            default:
-                fprintf(stderr, "Unknown pipe state");
-                exit(-1);
-                break;
+            if (res == -1 && errno == EINTR)
+            {
+                i--;
+                continue;
             }
-            waitRes = waitpid(childPid, &status, 0);
-            if (waitRes != -1)
+            if (res <= 0)
+                _exit((res == 0) ? EXIT_SUCCESS : EXIT_FAILURE); // Nothing left to read
+
+            if (i > 0 && res != len)
             {
-                if (DEBUG)
-                    printf("My child %d has served his country well. [%d]\n", waitRes, status);
+                fprintf(stderr, "%s: tee: short copy\n", SHELL_NAME);
+                _exit(EXIT_FAILURE);
             }
-            else
+            len = res;
+        }
+
+        for (int i = 0; i < fileCount - 1; i++)
+        {
+            for (ssize_t moved = 0; moved < len;)
             {
-                perror("waitpid: ");
+                ssize_t res = spliceOutput(copies[i][READ_END], fds[i], len - moved);
+
+                if (res <= 0)
+                    _exit(EXIT_FAILURE);
+                moved += res;
             }
         }
-        else if (state == BIN_BG)
+
+        // Consumes the data from the pipe
+        if (fileCount == 1)
         {
-            pChildProgram_t child = addProgram(childPid, argc, argv, proDes);
-            printf("[%d] %d\n", child->id, child->pid);
+            len = spliceOutput(inFd, fds[0], len);
+            if (len <= 0)
+                _exit((len == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
         }
+        else
+        {
+            for (ssize_t moved = 0; moved < len;)
+            {
+                ssize_t res = spliceOutput(inFd, fds[fileCount - 1], len - moved);
 
-        break;
+                if (res <= 0)
+                    _exit(EXIT_FAILURE);
+                moved += res;
+            }
+        }
     }
-
-    return 0;
 }
 
 /*
- * Function: getPwd
- * ----------------
- * Returns a char* corresponding the current working directory
- *
- *  Returns: The current working directory
- */
-inline char *getPwd()
-{
-    char cwd[MAX_PATH_LEN];
-    return getcwd(cwd, sizeof(cwd));
-}
-
-/*
- * Function: getBinPath
- * --------------------
- * Looks for the complete file path of a specific binary by going through the list of paths
+ * Function: spliceOutput
+ * ----------------------
+ * Moves bytes from a pipe to a file descriptor with one call to splice
+ * Falls back to read and write if the descriptor does not support splice
  *
- *  filename: The name of the binary to find
- *  paths:    The structure containing all paths referenced in the PATH environement variable
+ *  fromFd:  The read end of the pipe
+ *  toFd:    The file descriptor
+ *  len:     The largest number of bytes to move
  *
- *  Returns:  The complete path of a binary if it exists in one of the directories of paths
- *            NULL if the binary could not be found
+ *  Returns: The number of bytes moved (0 at the end of the pipe), -1 on error
  */
-char *getBinPath(char *filename, pPaths_t paths)
-{
-    char *binaryPath = (char *)malloc(MAX_PATH_LEN * sizeof(char));
-    pPath_t path_it = paths->first;
-
-    // Iterates over the Linked List of paths
-    while (path_it != NULL)
-    {
-        // Builds a possible complete path
-        strcpy(binaryPath, path_it->path_text);
-        strcat(binaryPath, "/");
-        strcat(binaryPath, filename);
-
-        // If the binary exists, returns its complete path
-        if (fileExists(binaryPath))
-        {
-            if (DEBUG)
-                printf("Located '%s' at \"%s\"\n", filename, binaryPath);
+ssize_t spliceOutput(int fromFd, int toFd, size_t len)
+{
+    static char buffer[TEE_BUFFER_LEN];
+    ssize_t res;
 
-            return binaryPath;
-        }
-        path_it = path_it->next;
+    do
+        res = splice(fromFd, NULL, toFd, NULL, len, SPLICE_F_MOVE);
+    while (res == -1 && errno == EINTR);
+
+    if (res == -1 && errno == EINVAL)
+    {
+        do
+            res = read(fromFd, buffer, (len < sizeof(buffer)) ? len : sizeof(buffer));
+        while (res == -1 && errno == EINTR);
+
+        if (res > 0 && writeAll(toFd, buffer, res) == -1)
+            return -1;
     }
-    return NULL; // The binary has not been found
+
+    return res;
 }
 
 /*
- * Function: fileExists
- * --------------------
- * Checks whether or not a given file exists in the current working directory
+ * Function: readInputLine
+ * -----------------------
+ * Reads a line of input: from the lines given to quysh_run, with the line editor if the Shell reads from a terminal,
+ * with readline otherwise
  *
- *  filename: The name of the file to check
+ *  arena:   The arena from which the line is allocated (malloc is used if it is NULL)
  *
- *  Returns:  0 if the file does not exist
- *            1 if the file exists
+ *  Returns: The line, NULL at the end of the input (Ctrl-D on a terminal) or of the lines given to quysh_run
  */
-inline int fileExists(char *filename)
+char *readInputLine(pArena_t arena)
 {
-    return (access(filename, F_OK) != -1);
+    if (scriptInput != NULL)
+        return readScriptLine(arena);
+
+    if (shellInteractive)
+        return editLine(arena);
+
+    return readline_in(arena);
 }
 
 /*
- * Function: isOperator
- * --------------------
- * Determines whether or not the given character corresponds to one of the Shell operators
- * 
- *  c:       The character to test
- * 
- *  Returns: 1 if c is a Shell operator, 0 otherwise
+ * Function: readScriptLine
+ * ------------------------
+ * Takes the next line of the lines given to quysh_run
+ *
+ *  arena:   The arena from which the line is allocated (malloc is used if it is NULL)
+ *
+ *  Returns: The line, NULL if all the lines have been read
  */
-int isOperator(char c)
+char *readScriptLine(pArena_t arena)
 {
-    for (int i = 0; i < SHELL_OPE_COUNT; i++)
-        if (SHELL_OPE[i] == c)
-            return 1;
+    const char *end = strchrnul(scriptInput, '\n');
+    size_t len = end - scriptInput;
+    char *line;
 
-    return 0;
+    if (*scriptInput == '\0')
+        return NULL;
+
+    if (arena != NULL)
+    {
+        line = arenaStrndup(arena, scriptInput, len);
+    }
+    else
+    {
+        line = (char *)malloc(len + 1);
+        memcpy(line, scriptInput, len);
+        line[len] = '\0';
+    }
+
+    scriptInput = (*end == '\n') ? end + 1 : end;
+
+    return line;
 }
 
 /*
@@ -785,8 +5670,10 @@ int printShellPrefix()
 {
     char username[32];
     char *cwd = getPwd(); // The current working directory
+    char *user = getenv("USER");
 
-    strcpy(username, getenv("USER"));
+    // USER may be unset (daemons, "env -i") or longer than the buffer
+    snprintf(username, sizeof(username), "%s", (user != NULL) ? user : "?");
 
     int cwdLen = strlen(cwd);
     int usernameLen = strlen(username);
@@ -869,6 +5756,8 @@ void freeProgramDescriptor(pProgDesc_t proDes)
             free(it->argv[i]);
         }
         free(it->argv);
+        free(it->stages);
+        removeJobCgroup(it->cgroup);
         prev = it;
         it = it->next;
         free(prev);
@@ -879,16 +5768,17 @@ void freeProgramDescriptor(pProgDesc_t proDes)
 /*
  * Function: addProgram
  * --------------------
- * Adds a specific child program to the list of children running in background
+ * Adds a specific child program to the list of children
+ * The child program has no stage and no ID yet: stages are added with addStage() as they are launched,
+ * and an ID is given once the child program goes to the background
  * 
- *  pid:     The PID of the child program
  *  argc:    The number of arguments given to the child program
  *  argv:    An array containing all the arguments given to the child program
  *  proDes:  A pointer to the Program Descriptor
  *
  *  Returns: A pointer to the newly allocated Child Program
  */
-pChildProgram_t addProgram(int pid, int argc, char **argv, pProgDesc_t proDes)
+pChildProgram_t addProgram(int argc, char **argv, pProgDesc_t proDes)
 {
     pChildProgram_t it = proDes->first;
     pChildProgram_t prev = NULL;
@@ -900,16 +5790,24 @@ pChildProgram_t addProgram(int pid, int argc, char **argv, pProgDesc_t proDes)
     }
 
     it = (pChildProgram_t)malloc(sizeof(childProgram_t));
-    it->id = ++proDes->serialID;
-    it->pid = pid;
+    it->id = 0;
+    it->pid = 0;
+    it->pgid = 0;
+    it->state = JOB_RUNNING;
+    it->status = 0;
+    it->stageCount = 0;
+    it->liveStages = 0;
+    it->stages = NULL;
+    it->cgroup = NULL;
+    clearLimits(&(it->limits));
     it->next = NULL;
 
     it->argc = argc;
-    it->argv = malloc(sizeof(char **));
+    it->argv = malloc(argc * sizeof(char *));
 
     for (int i = 0; i < argc; i++)
     {
-        it->argv[i] = malloc(strlen(argv[i]) * sizeof(char));
+        it->argv[i] = malloc((strlen(argv[i]) + 1) * sizeof(char));
         strcpy(it->argv[i], argv[i]);
     }
 
@@ -960,6 +5858,8 @@ int removeProgram(int id, pProgDesc_t proDes)
                 free(it->argv[i]);
             }
             free(it->argv);
+            free(it->stages);
+            removeJobCgroup(it->cgroup);
             free(it);
 
             proDes->children--;
@@ -976,12 +5876,37 @@ int removeProgram(int id, pProgDesc_t proDes)
     return 0;
 }
 
+/*
+ * Function: addStage
+ * ------------------
+ * Adds a newly launched process to a child program
+ * 
+ *  pid:   The PID of the process
+ *  child: A pointer to the child program
+ */
+void addStage(int pid, pChildProgram_t child)
+{
+    child->stages = realloc(child->stages, (child->stageCount + 1) * sizeof(jobStage_t));
+
+    pJobStage_t stage = &(child->stages[child->stageCount]);
+    stage->pid = pid;
+    stage->alive = 1;
+    stage->lastTicks = 0;
+    stage->lastSample = 0;
+    stage->started = statsClock();
+    stage->statsSlot = -1;
+
+    child->stageCount++;
+    child->liveStages++;
+    child->pid = pid;
+}
+
 /*
  * Function: findProgram
  * ---------------------
  * Searches for a specific child program in the list of children running in background
  * 
- *  pid:     The PID of the child program to find
+ *  pid:     The PID of one of the stages of the child program to find
  *  proDes:  A pointer to the Program Descriptor
  *
  *  Returns: A pointer to the child program matching the PID given in argument
@@ -993,11 +5918,450 @@ pChildProgram_t findProgram(int pid, pProgDesc_t proDes)
 
     while (it != NULL)
     {
-        if (it->pid == pid)
+        if (findStage(pid, it) != NULL)
             return it;
 
         it = it->next;
     }
 
     return NULL;
-}
\ No newline at end of file
+}
+
+/*
+ * Function: findStage
+ * -------------------
+ * Searches for a specific process among the stages of a child program
+ * 
+ *  pid:     The PID of the process to find
+ *  child:   A pointer to the child program
+ *
+ *  Returns: A pointer to the stage matching the PID given in argument
+ *           NULL if the process is not part of the child program
+ */
+pJobStage_t findStage(int pid, pChildProgram_t child)
+{
+    for (int i = 0; i < child->stageCount; i++)
+        if (child->stages[i].pid == pid)
+            return &(child->stages[i]);
+
+    return NULL;
+}
+
+/*
+ * Function: findJob
+ * -----------------
+ * Searches for a child program from a job specification given to a builtin ("%2", "2", "%%", "%+" or nothing)
+ * 
+ *  spec:    The job specification, NULL for the most recent child program
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: A pointer to the matching child program
+ *           NULL if no child program matches the specification
+ */
+pChildProgram_t findJob(char *spec, pProgDesc_t proDes)
+{
+    pChildProgram_t it = proDes->first;
+    pChildProgram_t last = NULL;
+    int id = -1;
+
+    if (spec != NULL)
+    {
+        if (spec[0] == '%')
+            spec++;
+        if (spec[0] != '\0' && strcmp(spec, "%") != 0 && strcmp(spec, "+") != 0)
+            id = atoi(spec);
+    }
+
+    while (it != NULL)
+    {
+        if (it->id != 0)
+        {
+            if (it->id == id)
+                return it;
+            last = it;
+        }
+        it = it->next;
+    }
+
+    return (id == -1) ? last : NULL;
+}
+
+/*
+ * Function: printProgram
+ * ----------------------
+ * Prints the status line of a child program, as in "[1]  Done		sleep 5"
+ * 
+ *  child:  A pointer to the child program
+ *  status: The status to display
+ */
+void printProgram(pChildProgram_t child, char *status)
+{
+    printf("[%d]  %s\t\t", child->id, status);
+    for (int i = 0; i < child->argc; i++)
+    {
+        printf("%s ", child->argv[i]);
+    }
+    printf("\n");
+}
+
+/*
+ * Function: finishPipeline
+ * ------------------------
+ * Called once the last stage of pipeJob has been launched. Waits for the pipeline if it runs in foreground,
+ * announces it as a background job otherwise
+ * 
+ *  state:   BIN_FG or BIN_BG
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The wait status of the last stage of a foreground pipeline, 0 otherwise
+ */
+int finishPipeline(int state, pProgDesc_t proDes)
+{
+    pChildProgram_t child = pipeJob;
+    pipeJob = NULL;
+
+    if (child == NULL)
+        return 0;
+
+    if (pipeMetered)
+    {
+        if (meterHopCount > 0 && child->stageCount > 0)
+            launchMeter(child, state == BIN_FG && isatty(STDERR_FILENO));
+        closeMeterHops();
+        pipeMetered = 0;
+    }
+
+    if (child->stageCount == 0)
+    {
+        closeJobOutput();
+        removeProgram(child->id, proDes);
+        return 0;
+    }
+
+    if (state == BIN_BG)
+    {
+        child->id = ++proDes->serialID;
+        printf("[%d] %d\n", child->id, child->pid);
+        if (jobOut[READ_END] != -1)
+            sendJobOutput(child->id);
+        closeJobOutput();
+        lastStatus = 0;
+        return 0;
+    }
+
+    closeJobOutput();
+    return waitProgram(child, proDes);
+}
+
+/*
+ * Function: waitProgram
+ * ---------------------
+ * Hands the terminal over to a child program and waits until all of its stages have ended or until it is stopped
+ * A stopped child program stays in the list of children (and gets an ID if it did not have one yet)
+ * 
+ *  child:   A pointer to the child program
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: The wait status of the last stage of the child program
+ */
+int waitProgram(pChildProgram_t child, pProgDesc_t proDes)
+{
+    int status = child->status;
+    int stopped = 0;
+
+    if (shellInteractive)
+        tcsetpgrp(STDIN_FILENO, child->pgid);
+
+    for (int i = 0; i < child->stageCount; i++)
+    {
+        pJobStage_t stage = &(child->stages[i]);
+        int stageStatus = 0;
+        int waitRes;
+
+        if (!stage->alive)
+            continue;
+
+        // Once a stage has been stopped, the others are only polled: some of them may not have been stopped
+        waitRes = waitpid(stage->pid, &stageStatus, stopped ? WUNTRACED | WNOHANG : WUNTRACED);
+
+        if (waitRes == 0)
+            continue;
+
+        if (waitRes == -1)
+        {
+            perror("waitpid: ");
+        }
+        else if (WIFSTOPPED(stageStatus))
+        {
+            stopped = 1;
+            continue;
+        }
+        else
+        {
+            if (DEBUG)
+                printf("My child %d has served his country well. [%d]\n", waitRes, stageStatus);
+
+            if (i == child->stageCount - 1)
+                status = stageStatus;
+        }
+
+        endStage(child, stage, stageStatus);
+    }
+
+    if (shellInteractive)
+        tcsetpgrp(STDIN_FILENO, shellPgid);
+
+    if (stopped && child->liveStages > 0)
+    {
+        child->state = JOB_STOPPED;
+        if (child->id == 0)
+            child->id = ++proDes->serialID;
+
+        printf("\n");
+        printProgram(child, "Stopped");
+        lastStatus = 128 + SIGTSTP;
+    }
+    else
+    {
+        removeProgram(child->id, proDes);
+        lastStatus = exitStatus(status);
+    }
+
+    return status;
+}
+
+/*
+ * Function: reapChildren
+ * ----------------------
+ * Collects the children which have ended or have been stopped without blocking,
+ * and reports the child programs which are done
+ * 
+ *  proDes:  A pointer to the Program Descriptor
+ */
+void reapChildren(pProgDesc_t proDes)
+{
+    pChildProgram_t it;
+    int live;
+    int collected = collectJobs(proDes, &live);
+
+    if (DEBUG)
+    {
+        if (collected == 0)
+            printf("My heirs are doing me proud.\n");
+        else
+            printf("Ended %d... They will be remembered.\n", collected);
+    }
+
+    // Reports the child programs which are done (by this call or by a "wait" builtin)
+    it = proDes->first;
+    while (it != NULL)
+    {
+        pChildProgram_t next = it->next;
+
+        if (it->state == JOB_DONE)
+        {
+            printProgram(it, "Done");
+            removeProgram(it->id, proDes);
+        }
+        it = next;
+    }
+}
+
+/*
+ * Function: waitNextChild
+ * -----------------------
+ * Blocks until one of the stages of the jobs ends or is stopped, and updates its child program
+ * The other children of the program running the Shell are never collected: waitid only peeks at them (WNOWAIT),
+ * and while one of them is waiting to be collected by its owner, the stages are polled every REAP_INTERVAL
+ * 
+ *  proDes:  A pointer to the Program Descriptor
+ *
+ *  Returns: 1 if a child has been collected, 0 if the Shell has no child left
+ */
+int waitNextChild(pProgDesc_t proDes)
+{
+    struct timespec interval = {0, REAP_INTERVAL};
+
+    for (;;)
+    {
+        siginfo_t info;
+        int live;
+
+        if (collectJobs(proDes, &live) > 0)
+            return 1;
+        if (live == 0)
+            return 0;
+
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOWAIT) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        if (info.si_pid == 0 || info.si_pid == muxPid)
+            continue;
+        if (findProgram(info.si_pid, proDes) == NULL)
+        {
+            pChildProgram_t child = NULL;
+
+            for (pQuyshCtx_t it = contexts; child == NULL && it != NULL; it = it->next)
+                child = findProgram(info.si_pid, it->proDes);
+            if (child == NULL)
+                nanosleep(&interval, NULL);
+        }
+    }
+}
+
+/*
+ * Function: collectJobs
+ * ---------------------
+ * Collects, without blocking, the stages of the jobs of every context which have ended or have been stopped,
+ * and the multiplexer if it has ended. Only these children are waited for, one PID at a time
+ * 
+ *  proDes:  A pointer to the Program Descriptor of the current context
+ *  live:    Receives the number of stages still running (or stopped)
+ *
+ *  Returns: The number of children collected
+ */
+int collectJobs(pProgDesc_t proDes, int *live)
+{
+    int collected;
+    int status;
+
+    *live = 0;
+
+    if (muxPid != 0 && waitpid(muxPid, &status, WNOHANG) == muxPid)
+        muxPid = 0;
+
+    collected = pollStages(proDes, live);
+    for (pQuyshCtx_t it = contexts; it != NULL; it = it->next)
+        if (it->proDes != proDes)
+            collected += pollStages(it->proDes, live);
+
+    return collected;
+}
+
+/*
+ * Function: pollStages
+ * --------------------
+ * Collects, without blocking, the stages of the jobs of a Program Descriptor which have ended or have been stopped
+ * A stage which is no longer a child (collected by the program running the Shell) is considered as ended
+ * 
+ *  proDes:  A pointer to the Program Descriptor
+ *  live:    Incremented by the number of stages still running (or stopped)
+ *
+ *  Returns: The number of children collected
+ */
+int pollStages(pProgDesc_t proDes, int *live)
+{
+    int collected = 0;
+
+    for (pChildProgram_t it = proDes->first; it != NULL; it = it->next)
+    {
+        for (int i = 0; i < it->stageCount; i++)
+        {
+            int status = 0;
+            int waitRes;
+
+            if (!it->stages[i].alive)
+                continue;
+
+            do
+                waitRes = waitpid(it->stages[i].pid, &status, WNOHANG | WUNTRACED);
+            while (waitRes == -1 && errno == EINTR);
+
+            if (waitRes == 0 || (waitRes > 0 && WIFSTOPPED(status)))
+                (*live)++;
+            if (waitRes == 0)
+                continue;
+
+            collectChild(it->stages[i].pid, (waitRes == -1) ? 0 : status, proDes);
+            collected++;
+        }
+    }
+
+    return collected;
+}
+
+/*
+ * Function: collectChild
+ * ----------------------
+ * Updates the child program of a child which has ended or has been stopped
+ * A child program whose stages have all ended becomes JOB_DONE, it is reported by reapChildren
+ * 
+ *  childPid: The PID of the child
+ *  status:   The wait status of the child
+ *  proDes:   A pointer to the Program Descriptor
+ */
+void collectChild(int childPid, int status, pProgDesc_t proDes)
+{
+    pChildProgram_t child = findProgram(childPid, proDes);
+    pJobStage_t stage;
+
+    // The child may have been launched by another context, or by the program running the Shell
+    for (pQuyshCtx_t it = contexts; child == NULL && it != NULL; it = it->next)
+        child = findProgram(childPid, it->proDes);
+
+    if (child == NULL)
+    {
+        if (DEBUG)
+            printf("Couldn't find %d\n", childPid);
+        return;
+    }
+
+    if (WIFSTOPPED(status))
+    {
+        if (child->state != JOB_STOPPED)
+        {
+            child->state = JOB_STOPPED;
+            printProgram(child, "Stopped");
+        }
+        return;
+    }
+
+    stage = findStage(childPid, child);
+    endStage(child, stage, status);
+
+    if (stage == &(child->stages[child->stageCount - 1]))
+        child->status = status;
+
+    if (child->liveStages == 0)
+        child->state = JOB_DONE;
+}
+
+/*
+ * Function: endStage
+ * ------------------
+ * Marks a stage of a child program as ended, and records the wall time of its command
+ * 
+ *  child:   A pointer to the child program
+ *  stage:   The stage which has ended
+ *  status:  The wait status of the stage
+ */
+void endStage(pChildProgram_t child, pJobStage_t stage, int status)
+{
+    stage->alive = 0;
+    child->liveStages--;
+
+    if (stage->statsSlot != -1)
+        recordCommandTime(stage->statsSlot, statsClock() - stage->started, !WIFEXITED(status) || WEXITSTATUS(status) != 0);
+}
+
+/*
+ * Function: exitStatus
+ * --------------------
+ * Converts a wait status into an exit status, as seen by "$?"
+ * 
+ *  status:  The wait status
+ *
+ *  Returns: The exit code of the process, or 128 + the signal which killed it
+ */
+int exitStatus(int status)
+{
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+
+    return WEXITSTATUS(status);
+}
@@ -0,0 +1,141 @@
+/*
+    Line reader of QuYsh ("read" builtin): each descriptor read line by line gets a read-ahead buffer, filled
+    READER_BLOCK bytes at a time, instead of being read one byte per system call. The lines are given as pointers
+    into the buffer, so that a "while read" loop over a pipe runs at the speed of memchr.
+    What has been read ahead belongs to the buffer: a buffer is dropped when its descriptor is given another file
+    (a seekable file is then moved back to the first byte which has not been consumed).
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "reader.h"
+
+pLineReader_t *lineReaders = NULL; // The readers, indexed by descriptor
+int lineReaderCount = 0;
+
+/*
+ * Function: getLineReader
+ * -----------------------
+ * Gives the reader of a descriptor, which is created at the first call
+ *
+ *  fd:      The descriptor
+ *
+ *  Returns: The reader
+ */
+pLineReader_t getLineReader(int fd)
+{
+    pLineReader_t reader;
+
+    if (fd >= lineReaderCount)
+    {
+        lineReaders = (pLineReader_t *)realloc(lineReaders, (fd + 1) * sizeof(pLineReader_t));
+        memset(lineReaders + lineReaderCount, 0, (fd + 1 - lineReaderCount) * sizeof(pLineReader_t));
+        lineReaderCount = fd + 1;
+    }
+
+    if (lineReaders[fd] == NULL)
+    {
+        reader = (pLineReader_t)calloc(1, sizeof(lineReader_t));
+        reader->fd = fd;
+        reader->capacity = READER_BLOCK;
+        reader->buffer = (char *)malloc(reader->capacity);
+        lineReaders[fd] = reader;
+    }
+
+    return lineReaders[fd];
+}
+
+/*
+ * Function: readLine
+ * ------------------
+ * Takes the next line of a descriptor
+ *
+ *  reader:   The reader of the descriptor
+ *  line:     Receives the beginning of the line (valid until the next call, not null-terminated)
+ *  complete: Set to 1 if the line ended with a newline, 0 if it ended with the input
+ *
+ *  Returns: The length of the line (without its newline), -1 at the end of the input
+ */
+ssize_t readLine(pLineReader_t reader, char **line, int *complete)
+{
+    for (;;)
+    {
+        char *newline = memchr(reader->buffer + reader->scanned, '\n', reader->end - reader->scanned);
+        size_t len;
+        ssize_t readLen;
+
+        if (newline != NULL)
+        {
+            len = newline - (reader->buffer + reader->start);
+            *line = reader->buffer + reader->start;
+            *complete = 1;
+            reader->start += len + 1;
+            reader->scanned = reader->start;
+            return len;
+        }
+        reader->scanned = reader->end;
+
+        if (reader->eof)
+        {
+            if (reader->start == reader->end)
+                return -1;
+
+            len = reader->end - reader->start;
+            *line = reader->buffer + reader->start;
+            *complete = 0;
+            reader->start = reader->scanned = reader->end;
+            return len;
+        }
+
+        // Makes room for another block: the consumed bytes are dropped, and a line longer than the buffer grows it
+        if (reader->start > 0)
+        {
+            memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+            reader->end -= reader->start;
+            reader->scanned -= reader->start;
+            reader->start = 0;
+        }
+        if (reader->capacity - reader->end < READER_BLOCK / 2)
+        {
+            reader->capacity *= 2;
+            reader->buffer = (char *)realloc(reader->buffer, reader->capacity);
+        }
+
+        do
+            readLen = read(reader->fd, reader->buffer + reader->end, reader->capacity - reader->end);
+        while (readLen == -1 && errno == EINTR);
+
+        if (readLen <= 0)
+            reader->eof = 1;
+        else
+            reader->end += readLen;
+    }
+}
+
+/*
+ * Function: dropLineReader
+ * ------------------------
+ * Forgets the buffer of a descriptor, which is about to be closed or given another file
+ * The offset of a seekable file is moved back to the first byte which has not been consumed
+ *
+ *  fd:      The descriptor
+ */
+void dropLineReader(int fd)
+{
+    pLineReader_t reader;
+
+    if (fd < 0 || fd >= lineReaderCount || lineReaders[fd] == NULL)
+        return;
+
+    reader = lineReaders[fd];
+    if (reader->end > reader->start)
+        lseek(fd, -(off_t)(reader->end - reader->start), SEEK_CUR);
+
+    free(reader->buffer);
+    free(reader);
+    lineReaders[fd] = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef READER_H
+#define READER_H
+
+#include <sys/types.h>
+
+#define READER_BLOCK 65536 // The number of bytes asked for by each read (the buffer grows for longer lines)
+
+/*
+ * Structure: lineReader
+ * ---------------------
+ * The read-ahead buffer of a descriptor, from which lines are taken without any copy
+ *
+ *  fd:       The descriptor
+ *  buffer:   The bytes read and not consumed yet
+ *  start:    The first byte which has not been consumed
+ *  scanned:  The first byte which has not been searched for a newline
+ *  end:      The end of the bytes read
+ *  capacity: The size of the buffer
+ *  eof:      1 once the end of the input has been read
+ */
+typedef struct lineReader
+{
+    int fd;
+    char *buffer;
+    size_t start;
+    size_t scanned;
+    size_t end;
+    size_t capacity;
+    int eof;
+} lineReader_t, *pLineReader_t;
+
+pLineReader_t getLineReader(int fd);
+ssize_t readLine(pLineReader_t reader, char **line, int *complete);
+void dropLineReader(int fd);
+
+#endif
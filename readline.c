@@ -9,29 +9,92 @@
 
 #include "./readline.h"
 
+/*
+ * Allocate from the arena, or via malloc(size_t) if there is none.
+ */
+static void* alloc_in(pArena_t arena, size_t size) {
+  return arena ? arenaAlloc(arena, size) : malloc(size);
+}
+
+/*
+ * Return a pointer just after the end of the word starting at cur.
+ * A word ends on a whitespace, an operator or a parenthesis, unless it is quoted
+ * ("..." or '...') or inside a substitution such as $(...) or ${...}.
+ * Quotes and substitutions are kept in the word.
+ */
+static char* skip_word(char *cur) {
+  char quote = 0;
+  int depth = 0;
+  for (; *cur; cur++) {
+    char c = *cur;
+    if (quote) {
+      if (c == quote)
+        quote = 0;
+      continue;
+    }
+    if (c == '"' || c == '\'') {
+      quote = c;
+      continue;
+    }
+    if (c == '$' && (cur[1] == '(' || cur[1] == '{')) {
+      depth++;
+      cur++;
+      continue;
+    }
+    if (depth > 0) {
+      if (c == '(' || c == '{')
+        depth++;
+      else if (c == ')' || c == '}')
+        depth--;
+      continue;
+    }
+    switch (c) {
+    case ' ':
+    case '\t':
+    case '<':
+    case '>':
+    case '|':
+    case ';':
+    case '&':
+    case '(':
+    case ')':
+      return cur;
+    default: ;
+    }
+  }
+  return cur;
+}
+
 /*
  * Read a line from standard input into a newly allocated 
  * array of char. The allocation is via malloc(size_t), the array 
  * must be freed via free(void*).
+ * Returns NULL at the end of the input.
  */
 
 char* readline(void) {
-  #define BUFFER_LENGTH 256
-  static char buffer[BUFFER_LENGTH];
-  int offset = 0;
-  for (;;) {
-    char c = fgetc(stdin);
-    if (c==EOF) {
-      printf("PANIC: EOF on stdin\n");
-      exit(-1);
-    }
-    if (c=='\n')
-      break;
-    buffer[offset++] = c;
-  }
-  buffer[offset++] = '\0';
-  char *line = malloc(offset);
-  strcpy(line,buffer);
+  return readline_in(NULL);
+}
+
+/*
+ * Read a line from standard input into an array of char allocated
+ * from the arena (or via malloc(size_t) if arena is NULL).
+ * Lines can be of any length: the line is first gathered into a
+ * buffer which grows as needed and is kept from one call to another.
+ * The line is taken from the buffer of stdin with getline, not one
+ * fgetc at a time; "read" takes its lines from the same buffer.
+ * Returns NULL at the end of the input.
+ */
+char* readline_in(pArena_t arena) {
+  static char *buffer = NULL;
+  static size_t capacity = 0;
+  ssize_t len = getline(&buffer, &capacity, stdin);
+  if (len == -1)
+    return NULL; /* End of the input */
+  size_t offset = (buffer[len - 1] == '\n') ? len - 1 : len;
+  char *line = alloc_in(arena, offset + 1);
+  memcpy(line, buffer, offset);
+  line[offset] = '\0';
   return line;
 }
 
@@ -41,12 +104,21 @@ char* readline(void) {
  * The array has been allocated by malloc, it must be freed by free.
  */
 char** split_in_words(char *line) {
-  #define MAX_NWORDS 256
-  static char* words[MAX_NWORDS];
+  return split_in_words_in(line, NULL);
+}
+
+/* 
+ * Same as split_in_words, but the array and the words are allocated
+ * from the arena (or via malloc(size_t) if arena is NULL).
+ * There is no limit on the number of words: they are gathered into
+ * an array which grows as needed and is kept from one call to another.
+ */
+char** split_in_words_in(char *line, pArena_t arena) {
+  static char** words = NULL;
+  static int capacity = 0;
   int nwords=0;
 	char *cur = line;
 	char c;
-  words[0]=NULL;
 	while ((c = *cur) != 0) {
 		char *word = NULL;
 		char *start;
@@ -76,44 +148,34 @@ char** split_in_words(char *line) {
 			word = "&";
 			cur++;
 			break;
+		case '(':
+			word = "(";
+			cur++;
+			break;
+		case ')':
+			word = ")";
+			cur++;
+			break;
 		default:
 			/* Another word */
 			start = cur;
-      if (c=='"') {
-        c = *++cur;
-        while (c != 0 && c != '"')
-          c = *++cur;
-        cur++;
-      } else {
-        while (c) {
-          c = *++cur;
-          switch (c) {
-          case 0:
-          case ' ':
-          case '\t':
-          case '<':
-          case '>':
-          case '|':
-          case ';':
-          case '&':
-            c = 0;
-            break;
-          default: ;
-          }
-        }
-      }
-			word = malloc((cur - start + 1) * sizeof(char));
+      cur = skip_word(cur);
+			word = alloc_in(arena, (cur - start + 1) * sizeof(char));
 			strncpy(word, start, cur - start);
 			word[cur - start] = 0;
 		}
 		if (word) {
+      if (nwords + 1 >= capacity) {
+        capacity = capacity ? capacity * 2 : 256;
+        words = realloc(words, capacity * sizeof(char *));
+      }
 			words[nwords++] = word;
-      words[nwords]=NULL;
 		}
 	}
   size_t size = (nwords + 1) * sizeof(char *);
-  char** tmp = malloc(size);
-  memcpy(tmp,words,size);
+  char** tmp = alloc_in(arena, size);
+  memcpy(tmp,words,nwords * sizeof(char *));
+  tmp[nwords]=NULL;
 	return tmp;
 }
 
@@ -1,2 +1,6 @@
+#include "arena.h"
+
 char* readline(void);
-char** split_in_words(char *line);
\ No newline at end of file
+char* readline_in(pArena_t arena);
+char** split_in_words(char *line);
+char** split_in_words_in(char *line, pArena_t arena);
@@ -0,0 +1,456 @@
+/*
+    Session snapshots of QuYsh: the warm state of a Shell (resolved commands, PATH, variables, history)
+    saved in a versioned binary file, which the next Shell maps in memory at startup instead of rebuilding it.
+    A snapshot is validated with a few comparisons (magic, version, sizes, checksum of the header, PATH)
+    and ignored if it does not match; its command table is only used if no directory of the PATH has changed.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define DIR_MISSING -1 // Modification time of a directory of the PATH which does not exist
+
+/*
+ * Structure: snapshotBuffer
+ * -------------------------
+ * The content of a snapshot being built
+ */
+typedef struct snapshotBuffer
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+} snapshotBuffer_t, *pSnapshotBuffer_t;
+
+uint64_t hashBytes(const void *bytes, size_t len);
+int validOffset(pSnapshot_t snapshot, uint64_t offset, uint64_t count, uint64_t size);
+uint32_t reserveBytes(pSnapshotBuffer_t buffer, size_t len);
+uint32_t appendString(pSnapshotBuffer_t buffer, const char *str, size_t len);
+
+/*
+ * Function: loadSnapshot
+ * ----------------------
+ * Maps a snapshot file in memory and checks that it can be used
+ *
+ *  file:    The snapshot file
+ *  path:    The current PATH (a snapshot taken with another PATH is stale)
+ *
+ *  Returns: The snapshot, NULL if there is none or if it is invalid or stale
+ */
+pSnapshot_t loadSnapshot(const char *file, const char *path)
+{
+    const snapshotHeader_t *header;
+    pSnapshot_t snapshot;
+    struct stat fileStat;
+    void *map;
+    int fd;
+
+    fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    if (fstat(fd, &fileStat) == -1 || fileStat.st_size < (off_t)sizeof(snapshotHeader_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    snapshot = (pSnapshot_t)malloc(sizeof(snapshot_t));
+    snapshot->map = (const char *)map;
+    snapshot->size = fileStat.st_size;
+    snapshot->header = header = (const snapshotHeader_t *)map;
+    snapshot->commandsValid = 1;
+
+    // Every string ends before the end of the file, whose last byte is a null character
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION ||
+        header->headerSize != sizeof(snapshotHeader_t) || header->fileSize != snapshot->size ||
+        header->checksum != hashBytes(header, offsetof(snapshotHeader_t, checksum)) ||
+        snapshot->map[snapshot->size - 1] != '\0' ||
+        !validOffset(snapshot, header->pathOffset, 1, 1) ||
+        !validOffset(snapshot, header->dirsOffset, header->dirCount, sizeof(snapshotDir_t)) ||
+        !validOffset(snapshot, header->cacheOffset, header->cacheSlots, sizeof(snapshotCommand_t)) ||
+        (header->cacheSlots & (header->cacheSlots - 1)) != 0 ||
+        !validOffset(snapshot, header->variablesOffset, header->variableCount, sizeof(uint32_t)) ||
+        !validOffset(snapshot, header->historyOffset, header->historyCount, sizeof(uint32_t)) ||
+        header->pathHash != hashString(path) || strcmp(snapshot->map + header->pathOffset, path) != 0)
+    {
+        freeSnapshot(snapshot);
+        return NULL;
+    }
+
+    // A command may have been added to or removed from a directory of the PATH since the snapshot
+    for (uint32_t i = 0; i < header->dirCount && snapshot->commandsValid; i++)
+    {
+        const snapshotDir_t *dir = (const snapshotDir_t *)(snapshot->map + header->dirsOffset) + i;
+        struct stat dirStat;
+
+        if (!validOffset(snapshot, dir->offset, 1, 1))
+            snapshot->commandsValid = 0;
+        else if (stat(snapshot->map + dir->offset, &dirStat) == -1)
+            snapshot->commandsValid = (dir->mtimeSec == DIR_MISSING);
+        else if (dirStat.st_mtim.tv_sec != dir->mtimeSec || dirStat.st_mtim.tv_nsec != dir->mtimeNsec)
+            snapshot->commandsValid = 0;
+    }
+
+    return snapshot;
+}
+
+/*
+ * Function: snapshotLookup
+ * ------------------------
+ * Looks for a command in the command table of a snapshot
+ *
+ *  snapshot: The snapshot
+ *  name:     The name of the command
+ *
+ *  Returns: The complete path of the command, NULL if the snapshot does not know it
+ */
+const char *snapshotLookup(pSnapshot_t snapshot, const char *name)
+{
+    const snapshotHeader_t *header = snapshot->header;
+    const snapshotCommand_t *table = (const snapshotCommand_t *)(snapshot->map + header->cacheOffset);
+    uint32_t mask = header->cacheSlots - 1;
+
+    if (!snapshot->commandsValid || header->cacheSlots == 0)
+        return NULL;
+
+    for (uint32_t slot = hashString(name) & mask, probes = 0; probes < header->cacheSlots; slot = (slot + 1) & mask, probes++)
+    {
+        const snapshotCommand_t *entry = &(table[slot]);
+
+        if (entry->nameOffset == 0 || !validOffset(snapshot, entry->nameOffset, 1, 1) || !validOffset(snapshot, entry->pathOffset, 1, 1))
+            return NULL;
+
+        if (strcmp(snapshot->map + entry->nameOffset, name) == 0)
+            return snapshot->map + entry->pathOffset;
+    }
+
+    return NULL;
+}
+
+/*
+ * Function: snapshotCommandName
+ * -----------------------------
+ *  Returns: The name of the command of a slot of the command table of a snapshot,
+ *           NULL if the slot is empty or out of range, or if the command table is stale
+ */
+const char *snapshotCommandName(pSnapshot_t snapshot, uint32_t slot)
+{
+    const snapshotCommand_t *table = (const snapshotCommand_t *)(snapshot->map + snapshot->header->cacheOffset);
+
+    if (!snapshot->commandsValid || slot >= snapshot->header->cacheSlots || table[slot].nameOffset == 0 ||
+        !validOffset(snapshot, table[slot].nameOffset, 1, 1))
+        return NULL;
+
+    return snapshot->map + table[slot].nameOffset;
+}
+
+/*
+ * Function: snapshotVariable
+ * --------------------------
+ *  Returns: A variable of a snapshot ("NAME=value"), NULL if index is out of range
+ */
+const char *snapshotVariable(pSnapshot_t snapshot, int index)
+{
+    const uint32_t *offsets = (const uint32_t *)(snapshot->map + snapshot->header->variablesOffset);
+
+    if (index < 0 || (uint32_t)index >= snapshot->header->variableCount || !validOffset(snapshot, offsets[index], 1, 1))
+        return NULL;
+
+    return snapshot->map + offsets[index];
+}
+
+/*
+ * Function: snapshotHistory
+ * -------------------------
+ *  Returns: A line of the history of a snapshot (0 for the oldest), NULL if index is out of range
+ */
+const char *snapshotHistory(pSnapshot_t snapshot, int index)
+{
+    const uint32_t *offsets = (const uint32_t *)(snapshot->map + snapshot->header->historyOffset);
+
+    if (index < 0 || (uint32_t)index >= snapshot->header->historyCount || !validOffset(snapshot, offsets[index], 1, 1))
+        return NULL;
+
+    return snapshot->map + offsets[index];
+}
+
+/*
+ * Function: freeSnapshot
+ * ----------------------
+ * Unmaps a snapshot
+ *
+ *  snapshot: The snapshot (may be NULL)
+ */
+void freeSnapshot(pSnapshot_t snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    munmap((void *)snapshot->map, snapshot->size);
+    free(snapshot);
+}
+
+/*
+ * Function: saveSnapshot
+ * ----------------------
+ * Writes the state of a Shell to a snapshot file
+ * The file is written next to the previous one, then renamed over it: a Shell never maps a partial snapshot
+ *
+ *  file:    The snapshot file
+ *  data:    The state to save
+ *
+ *  Returns: 0 if the snapshot has been written, -1 otherwise
+ */
+int saveSnapshot(const char *file, pSnapshotData_t data)
+{
+    snapshotBuffer_t buffer = {NULL, 0, 0};
+    snapshotHeader_t header;
+    uint32_t cacheSlots = 0;
+    uint32_t dirCount = 0;
+    const char *it;
+    char tmpFile[4096];
+    size_t written = 0;
+    int fd;
+
+    for (it = data->path; *it != '\0'; it++)
+        if ((it == data->path || it[-1] == ':') && *it != ':')
+            dirCount++;
+
+    // The command table is at most half full
+    if (data->commandCount > 0)
+        for (cacheSlots = 16; cacheSlots < (uint32_t)data->commandCount * 2; cacheSlots *= 2)
+            ;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(snapshotHeader_t);
+    header.dirCount = dirCount;
+    header.cacheSlots = cacheSlots;
+    header.variableCount = data->variableCount;
+    header.historyCount = data->historyCount;
+
+    // Arrays first (aligned), strings afterwards
+    reserveBytes(&buffer, sizeof(snapshotHeader_t));
+    header.dirsOffset = reserveBytes(&buffer, dirCount * sizeof(snapshotDir_t));
+    header.cacheOffset = reserveBytes(&buffer, cacheSlots * sizeof(snapshotCommand_t));
+    header.variablesOffset = reserveBytes(&buffer, data->variableCount * sizeof(uint32_t));
+    header.historyOffset = reserveBytes(&buffer, data->historyCount * sizeof(uint32_t));
+
+    header.pathOffset = appendString(&buffer, data->path, strlen(data->path));
+    header.pathHash = hashString(data->path);
+
+    dirCount = 0;
+    for (it = data->path; *it != '\0';)
+    {
+        const char *end = strchr(it, ':');
+        size_t len = (end != NULL) ? (size_t)(end - it) : strlen(it);
+
+        if (len > 0)
+        {
+            uint32_t offset = appendString(&buffer, it, len);
+            pSnapshotDir_t dir = (pSnapshotDir_t)(buffer.data + header.dirsOffset) + dirCount++;
+            struct stat dirStat;
+
+            dir->offset = offset;
+            dir->len = len;
+            if (stat(buffer.data + offset, &dirStat) == 0)
+            {
+                dir->mtimeSec = dirStat.st_mtim.tv_sec;
+                dir->mtimeNsec = dirStat.st_mtim.tv_nsec;
+            }
+            else
+            {
+                dir->mtimeSec = DIR_MISSING;
+                dir->mtimeNsec = DIR_MISSING;
+            }
+        }
+        it += len;
+        if (*it == ':')
+            it++;
+    }
+
+    for (int i = 0; i < data->commandCount; i++)
+    {
+        uint32_t nameOffset = appendString(&buffer, data->commandNames[i], strlen(data->commandNames[i]));
+        uint32_t pathOffset = appendString(&buffer, data->commandPaths[i], strlen(data->commandPaths[i]));
+        pSnapshotCommand_t table = (pSnapshotCommand_t)(buffer.data + header.cacheOffset);
+        uint32_t slot = hashString(data->commandNames[i]) & (cacheSlots - 1);
+
+        while (table[slot].nameOffset != 0)
+            slot = (slot + 1) & (cacheSlots - 1);
+        table[slot].nameOffset = nameOffset;
+        table[slot].pathOffset = pathOffset;
+    }
+
+    for (int i = 0; i < data->variableCount; i++)
+    {
+        uint32_t offset = appendString(&buffer, data->variables[i], strlen(data->variables[i]));
+        ((uint32_t *)(buffer.data + header.variablesOffset))[i] = offset;
+    }
+
+    for (int i = 0; i < data->historyCount; i++)
+    {
+        uint32_t offset = appendString(&buffer, data->history[i], strlen(data->history[i]));
+        ((uint32_t *)(buffer.data + header.historyOffset))[i] = offset;
+    }
+
+    header.fileSize = buffer.len;
+    header.checksum = hashBytes(&header, offsetof(snapshotHeader_t, checksum));
+    memcpy(buffer.data, &header, sizeof(header));
+
+    snprintf(tmpFile, sizeof(tmpFile), "%s.%d", file, (int)getpid());
+    fd = open(tmpFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        free(buffer.data);
+        return -1;
+    }
+
+    while (written < buffer.len)
+    {
+        ssize_t res = write(fd, buffer.data + written, buffer.len - written);
+
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            break;
+        written += res;
+    }
+
+    free(buffer.data);
+
+    if (close(fd) == -1 || written < header.fileSize || rename(tmpFile, file) == -1)
+    {
+        unlink(tmpFile);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function: hashString
+ * --------------------
+ * Hashes a string (FNV-1a)
+ *
+ *  str:     The string
+ *
+ *  Returns: The hash of the string
+ */
+uint64_t hashString(const char *str)
+{
+    return hashBytes(str, strlen(str));
+}
+
+/*
+ * Function: hashBytes
+ * -------------------
+ * Hashes bytes (FNV-1a)
+ *
+ *  bytes:   The bytes
+ *  len:     The number of bytes
+ *
+ *  Returns: The hash of the bytes
+ */
+uint64_t hashBytes(const void *bytes, size_t len)
+{
+    const unsigned char *it = (const unsigned char *)bytes;
+    uint64_t hash = FNV_OFFSET;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= it[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Function: validOffset
+ * ---------------------
+ * Checks that an array lies inside a snapshot
+ *
+ *  snapshot: The snapshot
+ *  offset:   The offset of the array
+ *  count:    The number of elements of the array
+ *  size:     The size of an element
+ *
+ *  Returns: 1 if the array lies inside the snapshot, 0 otherwise
+ */
+int validOffset(pSnapshot_t snapshot, uint64_t offset, uint64_t count, uint64_t size)
+{
+    return (offset <= snapshot->size && count * size <= snapshot->size - offset);
+}
+
+/*
+ * Function: reserveBytes
+ * ----------------------
+ * Appends zeroed bytes to a snapshot being built, aligned on 8 bytes
+ *
+ *  buffer:  The snapshot being built
+ *  len:     The number of bytes
+ *
+ *  Returns: The offset of the bytes
+ */
+uint32_t reserveBytes(pSnapshotBuffer_t buffer, size_t len)
+{
+    size_t offset = (buffer->len + 7) & ~(size_t)7;
+
+    if (offset + len > buffer->capacity)
+    {
+        while (offset + len > buffer->capacity)
+            buffer->capacity = (buffer->capacity == 0) ? 4096 : buffer->capacity * 2;
+        buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+    }
+
+    memset(buffer->data + buffer->len, 0, offset + len - buffer->len);
+    buffer->len = offset + len;
+
+    return offset;
+}
+
+/*
+ * Function: appendString
+ * ----------------------
+ * Appends a null-terminated copy of a string to a snapshot being built
+ *
+ *  buffer:  The snapshot being built
+ *  str:     The string
+ *  len:     The length of the string
+ *
+ *  Returns: The offset of the copy
+ */
+uint32_t appendString(pSnapshotBuffer_t buffer, const char *str, size_t len)
+{
+    size_t offset = buffer->len;
+
+    if (offset + len + 1 > buffer->capacity)
+    {
+        while (offset + len + 1 > buffer->capacity)
+            buffer->capacity = (buffer->capacity == 0) ? 4096 : buffer->capacity * 2;
+        buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+    }
+
+    memcpy(buffer->data + offset, str, len);
+    buffer->data[offset + len] = '\0';
+    buffer->len += len + 1;
+
+    return offset;
+}
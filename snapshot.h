@@ -0,0 +1,120 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC "QUYSHSNP"
+#define SNAPSHOT_VERSION 1
+
+/*
+ * Structure: snapshotHeader
+ * -------------------------
+ * The header of a snapshot file. Every offset is relative to the start of the file
+ *
+ *  magic:          SNAPSHOT_MAGIC
+ *  version:        SNAPSHOT_VERSION
+ *  headerSize:     The size of this structure (the layout of the file changes with it)
+ *  fileSize:       The size of the whole file
+ *  pathHash:       The hash of the PATH the snapshot has been taken with
+ *  pathOffset:     The PATH (null-terminated)
+ *  dirCount:       The number of directories of the PATH
+ *  dirsOffset:     An array of snapshotDir, one per directory of the PATH
+ *  cacheSlots:     The number of slots of the command table (a power of two)
+ *  cacheOffset:    An array of snapshotCommand, the command table (open addressing)
+ *  variableCount:  The number of variables
+ *  variablesOffset: An array of offsets of the variables ("NAME=value")
+ *  historyCount:   The number of lines of the history
+ *  historyOffset:  An array of offsets of the lines of the history, from the oldest
+ *  checksum:       The hash of the header (this field excluded)
+ */
+typedef struct snapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fileSize;
+    uint64_t pathHash;
+    uint32_t pathOffset;
+    uint32_t dirCount;
+    uint32_t dirsOffset;
+    uint32_t cacheSlots;
+    uint32_t cacheOffset;
+    uint32_t variableCount;
+    uint32_t variablesOffset;
+    uint32_t historyCount;
+    uint32_t historyOffset;
+    uint32_t padding;
+    uint64_t checksum;
+} snapshotHeader_t, *pSnapshotHeader_t;
+
+/*
+ * Structure: snapshotDir
+ * ----------------------
+ * A directory of the PATH, with its modification time when the snapshot was taken
+ * (a directory whose content has changed makes the command table stale)
+ */
+typedef struct snapshotDir
+{
+    uint32_t offset;
+    uint32_t len;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+} snapshotDir_t, *pSnapshotDir_t;
+
+/*
+ * Structure: snapshotCommand
+ * --------------------------
+ * A slot of the command table: the offsets of the name of a command and of its complete path (0 for an empty slot)
+ */
+typedef struct snapshotCommand
+{
+    uint32_t nameOffset;
+    uint32_t pathOffset;
+} snapshotCommand_t, *pSnapshotCommand_t;
+
+/*
+ * Structure: snapshot
+ * -------------------
+ * A snapshot file mapped in memory
+ *
+ *  map:          The mapping of the file
+ *  size:         The size of the mapping
+ *  header:       The header of the file
+ *  commandsValid: 1 if the command table can be used (no directory of the PATH has changed)
+ */
+typedef struct snapshot
+{
+    const char *map;
+    size_t size;
+    const snapshotHeader_t *header;
+    int commandsValid;
+} snapshot_t, *pSnapshot_t;
+
+/*
+ * Structure: snapshotData
+ * -----------------------
+ * The state of a Shell to be saved in a snapshot
+ */
+typedef struct snapshotData
+{
+    const char *path;
+    const char **commandNames;
+    const char **commandPaths;
+    int commandCount;
+    const char **variables;
+    int variableCount;
+    const char **history;
+    int historyCount;
+} snapshotData_t, *pSnapshotData_t;
+
+pSnapshot_t loadSnapshot(const char *file, const char *path);
+const char *snapshotLookup(pSnapshot_t snapshot, const char *name);
+const char *snapshotCommandName(pSnapshot_t snapshot, uint32_t slot);
+const char *snapshotVariable(pSnapshot_t snapshot, int index);
+const char *snapshotHistory(pSnapshot_t snapshot, int index);
+void freeSnapshot(pSnapshot_t snapshot);
+int saveSnapshot(const char *file, pSnapshotData_t data);
+uint64_t hashString(const char *str);
+
+#endif
@@ -0,0 +1,634 @@
+/*
+    Soak test of QuYsh ("make soak"): drives a single Shell session through the workloads which break long sessions
+    (thousands of background jobs, very long pipelines, million-line scripts, command lines of hundreds of KB),
+    one batch of commands at a time. After each batch the Shell prints a marker, at which point its resident memory,
+    its open descriptors, its zombie children and the jobs it still lists are sampled.
+    A workload fails when its descriptors or its memory grow after its first batch (leaked pipe ends, job list,
+    per-line allocations), when zombies or jobs are left behind, or when its batches get slower as it goes.
+    Usage: quysh-soak [-s divisor] [shell]   (the divisor shrinks every workload, for a quick run)
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SOAK_RSS_GROWTH (16 * 1024) // The growth of the resident memory (in KB) tolerated after the first batch of a workload
+#define SOAK_TIME_GROWTH 3.0        // How much slower the second half of a workload may run than its first half
+#define SOAK_TIME_NOISE 0.05        // Batches shorter than this (in seconds) are too noisy to be compared
+#define SOAK_MARKER "soak-sync-"    // Printed by the Shell at the end of each batch
+#define SOAK_LINE_LEN 300000        // The length of the long command lines
+#define SOAK_ERRORS_SHOWN 3         // The number of error messages shown per batch
+
+/*
+ * Structure: soakShell
+ * --------------------
+ * The Shell under test
+ *
+ *  pid:     Its PID
+ *  input:   The write end of its standard input
+ *  output:  The read end of its standard output and error
+ *  pending: The output which does not make a whole line yet
+ *  pendingLen: The length of pending
+ *  syncs:   The number of markers asked for
+ */
+typedef struct soakShell
+{
+    int pid;
+    int input;
+    int output;
+    char pending[65536];
+    size_t pendingLen;
+    int syncs;
+} soakShell_t, *pSoakShell_t;
+
+/*
+ * Structure: soakSample
+ * ---------------------
+ * What is sampled at the end of a batch
+ *
+ *  rss:     The resident memory of the Shell, in KB
+ *  fds:     The number of descriptors open in the Shell
+ *  zombies: The number of children of the Shell which have ended and have not been collected
+ *  jobs:    The number of jobs listed by "jobs" once "wait" has returned
+ *  errors:  The number of error messages printed during the batch
+ *  seconds: The wall time of the batch
+ */
+typedef struct soakSample
+{
+    long rss;
+    int fds;
+    int zombies;
+    int jobs;
+    int errors;
+    double seconds;
+} soakSample_t, *pSoakSample_t;
+
+/*
+ * Structure: soakBuffer
+ * ---------------------
+ * The commands of a batch
+ *
+ *  text:     The commands
+ *  len:      Their length
+ *  capacity: The number of bytes allocated
+ */
+typedef struct soakBuffer
+{
+    char *text;
+    size_t len;
+    size_t capacity;
+} soakBuffer_t, *pSoakBuffer_t;
+
+/* Writes the commands of one batch of a workload */
+typedef void (*soakBatch_t)(pSoakBuffer_t batch, int index, int size);
+
+/*
+ * Structure: soakWorkload
+ * -----------------------
+ * A workload, run as a number of batches of the same size
+ *
+ *  name:    The name of the workload
+ *  batches: The number of batches
+ *  size:    The number of commands of each batch
+ *  write:   Writes the commands of a batch
+ */
+typedef struct soakWorkload
+{
+    const char *name;
+    int batches;
+    int size;
+    soakBatch_t write;
+} soakWorkload_t;
+
+int startShell(const char *path, pSoakShell_t shell);
+int runBatch(pSoakShell_t shell, pSoakBuffer_t batch, pSoakSample_t sample);
+int readOutput(pSoakShell_t shell, pSoakSample_t sample, int *synced);
+void sampleShell(pSoakShell_t shell, pSoakSample_t sample);
+int runWorkload(pSoakShell_t shell, const soakWorkload_t *workload, int divisor);
+void appendText(pSoakBuffer_t buffer, const char *text, size_t len);
+void appendFormat(pSoakBuffer_t buffer, const char *format, ...);
+void writeJobs(pSoakBuffer_t batch, int index, int size);
+void writePipelines(pSoakBuffer_t batch, int index, int size);
+void writeScript(pSoakBuffer_t batch, int index, int size);
+void writeLongLines(pSoakBuffer_t batch, int index, int size);
+double soakClock();
+
+const soakWorkload_t workloads[] = {
+    {"jobs", 20, 500, writeJobs},          // 10000 background jobs, waited for after each batch
+    {"pipelines", 10, 10, writePipelines}, // 100 pipelines of 64 stages
+    {"script", 20, 50000, writeScript},    // A script of 1000000 lines
+    {"long lines", 10, 4, writeLongLines}, // 40 command lines of 300KB
+};
+
+int main(int argc, char **argv)
+{
+    const char *path = "./quysh";
+    int divisor = 1;
+    int failed = 0;
+    soakShell_t shell;
+    soakSample_t first;
+    soakSample_t last;
+    int status;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1)
+    {
+        if (opt == 's' && atoi(optarg) > 0)
+        {
+            divisor = atoi(optarg);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-s divisor] [shell]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc)
+        path = argv[optind];
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (startShell(path, &shell) == -1)
+        return 2;
+
+    // The descriptors of the whole session are compared with those of an idle Shell
+    memset(&first, 0, sizeof(first));
+    if (runBatch(&shell, NULL, &first) == -1)
+        return 2;
+
+    printf("%-12s %8s %9s %18s %10s %8s %5s\n", "workload", "batches", "time", "rss (KB)", "fds", "zombies", "jobs");
+    for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+        failed |= runWorkload(&shell, &workloads[i], divisor);
+
+    memset(&last, 0, sizeof(last));
+    runBatch(&shell, NULL, &last);
+    if (last.fds > first.fds)
+    {
+        printf("soak: session: %d descriptors leaked (%d open at the start, %d at the end)\n", last.fds - first.fds, first.fds, last.fds);
+        failed = 1;
+    }
+
+    write(shell.input, "exit\n", 5);
+    close(shell.input);
+    while (readOutput(&shell, NULL, NULL) > 0)
+        ;
+    waitpid(shell.pid, &status, 0);
+
+    printf("soak: %s\n", failed ? "FAILED" : "passed");
+
+    return failed;
+}
+
+/*
+ * Function: startShell
+ * --------------------
+ * Launches the Shell, with pipes as its standard input and output
+ *
+ *  path:    The path of the Shell
+ *  shell:   Receives the Shell
+ *
+ *  Returns: 0 on success, -1 on error
+ */
+int startShell(const char *path, pSoakShell_t shell)
+{
+    int inPipe[2];
+    int outPipe[2];
+
+    if (pipe2(inPipe, O_CLOEXEC) == -1 || pipe2(outPipe, O_CLOEXEC) == -1)
+    {
+        perror("pipe");
+        return -1;
+    }
+
+    shell->pid = fork();
+    switch (shell->pid)
+    {
+    case -1:
+        perror("fork");
+        return -1;
+    case 0:
+        dup2(inPipe[0], STDIN_FILENO);
+        dup2(outPipe[1], STDOUT_FILENO);
+        dup2(outPipe[1], STDERR_FILENO);
+        execl(path, path, (char *)NULL);
+        perror("execl");
+        _exit(127);
+    default:
+        break;
+    }
+
+    close(inPipe[0]);
+    close(outPipe[1]);
+    shell->input = inPipe[1];
+    shell->output = outPipe[0];
+    shell->pendingLen = 0;
+    shell->syncs = 0;
+
+    // The Shell is fed while its output is read: neither may block the other
+    fcntl(shell->input, F_SETFL, O_NONBLOCK);
+
+    return 0;
+}
+
+/*
+ * Function: runWorkload
+ * ---------------------
+ * Runs the batches of a workload, then compares its last batch with its first one
+ *
+ *  shell:   The Shell
+ *  workload: The workload
+ *  divisor: The divisor of its number of commands
+ *
+ *  Returns: 1 if the workload failed, 0 otherwise
+ */
+int runWorkload(pSoakShell_t shell, const soakWorkload_t *workload, int divisor)
+{
+    int size = (workload->size / divisor > 0) ? workload->size / divisor : 1;
+    int count = workload->batches;
+    soakSample_t *samples = (soakSample_t *)calloc(count, sizeof(soakSample_t));
+    soakBuffer_t batch = {NULL, 0, 0};
+    double early = 0;
+    double late = 0;
+    double total = 0;
+    int zombies = 0;
+    int jobs = 0;
+    int errors = 0;
+    int failed = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        batch.len = 0;
+        workload->write(&batch, i, size);
+        if (runBatch(shell, &batch, &samples[i]) == -1)
+        {
+            printf("soak: %s: the shell has ended during batch %d\n", workload->name, i);
+            free(samples);
+            free(batch.text);
+            return 1;
+        }
+
+        total += samples[i].seconds;
+        zombies = (samples[i].zombies > zombies) ? samples[i].zombies : zombies;
+        jobs = (samples[i].jobs > jobs) ? samples[i].jobs : jobs;
+        errors += samples[i].errors;
+    }
+
+    // The first batch grows the buffers of the Shell to their working size: it is left out of the comparisons
+    for (int i = 1; i < count; i++)
+    {
+        if (i <= count / 2)
+            early += samples[i].seconds / (count / 2);
+        else
+            late += samples[i].seconds / (count - 1 - count / 2);
+    }
+
+    printf("%-12s %8d %8.2fs %8ld -> %7ld %4d -> %3d %8d %5d\n", workload->name, count, total,
+           samples[0].rss, samples[count - 1].rss, samples[0].fds, samples[count - 1].fds, zombies, jobs);
+
+    if (samples[count - 1].fds > samples[0].fds)
+    {
+        printf("soak: %s: %d descriptors leaked\n", workload->name, samples[count - 1].fds - samples[0].fds);
+        failed = 1;
+    }
+    if (samples[count - 1].rss - samples[0].rss > SOAK_RSS_GROWTH)
+    {
+        printf("soak: %s: resident memory grew by %ld KB\n", workload->name, samples[count - 1].rss - samples[0].rss);
+        failed = 1;
+    }
+    if (zombies > 0)
+    {
+        printf("soak: %s: %d zombies left behind\n", workload->name, zombies);
+        failed = 1;
+    }
+    if (jobs > 0)
+    {
+        printf("soak: %s: %d jobs still listed after wait\n", workload->name, jobs);
+        failed = 1;
+    }
+    if (errors > 0)
+    {
+        printf("soak: %s: %d error messages\n", workload->name, errors);
+        failed = 1;
+    }
+    if (late > SOAK_TIME_NOISE && late > early * SOAK_TIME_GROWTH)
+    {
+        printf("soak: %s: batches slowed down from %.3fs to %.3fs\n", workload->name, early, late);
+        failed = 1;
+    }
+
+    free(samples);
+    free(batch.text);
+
+    return failed;
+}
+
+/*
+ * Function: runBatch
+ * ------------------
+ * Feeds a batch of commands to the Shell, followed by "wait", "jobs" and a marker, then samples the Shell once the
+ * marker has been printed (everything before it has been run)
+ *
+ *  shell:   The Shell
+ *  batch:   The commands (NULL for none)
+ *  sample:  Receives the sample
+ *
+ *  Returns: 0 on success, -1 if the Shell has ended
+ */
+int runBatch(pSoakShell_t shell, pSoakBuffer_t batch, pSoakSample_t sample)
+{
+    soakBuffer_t text = {NULL, 0, 0};
+    double start = soakClock();
+    size_t written = 0;
+    int synced = 0;
+
+    if (batch != NULL)
+        appendText(&text, batch->text, batch->len);
+    appendFormat(&text, "wait\njobs\necho %s%d\n", SOAK_MARKER, ++shell->syncs);
+
+    memset(sample, 0, sizeof(soakSample_t));
+
+    while (!synced)
+    {
+        struct pollfd fds[2] = {{shell->output, POLLIN, 0}, {shell->input, POLLOUT, 0}};
+
+        if (poll(fds, (written < text.len) ? 2 : 1, -1) == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            free(text.text);
+            return -1;
+        }
+
+        if (fds[0].revents != 0 && readOutput(shell, sample, &synced) <= 0)
+        {
+            free(text.text);
+            return -1;
+        }
+
+        if (written < text.len && fds[1].revents != 0)
+        {
+            ssize_t len = write(shell->input, text.text + written, text.len - written);
+
+            if (len == -1 && errno != EAGAIN && errno != EINTR)
+            {
+                free(text.text);
+                return -1;
+            }
+            if (len > 0)
+                written += len;
+        }
+    }
+
+    sample->seconds = soakClock() - start;
+    sampleShell(shell, sample);
+    free(text.text);
+
+    return 0;
+}
+
+/*
+ * Function: readOutput
+ * --------------------
+ * Reads what the Shell has printed, and scans it line by line: jobs listed, error messages and the marker
+ *
+ *  shell:   The Shell
+ *  sample:  The sample of the batch (NULL to discard the output)
+ *  synced:  Set to 1 once the marker of the batch has been read
+ *
+ *  Returns: The number of bytes read, 0 at the end of the output, -1 on error
+ */
+int readOutput(pSoakShell_t shell, pSoakSample_t sample, int *synced)
+{
+    char marker[64];
+    ssize_t len;
+    char *line;
+    char *newline;
+
+    do
+        len = read(shell->output, shell->pending + shell->pendingLen, sizeof(shell->pending) - shell->pendingLen);
+    while (len == -1 && errno == EINTR);
+
+    if (len <= 0 || sample == NULL)
+        return len;
+
+    shell->pendingLen += len;
+    snprintf(marker, sizeof(marker), "%s%d", SOAK_MARKER, shell->syncs);
+
+    line = shell->pending;
+    while ((newline = memchr(line, '\n', shell->pending + shell->pendingLen - line)) != NULL)
+    {
+        *newline = '\0';
+
+        if (strstr(line, "Running") != NULL || strstr(line, "Stopped") != NULL)
+            sample->jobs++;
+        if (strstr(line, "quysh: ") != NULL || strstr(line, "command not found") != NULL || strstr(line, "PANIC") != NULL)
+        {
+            // Only the first errors are shown: a broken command fails at each of its thousands of runs
+            if (sample->errors++ < SOAK_ERRORS_SHOWN)
+                fprintf(stderr, "%s\n", line);
+        }
+        if (strstr(line, marker) != NULL)
+            *synced = 1;
+
+        line = newline + 1;
+    }
+
+    // A line longer than the buffer is not scanned (the Shell prints no such line)
+    shell->pendingLen -= line - shell->pending;
+    if (shell->pendingLen == sizeof(shell->pending))
+        shell->pendingLen = 0;
+    memmove(shell->pending, line, shell->pendingLen);
+
+    return len;
+}
+
+/*
+ * Function: sampleShell
+ * ---------------------
+ * Samples the resident memory, the open descriptors and the zombie children of the Shell from /proc
+ *
+ *  shell:   The Shell
+ *  sample:  Receives the sample
+ */
+void sampleShell(pSoakShell_t shell, pSoakSample_t sample)
+{
+    char path[PATH_MAX];
+    char line[256];
+    FILE *file;
+    DIR *dir;
+    struct dirent *entry;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", shell->pid);
+    if ((file = fopen(path, "r")) != NULL)
+    {
+        while (fgets(line, sizeof(line), file) != NULL)
+            if (strncmp(line, "VmRSS:", 6) == 0)
+                sample->rss = atol(line + 6);
+        fclose(file);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", shell->pid);
+    if ((dir = opendir(path)) != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL)
+            if (entry->d_name[0] != '.')
+                sample->fds++;
+        closedir(dir);
+    }
+
+    // The children of the Shell are found by their parent: "pid (name) state ppid ..."
+    if ((dir = opendir("/proc")) != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL)
+        {
+            char *end;
+            char state;
+            int ppid;
+
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+                continue;
+
+            snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+            if ((file = fopen(path, "r")) == NULL)
+                continue;
+            if (fgets(line, sizeof(line), file) != NULL && (end = strrchr(line, ')')) != NULL &&
+                sscanf(end + 1, " %c %d", &state, &ppid) == 2 && ppid == shell->pid && state == 'Z')
+                sample->zombies++;
+            fclose(file);
+        }
+        closedir(dir);
+    }
+}
+
+/*
+ * Function: writeJobs
+ * -------------------
+ * Background jobs, launched all at once (the Shell has to keep track of all of them, then collect them)
+ */
+void writeJobs(pSoakBuffer_t batch, int index, int size)
+{
+    for (int i = 0; i < size; i++)
+        appendText(batch, "sleep 0 &\n", 10);
+}
+
+/*
+ * Function: writePipelines
+ * ------------------------
+ * Pipelines of 64 stages, which go through every pipe end the Shell juggles with
+ */
+void writePipelines(pSoakBuffer_t batch, int index, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        appendFormat(batch, "echo %d", index * size + i);
+        for (int j = 0; j < 62; j++)
+            appendText(batch, " | cat", 6);
+        appendText(batch, " | wc -c > /dev/null\n", 21);
+    }
+}
+
+/*
+ * Function: writeScript
+ * ---------------------
+ * Short commands run by the Shell itself: assignments, tests, expansions and output redirections
+ */
+void writeScript(pSoakBuffer_t batch, int index, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        switch (i % 4)
+        {
+        case 0:
+            appendFormat(batch, "set N %d\n", index * size + i);
+            break;
+        case 1:
+            appendText(batch, "[ $N -ge 0 ]\n", 13);
+            break;
+        case 2:
+            // N++ gives N and --N brings it back: any other value divides by zero
+            appendText(batch, "echo ${N%0} $((N + 1)) $((1 / (N++ == --N))) $((++N - N--)) > /dev/null\n", 72);
+            break;
+        default:
+            appendText(batch, "{ print N; } > /dev/null\n", 25);
+            break;
+        }
+    }
+}
+
+/*
+ * Function: writeLongLines
+ * ------------------------
+ * Command lines of SOAK_LINE_LEN bytes: one long word through a pipeline, then many short words
+ */
+void writeLongLines(pSoakBuffer_t batch, int index, int size)
+{
+    for (int i = 0; i < size; i++)
+    {
+        appendText(batch, "echo ", 5);
+        for (int j = 0; j < SOAK_LINE_LEN; j++)
+            appendText(batch, (i % 2 == 0) ? "a" : ((j % 2 == 0) ? "b" : " "), 1);
+        appendText(batch, (i % 2 == 0) ? " | wc -c > /dev/null\n" : " > /dev/null\n", (i % 2 == 0) ? 21 : 13);
+    }
+}
+
+/*
+ * Function: appendText
+ * --------------------
+ * Appends text to a buffer, which grows as needed
+ */
+void appendText(pSoakBuffer_t buffer, const char *text, size_t len)
+{
+    if (buffer->len + len + 1 > buffer->capacity)
+    {
+        buffer->capacity = (buffer->len + len + 1) * 2;
+        buffer->text = (char *)realloc(buffer->text, buffer->capacity);
+    }
+
+    memcpy(buffer->text + buffer->len, text, len);
+    buffer->len += len;
+    buffer->text[buffer->len] = '\0';
+}
+
+/*
+ * Function: appendFormat
+ * ----------------------
+ * Appends formatted text to a buffer
+ */
+void appendFormat(pSoakBuffer_t buffer, const char *format, ...)
+{
+    char text[256];
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    appendText(buffer, text, len);
+}
+
+/*
+ * Function: soakClock
+ * -------------------
+ * Returns: The time of a monotonic clock, in seconds
+ */
+double soakClock()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
@@ -0,0 +1,428 @@
+/*
+    Metrics of QuYsh: counters and latency histograms of the path of a command (parse, expansion, lookup, spawn),
+    and the wall time of each command name. Recording a value is an increment of a bucket found with a few
+    bit operations, so the metrics are always on. The "stats" builtin prints them as text or as JSON.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+#define STATS_COMMAND_SLOTS 128 // The number of slots of the table of command names (open addressing)
+#define STATS_COMMAND_MAX 64    // The number of command names with their own statistics, the others are merged
+#define STATS_OTHER STATS_COMMAND_SLOTS // The slot of the merged command names
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*
+ * Structure: commandStats
+ * -----------------------
+ * The statistics of a command name
+ *
+ *  name:     The name of the command (NULL for an empty slot)
+ *  runs:     The number of times the command has ended
+ *  failures: The number of times the command has ended with a non-zero status or because of a signal
+ *  wall:     The wall time of the command, from its launch to its end
+ */
+typedef struct commandStats
+{
+    char *name;
+    uint64_t runs;
+    uint64_t failures;
+    pHistogram_t wall;
+} commandStats_t, *pCommandStats_t;
+
+const char *COUNTER_NAMES[STAT_COUNTERS] = {
+    "lines", "commands", "builtins", "fork_failures", "exec_failures", "cache_hits", "cache_misses", "not_found"};
+const char *LATENCY_NAMES[STAT_LATENCIES] = {"parse", "expand", "lookup", "spawn"};
+
+uint64_t counters[STAT_COUNTERS];
+histogram_t latencies[STAT_LATENCIES];
+commandStats_t commands[STATS_COMMAND_SLOTS + 1];
+int commandNames = 0;
+
+int bucketIndex(uint64_t value);
+uint64_t bucketValue(int index);
+void formatDuration(uint64_t ns, char *buffer, int bufferLen);
+void printHistogram(const char *label, pHistogram_t histogram, int json);
+void printJsonString(const char *str);
+
+/*
+ * Function: statsClock
+ * --------------------
+ *  Returns: The current time of the monotonic clock in nanoseconds
+ */
+uint64_t statsClock()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * Function: countStat
+ * -------------------
+ *  counter: One of the counters (STAT_LINES, STAT_COMMANDS, ...) to increment
+ */
+void countStat(int counter)
+{
+    counters[counter]++;
+}
+
+/*
+ * Function: recordLatency
+ * -----------------------
+ *  latency: One of the latencies (STAT_PARSE, STAT_EXPAND, ...)
+ *  ns:      The duration to record
+ */
+void recordLatency(int latency, uint64_t ns)
+{
+    recordValue(&(latencies[latency]), ns);
+}
+
+/*
+ * Function: commandStatsSlot
+ * --------------------------
+ * Finds the statistics of a command name, or creates them
+ * A command launched through a path ("/bin/ls", "./ls") counts as its last component ("ls")
+ *
+ *  name:    The name of the command
+ *
+ *  Returns: The slot of the command name, to be given to recordCommandTime
+ */
+int commandStatsSlot(const char *name)
+{
+    const char *base = strrchr(name, '/');
+    uint64_t hash = FNV_OFFSET;
+    int slot;
+
+    if (base != NULL && base[1] != '\0')
+        name = base + 1;
+
+    for (const char *it = name; *it != '\0'; it++)
+        hash = (hash ^ (unsigned char)*it) * FNV_PRIME;
+
+    for (slot = hash & (STATS_COMMAND_SLOTS - 1); commands[slot].name != NULL; slot = (slot + 1) & (STATS_COMMAND_SLOTS - 1))
+    {
+        if (strcmp(commands[slot].name, name) == 0)
+            return slot;
+    }
+
+    // The table is kept half full at most
+    if (commandNames >= STATS_COMMAND_MAX)
+        slot = STATS_OTHER;
+    else
+        commandNames++;
+
+    if (commands[slot].name == NULL)
+    {
+        commands[slot].name = strdup((slot == STATS_OTHER) ? "(other)" : name);
+        commands[slot].wall = (pHistogram_t)calloc(1, sizeof(histogram_t));
+    }
+
+    return slot;
+}
+
+/*
+ * Function: recordCommandTime
+ * ---------------------------
+ *  slot:    The slot of the command name, given by commandStatsSlot
+ *  ns:      The wall time of the command
+ *  failed:  1 if the command has failed
+ */
+void recordCommandTime(int slot, uint64_t ns, int failed)
+{
+    pCommandStats_t command = &(commands[slot]);
+
+    // The statistics may have been reset while the command was running
+    if (command->name == NULL)
+        return;
+
+    command->runs++;
+    if (failed)
+        command->failures++;
+    recordValue(command->wall, ns);
+}
+
+/*
+ * Function: recordValue
+ * ---------------------
+ * Adds a value to a histogram
+ *
+ *  histogram: The histogram
+ *  value:     The value
+ */
+void recordValue(pHistogram_t histogram, uint64_t value)
+{
+    histogram->counts[bucketIndex(value)]++;
+
+    if (histogram->total == 0 || value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+
+    histogram->total++;
+    histogram->sum += value;
+}
+
+/*
+ * Function: histogramPercentile
+ * -----------------------------
+ * Estimates a percentile of the values of a histogram
+ *
+ *  histogram:  The histogram
+ *  percentile: The percentile (between 0 and 100)
+ *
+ *  Returns: The largest value of the bucket holding the percentile (the largest value of the histogram at most),
+ *           0 if the histogram is empty
+ */
+uint64_t histogramPercentile(pHistogram_t histogram, double percentile)
+{
+    uint64_t target = (uint64_t)(percentile / 100.0 * histogram->total + 0.5);
+    uint64_t seen = 0;
+
+    if (histogram->total == 0)
+        return 0;
+
+    if (target < 1)
+        target = 1;
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += histogram->counts[i];
+        if (seen >= target)
+        {
+            uint64_t value = bucketValue(i);
+            return (value < histogram->max) ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+/*
+ * Function: printStats
+ * --------------------
+ * Prints the counters, the latencies and the wall time of each command name
+ *
+ *  json:    1 to print a JSON object (durations in nanoseconds), 0 to print a table
+ */
+void printStats(int json)
+{
+    int first = 1;
+
+    if (json)
+    {
+        printf("{\"counters\": {");
+        for (int i = 0; i < STAT_COUNTERS; i++)
+            printf("%s\"%s\": %llu", (i > 0) ? ", " : "", COUNTER_NAMES[i], (unsigned long long)counters[i]);
+
+        printf("}, \"latencies\": {");
+        for (int i = 0; i < STAT_LATENCIES; i++)
+        {
+            printf("%s\"%s\": ", (i > 0) ? ", " : "", LATENCY_NAMES[i]);
+            printHistogram(NULL, &(latencies[i]), 1);
+        }
+
+        printf("}, \"commands\": {");
+        for (int i = 0; i <= STATS_COMMAND_SLOTS; i++)
+        {
+            if (commands[i].name == NULL || commands[i].runs == 0)
+                continue;
+
+            if (!first)
+                printf(", ");
+            first = 0;
+
+            printJsonString(commands[i].name);
+            printf(": {\"runs\": %llu, \"failures\": %llu, \"wall\": ",
+                   (unsigned long long)commands[i].runs, (unsigned long long)commands[i].failures);
+            printHistogram(NULL, commands[i].wall, 1);
+            printf("}");
+        }
+        printf("}}\n");
+        return;
+    }
+
+    for (int i = 0; i < STAT_COUNTERS; i++)
+        printf("%-16s %llu\n", COUNTER_NAMES[i], (unsigned long long)counters[i]);
+
+    printf("\n%-16s %8s %9s %9s %9s %9s %9s %9s\n", "latency", "count", "min", "mean", "p50", "p90", "p99", "max");
+    for (int i = 0; i < STAT_LATENCIES; i++)
+    {
+        char label[64];
+
+        snprintf(label, sizeof(label), "%-16s %8llu", LATENCY_NAMES[i], (unsigned long long)latencies[i].total);
+        printHistogram(label, &(latencies[i]), 0);
+    }
+
+    for (int i = 0; i <= STATS_COMMAND_SLOTS; i++)
+    {
+        char label[64];
+
+        if (commands[i].name == NULL || commands[i].runs == 0)
+            continue;
+
+        if (first)
+            printf("\n%-16s %8s %9s %9s %9s %9s %9s %9s %9s\n", "command", "runs", "failures", "min", "mean", "p50", "p90", "p99", "max");
+        first = 0;
+
+        snprintf(label, sizeof(label), "%-16s %8llu %9llu", commands[i].name,
+                 (unsigned long long)commands[i].runs, (unsigned long long)commands[i].failures);
+        printHistogram(label, commands[i].wall, 0);
+    }
+}
+
+/*
+ * Function: resetStats
+ * --------------------
+ * Clears all the counters, latencies and command names
+ */
+void resetStats()
+{
+    for (int i = 0; i <= STATS_COMMAND_SLOTS; i++)
+    {
+        free(commands[i].name);
+        free(commands[i].wall);
+    }
+
+    memset(counters, 0, sizeof(counters));
+    memset(latencies, 0, sizeof(latencies));
+    memset(commands, 0, sizeof(commands));
+    commandNames = 0;
+}
+
+/*
+ * Function: bucketIndex
+ * ---------------------
+ * Values below HISTOGRAM_SUB_COUNT have a bucket each. Above, each power of two is split into
+ * HISTOGRAM_SUB_COUNT buckets, selected by the bits following the most significant one
+ *
+ *  value:   The value
+ *
+ *  Returns: The bucket of the value
+ */
+int bucketIndex(uint64_t value)
+{
+    int magnitude;
+
+    if (value < HISTOGRAM_SUB_COUNT)
+        return (int)value;
+
+    if (value >= (1ULL << HISTOGRAM_MAX_BITS))
+        value = (1ULL << HISTOGRAM_MAX_BITS) - 1;
+
+    magnitude = 63 - __builtin_clzll(value);
+
+    return ((magnitude - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) +
+           (int)((value >> (magnitude - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_COUNT - 1));
+}
+
+/*
+ * Function: bucketValue
+ * ---------------------
+ *  Returns: The largest value of a bucket
+ */
+uint64_t bucketValue(int index)
+{
+    int magnitude;
+    int sub;
+
+    if (index < HISTOGRAM_SUB_COUNT)
+        return index;
+
+    magnitude = (index >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+    sub = index & (HISTOGRAM_SUB_COUNT - 1);
+
+    return ((uint64_t)(HISTOGRAM_SUB_COUNT + sub + 1) << (magnitude - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+/*
+ * Function: formatDuration
+ * ------------------------
+ * Converts a number of nanoseconds into a human-readable duration (e.g. "812ns", "15.2us", "3.40ms", "1.25s")
+ *
+ *  ns:        The duration
+ *  buffer:    The buffer to write into
+ *  bufferLen: The size of the buffer
+ */
+void formatDuration(uint64_t ns, char *buffer, int bufferLen)
+{
+    if (ns < 1000)
+        snprintf(buffer, bufferLen, "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000)
+        snprintf(buffer, bufferLen, "%.1fus", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buffer, bufferLen, "%.2fms", ns / 1e6);
+    else
+        snprintf(buffer, bufferLen, "%.2fs", ns / 1e9);
+}
+
+/*
+ * Function: printHistogram
+ * ------------------------
+ * Prints the summary of a histogram: as a line of a table, or as a JSON object
+ *
+ *  label:     The beginning of the line of the table, up to the counts (unused for JSON)
+ *  histogram: The histogram
+ *  json:      1 to print a JSON object, 0 to print a line of a table
+ */
+void printHistogram(const char *label, pHistogram_t histogram, int json)
+{
+    const double PERCENTILES[3] = {50, 90, 99};
+    uint64_t mean = (histogram->total > 0) ? histogram->sum / histogram->total : 0;
+    char values[6][16];
+
+    if (json)
+    {
+        printf("{\"count\": %llu, \"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"max\": %llu}",
+               (unsigned long long)histogram->total, (unsigned long long)histogram->min, (unsigned long long)mean,
+               (unsigned long long)histogramPercentile(histogram, PERCENTILES[0]),
+               (unsigned long long)histogramPercentile(histogram, PERCENTILES[1]),
+               (unsigned long long)histogramPercentile(histogram, PERCENTILES[2]),
+               (unsigned long long)histogram->max);
+        return;
+    }
+
+    if (histogram->total == 0)
+    {
+        printf("%s %9s %9s %9s %9s %9s %9s\n", label, "-", "-", "-", "-", "-", "-");
+        return;
+    }
+
+    formatDuration(histogram->min, values[0], sizeof(values[0]));
+    formatDuration(mean, values[1], sizeof(values[1]));
+    for (int i = 0; i < 3; i++)
+        formatDuration(histogramPercentile(histogram, PERCENTILES[i]), values[2 + i], sizeof(values[2 + i]));
+    formatDuration(histogram->max, values[5], sizeof(values[5]));
+
+    printf("%s %9s %9s %9s %9s %9s %9s\n", label, values[0], values[1], values[2], values[3], values[4], values[5]);
+}
+
+/*
+ * Function: printJsonString
+ * -------------------------
+ * Prints a string between double quotes, with the characters that JSON does not allow escaped
+ *
+ *  str:     The string
+ */
+void printJsonString(const char *str)
+{
+    putchar('"');
+    for (; *str != '\0'; str++)
+    {
+        unsigned char c = (unsigned char)*str;
+
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+    putchar('"');
+}
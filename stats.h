@@ -0,0 +1,60 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/* Counters */
+#define STAT_LINES 0          // Command lines read
+#define STAT_COMMANDS 1       // Processes launched (exec succeeded)
+#define STAT_BUILTINS 2       // Builtins run
+#define STAT_FORK_FAILURES 3  // Processes which could not be forked
+#define STAT_EXEC_FAILURES 4  // Processes which could not execute their binary
+#define STAT_CACHE_HITS 5     // Commands found in the command cache (or in the snapshot)
+#define STAT_CACHE_MISSES 6   // Commands searched in the directories of the PATH
+#define STAT_NOT_FOUND 7      // Commands found nowhere
+#define STAT_COUNTERS 8
+
+/* Latencies of the path of a command */
+#define STAT_PARSE 0  // Splitting a line into words
+#define STAT_EXPAND 1 // Expanding the words of a command
+#define STAT_LOOKUP 2 // Finding the binary of a command
+#define STAT_SPAWN 3  // From fork to the successful exec of the binary
+#define STAT_LATENCIES 4
+
+/* Histograms: log-linear buckets of nanoseconds (16 buckets per power of two, about 6% of precision) */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 46 // Longer durations (more than 19 hours) fall into the last bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_COUNT)
+
+/*
+ * Structure: histogram
+ * --------------------
+ * A distribution of durations, recorded in constant time and with a bounded size
+ *
+ *  counts: The number of values of each bucket
+ *  total:  The number of values
+ *  sum:    The sum of the values
+ *  min:    The smallest value
+ *  max:    The largest value
+ */
+typedef struct histogram
+{
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} histogram_t, *pHistogram_t;
+
+uint64_t statsClock();
+void countStat(int counter);
+void recordLatency(int latency, uint64_t ns);
+int commandStatsSlot(const char *name);
+void recordCommandTime(int slot, uint64_t ns, int failed);
+void recordValue(pHistogram_t histogram, uint64_t value);
+uint64_t histogramPercentile(pHistogram_t histogram, double percentile);
+void printStats(int json);
+void resetStats();
+
+#endif